@@ -20,6 +20,7 @@ struct _MetaCompositor
   Atom            atom_x_root_pixmap;
   Atom            atom_net_wm_window_opacity;
   guint           repaint_func_id;
+  guint           post_repaint_func_id;
 
   ClutterActor   *shadow_src;
 
@@ -34,6 +35,22 @@ struct _MetaCompositor
   guint           no_mipmaps  : 1;
 };
 
+typedef struct
+{
+  /* The window bypassing compositing on this monitor, or NULL */
+  MetaWindowActor *window;
+
+  /* When @window last changed, and when it last became NULL */
+  gint64           flip_time;
+  gint64           redirect_time;
+
+  /* How often the monitor has changed state, and the total time it
+   * has spent unredirected before the current period, in microseconds */
+  guint            n_unredirects;
+  guint            n_redirects;
+  gint64           unredirected_time;
+} MetaUnredirectMonitor;
+
 struct _MetaCompScreen
 {
   MetaScreen            *screen;
@@ -47,15 +64,30 @@ struct _MetaCompScreen
   CoglOnscreen          *onscreen;
   CoglFrameClosure      *frame_closure;
 
-  /* Used for unredirecting fullscreen windows */
+  /* Used for unredirecting windows that cover a monitor; one entry
+   * per monitor, see update_unredirected_windows() */
   guint                   disable_unredirect_count;
-  MetaWindowActor             *unredirected_window;
+  MetaUnredirectMonitor  *unredirect_monitors;
+  int                     n_unredirect_monitors;
 
   /* Before we create the output window */
   XserverRegion     pending_input_region;
 
   gint                   switch_workspace_in_progress;
 
+  /* XDamageNotify events received and texture updates done for
+   * them during the current frame; reset in pre_paint_windows().
+   * Events for fully obscured windows are only counted as deferred. */
+  guint                  damage_events_received;
+  guint                  damage_events_deferred;
+  guint                  damage_updates_applied;
+
+  /* Rectangles submitted painting window textures in the last frame,
+   * and the pipeline batches they went in; summed in
+   * after_stage_paint(). */
+  guint                  paint_rects;
+  guint                  paint_batches;
+
   MetaPluginManager *plugin_mgr;
 };
 
@@ -80,6 +80,8 @@
 #include <meta/meta-background-actor.h>
 #include <meta/meta-background-group.h>
 #include <meta/meta-shadow-factory.h>
+#include "meta-shadow-factory-private.h"
+#include "meta-frame-timings.h"
 #include "meta-window-actor-private.h"
 #include "meta-window-group.h"
 #include "window-private.h" /* to check window->hidden */
@@ -90,6 +92,9 @@
 /* #define DEBUG_TRACE g_print */
 #define DEBUG_TRACE(X)
 
+/* Upper bound on the size of the persistent shadow cache file */
+#define SHADOW_DISK_CACHE_MAX_SIZE (32 * 1024 * 1024)
+
 static inline gboolean
 composite_at_least_version (MetaDisplay *display, int maj, int min)
 {
@@ -143,6 +148,11 @@ void
 meta_compositor_destroy (MetaCompositor *compositor)
 {
   clutter_threads_remove_repaint_func (compositor->repaint_func_id);
+  clutter_threads_remove_repaint_func (compositor->post_repaint_func_id);
+
+  meta_shadow_factory_flush_disk_cache (meta_shadow_factory_get_default ());
+
+  meta_frame_timings_shutdown ();
 }
 
 static void
@@ -556,6 +566,14 @@ after_stage_paint (ClutterStage *stage,
 
   for (l = info->windows; l; l = l->next)
     meta_window_actor_post_paint (l->data);
+
+  meta_topic (META_DEBUG_COMPOSITOR,
+              "Frame paint: %u rectangles in %u batches\n",
+              info->paint_rects, info->paint_batches);
+  info->paint_rects = 0;
+  info->paint_batches = 0;
+
+  meta_frame_timings_end_paint ();
 }
 
 static void
@@ -737,39 +755,58 @@ meta_compositor_unmanage_screen (MetaCompositor *compositor,
 }
 
 /*
- * Shapes the cow so that the given window is exposed,
- * when metaWindow is NULL it clears the shape again
+ * Shapes the cow so that the unredirected windows are exposed; when
+ * there are none it clears the shape again
  */
 static void
-meta_shape_cow_for_window (MetaScreen *screen,
-                           MetaWindow *metaWindow)
+meta_shape_cow_for_unredirected_windows (MetaCompScreen *info)
 {
-  MetaCompScreen *info = meta_screen_get_compositor_data (screen);
-  Display *xdisplay = meta_display_get_xdisplay (meta_screen_get_display (screen));
+  Display *xdisplay = meta_display_get_xdisplay (meta_screen_get_display (info->screen));
+  XRectangle *window_bounds;
+  int n_bounds = 0;
+  int i, j;
+
+  window_bounds = g_newa (XRectangle, MAX (1, info->n_unredirect_monitors));
+
+  for (i = 0; i < info->n_unredirect_monitors; i++)
+    {
+      MetaWindowActor *window_actor = info->unredirect_monitors[i].window;
+      MetaRectangle rect;
+      gboolean seen = FALSE;
 
-  if (metaWindow == NULL)
+      if (window_actor == NULL)
+        continue;
+
+      /* A window covering several monitors only needs one hole */
+      for (j = 0; j < i; j++)
+        seen = seen || info->unredirect_monitors[j].window == window_actor;
+      if (seen)
+        continue;
+
+      meta_window_get_outer_rect (meta_window_actor_get_meta_window (window_actor), &rect);
+
+      window_bounds[n_bounds].x = rect.x;
+      window_bounds[n_bounds].y = rect.y;
+      window_bounds[n_bounds].width = rect.width;
+      window_bounds[n_bounds].height = rect.height;
+      n_bounds++;
+    }
+
+  if (n_bounds == 0)
       XFixesSetWindowShapeRegion (xdisplay, info->output, ShapeBounding, 0, 0, None);
   else
     {
       XserverRegion output_region;
-      XRectangle screen_rect, window_bounds;
+      XRectangle screen_rect;
       int width, height;
-      MetaRectangle rect;
-
-      meta_window_get_outer_rect (metaWindow, &rect);
-
-      window_bounds.x = rect.x;
-      window_bounds.y = rect.y;
-      window_bounds.width = rect.width;
-      window_bounds.height = rect.height;
 
-      meta_screen_get_size (screen, &width, &height);
+      meta_screen_get_size (info->screen, &width, &height);
       screen_rect.x = 0;
       screen_rect.y = 0;
       screen_rect.width = width;
       screen_rect.height = height;
 
-      output_region = XFixesCreateRegion (xdisplay, &window_bounds, 1);
+      output_region = XFixesCreateRegion (xdisplay, window_bounds, n_bounds);
 
       XFixesInvertRegion (xdisplay, output_region, &screen_rect, output_region);
       XFixesSetWindowShapeRegion (xdisplay, info->output, ShapeBounding, 0, 0, output_region);
@@ -808,12 +845,16 @@ meta_compositor_remove_window (MetaCompositor *compositor,
   screen = meta_window_get_screen (window);
   info = meta_screen_get_compositor_data (screen);
 
-  if (window_actor == info->unredirected_window)
+  if (meta_window_actor_is_unredirected (window_actor))
     {
+      int i;
+
+      for (i = 0; i < info->n_unredirect_monitors; i++)
+        if (info->unredirect_monitors[i].window == window_actor)
+          info->unredirect_monitors[i].window = NULL;
+
       meta_window_actor_set_redirected (window_actor, TRUE);
-      meta_shape_cow_for_window (meta_window_get_screen (meta_window_actor_get_meta_window (info->unredirected_window)),
-                                 NULL);
-      info->unredirected_window = NULL;
+      meta_shape_cow_for_unredirected_windows (info);
     }
 
   meta_window_actor_destroy (window_actor);
@@ -1391,6 +1432,8 @@ frame_callback (CoglOnscreen  *onscreen,
       gint64 presentation_time_cogl = cogl_frame_info_get_presentation_time (frame_info);
       gint64 presentation_time;
 
+      meta_frame_timings_set_refresh_rate (cogl_frame_info_get_refresh_rate (frame_info));
+
       if (presentation_time_cogl != 0)
         {
           /* Cogl reports presentation in terms of its own clock, which is
@@ -1419,52 +1462,318 @@ frame_callback (CoglOnscreen  *onscreen,
     }
 }
 
-static void
-pre_paint_windows (MetaCompScreen *info)
+/* After a monitor goes back to being composited, we wait this long
+ * before bypassing compositing on it again, so that something that
+ * keeps briefly appearing on top of a game (a tooltip, a notification)
+ * doesn't make us flip back and forth every frame.
+ */
+#define UNREDIRECT_HOLDOFF_USEC (G_USEC_PER_SEC / 2)
+
+static gboolean
+unredirect_windows_contain (MetaWindowActor **windows,
+                            int               n_windows,
+                            MetaWindowActor  *window_actor)
+{
+  int i;
+
+  for (i = 0; i < n_windows; i++)
+    if (windows[i] == window_actor)
+      return TRUE;
+
+  return FALSE;
+}
+
+/* Returns the topmost visible window overlapping @monitor_rect */
+static MetaWindowActor *
+find_top_window_on_monitor (MetaCompScreen *info,
+                            MetaRectangle  *monitor_rect)
 {
   GList *l;
-  MetaWindowActor *top_window;
-  MetaWindowActor *expected_unredirected_window = NULL;
 
-  if (info->onscreen == NULL)
+  for (l = g_list_last (info->windows); l; l = l->prev)
     {
-      info->onscreen = COGL_ONSCREEN (cogl_get_draw_framebuffer ());
-      info->frame_closure = cogl_onscreen_add_frame_callback (info->onscreen,
-                                                              frame_callback,
-                                                              info,
-                                                              NULL);
+      MetaWindowActor *window_actor = l->data;
+      MetaRectangle rect;
+
+      if (!CLUTTER_ACTOR_IS_VISIBLE (window_actor))
+        continue;
+
+      meta_window_get_outer_rect (meta_window_actor_get_meta_window (window_actor), &rect);
+      if (meta_rectangle_overlap (&rect, monitor_rect))
+        return window_actor;
     }
 
-  if (info->windows == NULL)
-    return;
+  return NULL;
+}
+
+static void
+log_unredirect_flip (MetaCompScreen        *info,
+                     int                    monitor_index,
+                     MetaUnredirectMonitor *monitor,
+                     gint64                 now)
+{
+  if (monitor->window != NULL)
+    monitor->n_unredirects++;
+  else
+    monitor->n_redirects++;
+
+  meta_topic (META_DEBUG_COMPOSITOR,
+              "Monitor %d: %s %s; %u unredirects, %u redirects, "
+              "%.1fs unredirected, %.1fs since the last change\n",
+              monitor_index,
+              monitor->window != NULL ? "unredirecting" : "redirecting",
+              monitor->window != NULL ?
+              meta_window_get_description (meta_window_actor_get_meta_window (monitor->window)) :
+              "all windows",
+              monitor->n_unredirects, monitor->n_redirects,
+              (double) monitor->unredirected_time / G_USEC_PER_SEC,
+              (double) (now - monitor->flip_time) / G_USEC_PER_SEC);
+}
+
+/* Like meta_window_is_monitor_sized(), but also true for managed
+ * windows that a game or video player sized to their monitor without
+ * asking to be fullscreen.
+ */
+static gboolean
+window_is_monitor_sized (MetaWindow *window)
+{
+  MetaRectangle window_rect, monitor_rect;
 
-  top_window = g_list_last (info->windows)->data;
+  if (meta_window_is_monitor_sized (window))
+    return TRUE;
+
+  if (window->monitor == NULL)
+    return FALSE;
 
-  if (meta_window_actor_should_unredirect (top_window) &&
-      info->disable_unredirect_count == 0)
-    expected_unredirected_window = top_window;
+  meta_window_get_outer_rect (window, &window_rect);
+  meta_screen_get_monitor_geometry (window->screen, window->monitor->number, &monitor_rect);
 
-  if (info->unredirected_window != expected_unredirected_window)
+  return meta_rectangle_equal (&window_rect, &monitor_rect);
+}
+
+/* Whether something the plugin put on the stage above the window
+ * group, like a panel or a notification, shows on @monitor_rect.
+ * Unredirecting a window there would hide it.
+ */
+static gboolean
+chrome_on_monitor (MetaCompScreen *info,
+                   MetaRectangle  *monitor_rect)
+{
+  ClutterActor *actor, *sibling;
+
+  for (actor = info->window_group;
+       actor != NULL && actor != info->stage;
+       actor = clutter_actor_get_parent (actor))
     {
-      if (info->unredirected_window != NULL)
+      for (sibling = clutter_actor_get_next_sibling (actor);
+           sibling != NULL;
+           sibling = clutter_actor_get_next_sibling (sibling))
         {
-          meta_window_actor_set_redirected (info->unredirected_window, TRUE);
-          meta_shape_cow_for_window (meta_window_get_screen (meta_window_actor_get_meta_window (info->unredirected_window)),
-                                     NULL);
+          ClutterActorBox box;
+          MetaRectangle rect;
+
+          /* Its windows are in info->windows, and so are checked by
+           * find_top_window_on_monitor() */
+          if (sibling == info->top_window_group)
+            continue;
+
+          if (!CLUTTER_ACTOR_IS_VISIBLE (sibling) ||
+              clutter_actor_get_opacity (sibling) == 0)
+            continue;
+
+          /* If we can't tell where it paints, assume it's in the way */
+          if (!clutter_actor_get_paint_box (sibling, &box))
+            return TRUE;
+
+          clutter_actor_box_clamp_to_pixel (&box);
+          rect.x = box.x1;
+          rect.y = box.y1;
+          rect.width = box.x2 - box.x1;
+          rect.height = box.y2 - box.y1;
+
+          if (rect.width > 0 && rect.height > 0 &&
+              meta_rectangle_overlap (&rect, monitor_rect))
+            return TRUE;
+        }
+    }
+
+  return FALSE;
+}
+
+/* Chooses, for each monitor, a window that bypasses compositing on
+ * it: the topmost window there, if it covers the monitor,
+ * meta_window_actor_should_unredirect() agrees, no chrome is shown
+ * above it and it isn't below some other window on another monitor it
+ * extends to.
+ */
+static void
+update_unredirected_windows (MetaCompScreen *info)
+{
+  MetaUnredirectMonitor *monitors = info->unredirect_monitors;
+  MetaWindowActor **top_windows;
+  MetaWindowActor **expected;
+  MetaWindowActor **old_windows;
+  MetaRectangle *monitor_rects;
+  gboolean changed = FALSE;
+  gint64 now;
+  int n_monitors, i, j;
+
+  n_monitors = meta_screen_get_n_monitors (info->screen);
+  now = g_get_monotonic_time ();
+
+  if (n_monitors != info->n_unredirect_monitors)
+    {
+      for (i = 0; i < info->n_unredirect_monitors; i++)
+        {
+          MetaWindowActor *window_actor = monitors[i].window;
+
+          if (window_actor != NULL)
+            {
+              for (j = i; j < info->n_unredirect_monitors; j++)
+                if (monitors[j].window == window_actor)
+                  monitors[j].window = NULL;
+
+              meta_window_actor_set_redirected (window_actor, TRUE);
+              changed = TRUE;
+            }
         }
 
-      if (expected_unredirected_window != NULL)
+      g_free (monitors);
+      monitors = info->unredirect_monitors = g_new0 (MetaUnredirectMonitor, n_monitors);
+      info->n_unredirect_monitors = n_monitors;
+
+      for (i = 0; i < n_monitors; i++)
+        monitors[i].flip_time = now;
+    }
+
+  top_windows = g_newa (MetaWindowActor *, n_monitors);
+  expected = g_newa (MetaWindowActor *, n_monitors);
+  monitor_rects = g_newa (MetaRectangle, n_monitors);
+
+  for (i = 0; i < n_monitors; i++)
+    {
+      meta_screen_get_monitor_geometry (info->screen, i, &monitor_rects[i]);
+      top_windows[i] = find_top_window_on_monitor (info, &monitor_rects[i]);
+    }
+
+  for (i = 0; i < n_monitors; i++)
+    {
+      MetaWindowActor *window_actor = top_windows[i];
+      MetaRectangle rect;
+
+      expected[i] = NULL;
+
+      if (window_actor == NULL || info->disable_unredirect_count > 0)
+        continue;
+
+      if (!window_is_monitor_sized (meta_window_actor_get_meta_window (window_actor)) ||
+          !meta_window_actor_should_unredirect (window_actor))
+        continue;
+
+      if (chrome_on_monitor (info, &monitor_rects[i]))
+        continue;
+
+      meta_window_get_outer_rect (meta_window_actor_get_meta_window (window_actor), &rect);
+
+      for (j = 0; j < n_monitors; j++)
+        if (top_windows[j] != window_actor &&
+            meta_rectangle_overlap (&rect, &monitor_rects[j]))
+          break;
+
+      if (j < n_monitors)
+        continue;
+
+      if (window_actor != monitors[i].window &&
+          now - monitors[i].redirect_time < UNREDIRECT_HOLDOFF_USEC)
+        continue;
+
+      expected[i] = window_actor;
+    }
+
+  old_windows = g_newa (MetaWindowActor *, n_monitors);
+
+  for (i = 0; i < n_monitors; i++)
+    {
+      MetaUnredirectMonitor *monitor = &monitors[i];
+
+      old_windows[i] = monitor->window;
+
+      if (monitor->window == expected[i])
+        continue;
+
+      if (monitor->window != NULL)
         {
-          meta_shape_cow_for_window (meta_window_get_screen (meta_window_actor_get_meta_window (top_window)),
-                                     meta_window_actor_get_meta_window (top_window));
-          meta_window_actor_set_redirected (top_window, FALSE);
+          monitor->unredirected_time += now - monitor->flip_time;
+          monitor->redirect_time = now;
         }
 
-      info->unredirected_window = expected_unredirected_window;
+      monitor->window = expected[i];
+      log_unredirect_flip (info, i, monitor, now);
+      monitor->flip_time = now;
+      changed = TRUE;
+    }
+
+  if (!changed)
+    return;
+
+  /* A window covering several monitors appears several times in each
+   * array, but is only redirected or unredirected once. Redirect
+   * first, so a window that takes over a monitor from another never
+   * has the other's hole in the cow. */
+  for (i = 0; i < n_monitors; i++)
+    {
+      MetaWindowActor *window_actor = old_windows[i];
+
+      if (window_actor != NULL &&
+          !unredirect_windows_contain (old_windows, i, window_actor) &&
+          !unredirect_windows_contain (expected, n_monitors, window_actor))
+        meta_window_actor_set_redirected (window_actor, TRUE);
+    }
+
+  meta_shape_cow_for_unredirected_windows (info);
+
+  for (i = 0; i < n_monitors; i++)
+    {
+      MetaWindowActor *window_actor = expected[i];
+
+      if (window_actor != NULL &&
+          !unredirect_windows_contain (expected, i, window_actor) &&
+          !unredirect_windows_contain (old_windows, n_monitors, window_actor))
+        meta_window_actor_set_redirected (window_actor, FALSE);
     }
+}
+
+static void
+pre_paint_windows (MetaCompScreen *info)
+{
+  GList *l;
+
+  if (info->onscreen == NULL)
+    {
+      info->onscreen = COGL_ONSCREEN (cogl_get_draw_framebuffer ());
+      info->frame_closure = cogl_onscreen_add_frame_callback (info->onscreen,
+                                                              frame_callback,
+                                                              info,
+                                                              NULL);
+    }
+
+  if (info->windows == NULL)
+    return;
+
+  update_unredirected_windows (info);
 
   for (l = info->windows; l; l = l->next)
     meta_window_actor_pre_paint (l->data);
+
+  if (info->damage_events_received > 0)
+    meta_topic (META_DEBUG_COMPOSITOR,
+                "Frame damage: %u events received, %u deferred, %u updates applied\n",
+                info->damage_events_received, info->damage_events_deferred,
+                info->damage_updates_applied);
+
+  info->damage_events_received = 0;
+  info->damage_events_deferred = 0;
+  info->damage_updates_applied = 0;
 }
 
 static gboolean
@@ -1473,6 +1782,10 @@ meta_repaint_func (gpointer data)
   MetaCompositor *compositor = data;
   GSList *screens = meta_display_get_screens (compositor->display);
   GSList *l;
+  gint64 start_time;
+
+  meta_frame_timings_begin_frame ();
+  start_time = meta_frame_timings_begin_phase ();
 
   for (l = screens; l; l = l->next)
     {
@@ -1484,6 +1797,16 @@ meta_repaint_func (gpointer data)
       pre_paint_windows (info);
     }
 
+  meta_frame_timings_end_phase (META_FRAME_PHASE_PRE_PAINT, start_time);
+
+  return TRUE;
+}
+
+static gboolean
+meta_post_repaint_func (gpointer data)
+{
+  meta_frame_timings_end_frame ();
+
   return TRUE;
 }
 
@@ -1533,6 +1856,16 @@ meta_compositor_new (MetaDisplay *display)
   if (g_getenv("META_DISABLE_MIPMAPS"))
     compositor->no_mipmaps = TRUE;
 
+  if (!g_getenv ("META_DISABLE_SHADOW_CACHE"))
+    {
+      char *filename = g_build_filename (g_get_user_cache_dir (),
+                                         "mutter", "shadows.cache", NULL);
+      meta_shadow_factory_load_disk_cache (meta_shadow_factory_get_default (),
+                                           filename,
+                                           SHADOW_DISK_CACHE_MAX_SIZE);
+      g_free (filename);
+    }
+
   meta_verbose ("Creating %d atoms\n", (int) G_N_ELEMENTS (atom_names));
   XInternAtoms (xdisplay, atom_names, G_N_ELEMENTS (atom_names),
                 False, atoms);
@@ -1548,6 +1881,12 @@ meta_compositor_new (MetaDisplay *display)
   compositor->repaint_func_id = clutter_threads_add_repaint_func (meta_repaint_func,
                                                                   compositor,
                                                                   NULL);
+  compositor->post_repaint_func_id = clutter_threads_add_repaint_func_full (CLUTTER_REPAINT_FLAGS_POST_PAINT,
+                                                                            meta_post_repaint_func,
+                                                                            compositor,
+                                                                            NULL);
+
+  meta_frame_timings_init ();
 
   return compositor;
 }
@@ -28,6 +28,9 @@
 
 #include <config.h>
 
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+
 #include <cogl/cogl-texture-pixmap-x11.h>
 
 #include <clutter/clutter.h>
@@ -78,6 +81,17 @@ struct _MetaBackgroundPrivate
 
   char  *filename;
 
+  /* Set while the texture is the one loaded from @filename, with the
+   * size bound it was decoded at; see get_max_image_size().
+   */
+  gboolean  texture_from_file;
+  int       texture_max_width;
+  int       texture_max_height;
+
+  /* Reload of @filename after the monitors changed, if one is pending */
+  GCancellable *reload_cancellable;
+  gulong        monitors_changed_id;
+
   float brightness;
   float vignette_sharpness;
 };
@@ -93,6 +107,8 @@ enum
 
 static void clutter_content_iface_init (ClutterContentIface *iface);
 static void unset_texture (MetaBackground *self);
+static void set_screen    (MetaBackground *self,
+                           MetaScreen     *screen);
 
 G_DEFINE_TYPE_WITH_CODE (MetaBackground, meta_background, G_TYPE_OBJECT,
                          G_IMPLEMENT_INTERFACE (CLUTTER_TYPE_CONTENT,
@@ -457,6 +473,39 @@ clutter_content_iface_init (ClutterContentIface *iface)
   iface->paint_content = meta_background_paint_content;
 }
 
+static int
+get_bytes_per_pixel (CoglPixelFormat format)
+{
+  switch (format)
+    {
+    case COGL_PIXEL_FORMAT_A_8:
+    case COGL_PIXEL_FORMAT_G_8:
+      return 1;
+    case COGL_PIXEL_FORMAT_RGB_565:
+    case COGL_PIXEL_FORMAT_RGBA_4444:
+    case COGL_PIXEL_FORMAT_RGBA_5551:
+    case COGL_PIXEL_FORMAT_RGBA_4444_PRE:
+    case COGL_PIXEL_FORMAT_RGBA_5551_PRE:
+      return 2;
+    case COGL_PIXEL_FORMAT_RGB_888:
+    case COGL_PIXEL_FORMAT_BGR_888:
+      return 3;
+    default:
+      return 4;
+    }
+}
+
+/* The size of the texture data of @texture, from its size and the
+ * format Cogl stores it in. Background textures have no mipmaps.
+ */
+static gsize
+get_texture_memory (CoglTexture *texture)
+{
+  return (gsize) cogl_texture_get_width (texture) *
+         cogl_texture_get_height (texture) *
+         get_bytes_per_pixel (cogl_texture_get_format (texture));
+}
+
 static void
 meta_background_dispose (GObject *object)
 {
@@ -464,6 +513,7 @@ meta_background_dispose (GObject *object)
   MetaBackgroundPrivate *priv = self->priv;
 
   unset_texture (self);
+  set_screen (self, NULL);
 
   g_clear_pointer (&priv->pipeline,
                    (GDestroyNotify)
@@ -594,7 +644,7 @@ meta_background_set_property (GObject      *object,
   switch (prop_id)
     {
     case PROP_META_SCREEN:
-      priv->screen = g_value_get_object (value);
+      set_screen (self, g_value_get_object (value));
       break;
     case PROP_MONITOR:
       priv->monitor = g_value_get_int (value);
@@ -721,6 +771,14 @@ unset_texture (MetaBackground *self)
   g_clear_pointer (&priv->texture,
                    (GDestroyNotify)
                    cogl_object_unref);
+
+  /* Whatever replaces the texture wins over a pending reload */
+  priv->texture_from_file = FALSE;
+  if (priv->reload_cancellable != NULL)
+    {
+      g_cancellable_cancel (priv->reload_cancellable);
+      g_clear_object (&priv->reload_cancellable);
+    }
 }
 
 static void
@@ -941,39 +999,227 @@ typedef struct
 {
   GDesktopBackgroundStyle style;
   char *filename;
+
+  /* Largest size the image is ever drawn at for this style; the
+   * image is decoded at most this big. Zero means full size.
+   */
+  int max_width;
+  int max_height;
+
+  /* Key for texture_cache, or NULL if the file can't be cached */
+  char *cache_key;
+
+  /* The loaded texture, once there is one */
+  CoglTexture *texture;
+
+  /* Size of the image in the file, set by load_file() */
+  int image_width;
+  int image_height;
 } LoadFileTaskData;
 
+/* Textures loaded from files, so that backgrounds showing the same
+ * file with the same style share one texture instead of each decoding
+ * and uploading their own. Entries don't hold a reference; they are
+ * removed when the texture is destroyed.
+ */
+static GHashTable *texture_cache = NULL;
+static CoglUserDataKey texture_cache_key;
+
+static void
+texture_cache_log_total (void)
+{
+  GHashTableIter iter;
+  gpointer value;
+  gsize total = 0;
+
+  g_hash_table_iter_init (&iter, texture_cache);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    total += get_texture_memory (value);
+
+  meta_verbose ("Background texture cache: %u textures, %" G_GSIZE_FORMAT " KiB\n",
+                g_hash_table_size (texture_cache), total / 1024);
+}
+
+static void
+texture_cache_entry_destroyed (void *user_data)
+{
+  g_hash_table_remove (texture_cache, user_data);
+  texture_cache_log_total ();
+}
+
+static CoglTexture *
+texture_cache_lookup (const char *cache_key)
+{
+  if (texture_cache == NULL || cache_key == NULL)
+    return NULL;
+
+  return g_hash_table_lookup (texture_cache, cache_key);
+}
+
+static void
+texture_cache_insert (const char  *cache_key,
+                      CoglTexture *texture)
+{
+  char *key;
+
+  if (texture_cache == NULL)
+    texture_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                           g_free, NULL);
+
+  key = g_strdup (cache_key);
+  g_hash_table_insert (texture_cache, key, texture);
+  cogl_object_set_user_data (COGL_OBJECT (texture), &texture_cache_key,
+                             key, texture_cache_entry_destroyed);
+
+  texture_cache_log_total ();
+}
+
+static void
+get_max_image_size (MetaScreen              *screen,
+                    GDesktopBackgroundStyle  style,
+                    int                     *max_width,
+                    int                     *max_height)
+{
+  MetaRectangle geometry;
+  int n_monitors, i;
+
+  *max_width = 0;
+  *max_height = 0;
+
+  switch (style)
+    {
+    case G_DESKTOP_BACKGROUND_STYLE_STRETCHED:
+    case G_DESKTOP_BACKGROUND_STYLE_SCALED:
+    case G_DESKTOP_BACKGROUND_STYLE_ZOOM:
+      /* Drawn scaled to the monitor the background is on */
+      n_monitors = meta_screen_get_n_monitors (screen);
+      for (i = 0; i < n_monitors; i++)
+        {
+          meta_screen_get_monitor_geometry (screen, i, &geometry);
+          *max_width = MAX (*max_width, geometry.width);
+          *max_height = MAX (*max_height, geometry.height);
+        }
+      break;
+    case G_DESKTOP_BACKGROUND_STYLE_SPANNED:
+      /* Drawn stretched across the whole screen */
+      meta_screen_get_size (screen, max_width, max_height);
+      break;
+    default:
+      /* Drawn at the image's own size */
+      break;
+    }
+}
+
 static LoadFileTaskData *
-load_file_task_data_new (const char              *filename,
+load_file_task_data_new (MetaScreen              *screen,
+                         const char              *filename,
                          GDesktopBackgroundStyle  style)
 {
   LoadFileTaskData *task_data;
+  struct stat statbuf;
 
-  task_data = g_slice_new (LoadFileTaskData);
+  task_data = g_slice_new0 (LoadFileTaskData);
   task_data->style = style;
   task_data->filename = g_strdup (filename);
 
+  get_max_image_size (screen, style,
+                      &task_data->max_width, &task_data->max_height);
+
+  /* The modification time is part of the key so that a wallpaper
+   * rewritten in place isn't shown from a stale texture.
+   */
+  if (g_stat (filename, &statbuf) == 0)
+    task_data->cache_key = g_strdup_printf ("%d:%dx%d:%ld:%s",
+                                            style,
+                                            task_data->max_width,
+                                            task_data->max_height,
+                                            (long) statbuf.st_mtime,
+                                            filename);
+
   return task_data;
 }
 
 static void
 load_file_task_data_free (LoadFileTaskData *task_data)
 {
+  if (task_data->texture)
+    cogl_object_unref (task_data->texture);
+  g_free (task_data->cache_key);
   g_free (task_data->filename);
   g_slice_free (LoadFileTaskData, task_data);
 }
 
+/* A decode of a file, shared by every meta_background_load_file_async()
+ * for the same file, style and size bound made while it runs; all
+ * the copies of a background reload at once when the monitors change.
+ * The decode isn't tied to any of the loads, so cancelling one of them
+ * doesn't affect the others.
+ */
+typedef struct
+{
+  LoadFileTaskData *task_data;
+  GSList *waiters;  /* GTasks of meta_background_load_file_async() */
+} PendingLoad;
+
+/* Cache key => PendingLoad */
+static GHashTable *pending_loads = NULL;
+
 static void
-load_file (GTask            *task,
-           MetaBackground   *self,
-           LoadFileTaskData *task_data,
-           GCancellable     *cancellable)
+load_file (GTask        *task,
+           gpointer      source_object,
+           PendingLoad  *pending,
+           GCancellable *cancellable)
 {
+  LoadFileTaskData *task_data = pending->task_data;
   GError *error = NULL;
   GdkPixbuf *pixbuf;
+  int width, height;
 
-  pixbuf = gdk_pixbuf_new_from_file (task_data->filename,
-                                     &error);
+  if (task_data->max_width > 0 &&
+      gdk_pixbuf_get_file_info (task_data->filename, &width, &height) != NULL)
+    {
+      task_data->image_width = width;
+      task_data->image_height = height;
+
+      if (task_data->style == G_DESKTOP_BACKGROUND_STYLE_STRETCHED ||
+          task_data->style == G_DESKTOP_BACKGROUND_STYLE_SPANNED)
+        {
+          /* Each dimension is scaled on its own */
+          width = MIN (width, task_data->max_width);
+          height = MIN (height, task_data->max_height);
+        }
+      else
+        {
+          /* The aspect ratio is kept, and the image covers at most the
+           * largest monitor in both dimensions.
+           */
+          double scale = MAX ((double) task_data->max_width / width,
+                              (double) task_data->max_height / height);
+
+          if (scale < 1.0)
+            {
+              width = MAX (1, (int) (width * scale + 0.5));
+              height = MAX (1, (int) (height * scale + 0.5));
+            }
+        }
+
+      /* Loaders that support it (like JPEG) decode straight to the
+       * smaller size instead of decoding at full size and scaling.
+       */
+      pixbuf = gdk_pixbuf_new_from_file_at_scale (task_data->filename,
+                                                  width, height, FALSE,
+                                                  &error);
+    }
+  else
+    {
+      pixbuf = gdk_pixbuf_new_from_file (task_data->filename,
+                                         &error);
+      if (pixbuf != NULL)
+        {
+          task_data->image_width = gdk_pixbuf_get_width (pixbuf);
+          task_data->image_height = gdk_pixbuf_get_height (pixbuf);
+        }
+    }
 
   if (pixbuf == NULL)
     {
@@ -984,6 +1230,99 @@ load_file (GTask            *task,
   g_task_return_pointer (task, pixbuf, (GDestroyNotify) g_object_unref);
 }
 
+static CoglTexture *
+texture_from_pixbuf (GdkPixbuf  *pixbuf,
+                     GError    **error)
+{
+  CoglTexture *texture;
+
+  texture = cogl_texture_new_from_data (gdk_pixbuf_get_width (pixbuf),
+                                        gdk_pixbuf_get_height (pixbuf),
+                                        COGL_TEXTURE_NO_ATLAS,
+                                        gdk_pixbuf_get_has_alpha (pixbuf) ?
+                                        COGL_PIXEL_FORMAT_RGBA_8888 :
+                                        COGL_PIXEL_FORMAT_RGB_888,
+                                        COGL_PIXEL_FORMAT_ANY,
+                                        gdk_pixbuf_get_rowstride (pixbuf),
+                                        gdk_pixbuf_get_pixels (pixbuf));
+
+  if (texture == NULL)
+    g_set_error_literal (error,
+                         COGL_BITMAP_ERROR,
+                         COGL_BITMAP_ERROR_FAILED,
+                         _("background texture could not be created from file"));
+
+  return texture;
+}
+
+static void
+on_file_decoded (GObject      *source_object,
+                 GAsyncResult *result,
+                 gpointer      user_data)
+{
+  PendingLoad *pending = user_data;
+  LoadFileTaskData *task_data = pending->task_data;
+  CoglTexture *texture = NULL;
+  GdkPixbuf *pixbuf;
+  GError *error = NULL;
+  GSList *l;
+
+  if (task_data->cache_key != NULL)
+    g_hash_table_remove (pending_loads, task_data->cache_key);
+
+  pixbuf = g_task_propagate_pointer (G_TASK (result), &error);
+  if (pixbuf != NULL)
+    {
+      texture = texture_from_pixbuf (pixbuf, &error);
+      g_object_unref (pixbuf);
+    }
+
+  if (texture != NULL)
+    {
+      meta_verbose ("Background %s: %dx%d image decoded at %dx%d for %u loads, "
+                    "%" G_GSIZE_FORMAT " KiB of texture\n",
+                    task_data->filename,
+                    task_data->image_width, task_data->image_height,
+                    cogl_texture_get_width (texture),
+                    cogl_texture_get_height (texture),
+                    g_slist_length (pending->waiters),
+                    get_texture_memory (texture) / 1024);
+
+      if (task_data->cache_key != NULL)
+        texture_cache_insert (task_data->cache_key, texture);
+    }
+
+  /* Returning may call back into meta_background_load_file_async(),
+   * which no longer sees this load as pending. */
+  for (l = pending->waiters; l; l = l->next)
+    {
+      GTask *task = l->data;
+
+      if (texture != NULL)
+        {
+          LoadFileTaskData *waiter_data = g_task_get_task_data (task);
+
+          waiter_data->texture = cogl_object_ref (texture);
+          g_task_return_pointer (task, NULL, NULL);
+        }
+      else
+        {
+          g_task_return_error (task, g_error_copy (error));
+        }
+
+      g_object_unref (task);
+    }
+
+  /* The waiters hold the texture now; the cache holds no reference */
+  if (texture != NULL)
+    cogl_object_unref (texture);
+  g_clear_error (&error);
+
+  g_slist_free (pending->waiters);
+  load_file_task_data_free (pending->task_data);
+  g_slice_free (PendingLoad, pending);
+}
+
 /**
  * meta_background_load_file_async:
  * @self: the #MetaBackground
@@ -994,6 +1333,9 @@ load_file (GTask            *task,
  * @user_data: user data for callback
  *
  * Loads the specified image and uses it as the background source.
+ * The image is decoded no larger than it will be drawn, and if
+ * another background is already showing the same file with the same
+ * style, its texture is shared rather than loaded again.
  */
 void
 meta_background_load_file_async (MetaBackground          *self,
@@ -1004,15 +1346,61 @@ meta_background_load_file_async (MetaBackground          *self,
                                  gpointer                 user_data)
 {
     LoadFileTaskData *task_data;
+    CoglTexture *texture;
+    PendingLoad *pending = NULL;
     GTask *task;
 
     task = g_task_new (self, cancellable, callback, user_data);
 
-    task_data = load_file_task_data_new (filename, style);
+    task_data = load_file_task_data_new (self->priv->screen, filename, style);
     g_task_set_task_data (task, task_data, (GDestroyNotify) load_file_task_data_free);
 
-    g_task_run_in_thread (task, (GTaskThreadFunc) load_file);
-    g_object_unref (task);
+    texture = texture_cache_lookup (task_data->cache_key);
+    if (texture != NULL)
+      {
+        meta_verbose ("Background %s: sharing %dx%d texture\n",
+                      filename,
+                      cogl_texture_get_width (texture),
+                      cogl_texture_get_height (texture));
+
+        task_data->texture = cogl_object_ref (texture);
+        g_task_return_pointer (task, NULL, NULL);
+        g_object_unref (task);
+        return;
+      }
+
+    if (task_data->cache_key != NULL && pending_loads != NULL)
+      pending = g_hash_table_lookup (pending_loads, task_data->cache_key);
+
+    if (pending == NULL)
+      {
+        GTask *decode_task;
+
+        pending = g_slice_new0 (PendingLoad);
+        pending->task_data = load_file_task_data_new (self->priv->screen,
+                                                      filename, style);
+
+        if (pending->task_data->cache_key != NULL)
+          {
+            if (pending_loads == NULL)
+              pending_loads = g_hash_table_new (g_str_hash, g_str_equal);
+            g_hash_table_insert (pending_loads,
+                                 pending->task_data->cache_key, pending);
+          }
+
+        decode_task = g_task_new (NULL, NULL, on_file_decoded, pending);
+        g_task_set_task_data (decode_task, pending, NULL);
+        g_task_run_in_thread (decode_task, (GTaskThreadFunc) load_file);
+        g_object_unref (decode_task);
+      }
+    else
+      {
+        meta_verbose ("Background %s: waiting for a load already running\n",
+                      filename);
+      }
+
+    /* Held until the decode is done */
+    pending->waiters = g_slist_prepend (pending->waiters, task);
 }
 
 /**
@@ -1034,47 +1422,17 @@ meta_background_load_file_finish (MetaBackground  *self,
   GTask *task;
   LoadFileTaskData *task_data;
   CoglTexture *texture;
-  GdkPixbuf *pixbuf;
-  int width, height, row_stride;
-  guchar *pixels;
-  gboolean has_alpha;
-  gboolean loaded = FALSE;
 
   g_return_val_if_fail (g_task_is_valid (result, self), FALSE);
 
   task = G_TASK (result);
-
-  pixbuf = g_task_propagate_pointer (task, error);
-
-  if (pixbuf == NULL)
-    goto out;
-
   task_data = g_task_get_task_data (task);
 
-  width = gdk_pixbuf_get_width (pixbuf);
-  height = gdk_pixbuf_get_height (pixbuf);
-  row_stride = gdk_pixbuf_get_rowstride (pixbuf);
-  pixels = gdk_pixbuf_get_pixels (pixbuf);
-  has_alpha = gdk_pixbuf_get_has_alpha (pixbuf);
-
-  texture = cogl_texture_new_from_data (width,
-                                        height,
-                                        COGL_TEXTURE_NO_ATLAS,
-                                        has_alpha ?
-                                        COGL_PIXEL_FORMAT_RGBA_8888 :
-                                        COGL_PIXEL_FORMAT_RGB_888,
-                                        COGL_PIXEL_FORMAT_ANY,
-                                        row_stride,
-                                        pixels);
+  g_task_propagate_pointer (task, error);
+  if (g_task_had_error (task))
+    return FALSE;
 
-  if (texture == NULL)
-    {
-      g_set_error_literal (error,
-                           COGL_BITMAP_ERROR,
-                           COGL_BITMAP_ERROR_FAILED,
-                           _("background texture could not be created from file"));
-      goto out;
-    }
+  texture = cogl_object_ref (task_data->texture);
 
   ensure_pipeline (self);
   unset_texture (self);
@@ -1082,13 +1440,96 @@ meta_background_load_file_finish (MetaBackground  *self,
   set_filename (self, task_data->filename);
   set_texture (self, texture);
 
+  self->priv->texture_from_file = TRUE;
+  self->priv->texture_max_width = task_data->max_width;
+  self->priv->texture_max_height = task_data->max_height;
+
   clutter_content_invalidate (CLUTTER_CONTENT (self));
-  loaded = TRUE;
 
-out:
-  if (pixbuf != NULL)
-    g_object_unref (pixbuf);
-  return loaded;
+  return TRUE;
+}
+
+static void
+on_background_reloaded (GObject      *source,
+                        GAsyncResult *result,
+                        gpointer      user_data)
+{
+  GError *error = NULL;
+
+  if (!meta_background_load_file_finish (META_BACKGROUND (source), result, &error))
+    {
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        meta_warning ("Failed to reload background: %s\n", error->message);
+      g_error_free (error);
+    }
+}
+
+/* The texture of a background loaded from a file is only as big as
+ * the monitors were at the time, so when they change size it has to
+ * be loaded again; otherwise a monitor bigger than all the previous
+ * ones would show it scaled up.
+ */
+static void
+on_monitors_changed (MetaScreen     *screen,
+                     MetaBackground *self)
+{
+  MetaBackgroundPrivate *priv = self->priv;
+  int max_width, max_height;
+
+  if (!priv->texture_from_file)
+    return;
+
+  get_max_image_size (screen, priv->style, &max_width, &max_height);
+
+  if (max_width == priv->texture_max_width &&
+      max_height == priv->texture_max_height)
+    return;
+
+  meta_verbose ("Background %s: monitors changed, reloading at %dx%d\n",
+                priv->filename, max_width, max_height);
+
+  if (priv->reload_cancellable != NULL)
+    {
+      g_cancellable_cancel (priv->reload_cancellable);
+      g_object_unref (priv->reload_cancellable);
+    }
+  priv->reload_cancellable = g_cancellable_new ();
+
+  meta_background_load_file_async (self, priv->filename, priv->style,
+                                   priv->reload_cancellable,
+                                   on_background_reloaded, NULL);
+}
+
+static void
+set_screen (MetaBackground *self,
+            MetaScreen     *screen)
+{
+  MetaBackgroundPrivate *priv = self->priv;
+
+  if (priv->screen == screen)
+    return;
+
+  if (priv->monitors_changed_id != 0)
+    {
+      g_signal_handler_disconnect (priv->screen, priv->monitors_changed_id);
+      priv->monitors_changed_id = 0;
+    }
+
+  priv->screen = screen;
+
+  if (priv->screen != NULL)
+    priv->monitors_changed_id = g_signal_connect (priv->screen, "monitors-changed",
+                                                  G_CALLBACK (on_monitors_changed),
+                                                  self);
+}
+
+static void
+copy_file_texture_state (MetaBackground *background,
+                         MetaBackground *self)
+{
+  background->priv->texture_from_file = self->priv->texture_from_file;
+  background->priv->texture_max_width = self->priv->texture_max_width;
+  background->priv->texture_max_height = self->priv->texture_max_height;
 }
 
 /**
@@ -1132,6 +1573,7 @@ meta_background_copy (MetaBackground        *self,
       background->priv->pipeline = cogl_pipeline_copy (self->priv->pipeline);
       background->priv->texture = cogl_object_ref (self->priv->texture);
       background->priv->style = self->priv->style;
+      copy_file_texture_state (background, self);
 
       if (effects != self->priv->effects)
         {
@@ -1153,7 +1595,10 @@ meta_background_copy (MetaBackground        *self,
     {
       ensure_pipeline (background);
       if (self->priv->texture != NULL)
-        set_texture (background, cogl_object_ref (self->priv->texture));
+        {
+          set_texture (background, cogl_object_ref (self->priv->texture));
+          copy_file_texture_state (background, self);
+        }
       set_style (background, self->priv->style);
       set_effects (background, effects);
 
@@ -1273,3 +1718,26 @@ meta_background_get_filename (MetaBackground *self)
 {
     return self->priv->filename;
 }
+
+/**
+ * meta_background_get_texture_memory:
+ * @self: a #MetaBackground
+ *
+ * Returns the amount of memory taken by the texture @self draws,
+ * computed from its size and pixel format. Backgrounds showing the
+ * same file share one texture, so the memory may be counted for more
+ * than one background.
+ *
+ * Return value: the size of the background's texture in bytes, or 0
+ *   if it has none
+ */
+gsize
+meta_background_get_texture_memory (MetaBackground *self)
+{
+  g_return_val_if_fail (META_IS_BACKGROUND (self), 0);
+
+  if (self->priv->texture == NULL)
+    return 0;
+
+  return get_texture_memory (self->priv->texture);
+}
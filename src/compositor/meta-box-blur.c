@@ -0,0 +1,786 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * Box blur engine used to generate shadow textures
+ *
+ * Copyright (C) 2010 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <config.h>
+#include <math.h>
+#include <string.h>
+
+#include "meta-box-blur.h"
+
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+/* We emulate a 1D Gaussian blur by using 3 consecutive box blurs;
+ * this produces a result that's within 3% of the original and can be
+ * implemented much faster for large filter sizes because of the
+ * efficiency of implementation of a box blur. Idea and formula
+ * for choosing the box blur size come from:
+ *
+ * http://www.w3.org/TR/SVG/filters.html#feGaussianBlurElement
+ *
+ * The 2D blur is then done by blurring the rows and blurring the
+ * columns. (This is possible because the Gaussian kernel is
+ * separable - it's the product of a horizontal blur and a vertical
+ * blur.)
+ *
+ * The reference implementation blurs the columns by transposing the
+ * image, blurring rows, and transposing back, and divides by the
+ * filter width for every pixel of every pass. The other backends
+ * avoid both costs:
+ *
+ * - Columns are blurred in place: we walk down the span of rows
+ *   keeping one running sum per column, so each step handles a whole
+ *   row of adjacent pixels. That is both cache friendly and
+ *   trivially vectorizable across columns.
+ *
+ * - The divide is replaced by a multiplication with a precomputed
+ *   reciprocal. For a numerator n and divisor d with n * d < 2^32,
+ *   (n * (floor (2^32 / d) + 1)) >> 32 is exactly n / d, so the
+ *   result is bit-identical to the reference. Each pass is still
+ *   rounded separately; accumulating all three passes and dividing
+ *   once at the end would be cheaper but would change the output.
+ */
+
+/* n is at most 255.5 * d, so n * d < 2^32 holds for d below this */
+#define MAX_RECIPROCAL_FILTER_SIZE 4096
+
+static MetaBoxBlurBackend current_backend = META_BOX_BLUR_BACKEND_AUTO;
+
+int
+meta_box_blur_get_filter_size (int radius)
+{
+  return (int)(0.5 + radius * (0.75 * sqrt(2*M_PI)));
+}
+
+/* The "spread" of the filter is the number of pixels from an original
+ * pixel that it's blurred image extends. (A no-op blur that doesn't
+ * blur would have a spread of 0.) See comment in blur_rows() for why the
+ * odd and even cases are different
+ */
+int
+meta_box_blur_get_spread (int radius)
+{
+  int d = meta_box_blur_get_filter_size (radius);
+
+  if (d % 2 == 1)
+    return 3 * (d / 2);
+  else
+    return 3 * (d / 2) - 1;
+}
+
+static guint32
+get_reciprocal (int d)
+{
+  return (guint32)(G_GUINT64_CONSTANT (0x100000000) / d + 1);
+}
+
+static inline guchar
+reciprocal_divide (guint32 n,
+                   guint32 reciprocal)
+{
+  return (guchar)(((guint64)n * reciprocal) >> 32);
+}
+
+/* The offset of the blurred output relative to the input; d is the
+ * filter width; for even d shift indicates how the blurred result is
+ * aligned with the original - does ' x ' go to ' yy' (shift=1) or
+ * 'yy ' (shift=-1)
+ */
+static int
+get_pass_offset (int d,
+                 int shift)
+{
+  if (d % 2 == 1)
+    return d / 2;
+  else
+    return (d - shift) / 2;
+}
+
+/* Reference implementation */
+
+/* This applies a single box blur pass to a horizontal range of pixels;
+ * since the box blur has the same weight for all pixels, we can
+ * implement an efficient sliding window algorithm where we add
+ * in pixels coming into the window from the right and remove
+ * them when they leave the windw to the left.
+ */
+static void
+blur_xspan (guchar *row,
+            guchar *tmp_buffer,
+            int     row_width,
+            int     x0,
+            int     x1,
+            int     d,
+            int     shift)
+{
+  int offset = get_pass_offset (d, shift);
+  int sum = 0;
+  int i;
+
+  /* All the conditionals in here look slow, but the branches will
+   * be well predicted and there are enough different possibilities
+   * that trying to write this as a series of unconditional loops
+   * is hard and not an obvious win.
+   */
+  for (i = x0 - d + offset; i < x1 + offset; i++)
+    {
+      if (i >= 0 && i < row_width)
+	sum += row[i];
+
+      if (i >= x0 + offset)
+	{
+	  if (i >= d)
+	    sum -= row[i - d];
+
+	  tmp_buffer[i - offset] = (sum + d / 2) / d;
+	}
+    }
+
+  memcpy(row + x0, tmp_buffer + x0, x1 - x0);
+}
+
+/* Same as blur_xspan(), but with the per-pixel divide replaced by a
+ * multiplication with the reciprocal of d */
+static void
+blur_xspan_reciprocal (guchar *row,
+                       guchar *tmp_buffer,
+                       int     row_width,
+                       int     x0,
+                       int     x1,
+                       int     d,
+                       int     shift)
+{
+  int offset = get_pass_offset (d, shift);
+  guint32 reciprocal = get_reciprocal (d);
+  guint32 sum = 0;
+  int i;
+
+  for (i = x0 - d + offset; i < x1 + offset; i++)
+    {
+      if (i >= 0 && i < row_width)
+	sum += row[i];
+
+      if (i >= x0 + offset)
+	{
+	  if (i >= d)
+	    sum -= row[i - d];
+
+	  tmp_buffer[i - offset] = reciprocal_divide (sum + d / 2, reciprocal);
+	}
+    }
+
+  memcpy(row + x0, tmp_buffer + x0, x1 - x0);
+}
+
+typedef void (*BlurXspanFunc) (guchar *row,
+                               guchar *tmp_buffer,
+                               int     row_width,
+                               int     x0,
+                               int     x1,
+                               int     d,
+                               int     shift);
+
+static void
+blur_rows (cairo_region_t   *convolve_region,
+           int               x_offset,
+           int               y_offset,
+	   guchar           *buffer,
+	   int               buffer_width,
+	   int               buffer_height,
+           int               d,
+           BlurXspanFunc     blur_xspan_func)
+{
+  int i, j;
+  int n_rectangles;
+  guchar *tmp_buffer;
+
+  tmp_buffer = g_malloc (buffer_width);
+
+  n_rectangles = cairo_region_num_rectangles (convolve_region);
+  for (i = 0; i < n_rectangles; i++)
+    {
+      cairo_rectangle_int_t rect;
+
+      cairo_region_get_rectangle (convolve_region, i, &rect);
+
+      for (j = y_offset + rect.y; j < y_offset + rect.y + rect.height; j++)
+	{
+	  guchar *row = buffer + j * buffer_width;
+	  int x0 = x_offset + rect.x;
+	  int x1 = x0 + rect.width;
+
+          /* We want to produce a symmetric blur that spreads a pixel
+           * equally far to the left and right. If d is odd that happens
+           * naturally, but for d even, we approximate by using a blur
+           * on either side and then a centered blur of size d + 1.
+           * (techique also from the SVG specification)
+           */
+	  if (d % 2 == 1)
+	    {
+	      blur_xspan_func (row, tmp_buffer, buffer_width, x0, x1, d, 0);
+	      blur_xspan_func (row, tmp_buffer, buffer_width, x0, x1, d, 0);
+	      blur_xspan_func (row, tmp_buffer, buffer_width, x0, x1, d, 0);
+	    }
+	  else
+	    {
+	      blur_xspan_func (row, tmp_buffer, buffer_width, x0, x1, d, 1);
+	      blur_xspan_func (row, tmp_buffer, buffer_width, x0, x1, d, -1);
+	      blur_xspan_func (row, tmp_buffer, buffer_width, x0, x1, d + 1, 0);
+	    }
+	}
+    }
+
+  g_free (tmp_buffer);
+}
+
+/* Swaps width and height. Either swaps in-place and returns the original
+ * buffer or allocates a new buffer, frees the original buffer and returns
+ * the new buffer.
+ */
+static guchar *
+flip_buffer (guchar *buffer,
+	     int     width,
+             int     height)
+{
+  /* Working in blocks increases cache efficiency, compared to reading
+   * or writing an entire column at once */
+#define BLOCK_SIZE 16
+
+  if (width == height)
+    {
+      int i0, j0;
+
+      for (j0 = 0; j0 < height; j0 += BLOCK_SIZE)
+	for (i0 = 0; i0 <= j0; i0 += BLOCK_SIZE)
+	  {
+	    int max_j = MIN(j0 + BLOCK_SIZE, height);
+	    int max_i = MIN(i0 + BLOCK_SIZE, width);
+	    int i, j;
+
+	    if (i0 == j0)
+	      {
+		for (j = j0; j < max_j; j++)
+		  for (i = i0; i < j; i++)
+		    {
+		      guchar tmp = buffer[j * width + i];
+		      buffer[j * width + i] = buffer[i * width + j];
+		      buffer[i * width + j] = tmp;
+		    }
+	      }
+	    else
+	      {
+		for (j = j0; j < max_j; j++)
+		  for (i = i0; i < max_i; i++)
+		    {
+		      guchar tmp = buffer[j * width + i];
+		      buffer[j * width + i] = buffer[i * width + j];
+		      buffer[i * width + j] = tmp;
+		    }
+	      }
+	  }
+
+      return buffer;
+    }
+  else
+    {
+      guchar *new_buffer = g_malloc (height * width);
+      int i0, j0;
+
+      for (i0 = 0; i0 < width; i0 += BLOCK_SIZE)
+        for (j0 = 0; j0 < height; j0 += BLOCK_SIZE)
+	  {
+	    int max_j = MIN(j0 + BLOCK_SIZE, height);
+	    int max_i = MIN(i0 + BLOCK_SIZE, width);
+	    int i, j;
+
+            for (i = i0; i < max_i; i++)
+              for (j = j0; j < max_j; j++)
+		new_buffer[i * height + j] = buffer[j * width + i];
+	  }
+
+      g_free (buffer);
+
+      return new_buffer;
+    }
+#undef BLOCK_SIZE
+}
+
+/* Column blurring without transposes */
+
+/* One step of the sliding window down a set of adjacent columns: add
+ * in the pixels of add_row (if not NULL), remove the pixels of
+ * sub_row (if not NULL), and write the divided sums to out_row (if
+ * not NULL). The SIMD variants handle as many columns as they can
+ * and return the number of columns processed.
+ */
+typedef int (*BlurColumnStepFunc) (guint32      *sums,
+                                   const guchar *add_row,
+                                   const guchar *sub_row,
+                                   guchar       *out_row,
+                                   int           n_columns,
+                                   guint32       half_d,
+                                   guint32       reciprocal);
+
+static void
+blur_column_step_scalar (guint32      *sums,
+                         const guchar *add_row,
+                         const guchar *sub_row,
+                         guchar       *out_row,
+                         int           start,
+                         int           n_columns,
+                         guint32       half_d,
+                         guint32       reciprocal)
+{
+  int i;
+
+  if (add_row)
+    for (i = start; i < n_columns; i++)
+      sums[i] += add_row[i];
+
+  if (sub_row)
+    for (i = start; i < n_columns; i++)
+      sums[i] -= sub_row[i];
+
+  if (out_row)
+    for (i = start; i < n_columns; i++)
+      out_row[i] = reciprocal_divide (sums[i] + half_d, reciprocal);
+}
+
+#ifdef HAVE_X86_SIMD
+
+/* Multiplies 4 32-bit lanes by the reciprocal, keeping the high 32
+ * bits of each 64-bit product. SSE2 only has an even-lane 32x32->64
+ * multiply, so do the even and odd lanes separately and merge. */
+__attribute__ ((target ("sse2")))
+static inline __m128i
+reciprocal_divide_sse2 (__m128i n,
+                        __m128i reciprocal,
+                        __m128i high_mask)
+{
+  __m128i even = _mm_srli_epi64 (_mm_mul_epu32 (n, reciprocal), 32);
+  __m128i odd = _mm_mul_epu32 (_mm_srli_epi64 (n, 32), reciprocal);
+
+  return _mm_or_si128 (even, _mm_and_si128 (odd, high_mask));
+}
+
+__attribute__ ((target ("sse2")))
+static int
+blur_column_step_sse2 (guint32      *sums,
+                       const guchar *add_row,
+                       const guchar *sub_row,
+                       guchar       *out_row,
+                       int           n_columns,
+                       guint32       half_d,
+                       guint32       reciprocal)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i half = _mm_set1_epi32 (half_d);
+  const __m128i recip = _mm_set1_epi32 (reciprocal);
+  const __m128i high_mask = _mm_set_epi32 (-1, 0, -1, 0);
+  int i;
+
+  for (i = 0; i + 16 <= n_columns; i += 16)
+    {
+      __m128i s[4];
+      int k;
+
+      for (k = 0; k < 4; k++)
+        s[k] = _mm_loadu_si128 ((const __m128i *)(sums + i + 4 * k));
+
+      if (add_row)
+        {
+          __m128i p = _mm_loadu_si128 ((const __m128i *)(add_row + i));
+          __m128i lo = _mm_unpacklo_epi8 (p, zero);
+          __m128i hi = _mm_unpackhi_epi8 (p, zero);
+
+          s[0] = _mm_add_epi32 (s[0], _mm_unpacklo_epi16 (lo, zero));
+          s[1] = _mm_add_epi32 (s[1], _mm_unpackhi_epi16 (lo, zero));
+          s[2] = _mm_add_epi32 (s[2], _mm_unpacklo_epi16 (hi, zero));
+          s[3] = _mm_add_epi32 (s[3], _mm_unpackhi_epi16 (hi, zero));
+        }
+
+      if (sub_row)
+        {
+          __m128i p = _mm_loadu_si128 ((const __m128i *)(sub_row + i));
+          __m128i lo = _mm_unpacklo_epi8 (p, zero);
+          __m128i hi = _mm_unpackhi_epi8 (p, zero);
+
+          s[0] = _mm_sub_epi32 (s[0], _mm_unpacklo_epi16 (lo, zero));
+          s[1] = _mm_sub_epi32 (s[1], _mm_unpackhi_epi16 (lo, zero));
+          s[2] = _mm_sub_epi32 (s[2], _mm_unpacklo_epi16 (hi, zero));
+          s[3] = _mm_sub_epi32 (s[3], _mm_unpackhi_epi16 (hi, zero));
+        }
+
+      for (k = 0; k < 4; k++)
+        _mm_storeu_si128 ((__m128i *)(sums + i + 4 * k), s[k]);
+
+      if (out_row)
+        {
+          __m128i q[4];
+
+          for (k = 0; k < 4; k++)
+            q[k] = reciprocal_divide_sse2 (_mm_add_epi32 (s[k], half),
+                                           recip, high_mask);
+
+          /* Every quotient is <= 255, so the saturating packs are exact */
+          _mm_storeu_si128 ((__m128i *)(out_row + i),
+                            _mm_packus_epi16 (_mm_packs_epi32 (q[0], q[1]),
+                                              _mm_packs_epi32 (q[2], q[3])));
+        }
+    }
+
+  return i;
+}
+
+__attribute__ ((target ("avx2")))
+static inline __m256i
+reciprocal_divide_avx2 (__m256i n,
+                        __m256i reciprocal,
+                        __m256i high_mask)
+{
+  __m256i even = _mm256_srli_epi64 (_mm256_mul_epu32 (n, reciprocal), 32);
+  __m256i odd = _mm256_mul_epu32 (_mm256_srli_epi64 (n, 32), reciprocal);
+
+  return _mm256_or_si256 (even, _mm256_and_si256 (odd, high_mask));
+}
+
+__attribute__ ((target ("avx2")))
+static int
+blur_column_step_avx2 (guint32      *sums,
+                       const guchar *add_row,
+                       const guchar *sub_row,
+                       guchar       *out_row,
+                       int           n_columns,
+                       guint32       half_d,
+                       guint32       reciprocal)
+{
+  const __m256i half = _mm256_set1_epi32 (half_d);
+  const __m256i recip = _mm256_set1_epi32 (reciprocal);
+  const __m256i high_mask = _mm256_set_epi32 (-1, 0, -1, 0, -1, 0, -1, 0);
+  int i;
+
+  for (i = 0; i + 16 <= n_columns; i += 16)
+    {
+      __m256i s0 = _mm256_loadu_si256 ((const __m256i *)(sums + i));
+      __m256i s1 = _mm256_loadu_si256 ((const __m256i *)(sums + i + 8));
+
+      if (add_row)
+        {
+          s0 = _mm256_add_epi32 (s0, _mm256_cvtepu8_epi32 (_mm_loadl_epi64 ((const __m128i *)(add_row + i))));
+          s1 = _mm256_add_epi32 (s1, _mm256_cvtepu8_epi32 (_mm_loadl_epi64 ((const __m128i *)(add_row + i + 8))));
+        }
+
+      if (sub_row)
+        {
+          s0 = _mm256_sub_epi32 (s0, _mm256_cvtepu8_epi32 (_mm_loadl_epi64 ((const __m128i *)(sub_row + i))));
+          s1 = _mm256_sub_epi32 (s1, _mm256_cvtepu8_epi32 (_mm_loadl_epi64 ((const __m128i *)(sub_row + i + 8))));
+        }
+
+      _mm256_storeu_si256 ((__m256i *)(sums + i), s0);
+      _mm256_storeu_si256 ((__m256i *)(sums + i + 8), s1);
+
+      if (out_row)
+        {
+          __m256i q0 = reciprocal_divide_avx2 (_mm256_add_epi32 (s0, half), recip, high_mask);
+          __m256i q1 = reciprocal_divide_avx2 (_mm256_add_epi32 (s1, half), recip, high_mask);
+          __m128i w0 = _mm_packs_epi32 (_mm256_castsi256_si128 (q0),
+                                        _mm256_extracti128_si256 (q0, 1));
+          __m128i w1 = _mm_packs_epi32 (_mm256_castsi256_si128 (q1),
+                                        _mm256_extracti128_si256 (q1, 1));
+
+          _mm_storeu_si128 ((__m128i *)(out_row + i), _mm_packus_epi16 (w0, w1));
+        }
+    }
+
+  return i;
+}
+
+#endif /* HAVE_X86_SIMD */
+
+/* Applies a single box blur pass to the rows y0 <= y < y1 of the
+ * columns x0 <= x < x1. This is exactly blur_xspan() applied to
+ * each column, except that all the columns advance together. */
+static void
+blur_yspan (guchar             *buffer,
+            guchar             *tmp_buffer,
+            guint32            *sums,
+            int                 buffer_width,
+            int                 buffer_height,
+            int                 x0,
+            int                 x1,
+            int                 y0,
+            int                 y1,
+            int                 d,
+            int                 shift,
+            BlurColumnStepFunc  step_func)
+{
+  int offset = get_pass_offset (d, shift);
+  guint32 reciprocal = get_reciprocal (d);
+  guint32 half_d = d / 2;
+  int n_columns = x1 - x0;
+  int i;
+
+  memset (sums, 0, n_columns * sizeof (guint32));
+
+  for (i = y0 - d + offset; i < y1 + offset; i++)
+    {
+      const guchar *add_row = NULL;
+      const guchar *sub_row = NULL;
+      guchar *out_row = NULL;
+      int done = 0;
+
+      if (i >= 0 && i < buffer_height)
+        add_row = buffer + i * buffer_width + x0;
+
+      if (i >= y0 + offset)
+        {
+          if (i >= d)
+            sub_row = buffer + (i - d) * buffer_width + x0;
+
+          out_row = tmp_buffer + (i - offset - y0) * n_columns;
+        }
+
+      if (add_row == NULL && sub_row == NULL && out_row == NULL)
+        continue;
+
+      if (step_func)
+        done = step_func (sums, add_row, sub_row, out_row,
+                          n_columns, half_d, reciprocal);
+
+      blur_column_step_scalar (sums, add_row, sub_row, out_row,
+                               done, n_columns, half_d, reciprocal);
+    }
+
+  for (i = y0; i < y1; i++)
+    memcpy (buffer + i * buffer_width + x0,
+            tmp_buffer + (i - y0) * n_columns,
+            n_columns);
+}
+
+/* The column convolve region is flipped, like for the reference
+ * implementation, so rect.x/rect.width give the range of rows and
+ * rect.y/rect.height the range of columns. */
+static void
+blur_columns (cairo_region_t     *convolve_region,
+              int                 x_offset,
+              int                 y_offset,
+              guchar             *buffer,
+              int                 buffer_width,
+              int                 buffer_height,
+              int                 d,
+              BlurColumnStepFunc  step_func)
+{
+  int i;
+  int n_rectangles;
+  guchar *tmp_buffer = NULL;
+  guint32 *sums = NULL;
+  gsize tmp_size = 0;
+
+  sums = g_new (guint32, buffer_width);
+
+  n_rectangles = cairo_region_num_rectangles (convolve_region);
+  for (i = 0; i < n_rectangles; i++)
+    {
+      cairo_rectangle_int_t rect;
+      int x0, x1, y0, y1;
+
+      cairo_region_get_rectangle (convolve_region, i, &rect);
+
+      x0 = x_offset + rect.y;
+      x1 = x0 + rect.height;
+      y0 = y_offset + rect.x;
+      y1 = y0 + rect.width;
+
+      if (x1 <= x0 || y1 <= y0)
+        continue;
+
+      if ((gsize)(x1 - x0) * (y1 - y0) > tmp_size)
+        {
+          tmp_size = (gsize)(x1 - x0) * (y1 - y0);
+          g_free (tmp_buffer);
+          tmp_buffer = g_malloc (tmp_size);
+        }
+
+      /* See blur_rows() for the odd/even distinction */
+      if (d % 2 == 1)
+        {
+          blur_yspan (buffer, tmp_buffer, sums, buffer_width, buffer_height,
+                      x0, x1, y0, y1, d, 0, step_func);
+          blur_yspan (buffer, tmp_buffer, sums, buffer_width, buffer_height,
+                      x0, x1, y0, y1, d, 0, step_func);
+          blur_yspan (buffer, tmp_buffer, sums, buffer_width, buffer_height,
+                      x0, x1, y0, y1, d, 0, step_func);
+        }
+      else
+        {
+          blur_yspan (buffer, tmp_buffer, sums, buffer_width, buffer_height,
+                      x0, x1, y0, y1, d, 1, step_func);
+          blur_yspan (buffer, tmp_buffer, sums, buffer_width, buffer_height,
+                      x0, x1, y0, y1, d, -1, step_func);
+          blur_yspan (buffer, tmp_buffer, sums, buffer_width, buffer_height,
+                      x0, x1, y0, y1, d + 1, 0, step_func);
+        }
+    }
+
+  g_free (tmp_buffer);
+  g_free (sums);
+}
+
+/* Backend selection */
+
+gboolean
+meta_box_blur_backend_supported (MetaBoxBlurBackend backend)
+{
+  switch (backend)
+    {
+    case META_BOX_BLUR_BACKEND_AUTO:
+    case META_BOX_BLUR_BACKEND_REFERENCE:
+    case META_BOX_BLUR_BACKEND_SCALAR:
+      return TRUE;
+#ifdef HAVE_X86_SIMD
+    case META_BOX_BLUR_BACKEND_SSE2:
+      __builtin_cpu_init ();
+      return __builtin_cpu_supports ("sse2");
+    case META_BOX_BLUR_BACKEND_AVX2:
+      __builtin_cpu_init ();
+      return __builtin_cpu_supports ("avx2");
+#else
+    case META_BOX_BLUR_BACKEND_SSE2:
+    case META_BOX_BLUR_BACKEND_AVX2:
+      return FALSE;
+#endif
+    }
+
+  return FALSE;
+}
+
+const char *
+meta_box_blur_backend_name (MetaBoxBlurBackend backend)
+{
+  switch (backend)
+    {
+    case META_BOX_BLUR_BACKEND_AUTO:
+      return "auto";
+    case META_BOX_BLUR_BACKEND_REFERENCE:
+      return "reference";
+    case META_BOX_BLUR_BACKEND_SCALAR:
+      return "scalar";
+    case META_BOX_BLUR_BACKEND_SSE2:
+      return "sse2";
+    case META_BOX_BLUR_BACKEND_AVX2:
+      return "avx2";
+    }
+
+  return "unknown";
+}
+
+/* Overrides the automatically chosen backend; mostly useful for
+ * testing and benchmarking. Unsupported backends are ignored. */
+void
+meta_box_blur_set_backend (MetaBoxBlurBackend backend)
+{
+  g_return_if_fail (meta_box_blur_backend_supported (backend));
+
+  current_backend = backend;
+}
+
+MetaBoxBlurBackend
+meta_box_blur_get_backend (void)
+{
+  if (current_backend == META_BOX_BLUR_BACKEND_AUTO)
+    {
+      if (meta_box_blur_backend_supported (META_BOX_BLUR_BACKEND_AVX2))
+        current_backend = META_BOX_BLUR_BACKEND_AVX2;
+      else if (meta_box_blur_backend_supported (META_BOX_BLUR_BACKEND_SSE2))
+        current_backend = META_BOX_BLUR_BACKEND_SSE2;
+      else
+        current_backend = META_BOX_BLUR_BACKEND_SCALAR;
+    }
+
+  return current_backend;
+}
+
+/**
+ * meta_box_blur_region:
+ * @buffer: an A8 buffer, @buffer_width pixels per row
+ * @buffer_width: width of @buffer
+ * @buffer_height: height of @buffer
+ * @row_convolve_region: region in which to blur rows
+ * @column_convolve_region: region in which to blur columns, with x and
+ *   y interchanged (see meta_make_border_region())
+ * @x_offset: x offset of the regions within the buffer
+ * @y_offset: y offset of the regions within the buffer
+ * @d: box filter size, from meta_box_blur_get_filter_size()
+ *
+ * Blurs the columns and then the rows of @buffer with three box
+ * filter passes each, using the current backend.
+ *
+ * Return value: the blurred buffer; this may be a different buffer
+ *   than the one passed in, in which case @buffer was freed.
+ */
+guchar *
+meta_box_blur_region (guchar         *buffer,
+                      int             buffer_width,
+                      int             buffer_height,
+                      cairo_region_t *row_convolve_region,
+                      cairo_region_t *column_convolve_region,
+                      int             x_offset,
+                      int             y_offset,
+                      int             d)
+{
+  MetaBoxBlurBackend backend = meta_box_blur_get_backend ();
+  BlurColumnStepFunc step_func = NULL;
+
+  if (backend == META_BOX_BLUR_BACKEND_REFERENCE ||
+      d + 1 >= MAX_RECIPROCAL_FILTER_SIZE)
+    {
+      buffer = flip_buffer (buffer, buffer_width, buffer_height);
+      blur_rows (column_convolve_region, y_offset, x_offset,
+                 buffer, buffer_height, buffer_width,
+                 d, blur_xspan);
+      buffer = flip_buffer (buffer, buffer_height, buffer_width);
+      blur_rows (row_convolve_region, x_offset, y_offset,
+                 buffer, buffer_width, buffer_height,
+                 d, blur_xspan);
+
+      return buffer;
+    }
+
+#ifdef HAVE_X86_SIMD
+  if (backend == META_BOX_BLUR_BACKEND_AVX2)
+    step_func = blur_column_step_avx2;
+  else if (backend == META_BOX_BLUR_BACKEND_SSE2)
+    step_func = blur_column_step_sse2;
+#endif
+
+  blur_columns (column_convolve_region, x_offset, y_offset,
+                buffer, buffer_width, buffer_height,
+                d, step_func);
+  blur_rows (row_convolve_region, x_offset, y_offset,
+             buffer, buffer_width, buffer_height,
+             d, blur_xspan_reciprocal);
+
+  return buffer;
+}
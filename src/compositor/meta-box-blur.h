@@ -0,0 +1,68 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * Box blur engine used to generate shadow textures
+ *
+ * Copyright (C) 2010 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef __META_BOX_BLUR_H__
+#define __META_BOX_BLUR_H__
+
+#include <cairo.h>
+#include <glib.h>
+
+/**
+ * MetaBoxBlurBackend:
+ * @META_BOX_BLUR_BACKEND_AUTO: pick the fastest backend the CPU supports
+ * @META_BOX_BLUR_BACKEND_REFERENCE: the original transpose-and-divide code;
+ *   kept to verify the other backends against
+ * @META_BOX_BLUR_BACKEND_SCALAR: portable C, no transposes and no divides
+ * @META_BOX_BLUR_BACKEND_SSE2: column passes vectorized with SSE2
+ * @META_BOX_BLUR_BACKEND_AVX2: column passes vectorized with AVX2
+ *
+ * All backends produce bit-identical output.
+ */
+typedef enum
+{
+  META_BOX_BLUR_BACKEND_AUTO,
+  META_BOX_BLUR_BACKEND_REFERENCE,
+  META_BOX_BLUR_BACKEND_SCALAR,
+  META_BOX_BLUR_BACKEND_SSE2,
+  META_BOX_BLUR_BACKEND_AVX2
+} MetaBoxBlurBackend;
+
+#define META_BOX_BLUR_N_BACKENDS (META_BOX_BLUR_BACKEND_AVX2 + 1)
+
+gboolean           meta_box_blur_backend_supported (MetaBoxBlurBackend backend);
+const char *       meta_box_blur_backend_name      (MetaBoxBlurBackend backend);
+void               meta_box_blur_set_backend       (MetaBoxBlurBackend backend);
+MetaBoxBlurBackend meta_box_blur_get_backend       (void);
+
+int meta_box_blur_get_filter_size (int radius);
+int meta_box_blur_get_spread      (int radius);
+
+guchar *meta_box_blur_region (guchar         *buffer,
+                              int             buffer_width,
+                              int             buffer_height,
+                              cairo_region_t *row_convolve_region,
+                              cairo_region_t *column_convolve_region,
+                              int             x_offset,
+                              int             y_offset,
+                              int             d);
+
+#endif /* __META_BOX_BLUR_H__ */
@@ -0,0 +1,376 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * MetaFrameTimings: record where the time of each stage frame goes
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/*
+ * The compositor calls meta_frame_timings_begin_frame() from its
+ * pre-paint repaint function, meta_frame_timings_end_paint() once
+ * the stage has been painted and meta_frame_timings_end_frame() from
+ * a post-paint repaint function, after the buffer swap. In between,
+ * the expensive parts of painting time themselves with
+ * meta_frame_timings_begin_phase()/meta_frame_timings_end_phase().
+ *
+ * Finished frames go into a ring buffer of the last N_FRAMES frames.
+ * It can be read over D-Bus (org.gnome.Mutter.FrameTimings at
+ * /org/gnome/Mutter/FrameTimings), and if MUTTER_DEBUG_FRAME_TIMINGS
+ * is set to a filename, the contents are appended to that file as
+ * text each time the ring fills up, and when mutter exits, followed
+ * by how many pixels the texture towers redrew at each level since the
+ * previous dump.
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <meta/main.h>
+#include <meta/util.h>
+#include "meta-frame-timings.h"
+#include "meta-dbus-frame-timings.h"
+#include "meta-texture-tower.h"
+
+/* About ten seconds at 60Hz */
+#define N_FRAMES 600
+
+typedef struct
+{
+  gint64  start_time;
+  guint32 phase_time[META_N_FRAME_PHASES];
+  guint32 total_time;
+} FrameRecord;
+
+static FrameRecord frames[N_FRAMES];
+/* Number of frames recorded so far; the next one goes into
+ * frames[n_frames % N_FRAMES] */
+static guint64 n_frames;
+/* Value of n_frames when the ring was last written to dump_filename */
+static guint64 n_frames_dumped;
+
+static gboolean    in_frame;
+static FrameRecord current_frame;
+static gint64      current_phase_time[META_N_FRAME_PHASES];
+static gint64      paint_end_time;
+
+static char *dump_filename;
+static guint dbus_name_id;
+static MetaDBusFrameTimings *skeleton;
+
+static guint32
+clamp_duration (gint64 duration)
+{
+  return CLAMP (duration, 0, G_MAXUINT32);
+}
+
+static const FrameRecord *
+get_frame (guint64 frame_number)
+{
+  return &frames[frame_number % N_FRAMES];
+}
+
+static void
+dump_texture_tower_fill (FILE *file)
+{
+  guint64 pixels[16];
+  int n_levels, i;
+
+  n_levels = meta_texture_tower_get_fill_stats (pixels, G_N_ELEMENTS (pixels));
+  meta_texture_tower_reset_fill_stats ();
+
+  /* Level 0 is the base texture, which is never redrawn */
+  fprintf (file, "# texture tower pixels per level:");
+  for (i = 1; i < n_levels; i++)
+    fprintf (file, " %" G_GUINT64_FORMAT, pixels[i]);
+  fprintf (file, "\n");
+}
+
+static void
+dump_frames (void)
+{
+  FILE *file;
+  guint64 first, i;
+
+  if (n_frames == n_frames_dumped)
+    return;
+
+  file = fopen (dump_filename, "a");
+  if (file == NULL)
+    {
+      meta_warning ("Failed to open %s to dump frame timings: %s\n",
+                    dump_filename, g_strerror (errno));
+      g_clear_pointer (&dump_filename, g_free);
+      return;
+    }
+
+  if (n_frames_dumped == 0)
+    fprintf (file, "# start_time pre_paint window_group_paint shadows texture_tower swap total\n");
+
+  first = MAX (n_frames_dumped, n_frames > N_FRAMES ? n_frames - N_FRAMES : 0);
+
+  for (i = first; i < n_frames; i++)
+    {
+      const FrameRecord *frame = get_frame (i);
+
+      fprintf (file, "%" G_GINT64_FORMAT " %u %u %u %u %u %u\n",
+               frame->start_time,
+               frame->phase_time[META_FRAME_PHASE_PRE_PAINT],
+               frame->phase_time[META_FRAME_PHASE_WINDOW_GROUP_PAINT],
+               frame->phase_time[META_FRAME_PHASE_SHADOWS],
+               frame->phase_time[META_FRAME_PHASE_TEXTURE_TOWER],
+               frame->phase_time[META_FRAME_PHASE_SWAP],
+               frame->total_time);
+    }
+
+  dump_texture_tower_fill (file);
+
+  fclose (file);
+
+  n_frames_dumped = n_frames;
+}
+
+/**
+ * meta_frame_timings_begin_frame:
+ *
+ * Starts recording a new stage frame. A frame that was begun but
+ * never painted is dropped.
+ */
+void
+meta_frame_timings_begin_frame (void)
+{
+  in_frame = TRUE;
+  paint_end_time = 0;
+
+  memset (&current_frame, 0, sizeof (current_frame));
+  memset (current_phase_time, 0, sizeof (current_phase_time));
+  current_frame.start_time = g_get_monotonic_time ();
+}
+
+/**
+ * meta_frame_timings_end_paint:
+ *
+ * Notes that the stage has been painted; what follows until
+ * meta_frame_timings_end_frame() is the buffer swap.
+ */
+void
+meta_frame_timings_end_paint (void)
+{
+  if (in_frame)
+    paint_end_time = g_get_monotonic_time ();
+}
+
+/**
+ * meta_frame_timings_end_frame:
+ *
+ * Finishes the current frame and adds it to the ring buffer.
+ */
+void
+meta_frame_timings_end_frame (void)
+{
+  gint64 now;
+  int i;
+
+  if (!in_frame)
+    return;
+
+  in_frame = FALSE;
+
+  /* Nothing was drawn, the master clock only ran for timelines */
+  if (paint_end_time == 0)
+    return;
+
+  now = g_get_monotonic_time ();
+  current_phase_time[META_FRAME_PHASE_SWAP] = now - paint_end_time;
+
+  for (i = 0; i < META_N_FRAME_PHASES; i++)
+    current_frame.phase_time[i] = clamp_duration (current_phase_time[i]);
+  current_frame.total_time = clamp_duration (now - current_frame.start_time);
+
+  frames[n_frames % N_FRAMES] = current_frame;
+  n_frames++;
+
+  if (dump_filename != NULL && n_frames - n_frames_dumped >= N_FRAMES)
+    dump_frames ();
+}
+
+/**
+ * meta_frame_timings_begin_phase:
+ *
+ * Returns: the time to pass to meta_frame_timings_end_phase()
+ */
+gint64
+meta_frame_timings_begin_phase (void)
+{
+  return in_frame ? g_get_monotonic_time () : 0;
+}
+
+/**
+ * meta_frame_timings_end_phase:
+ * @phase: the part of the frame that was timed
+ * @start_time: the value returned by meta_frame_timings_begin_phase()
+ */
+void
+meta_frame_timings_end_phase (MetaFramePhase phase,
+                              gint64         start_time)
+{
+  if (!in_frame || start_time == 0)
+    return;
+
+  current_phase_time[phase] += g_get_monotonic_time () - start_time;
+}
+
+/**
+ * meta_frame_timings_set_refresh_rate:
+ * @refresh_rate: the refresh rate of the stage in Hz, or 0 if unknown
+ */
+void
+meta_frame_timings_set_refresh_rate (float refresh_rate)
+{
+  guint budget;
+
+  if (skeleton == NULL)
+    return;
+
+  budget = refresh_rate > 0 ? (guint) (G_USEC_PER_SEC / refresh_rate) : 0;
+  if (budget != meta_dbus_frame_timings_get_frame_budget (skeleton))
+    meta_dbus_frame_timings_set_frame_budget (skeleton, budget);
+}
+
+static gboolean
+handle_get_frame_timings (MetaDBusFrameTimings  *object,
+                          GDBusMethodInvocation *invocation)
+{
+  GVariantBuilder builder;
+  guint64 first, i;
+
+  first = n_frames > N_FRAMES ? n_frames - N_FRAMES : 0;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(xuuuuuu)"));
+  for (i = first; i < n_frames; i++)
+    {
+      const FrameRecord *frame = get_frame (i);
+
+      g_variant_builder_add (&builder, "(xuuuuuu)",
+                             frame->start_time,
+                             frame->phase_time[META_FRAME_PHASE_PRE_PAINT],
+                             frame->phase_time[META_FRAME_PHASE_WINDOW_GROUP_PAINT],
+                             frame->phase_time[META_FRAME_PHASE_SHADOWS],
+                             frame->phase_time[META_FRAME_PHASE_TEXTURE_TOWER],
+                             frame->phase_time[META_FRAME_PHASE_SWAP],
+                             frame->total_time);
+    }
+
+  meta_dbus_frame_timings_complete_get_frame_timings (object, invocation,
+                                                      g_variant_builder_end (&builder));
+
+  return TRUE;
+}
+
+static void
+on_bus_acquired (GDBusConnection *connection,
+                 const char      *name,
+                 gpointer         user_data)
+{
+  GError *error = NULL;
+
+  if (!g_dbus_interface_skeleton_export (G_DBUS_INTERFACE_SKELETON (skeleton),
+                                         connection,
+                                         "/org/gnome/Mutter/FrameTimings",
+                                         &error))
+    {
+      meta_warning ("Failed to export frame timings object: %s\n", error->message);
+      g_error_free (error);
+    }
+}
+
+static void
+on_name_acquired (GDBusConnection *connection,
+                  const char      *name,
+                  gpointer         user_data)
+{
+  meta_verbose ("Acquired name %s\n", name);
+}
+
+static void
+on_name_lost (GDBusConnection *connection,
+              const char      *name,
+              gpointer         user_data)
+{
+  meta_verbose ("Lost or failed to acquire name %s\n", name);
+}
+
+/**
+ * meta_frame_timings_init:
+ *
+ * Exports the frame timings over D-Bus and sets up dumping them to
+ * the file named by MUTTER_DEBUG_FRAME_TIMINGS.
+ */
+void
+meta_frame_timings_init (void)
+{
+  const char *filename;
+
+  if (dbus_name_id > 0)
+    return;
+
+  filename = g_getenv ("MUTTER_DEBUG_FRAME_TIMINGS");
+  if (filename != NULL && *filename != '\0')
+    dump_filename = g_strdup (filename);
+
+  skeleton = meta_dbus_frame_timings_skeleton_new ();
+  g_signal_connect (skeleton, "handle-get-frame-timings",
+                    G_CALLBACK (handle_get_frame_timings), NULL);
+
+  dbus_name_id = g_bus_own_name (G_BUS_TYPE_SESSION,
+                                 "org.gnome.Mutter.FrameTimings",
+                                 G_BUS_NAME_OWNER_FLAGS_ALLOW_REPLACEMENT |
+                                 (meta_get_replace_current_wm () ?
+                                  G_BUS_NAME_OWNER_FLAGS_REPLACE : 0),
+                                 on_bus_acquired,
+                                 on_name_acquired,
+                                 on_name_lost,
+                                 NULL, NULL);
+}
+
+/**
+ * meta_frame_timings_shutdown:
+ *
+ * Writes out any frames not yet dumped and stops exporting the
+ * frame timings.
+ */
+void
+meta_frame_timings_shutdown (void)
+{
+  if (dump_filename != NULL)
+    dump_frames ();
+  g_clear_pointer (&dump_filename, g_free);
+
+  if (dbus_name_id > 0)
+    {
+      g_bus_unown_name (dbus_name_id);
+      dbus_name_id = 0;
+    }
+
+  if (skeleton != NULL)
+    {
+      if (g_dbus_interface_skeleton_get_connection (G_DBUS_INTERFACE_SKELETON (skeleton)))
+        g_dbus_interface_skeleton_unexport (G_DBUS_INTERFACE_SKELETON (skeleton));
+      g_clear_object (&skeleton);
+    }
+}
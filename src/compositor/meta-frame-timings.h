@@ -0,0 +1,61 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * MetaFrameTimings: record where the time of each stage frame goes
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef __META_FRAME_TIMINGS_H__
+#define __META_FRAME_TIMINGS_H__
+
+#include <glib.h>
+
+/* The parts of a frame that are timed separately. The shadow and
+ * texture tower phases happen inside the window group paint.
+ */
+typedef enum {
+  META_FRAME_PHASE_PRE_PAINT,
+  META_FRAME_PHASE_WINDOW_GROUP_PAINT,
+  META_FRAME_PHASE_SHADOWS,
+  META_FRAME_PHASE_TEXTURE_TOWER,
+  META_FRAME_PHASE_SWAP,
+
+  META_N_FRAME_PHASES
+} MetaFramePhase;
+
+void   meta_frame_timings_init             (void);
+void   meta_frame_timings_shutdown         (void);
+
+void   meta_frame_timings_begin_frame      (void);
+void   meta_frame_timings_end_paint        (void);
+void   meta_frame_timings_end_frame        (void);
+
+void   meta_frame_timings_set_refresh_rate (float  refresh_rate);
+
+/* Time a phase with:
+ *
+ *   gint64 start = meta_frame_timings_begin_phase ();
+ *   ...
+ *   meta_frame_timings_end_phase (META_FRAME_PHASE_SHADOWS, start);
+ *
+ * Time spent in a phase more than once during a frame adds up; time
+ * spent outside a frame is ignored.
+ */
+gint64 meta_frame_timings_begin_phase      (void);
+void   meta_frame_timings_end_phase        (MetaFramePhase phase,
+                                            gint64         start_time);
+
+#endif /* __META_FRAME_TIMINGS_H__ */
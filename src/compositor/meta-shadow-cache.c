@@ -0,0 +1,629 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * MetaShadowCache: persistent on-disk cache of blurred shadow images
+ *
+ * Copyright (C) 2010 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <config.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "meta-shadow-cache.h"
+
+/* File format; all values are in host byte order, a file written
+ * on a machine with different endianness fails the magic check.
+ *
+ *  FileHeader
+ *  FileEntry[n_entries]
+ *  for each entry, at the offsets given in the FileEntry:
+ *    gint32[4 * n_rectangles]    x, y, width, height of the region
+ *    guint8[width * height]      the blurred image
+ *
+ * Bump CACHE_VERSION whenever the format or the output of the blur
+ * changes; files with any other version are ignored and overwritten.
+ */
+#define CACHE_MAGIC   G_GUINT64_CONSTANT (0x57444853544d) /* "MTSHDW" */
+#define CACHE_VERSION 1
+
+/* Delay between the first change and writing the file out */
+#define SAVE_TIMEOUT_SECONDS 10
+
+typedef struct
+{
+  guint64 magic;
+  guint32 version;
+  guint32 n_entries;
+} FileHeader;
+
+typedef struct
+{
+  guint64 hash;
+  gint64  last_used;
+  gint32  radius;
+  gint32  top_fade;
+  guint32 n_rectangles;
+  guint32 width;
+  guint32 height;
+  guint32 rectangles_offset;
+  guint32 data_offset;
+  guint32 padding;
+} FileEntry;
+
+typedef struct
+{
+  guint64 hash;
+  gint64 last_used;
+  int radius;
+  int top_fade;
+  int n_rectangles;
+  int width;
+  int height;
+
+  /* Either point into the mapped file or are owned by the entry */
+  const gint32 *rectangles;
+  const guchar *data;
+  gboolean owns_data;
+} CacheEntry;
+
+struct _MetaShadowCache
+{
+  char *filename;
+  gsize max_size;
+
+  GMappedFile *mapped_file;
+
+  /* guint64 hash => GSList of CacheEntry */
+  GHashTable *entries;
+
+  guint save_id;
+};
+
+static guint
+hash_uint64 (gconstpointer v)
+{
+  guint64 value = *(const guint64 *)v;
+
+  return (guint)(value ^ (value >> 32));
+}
+
+static gboolean
+equal_uint64 (gconstpointer a,
+              gconstpointer b)
+{
+  return *(const guint64 *)a == *(const guint64 *)b;
+}
+
+/* The hash has to be stable across runs, so unlike
+ * meta_window_shape_hash() it is computed from the actual rectangles
+ * with a fixed function (64-bit FNV-1a). */
+static guint64
+hash_int (guint64 hash,
+          gint32  value)
+{
+  guint32 v = (guint32)value;
+  int i;
+
+  for (i = 0; i < 4; i++)
+    {
+      hash ^= (v >> (8 * i)) & 0xff;
+      hash *= G_GUINT64_CONSTANT (0x100000001b3);
+    }
+
+  return hash;
+}
+
+static guint64
+compute_hash (cairo_region_t *region,
+              int             radius,
+              int             top_fade)
+{
+  guint64 hash = G_GUINT64_CONSTANT (0xcbf29ce484222325);
+  int n_rectangles, i;
+
+  hash = hash_int (hash, radius);
+  hash = hash_int (hash, top_fade);
+
+  n_rectangles = cairo_region_num_rectangles (region);
+  hash = hash_int (hash, n_rectangles);
+
+  for (i = 0; i < n_rectangles; i++)
+    {
+      cairo_rectangle_int_t rect;
+
+      cairo_region_get_rectangle (region, i, &rect);
+      hash = hash_int (hash, rect.x);
+      hash = hash_int (hash, rect.y);
+      hash = hash_int (hash, rect.width);
+      hash = hash_int (hash, rect.height);
+    }
+
+  return hash;
+}
+
+static gsize
+entry_size (CacheEntry *entry)
+{
+  return (sizeof (FileEntry) +
+          entry->n_rectangles * 4 * sizeof (gint32) +
+          (gsize)entry->width * entry->height);
+}
+
+static void
+entry_free (CacheEntry *entry)
+{
+  if (entry->owns_data)
+    {
+      g_free ((gint32 *)entry->rectangles);
+      g_free ((guchar *)entry->data);
+    }
+
+  g_slice_free (CacheEntry, entry);
+}
+
+static gboolean
+entry_matches (CacheEntry     *entry,
+               cairo_region_t *region,
+               int             radius,
+               int             top_fade)
+{
+  int i;
+
+  if (entry->radius != radius || entry->top_fade != top_fade)
+    return FALSE;
+
+  if (entry->n_rectangles != cairo_region_num_rectangles (region))
+    return FALSE;
+
+  for (i = 0; i < entry->n_rectangles; i++)
+    {
+      cairo_rectangle_int_t rect;
+      const gint32 *r = entry->rectangles + 4 * i;
+
+      cairo_region_get_rectangle (region, i, &rect);
+      if (r[0] != rect.x || r[1] != rect.y ||
+          r[2] != rect.width || r[3] != rect.height)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static void
+add_entry (MetaShadowCache *cache,
+           CacheEntry      *entry)
+{
+  GSList *chain;
+
+  chain = g_hash_table_lookup (cache->entries, &entry->hash);
+  g_hash_table_steal (cache->entries, &entry->hash);
+  chain = g_slist_prepend (chain, entry);
+  g_hash_table_insert (cache->entries, &entry->hash, chain);
+}
+
+static void
+free_chain (gpointer data)
+{
+  g_slist_free_full (data, (GDestroyNotify)entry_free);
+}
+
+static void
+load_file (MetaShadowCache *cache)
+{
+  GError *error = NULL;
+  const char *contents;
+  const FileHeader *header;
+  const FileEntry *file_entries;
+  gsize length;
+  guint i;
+
+  cache->mapped_file = g_mapped_file_new (cache->filename, FALSE, &error);
+  if (cache->mapped_file == NULL)
+    {
+      if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        g_warning ("Failed to load shadow cache %s: %s",
+                   cache->filename, error->message);
+      g_error_free (error);
+      return;
+    }
+
+  contents = g_mapped_file_get_contents (cache->mapped_file);
+  length = g_mapped_file_get_length (cache->mapped_file);
+  header = (const FileHeader *)contents;
+
+  if (length < sizeof (FileHeader) ||
+      header->magic != CACHE_MAGIC ||
+      header->version != CACHE_VERSION ||
+      header->n_entries > (length - sizeof (FileHeader)) / sizeof (FileEntry))
+    goto out;
+
+  file_entries = (const FileEntry *)(contents + sizeof (FileHeader));
+
+  for (i = 0; i < header->n_entries; i++)
+    {
+      const FileEntry *file_entry = &file_entries[i];
+      CacheEntry *entry;
+      gsize rectangles_size = (gsize)file_entry->n_rectangles * 4 * sizeof (gint32);
+      gsize data_size = (gsize)file_entry->width * file_entry->height;
+
+      /* Don't trust anything in the file */
+      if (file_entry->rectangles_offset % sizeof (gint32) != 0 ||
+          file_entry->rectangles_offset > length ||
+          rectangles_size > length - file_entry->rectangles_offset ||
+          file_entry->data_offset > length ||
+          data_size > length - file_entry->data_offset)
+        goto out;
+
+      entry = g_slice_new0 (CacheEntry);
+      entry->hash = file_entry->hash;
+      entry->last_used = file_entry->last_used;
+      entry->radius = file_entry->radius;
+      entry->top_fade = file_entry->top_fade;
+      entry->n_rectangles = file_entry->n_rectangles;
+      entry->width = file_entry->width;
+      entry->height = file_entry->height;
+      entry->rectangles = (const gint32 *)(contents + file_entry->rectangles_offset);
+      entry->data = (const guchar *)(contents + file_entry->data_offset);
+      entry->owns_data = FALSE;
+
+      add_entry (cache, entry);
+    }
+
+  return;
+
+ out:
+  g_warning ("Ignoring invalid or outdated shadow cache %s", cache->filename);
+  g_hash_table_remove_all (cache->entries);
+  g_mapped_file_unref (cache->mapped_file);
+  cache->mapped_file = NULL;
+}
+
+/**
+ * meta_shadow_cache_new:
+ * @filename: the file to store the cache in
+ * @max_size: the maximum size of the file, in bytes
+ *
+ * Creates a new shadow cache, loading any entries already stored in
+ * @filename.
+ *
+ * Return value: the new cache; free with meta_shadow_cache_free()
+ */
+MetaShadowCache *
+meta_shadow_cache_new (const char *filename,
+                       gsize       max_size)
+{
+  MetaShadowCache *cache;
+
+  cache = g_slice_new0 (MetaShadowCache);
+  cache->filename = g_strdup (filename);
+  cache->max_size = max_size;
+  cache->entries = g_hash_table_new_full (hash_uint64, equal_uint64,
+                                          NULL, free_chain);
+
+  load_file (cache);
+
+  return cache;
+}
+
+/**
+ * meta_shadow_cache_free:
+ * @cache: a #MetaShadowCache
+ *
+ * Writes out any pending changes and frees the cache.
+ */
+void
+meta_shadow_cache_free (MetaShadowCache *cache)
+{
+  meta_shadow_cache_flush (cache);
+
+  g_hash_table_destroy (cache->entries);
+  if (cache->mapped_file)
+    g_mapped_file_unref (cache->mapped_file);
+
+  g_free (cache->filename);
+  g_slice_free (MetaShadowCache, cache);
+}
+
+/**
+ * meta_shadow_cache_flush:
+ * @cache: a #MetaShadowCache
+ *
+ * Writes the cache to disk now if a save is waiting for its timeout,
+ * so that the entries added since the last save aren't lost when
+ * mutter exits before it fires.
+ */
+void
+meta_shadow_cache_flush (MetaShadowCache *cache)
+{
+  if (cache->save_id != 0)
+    meta_shadow_cache_save (cache);
+}
+
+static gboolean
+save_timeout (gpointer data)
+{
+  MetaShadowCache *cache = data;
+
+  cache->save_id = 0;
+  meta_shadow_cache_save (cache);
+
+  return FALSE;
+}
+
+static void
+queue_save (MetaShadowCache *cache)
+{
+  if (cache->save_id == 0)
+    cache->save_id = g_timeout_add_seconds (SAVE_TIMEOUT_SECONDS,
+                                            save_timeout, cache);
+}
+
+/**
+ * meta_shadow_cache_lookup:
+ * @cache: a #MetaShadowCache
+ * @region: the region that was blurred
+ * @radius: the blur radius
+ * @top_fade: the top fade distance, or -1
+ * @width: (out): location to store the width of the image
+ * @height: (out): location to store the height of the image
+ * @data: (out): location to store the image data; it has a rowstride
+ *   of @width and is only valid until control returns to the main loop
+ *
+ * Looks up a previously stored shadow image.
+ *
+ * Return value: %TRUE if an image was found
+ */
+gboolean
+meta_shadow_cache_lookup (MetaShadowCache *cache,
+                          cairo_region_t  *region,
+                          int              radius,
+                          int              top_fade,
+                          int             *width,
+                          int             *height,
+                          const guchar   **data)
+{
+  guint64 hash = compute_hash (region, radius, top_fade);
+  GSList *l;
+
+  for (l = g_hash_table_lookup (cache->entries, &hash); l; l = l->next)
+    {
+      CacheEntry *entry = l->data;
+
+      if (entry_matches (entry, region, radius, top_fade))
+        {
+          /* Only kept in memory; it goes to disk with the next
+           * entry that is added, when it matters for choosing what
+           * to evict. Rewriting the file for every hit would cost
+           * more than the cache saves.
+           */
+          entry->last_used = g_get_real_time () / G_USEC_PER_SEC;
+
+          *width = entry->width;
+          *height = entry->height;
+          *data = entry->data;
+
+          return TRUE;
+        }
+    }
+
+  return FALSE;
+}
+
+/**
+ * meta_shadow_cache_insert:
+ * @cache: a #MetaShadowCache
+ * @region: the region that was blurred
+ * @radius: the blur radius
+ * @top_fade: the top fade distance, or -1
+ * @width: width of the image
+ * @height: height of the image
+ * @rowstride: rowstride of @data
+ * @data: the blurred image
+ *
+ * Adds a shadow image to the cache; the data is copied and will
+ * be written to disk shortly.
+ */
+void
+meta_shadow_cache_insert (MetaShadowCache *cache,
+                          cairo_region_t  *region,
+                          int              radius,
+                          int              top_fade,
+                          int              width,
+                          int              height,
+                          int              rowstride,
+                          const guchar    *data)
+{
+  CacheEntry *entry;
+  gint32 *rectangles;
+  guchar *pixels;
+  int i;
+
+  entry = g_slice_new0 (CacheEntry);
+  entry->hash = compute_hash (region, radius, top_fade);
+  entry->last_used = g_get_real_time () / G_USEC_PER_SEC;
+  entry->radius = radius;
+  entry->top_fade = top_fade;
+  entry->n_rectangles = cairo_region_num_rectangles (region);
+  entry->width = width;
+  entry->height = height;
+  entry->owns_data = TRUE;
+
+  /* A single entry that doesn't fit isn't worth keeping */
+  if (sizeof (FileHeader) + entry_size (entry) > cache->max_size)
+    {
+      g_slice_free (CacheEntry, entry);
+      return;
+    }
+
+  rectangles = g_new (gint32, 4 * entry->n_rectangles);
+  for (i = 0; i < entry->n_rectangles; i++)
+    {
+      cairo_rectangle_int_t rect;
+
+      cairo_region_get_rectangle (region, i, &rect);
+      rectangles[4 * i + 0] = rect.x;
+      rectangles[4 * i + 1] = rect.y;
+      rectangles[4 * i + 2] = rect.width;
+      rectangles[4 * i + 3] = rect.height;
+    }
+  entry->rectangles = rectangles;
+
+  pixels = g_malloc ((gsize)width * height);
+  for (i = 0; i < height; i++)
+    memcpy (pixels + i * width, data + i * rowstride, width);
+  entry->data = pixels;
+
+  add_entry (cache, entry);
+  queue_save (cache);
+}
+
+static int
+compare_entries_by_use (gconstpointer a,
+                        gconstpointer b)
+{
+  const CacheEntry *entry_a = *(const CacheEntry **)a;
+  const CacheEntry *entry_b = *(const CacheEntry **)b;
+
+  /* Most recently used first */
+  if (entry_a->last_used > entry_b->last_used)
+    return -1;
+  else if (entry_a->last_used < entry_b->last_used)
+    return 1;
+  else
+    return 0;
+}
+
+/**
+ * meta_shadow_cache_save:
+ * @cache: a #MetaShadowCache
+ *
+ * Writes the cache to disk now, evicting the least recently used
+ * entries if it's over its size limit, and maps the new file.
+ */
+void
+meta_shadow_cache_save (MetaShadowCache *cache)
+{
+  GError *error = NULL;
+  GPtrArray *sorted;
+  GHashTableIter iter;
+  gpointer value;
+  FileHeader *header;
+  FileEntry *file_entries;
+  char *contents;
+  char *dirname;
+  gsize size, offset;
+  guint n_kept, i;
+
+  if (cache->save_id != 0)
+    {
+      g_source_remove (cache->save_id);
+      cache->save_id = 0;
+    }
+
+  sorted = g_ptr_array_new ();
+  g_hash_table_iter_init (&iter, cache->entries);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      GSList *l;
+
+      for (l = value; l; l = l->next)
+        g_ptr_array_add (sorted, l->data);
+    }
+
+  g_ptr_array_sort (sorted, compare_entries_by_use);
+
+  size = sizeof (FileHeader);
+  for (n_kept = 0; n_kept < sorted->len; n_kept++)
+    {
+      gsize this_size = entry_size (g_ptr_array_index (sorted, n_kept));
+
+      if (size + this_size > cache->max_size)
+        break;
+
+      size += this_size;
+    }
+
+  contents = g_malloc0 (size);
+  header = (FileHeader *)contents;
+  header->magic = CACHE_MAGIC;
+  header->version = CACHE_VERSION;
+  header->n_entries = n_kept;
+
+  file_entries = (FileEntry *)(contents + sizeof (FileHeader));
+  offset = sizeof (FileHeader) + n_kept * sizeof (FileEntry);
+
+  /* Put all the rectangles first so they stay aligned */
+  for (i = 0; i < n_kept; i++)
+    {
+      CacheEntry *entry = g_ptr_array_index (sorted, i);
+      gsize rectangles_size = entry->n_rectangles * 4 * sizeof (gint32);
+
+      file_entries[i].hash = entry->hash;
+      file_entries[i].last_used = entry->last_used;
+      file_entries[i].radius = entry->radius;
+      file_entries[i].top_fade = entry->top_fade;
+      file_entries[i].n_rectangles = entry->n_rectangles;
+      file_entries[i].width = entry->width;
+      file_entries[i].height = entry->height;
+
+      file_entries[i].rectangles_offset = offset;
+      memcpy (contents + offset, entry->rectangles, rectangles_size);
+      offset += rectangles_size;
+    }
+
+  for (i = 0; i < n_kept; i++)
+    {
+      CacheEntry *entry = g_ptr_array_index (sorted, i);
+      gsize data_size = (gsize)entry->width * entry->height;
+
+      file_entries[i].data_offset = offset;
+      memcpy (contents + offset, entry->data, data_size);
+      offset += data_size;
+    }
+
+  g_assert (offset == size);
+
+  g_ptr_array_free (sorted, TRUE);
+
+  dirname = g_path_get_dirname (cache->filename);
+  g_mkdir_with_parents (dirname, 0700);
+  g_free (dirname);
+
+  /* g_file_set_contents() replaces the file atomically, so the old
+   * mapping stays valid until we drop it below */
+  if (!g_file_set_contents (cache->filename, contents, size, &error))
+    {
+      g_warning ("Failed to save shadow cache %s: %s",
+                 cache->filename, error->message);
+      g_error_free (error);
+      g_free (contents);
+      return;
+    }
+
+  g_free (contents);
+
+  /* Switch over to the new file; this also drops the in-memory copies
+   * of new entries and anything that was evicted */
+  g_hash_table_remove_all (cache->entries);
+  if (cache->mapped_file)
+    g_mapped_file_unref (cache->mapped_file);
+  cache->mapped_file = NULL;
+
+  load_file (cache);
+}
@@ -0,0 +1,64 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * MetaShadowCache: persistent on-disk cache of blurred shadow images
+ *
+ * Copyright (C) 2010 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef __META_SHADOW_CACHE_H__
+#define __META_SHADOW_CACHE_H__
+
+#include <cairo.h>
+#include <glib.h>
+
+/**
+ * MetaShadowCache:
+ *
+ * A #MetaShadowCache keeps the A8 images produced by blurring window
+ * shapes in a file, so that shadows don't have to be regenerated
+ * every time mutter starts. The file is memory-mapped when the cache
+ * is created; new entries are kept in memory and written out (along
+ * with updated use times) a few seconds after they are added. When
+ * the file would exceed its size limit, the least recently used
+ * entries are dropped.
+ */
+typedef struct _MetaShadowCache MetaShadowCache;
+
+MetaShadowCache *meta_shadow_cache_new    (const char      *filename,
+                                           gsize            max_size);
+void             meta_shadow_cache_free   (MetaShadowCache *cache);
+
+gboolean         meta_shadow_cache_lookup (MetaShadowCache *cache,
+                                           cairo_region_t  *region,
+                                           int              radius,
+                                           int              top_fade,
+                                           int             *width,
+                                           int             *height,
+                                           const guchar   **data);
+void             meta_shadow_cache_insert (MetaShadowCache *cache,
+                                           cairo_region_t  *region,
+                                           int              radius,
+                                           int              top_fade,
+                                           int              width,
+                                           int              height,
+                                           int              rowstride,
+                                           const guchar    *data);
+void             meta_shadow_cache_save   (MetaShadowCache *cache);
+void             meta_shadow_cache_flush  (MetaShadowCache *cache);
+
+#endif /* __META_SHADOW_CACHE_H__ */
@@ -65,4 +65,9 @@ MetaShadow *meta_shadow_factory_get_shadow (MetaShadowFactory *factory,
                                             const char        *class_name,
                                             gboolean           focused);
 
+void meta_shadow_factory_load_disk_cache (MetaShadowFactory *factory,
+                                          const char        *filename,
+                                          gsize              max_size);
+void meta_shadow_factory_flush_disk_cache (MetaShadowFactory *factory);
+
 #endif /* __META_SHADOW_FACTORY_PRIVATE_H__ */
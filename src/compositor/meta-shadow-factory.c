@@ -29,6 +29,9 @@
 #include <string.h>
 
 #include "cogl-utils.h"
+#include "meta-box-blur.h"
+#include "meta-frame-timings.h"
+#include "meta-shadow-cache.h"
 #include "meta-shadow-factory-private.h"
 #include "region-utils.h"
 
@@ -46,10 +49,12 @@
  *   2D blur as 1D blur of the rows followed by a 1D blur of the
  *   columns.
  *
- * - For better cache efficiency, we blur rows, transpose the image
- *   in blocks, blur rows again, and then transpose back.
- *
  * - We approximate the 1D gaussian blur as 3 successive box filters.
+ *
+ * - The box filters themselves live in meta-box-blur.c; columns are
+ *   blurred in place, several at a time with SSE2/AVX2 when the CPU
+ *   supports it, and the per-pixel divide is replaced by an exact
+ *   reciprocal multiply.
  */
 
 typedef struct _MetaShadowCacheKey  MetaShadowCacheKey;
@@ -104,6 +109,9 @@ struct _MetaShadowFactory
 
   /* class name => MetaShadowClassInfo */
   GHashTable *shadow_classes;
+
+  /* Persistent copies of the blurred images, or NULL */
+  MetaShadowCache *disk_cache;
 };
 
 struct _MetaShadowFactoryClass
@@ -430,6 +438,9 @@ meta_shadow_factory_finalize (GObject *object)
   g_hash_table_destroy (factory->shadows);
   g_hash_table_destroy (factory->shadow_classes);
 
+  if (factory->disk_cache)
+    meta_shadow_cache_free (factory->disk_cache);
+
   G_OBJECT_CLASS (meta_shadow_factory_parent_class)->finalize (object);
 }
 
@@ -471,147 +482,6 @@ meta_shadow_factory_get_default (void)
   return factory;
 }
 
-/* We emulate a 1D Gaussian blur by using 3 consecutive box blurs;
- * this produces a result that's within 3% of the original and can be
- * implemented much faster for large filter sizes because of the
- * efficiency of implementation of a box blur. Idea and formula
- * for choosing the box blur size come from:
- *
- * http://www.w3.org/TR/SVG/filters.html#feGaussianBlurElement
- *
- * The 2D blur is then done by blurring the rows, flipping the
- * image and blurring the columns. (This is possible because the
- * Gaussian kernel is separable - it's the product of a horizontal
- * blur and a vertical blur.)
- */
-static int
-get_box_filter_size (int radius)
-{
-  return (int)(0.5 + radius * (0.75 * sqrt(2*M_PI)));
-}
-
-/* The "spread" of the filter is the number of pixels from an original
- * pixel that it's blurred image extends. (A no-op blur that doesn't
- * blur would have a spread of 0.) See comment in blur_rows() for why the
- * odd and even cases are different
- */
-static int
-get_shadow_spread (int radius)
-{
-  int d = get_box_filter_size (radius);
-
-  if (d % 2 == 1)
-    return 3 * (d / 2);
-  else
-    return 3 * (d / 2) - 1;
-}
-
-/* This applies a single box blur pass to a horizontal range of pixels;
- * since the box blur has the same weight for all pixels, we can
- * implement an efficient sliding window algorithm where we add
- * in pixels coming into the window from the right and remove
- * them when they leave the windw to the left.
- *
- * d is the filter width; for even d shift indicates how the blurred
- * result is aligned with the original - does ' x ' go to ' yy' (shift=1)
- * or 'yy ' (shift=-1)
- */
-static void
-blur_xspan (guchar *row,
-            guchar *tmp_buffer,
-            int     row_width,
-            int     x0,
-            int     x1,
-            int     d,
-            int     shift)
-{
-  int offset;
-  int sum = 0;
-  int i;
-
-  if (d % 2 == 1)
-    offset = d / 2;
-  else
-    offset = (d - shift) / 2;
-
-  /* All the conditionals in here look slow, but the branches will
-   * be well predicted and there are enough different possibilities
-   * that trying to write this as a series of unconditional loops
-   * is hard and not an obvious win. The main slow down here seems
-   * to be the integer division for pixel; one possible optimization
-   * would be to accumulate into two 16-bit integer buffers and
-   * only divide down after all three passes. (SSE parallel implementation
-   * of the divide step is possible.)
-   */
-  for (i = x0 - d + offset; i < x1 + offset; i++)
-    {
-      if (i >= 0 && i < row_width)
-	sum += row[i];
-
-      if (i >= x0 + offset)
-	{
-	  if (i >= d)
-	    sum -= row[i - d];
-
-	  tmp_buffer[i - offset] = (sum + d / 2) / d;
-	}
-    }
-
-  memcpy(row + x0, tmp_buffer + x0, x1 - x0);
-}
-
-static void
-blur_rows (cairo_region_t   *convolve_region,
-           int               x_offset,
-           int               y_offset,
-	   guchar           *buffer,
-	   int               buffer_width,
-	   int               buffer_height,
-           int               d)
-{
-  int i, j;
-  int n_rectangles;
-  guchar *tmp_buffer;
-
-  tmp_buffer = g_malloc (buffer_width);
-
-  n_rectangles = cairo_region_num_rectangles (convolve_region);
-  for (i = 0; i < n_rectangles; i++)
-    {
-      cairo_rectangle_int_t rect;
-
-      cairo_region_get_rectangle (convolve_region, i, &rect);
-
-      for (j = y_offset + rect.y; j < y_offset + rect.y + rect.height; j++)
-	{
-	  guchar *row = buffer + j * buffer_width;
-	  int x0 = x_offset + rect.x;
-	  int x1 = x0 + rect.width;
-
-          /* We want to produce a symmetric blur that spreads a pixel
-           * equally far to the left and right. If d is odd that happens
-           * naturally, but for d even, we approximate by using a blur
-           * on either side and then a centered blur of size d + 1.
-           * (techique also from the SVG specification)
-           */
-	  if (d % 2 == 1)
-	    {
-	      blur_xspan (row, tmp_buffer, buffer_width, x0, x1, d, 0);
-	      blur_xspan (row, tmp_buffer, buffer_width, x0, x1, d, 0);
-	      blur_xspan (row, tmp_buffer, buffer_width, x0, x1, d, 0);
-	    }
-	  else
-	    {
-	      blur_xspan (row, tmp_buffer, buffer_width, x0, x1, d, 1);
-	      blur_xspan (row, tmp_buffer, buffer_width, x0, x1, d, -1);
-	      blur_xspan (row, tmp_buffer, buffer_width, x0, x1, d + 1, 0);
-	    }
-	}
-    }
-
-  g_free (tmp_buffer);
-}
-
 static void
 fade_bytes (guchar *bytes,
             int     width,
@@ -625,96 +495,53 @@ fade_bytes (guchar *bytes,
     bytes[i] = (bytes[i] * multiplier) >> 16;
 }
 
-/* Swaps width and height. Either swaps in-place and returns the original
- * buffer or allocates a new buffer, frees the original buffer and returns
- * the new buffer.
- */
-static guchar *
-flip_buffer (guchar *buffer,
-	     int     width,
-             int     height)
-{
-  /* Working in blocks increases cache efficiency, compared to reading
-   * or writing an entire column at once */
-#define BLOCK_SIZE 16
-
-  if (width == height)
-    {
-      int i0, j0;
-
-      for (j0 = 0; j0 < height; j0 += BLOCK_SIZE)
-	for (i0 = 0; i0 <= j0; i0 += BLOCK_SIZE)
-	  {
-	    int max_j = MIN(j0 + BLOCK_SIZE, height);
-	    int max_i = MIN(i0 + BLOCK_SIZE, width);
-	    int i, j;
-
-	    if (i0 == j0)
-	      {
-		for (j = j0; j < max_j; j++)
-		  for (i = i0; i < j; i++)
-		    {
-		      guchar tmp = buffer[j * width + i];
-		      buffer[j * width + i] = buffer[i * width + j];
-		      buffer[i * width + j] = tmp;
-		    }
-	      }
-	    else
-	      {
-		for (j = j0; j < max_j; j++)
-		  for (i = i0; i < max_i; i++)
-		    {
-		      guchar tmp = buffer[j * width + i];
-		      buffer[j * width + i] = buffer[i * width + j];
-		      buffer[i * width + j] = tmp;
-		    }
-	      }
-	  }
-
-      return buffer;
-    }
-  else
-    {
-      guchar *new_buffer = g_malloc (height * width);
-      int i0, j0;
-
-      for (i0 = 0; i0 < width; i0 += BLOCK_SIZE)
-        for (j0 = 0; j0 < height; j0 += BLOCK_SIZE)
-	  {
-	    int max_j = MIN(j0 + BLOCK_SIZE, height);
-	    int max_i = MIN(i0 + BLOCK_SIZE, width);
-	    int i, j;
-
-            for (i = i0; i < max_i; i++)
-              for (j = j0; j < max_j; j++)
-		new_buffer[i * height + j] = buffer[j * width + i];
-	  }
-
-      g_free (buffer);
-
-      return new_buffer;
-    }
-#undef BLOCK_SIZE
-}
-
 static void
-make_shadow (MetaShadow     *shadow,
-             cairo_region_t *region)
+make_shadow (MetaShadow      *shadow,
+             cairo_region_t  *region,
+             MetaShadowCache *disk_cache)
 {
-  int d = get_box_filter_size (shadow->key.radius);
-  int spread = get_shadow_spread (shadow->key.radius);
+  int d = meta_box_blur_get_filter_size (shadow->key.radius);
+  int spread = meta_box_blur_get_spread (shadow->key.radius);
   cairo_rectangle_int_t extents;
   cairo_region_t *row_convolve_region;
   cairo_region_t *column_convolve_region;
   guchar *buffer;
+  guchar *texture_data;
   int buffer_width;
   int buffer_height;
   int x_offset;
   int y_offset;
+  int texture_width;
+  int texture_height;
   int n_rectangles, j, k;
 
   cairo_region_get_extents (region, &extents);
 
+  texture_width = shadow->outer_border_left + extents.width + shadow->outer_border_right;
+  texture_height = shadow->outer_border_top + extents.height + shadow->outer_border_bottom;
+
+  if (disk_cache)
+    {
+      const guchar *cached_data;
+      int cached_width, cached_height;
+
+      if (meta_shadow_cache_lookup (disk_cache, region,
+                                    shadow->key.radius, shadow->key.top_fade,
+                                    &cached_width, &cached_height, &cached_data) &&
+          cached_width == texture_width && cached_height == texture_height)
+        {
+          shadow->texture = cogl_texture_new_from_data (texture_width,
+                                                        texture_height,
+                                                        COGL_TEXTURE_NONE,
+                                                        COGL_PIXEL_FORMAT_A_8,
+                                                        COGL_PIXEL_FORMAT_ANY,
+                                                        texture_width,
+                                                        cached_data);
+          shadow->pipeline = meta_create_texture_pipeline (shadow->texture);
+          return;
+        }
+    }
+
   /* In the case where top_fade >= 0 and the portion above the top
    * edge of the shape will be cropped, it seems like we could create
    * a smaller buffer and omit the top portion, but actually, in our
@@ -763,23 +590,12 @@ make_shadow (MetaShadow     *shadow,
 	memset (buffer + buffer_width * j + x_offset + rect.x, 255, rect.width);
     }
 
-  /* Step 2: swap rows and columns */
-  buffer = flip_buffer (buffer, buffer_width, buffer_height);
-
-  /* Step 3: blur rows (really columns) */
-  blur_rows (column_convolve_region, y_offset, x_offset,
-             buffer, buffer_height, buffer_width,
-             d);
-
-  /* Step 4: swap rows and columns */
-  buffer = flip_buffer (buffer, buffer_height, buffer_width);
-
-  /* Step 5: blur rows */
-  blur_rows (row_convolve_region, x_offset, y_offset,
-             buffer, buffer_width, buffer_height,
-             d);
+  /* Step 2: blur columns and then rows */
+  buffer = meta_box_blur_region (buffer, buffer_width, buffer_height,
+                                 row_convolve_region, column_convolve_region,
+                                 x_offset, y_offset, d);
 
-  /* Step 6: fade out the top, if applicable */
+  /* Step 3: fade out the top, if applicable */
   if (shadow->key.top_fade >= 0)
     {
       for (j = y_offset; j < y_offset + MIN (shadow->key.top_fade, extents.height + shadow->outer_border_bottom); j++)
@@ -790,15 +606,23 @@ make_shadow (MetaShadow     *shadow,
    * in the case of top_fade >= 0. We also account for padding at the left for symmetry
    * though that doesn't currently occur.
    */
-  shadow->texture = cogl_texture_new_from_data (shadow->outer_border_left + extents.width + shadow->outer_border_right,
-                                                shadow->outer_border_top + extents.height + shadow->outer_border_bottom,
+  texture_data = (buffer +
+                  (y_offset - shadow->outer_border_top) * buffer_width +
+                  (x_offset - shadow->outer_border_left));
+
+  shadow->texture = cogl_texture_new_from_data (texture_width,
+                                                texture_height,
                                                 COGL_TEXTURE_NONE,
                                                 COGL_PIXEL_FORMAT_A_8,
                                                 COGL_PIXEL_FORMAT_ANY,
                                                 buffer_width,
-                                                (buffer +
-                                                 (y_offset - shadow->outer_border_top) * buffer_width +
-                                                 (x_offset - shadow->outer_border_left)));
+                                                texture_data);
+
+  if (disk_cache)
+    meta_shadow_cache_insert (disk_cache, region,
+                              shadow->key.radius, shadow->key.top_fade,
+                              texture_width, texture_height,
+                              buffer_width, texture_data);
 
   cairo_region_destroy (row_convolve_region);
   cairo_region_destroy (column_convolve_region);
@@ -875,6 +699,7 @@ meta_shadow_factory_get_shadow (MetaShadowFactory *factory,
   gboolean scale_width, scale_height;
   gboolean cacheable;
   int center_width, center_height;
+  gint64 start_time;
 
   g_return_val_if_fail (META_IS_SHADOW_FACTORY (factory), NULL);
   g_return_val_if_fail (shape != NULL, NULL);
@@ -905,7 +730,7 @@ meta_shadow_factory_get_shadow (MetaShadowFactory *factory,
 
   params = get_shadow_params (factory, class_name, focused, FALSE);
 
-  spread = get_shadow_spread (params->radius);
+  spread = meta_box_blur_get_spread (params->radius);
   meta_window_shape_get_borders (shape,
                                  &shape_border_top,
                                  &shape_border_right,
@@ -968,7 +793,11 @@ meta_shadow_factory_get_shadow (MetaShadowFactory *factory,
   g_assert (center_width >= 0 && center_height >= 0);
 
   region = meta_window_shape_to_region (shape, center_width, center_height);
-  make_shadow (shadow, region);
+  /* Only the size-independent shadows are worth keeping across
+   * restarts; the others are specific to one window size */
+  start_time = meta_frame_timings_begin_phase ();
+  make_shadow (shadow, region, cacheable ? factory->disk_cache : NULL);
+  meta_frame_timings_end_phase (META_FRAME_PHASE_SHADOWS, start_time);
 
   cairo_region_destroy (region);
 
@@ -978,6 +807,46 @@ meta_shadow_factory_get_shadow (MetaShadowFactory *factory,
   return shadow;
 }
 
+/**
+ * meta_shadow_factory_load_disk_cache:
+ * @factory: a #MetaShadowFactory
+ * @filename: the file to keep the cache in
+ * @max_size: the maximum size of the cache file, in bytes
+ *
+ * Makes @factory keep the shadow images it generates in @filename
+ * and reuse the ones stored there by previous runs, so that
+ * shadows don't all have to be regenerated when mutter restarts.
+ */
+void
+meta_shadow_factory_load_disk_cache (MetaShadowFactory *factory,
+                                     const char        *filename,
+                                     gsize              max_size)
+{
+  g_return_if_fail (META_IS_SHADOW_FACTORY (factory));
+
+  if (factory->disk_cache)
+    meta_shadow_cache_free (factory->disk_cache);
+
+  factory->disk_cache = meta_shadow_cache_new (filename, max_size);
+}
+
+/**
+ * meta_shadow_factory_flush_disk_cache:
+ * @factory: a #MetaShadowFactory
+ *
+ * Writes out any changes to the disk cache that are waiting to be
+ * saved. The default factory is never freed, so this is called when
+ * the compositor shuts down.
+ */
+void
+meta_shadow_factory_flush_disk_cache (MetaShadowFactory *factory)
+{
+  g_return_if_fail (META_IS_SHADOW_FACTORY (factory));
+
+  if (factory->disk_cache)
+    meta_shadow_cache_flush (factory->disk_cache);
+}
+
 /**
  * meta_shadow_factory_set_params:
  * @factory: a #MetaShadowFactory
@@ -0,0 +1,19 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+#ifndef META_SHAPED_TEXTURE_PRIVATE_H
+#define META_SHAPED_TEXTURE_PRIVATE_H
+
+#include <meta/meta-shaped-texture.h>
+
+void meta_shaped_texture_set_mask_tiles (MetaShapedTexture           *stex,
+                                         cairo_region_t              *shape_region,
+                                         const cairo_rectangle_int_t *tile_rects,
+                                         CoglTexture                **tile_textures,
+                                         int                          n_tiles);
+
+void meta_shaped_texture_finish_frame_stats (MetaShapedTexture *stex);
+void meta_shaped_texture_get_paint_stats    (MetaShapedTexture *stex,
+                                             guint             *n_rects,
+                                             guint             *n_batches);
+
+#endif /* META_SHAPED_TEXTURE_PRIVATE_H */
@@ -30,12 +30,14 @@
 #include <config.h>
 
 #include <meta/meta-shaped-texture.h>
+#include "meta-shaped-texture-private.h"
 #include "meta-texture-tower.h"
 
 #include <clutter/clutter.h>
 #include <cogl/cogl.h>
 #include <cogl/cogl-texture-pixmap-x11.h>
 #include <gdk/gdk.h> /* for gdk_rectangle_intersect() */
+#include <string.h>
 
 static void meta_shaped_texture_dispose  (GObject    *object);
 
@@ -62,6 +64,12 @@ G_DEFINE_TYPE (MetaShapedTexture, meta_shaped_texture,
   (G_TYPE_INSTANCE_GET_PRIVATE ((obj), META_TYPE_SHAPED_TEXTURE, \
                                 MetaShapedTexturePrivate))
 
+typedef struct
+{
+  cairo_rectangle_int_t rect;
+  CoglTexture *texture;
+} MaskTile;
+
 struct _MetaShapedTexturePrivate
 {
   MetaTextureTower *paint_tower;
@@ -69,11 +77,28 @@ struct _MetaShapedTexturePrivate
   CoglTexturePixmapX11 *texture;
   CoglTexture *mask_texture;
 
+  /* Instead of a mask texture covering the whole window, the shape
+   * can be given as a region, with small mask textures only for the
+   * tiles where its edges are soft; see meta_shaped_texture_set_mask_tiles().
+   * mask_shape is the union of shape_region and the tiles, and
+   * mask_tiles_region the union of the tiles.
+   */
+  cairo_region_t *mask_shape;
+  cairo_region_t *mask_tiles_region;
+  MaskTile *mask_tiles;
+  int n_mask_tiles;
+
   cairo_region_t *clip_region;
   cairo_region_t *opaque_region;
 
   guint tex_width, tex_height;
 
+  /* Rectangles submitted while painting the current frame, and the
+   * number of batches they went in, each a run of rectangles with one
+   * pipeline; plus the totals for the last finished frame */
+  guint frame_rects, frame_batches;
+  guint last_frame_rects, last_frame_batches;
+
   guint create_mipmaps : 1;
 };
 
@@ -165,13 +190,39 @@ get_unblended_pipeline (CoglContext *ctx)
   return cogl_pipeline_copy (template);
 }
 
+/* Rectangles to draw with one pipeline. Each one is stored as its
+ * position followed by the texture coordinates for the paint texture
+ * and for the mask layer, which differ from the first when the mask
+ * is a tile covering only part of the actor.
+ */
+#define RECT_BATCH_STRIDE 12
+
+typedef struct
+{
+  GArray *coords;
+  int     n_rects;
+} RectBatch;
+
+static void
+rect_batch_init (RectBatch *batch)
+{
+  batch->coords = g_array_new (FALSE, FALSE, sizeof (float));
+  batch->n_rects = 0;
+}
+
+static void
+rect_batch_free (RectBatch *batch)
+{
+  g_array_free (batch->coords, TRUE);
+}
+
 static void
-paint_clipped_rectangle (CoglFramebuffer       *fb,
-                         CoglPipeline          *pipeline,
-                         cairo_rectangle_int_t *rect,
-                         ClutterActorBox       *alloc)
+rect_batch_add (RectBatch             *batch,
+                cairo_rectangle_int_t *rect,
+                ClutterActorBox       *alloc,
+                cairo_rectangle_int_t *mask_rect)
 {
-  float coords[8];
+  float c[RECT_BATCH_STRIDE];
   float x1, y1, x2, y2;
 
   x1 = rect->x;
@@ -179,20 +230,168 @@ paint_clipped_rectangle (CoglFramebuffer       *fb,
   x2 = rect->x + rect->width;
   y2 = rect->y + rect->height;
 
-  coords[0] = rect->x / (alloc->x2 - alloc->x1);
-  coords[1] = rect->y / (alloc->y2 - alloc->y1);
-  coords[2] = (rect->x + rect->width) / (alloc->x2 - alloc->x1);
-  coords[3] = (rect->y + rect->height) / (alloc->y2 - alloc->y1);
+  c[0] = x1;
+  c[1] = y1;
+  c[2] = x2;
+  c[3] = y2;
 
-  coords[4] = coords[0];
-  coords[5] = coords[1];
-  coords[6] = coords[2];
-  coords[7] = coords[3];
+  c[4] = x1 / (alloc->x2 - alloc->x1);
+  c[5] = y1 / (alloc->y2 - alloc->y1);
+  c[6] = x2 / (alloc->x2 - alloc->x1);
+  c[7] = y2 / (alloc->y2 - alloc->y1);
 
-  cogl_framebuffer_draw_multitextured_rectangle (fb, pipeline,
-                                                 x1, y1, x2, y2,
-                                                 &coords[0], 8);
+  if (mask_rect != NULL)
+    {
+      c[8] = (x1 - mask_rect->x) / mask_rect->width;
+      c[9] = (y1 - mask_rect->y) / mask_rect->height;
+      c[10] = (x2 - mask_rect->x) / mask_rect->width;
+      c[11] = (y2 - mask_rect->y) / mask_rect->height;
+    }
+  else
+    {
+      memcpy (&c[8], &c[4], 4 * sizeof (float));
+    }
 
+  g_array_append_vals (batch->coords, c, RECT_BATCH_STRIDE);
+  batch->n_rects++;
+}
+
+static void
+rect_batch_add_region (RectBatch             *batch,
+                       cairo_region_t        *region,
+                       ClutterActorBox       *alloc,
+                       cairo_rectangle_int_t *mask_rect)
+{
+  int n_rects, i;
+
+  n_rects = cairo_region_num_rectangles (region);
+  for (i = 0; i < n_rects; i++)
+    {
+      cairo_rectangle_int_t rect;
+
+      cairo_region_get_rectangle (region, i, &rect);
+      rect_batch_add (batch, &rect, alloc, mask_rect);
+    }
+}
+
+/* Draws and empties @batch. @n_layers is the number of layers of
+ * @pipeline that need texture coordinates. Cogl maps the coordinates
+ * for each layer's texture (y-inverted, rectangle or sliced) and
+ * logs each rectangle in its journal; with only one pipeline, the
+ * journal can flush them all together. */
+static void
+rect_batch_draw (RectBatch         *batch,
+                 MetaShapedTexture *stex,
+                 CoglFramebuffer   *fb,
+                 CoglPipeline      *pipeline,
+                 int                n_layers)
+{
+  MetaShapedTexturePrivate *priv = stex->priv;
+  float *c = (float *) batch->coords->data;
+  int i;
+
+  if (batch->n_rects == 0)
+    return;
+
+  if (n_layers == 1)
+    {
+      /* Same layout as cogl_framebuffer_draw_textured_rectangles()
+       * wants, apart from the mask coordinates, so pack them first */
+      for (i = 0; i < batch->n_rects; i++)
+        memmove (&c[i * 8], &c[i * RECT_BATCH_STRIDE], 8 * sizeof (float));
+
+      cogl_framebuffer_draw_textured_rectangles (fb, pipeline,
+                                                 c, batch->n_rects);
+    }
+  else
+    {
+      for (i = 0; i < batch->n_rects; i++)
+        {
+          float *rect = &c[i * RECT_BATCH_STRIDE];
+
+          cogl_framebuffer_draw_multitextured_rectangle (fb, pipeline,
+                                                         rect[0], rect[1],
+                                                         rect[2], rect[3],
+                                                         &rect[4], 8);
+        }
+    }
+
+  priv->frame_rects += batch->n_rects;
+  priv->frame_batches++;
+
+  g_array_set_size (batch->coords, 0);
+  batch->n_rects = 0;
+}
+
+/* Paints @paint_region, or all of the texture if it is %NULL, when
+ * the shape is given by tiles rather than one mask texture. Only the
+ * tiles are painted with a mask; the rest of the shape is exact
+ * rectangles that are painted as is.
+ */
+static void
+paint_tiled (MetaShapedTexture *stex,
+             CoglContext       *ctx,
+             CoglFramebuffer   *fb,
+             CoglTexture       *paint_tex,
+             guchar             opacity,
+             cairo_region_t    *paint_region,
+             ClutterActorBox   *alloc,
+             RectBatch         *batch)
+{
+  MetaShapedTexturePrivate *priv = stex->priv;
+  CoglPipeline *pipeline;
+  CoglColor color;
+  cairo_region_t *region, *unmasked_region;
+  int i;
+
+  cogl_color_init_from_4ub (&color, opacity, opacity, opacity, opacity);
+
+  if (paint_region != NULL)
+    {
+      region = cairo_region_copy (paint_region);
+      cairo_region_intersect (region, priv->mask_shape);
+    }
+  else
+    {
+      region = cairo_region_copy (priv->mask_shape);
+    }
+
+  pipeline = get_unmasked_pipeline (ctx);
+  cogl_pipeline_set_layer_texture (pipeline, 0, paint_tex);
+  cogl_pipeline_set_color (pipeline, &color);
+
+  unmasked_region = cairo_region_copy (region);
+  cairo_region_subtract (unmasked_region, priv->mask_tiles_region);
+  rect_batch_add_region (batch, unmasked_region, alloc, NULL);
+  rect_batch_draw (batch, stex, fb, pipeline, 1);
+  cairo_region_destroy (unmasked_region);
+
+  cogl_object_unref (pipeline);
+
+  for (i = 0; i < priv->n_mask_tiles; i++)
+    {
+      MaskTile *tile = &priv->mask_tiles[i];
+      cairo_region_t *tile_region;
+
+      if (cairo_region_contains_rectangle (region, &tile->rect) == CAIRO_REGION_OVERLAP_OUT)
+        continue;
+
+      tile_region = cairo_region_create_rectangle (&tile->rect);
+      cairo_region_intersect (tile_region, region);
+
+      pipeline = get_masked_pipeline (ctx);
+      cogl_pipeline_set_layer_texture (pipeline, 0, paint_tex);
+      cogl_pipeline_set_layer_texture (pipeline, 1, tile->texture);
+      cogl_pipeline_set_color (pipeline, &color);
+
+      rect_batch_add_region (batch, tile_region, alloc, &tile->rect);
+      rect_batch_draw (batch, stex, fb, pipeline, 2);
+
+      cogl_object_unref (pipeline);
+      cairo_region_destroy (tile_region);
+    }
+
+  cairo_region_destroy (region);
 }
 
 
@@ -209,6 +408,7 @@ meta_shaped_texture_paint (ClutterActor *actor)
   CoglTexture *paint_tex;
   ClutterActorBox alloc;
   cairo_region_t *blended_region = NULL;
+  RectBatch batch;
 
   if (priv->clip_region && cairo_region_is_empty (priv->clip_region))
     return;
@@ -251,12 +451,12 @@ meta_shaped_texture_paint (ClutterActor *actor)
   opacity = clutter_actor_get_paint_opacity (actor);
   clutter_actor_get_allocation_box (actor, &alloc);
 
+  rect_batch_init (&batch);
+
   if (priv->opaque_region != NULL && opacity == 255)
     {
       CoglPipeline *opaque_pipeline;
       cairo_region_t *region;
-      int n_rects;
-      int i;
 
       if (priv->clip_region != NULL)
         {
@@ -274,13 +474,8 @@ meta_shaped_texture_paint (ClutterActor *actor)
       opaque_pipeline = get_unblended_pipeline (ctx);
       cogl_pipeline_set_layer_texture (opaque_pipeline, 0, paint_tex);
 
-      n_rects = cairo_region_num_rectangles (region);
-      for (i = 0; i < n_rects; i++)
-        {
-          cairo_rectangle_int_t rect;
-          cairo_region_get_rectangle (region, i, &rect);
-          paint_clipped_rectangle (fb, opaque_pipeline, &rect, &alloc);
-        }
+      rect_batch_add_region (&batch, region, &alloc, NULL);
+      rect_batch_draw (&batch, stex, fb, opaque_pipeline, 1);
 
       cogl_object_unref (opaque_pipeline);
 
@@ -306,6 +501,13 @@ meta_shaped_texture_paint (ClutterActor *actor)
   if (blended_region != NULL && cairo_region_is_empty (blended_region))
     goto out;
 
+  if (priv->mask_shape != NULL)
+    {
+      paint_tiled (stex, ctx, fb, paint_tex, opacity, blended_region, &alloc,
+                   &batch);
+      goto out;
+    }
+
   if (priv->mask_texture == NULL)
     {
       pipeline = get_unmasked_pipeline (ctx);
@@ -329,8 +531,11 @@ meta_shaped_texture_paint (ClutterActor *actor)
       int n_rects;
 
       /* Limit to how many separate rectangles we'll draw; beyond this just
-       * fall back and draw the whole thing */
-#     define MAX_RECTS 16
+       * fall back and draw the whole thing. Every rectangle costs a
+       * journal entry and its vertices on the CPU, masked or not, while
+       * drawing the whole texture costs fill; past a few hundred small
+       * rectangles the fill saved no longer pays for them. */
+#     define MAX_RECTS 256
 
       n_rects = cairo_region_num_rectangles (blended_region);
       if (n_rects <= MAX_RECTS)
@@ -347,9 +552,11 @@ meta_shaped_texture_paint (ClutterActor *actor)
 	      if (!gdk_rectangle_intersect (&tex_rect, &rect, &rect))
 		continue;
 
-              paint_clipped_rectangle (fb, pipeline, &rect, &alloc);
+              rect_batch_add (&batch, &rect, &alloc, NULL);
             }
 
+          rect_batch_draw (&batch, stex, fb, pipeline,
+                           priv->mask_texture != NULL ? 2 : 1);
           goto out;
 	}
     }
@@ -358,8 +565,11 @@ meta_shaped_texture_paint (ClutterActor *actor)
                                    0, 0,
                                    alloc.x2 - alloc.x1,
                                    alloc.y2 - alloc.y1);
+  priv->frame_rects++;
+  priv->frame_batches++;
 
  out:
+  rect_batch_free (&batch);
   if (pipeline != NULL)
     cogl_object_unref (pipeline);
   if (blended_region != NULL)
@@ -374,8 +584,42 @@ meta_shaped_texture_pick (ClutterActor       *actor,
   MetaShapedTexturePrivate *priv = stex->priv;
 
   /* If there is no region then use the regular pick */
-  if (priv->mask_texture == NULL)
+  if (priv->mask_texture == NULL && priv->mask_shape == NULL)
     CLUTTER_ACTOR_CLASS (meta_shaped_texture_parent_class)->pick (actor, color);
+  else if (priv->mask_shape != NULL)
+    {
+      CoglPipeline *pipeline;
+      CoglContext *ctx;
+      CoglFramebuffer *fb;
+      CoglColor cogl_color;
+      int n_rects, i;
+
+      if (!clutter_actor_should_pick_paint (actor))
+        return;
+
+      ctx = clutter_backend_get_cogl_context (clutter_get_default_backend ());
+      fb = cogl_get_draw_framebuffer ();
+
+      cogl_color_init_from_4ub (&cogl_color, color->red, color->green, color->blue, color->alpha);
+
+      /* Soft edges are picked as if they were solid */
+      pipeline = cogl_pipeline_new (ctx);
+      cogl_pipeline_set_color (pipeline, &cogl_color);
+
+      n_rects = cairo_region_num_rectangles (priv->mask_shape);
+      for (i = 0; i < n_rects; i++)
+        {
+          cairo_rectangle_int_t rect;
+
+          cairo_region_get_rectangle (priv->mask_shape, i, &rect);
+          cogl_framebuffer_draw_rectangle (fb, pipeline,
+                                           rect.x, rect.y,
+                                           rect.x + rect.width,
+                                           rect.y + rect.height);
+        }
+
+      cogl_object_unref (pipeline);
+    }
   else if (clutter_actor_should_pick_paint (actor))
     {
       CoglTexture *paint_tex;
@@ -491,6 +735,22 @@ meta_shaped_texture_set_create_mipmaps (MetaShapedTexture *stex,
     }
 }
 
+static void
+clear_mask_tiles (MetaShapedTexture *stex)
+{
+  MetaShapedTexturePrivate *priv = stex->priv;
+  int i;
+
+  for (i = 0; i < priv->n_mask_tiles; i++)
+    cogl_object_unref (priv->mask_tiles[i].texture);
+
+  g_clear_pointer (&priv->mask_tiles, g_free);
+  priv->n_mask_tiles = 0;
+
+  g_clear_pointer (&priv->mask_shape, cairo_region_destroy);
+  g_clear_pointer (&priv->mask_tiles_region, cairo_region_destroy);
+}
+
 void
 meta_shaped_texture_set_mask_texture (MetaShapedTexture *stex,
                                       CoglTexture       *mask_texture)
@@ -502,6 +762,7 @@ meta_shaped_texture_set_mask_texture (MetaShapedTexture *stex,
   priv = stex->priv;
 
   g_clear_pointer (&priv->mask_texture, cogl_object_unref);
+  clear_mask_tiles (stex);
 
   if (mask_texture != NULL)
     {
@@ -512,6 +773,101 @@ meta_shaped_texture_set_mask_texture (MetaShapedTexture *stex,
   clutter_actor_queue_redraw (CLUTTER_ACTOR (stex));
 }
 
+/**
+ * meta_shaped_texture_set_mask_tiles:
+ * @stex: a #MetaShapedTexture
+ * @shape_region: the part of the texture that is fully shown
+ * @tile_rects: (array length=n_tiles): where each tile goes
+ * @tile_textures: (array length=n_tiles): an A8 mask for each tile,
+ *   covering its rectangle
+ * @n_tiles: the number of tiles
+ *
+ * Sets the shape of the texture without a mask texture the size of the
+ * whole window: everything in @shape_region is painted unmasked, and
+ * only the tiles, typically the antialiased corners of a frame, are
+ * painted through a mask. Anything else isn't painted. This replaces
+ * any mask set with meta_shaped_texture_set_mask_texture().
+ */
+void
+meta_shaped_texture_set_mask_tiles (MetaShapedTexture           *stex,
+                                    cairo_region_t              *shape_region,
+                                    const cairo_rectangle_int_t *tile_rects,
+                                    CoglTexture                **tile_textures,
+                                    int                          n_tiles)
+{
+  MetaShapedTexturePrivate *priv;
+  int i;
+
+  g_return_if_fail (META_IS_SHAPED_TEXTURE (stex));
+
+  priv = stex->priv;
+
+  g_clear_pointer (&priv->mask_texture, cogl_object_unref);
+  clear_mask_tiles (stex);
+
+  priv->mask_shape = cairo_region_copy (shape_region);
+  priv->mask_tiles_region = cairo_region_create ();
+  priv->mask_tiles = g_new (MaskTile, MAX (n_tiles, 1));
+  priv->n_mask_tiles = n_tiles;
+
+  for (i = 0; i < n_tiles; i++)
+    {
+      priv->mask_tiles[i].rect = tile_rects[i];
+      priv->mask_tiles[i].texture = cogl_object_ref (tile_textures[i]);
+
+      cairo_region_union_rectangle (priv->mask_tiles_region, &tile_rects[i]);
+    }
+
+  cairo_region_union (priv->mask_shape, priv->mask_tiles_region);
+
+  clutter_actor_queue_redraw (CLUTTER_ACTOR (stex));
+}
+
+/**
+ * meta_shaped_texture_finish_frame_stats:
+ * @stex: a #MetaShapedTexture
+ *
+ * Ends the paint statistics for the current frame; the counts can then
+ * be read with meta_shaped_texture_get_paint_stats() until the next
+ * call.
+ */
+void
+meta_shaped_texture_finish_frame_stats (MetaShapedTexture *stex)
+{
+  MetaShapedTexturePrivate *priv;
+
+  g_return_if_fail (META_IS_SHAPED_TEXTURE (stex));
+
+  priv = stex->priv;
+
+  priv->last_frame_rects = priv->frame_rects;
+  priv->last_frame_batches = priv->frame_batches;
+  priv->frame_rects = 0;
+  priv->frame_batches = 0;
+}
+
+/**
+ * meta_shaped_texture_get_paint_stats:
+ * @stex: a #MetaShapedTexture
+ * @n_rects: (out) (allow-none): the number of rectangles painted
+ * @n_batches: (out) (allow-none): the number of pipeline batches they
+ *   were submitted in
+ *
+ * Gets how much work painting @stex took in the last finished frame.
+ */
+void
+meta_shaped_texture_get_paint_stats (MetaShapedTexture *stex,
+                                     guint             *n_rects,
+                                     guint             *n_batches)
+{
+  g_return_if_fail (META_IS_SHAPED_TEXTURE (stex));
+
+  if (n_rects)
+    *n_rects = stex->priv->last_frame_rects;
+  if (n_batches)
+    *n_batches = stex->priv->last_frame_batches;
+}
+
 
 /**
  * meta_shaped_texture_update_area:
@@ -827,6 +1183,56 @@ meta_shaped_texture_get_image (MetaShapedTexture     *stex,
       if (clip != NULL)
         cogl_object_unref (mask_texture);
     }
+  else if (stex->priv->mask_shape != NULL)
+    {
+      MetaShapedTexturePrivate *priv = stex->priv;
+      cairo_t *cr;
+      cairo_surface_t *mask_surface;
+      int i;
+
+      mask_surface = cairo_image_surface_create (CAIRO_FORMAT_A8,
+                                                 cairo_image_surface_get_width (surface),
+                                                 cairo_image_surface_get_height (surface));
+
+      cr = cairo_create (mask_surface);
+      if (clip != NULL)
+        cairo_translate (cr, - clip->x, - clip->y);
+
+      gdk_cairo_region (cr, priv->mask_shape);
+      cairo_fill (cr);
+
+      cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+
+      for (i = 0; i < priv->n_mask_tiles; i++)
+        {
+          MaskTile *tile = &priv->mask_tiles[i];
+          cairo_surface_t *tile_surface;
+
+          tile_surface = cairo_image_surface_create (CAIRO_FORMAT_A8,
+                                                     tile->rect.width,
+                                                     tile->rect.height);
+          cogl_texture_get_data (tile->texture, COGL_PIXEL_FORMAT_A_8,
+                                 cairo_image_surface_get_stride (tile_surface),
+                                 cairo_image_surface_get_data (tile_surface));
+          cairo_surface_mark_dirty (tile_surface);
+
+          cairo_set_source_surface (cr, tile_surface, tile->rect.x, tile->rect.y);
+          gdk_cairo_rectangle (cr, &tile->rect);
+          cairo_fill (cr);
+
+          cairo_surface_destroy (tile_surface);
+        }
+
+      cairo_destroy (cr);
+
+      cr = cairo_create (surface);
+      cairo_set_source_surface (cr, mask_surface, 0, 0);
+      cairo_set_operator (cr, CAIRO_OPERATOR_DEST_IN);
+      cairo_paint (cr);
+      cairo_destroy (cr);
+
+      cairo_surface_destroy (mask_surface);
+    }
 
   return surface;
 }
@@ -25,6 +25,7 @@
 #include <math.h>
 #include <string.h>
 
+#include "meta-frame-timings.h"
 #include "meta-texture-tower.h"
 #include "meta-texture-rectangle.h"
 
@@ -34,6 +35,12 @@
 
 #define MAX_TEXTURE_LEVELS 12
 
+/* Each level tracks its invalid area as a handful of rectangles, so
+ * that small changes at opposite ends of a window don't invalidate
+ * everything in between. When the list is full, a new rectangle is
+ * merged into the existing one whose bounding box grows the least. */
+#define MAX_INVALID_BOXES 8
+
 /* If the texture format in memory doesn't match this, then Mesa
  * will do the conversion, so things will still work, but it might
  * be slow depending on how efficient Mesa is. These should be the
@@ -56,15 +63,108 @@ typedef struct
   guint16 y2;
 } Box;
 
+typedef struct
+{
+  int n_boxes;
+  Box boxes[MAX_INVALID_BOXES];
+} InvalidArea;
+
 struct _MetaTextureTower
 {
   int n_levels;
   CoglTexture *textures[MAX_TEXTURE_LEVELS];
   CoglOffscreen *fbos[MAX_TEXTURE_LEVELS];
-  Box invalid[MAX_TEXTURE_LEVELS];
+  InvalidArea invalid[MAX_TEXTURE_LEVELS];
   CoglPipeline *pipeline_template;
 };
 
+/* Number of pixels drawn when revalidating each level, summed
+ * over all towers; see meta_texture_tower_get_fill_stats() */
+static guint64 pixels_rendered[MAX_TEXTURE_LEVELS];
+
+static int
+box_area (const Box *box)
+{
+  return (box->x2 - box->x1) * (box->y2 - box->y1);
+}
+
+static gboolean
+box_contains (const Box *outer,
+              const Box *inner)
+{
+  return (outer->x1 <= inner->x1 && outer->y1 <= inner->y1 &&
+          outer->x2 >= inner->x2 && outer->y2 >= inner->y2);
+}
+
+static void
+box_union (Box       *dest,
+           const Box *src)
+{
+  dest->x1 = MIN (dest->x1, src->x1);
+  dest->y1 = MIN (dest->y1, src->y1);
+  dest->x2 = MAX (dest->x2, src->x2);
+  dest->y2 = MAX (dest->y2, src->y2);
+}
+
+static void
+invalid_area_add (InvalidArea *area,
+                  const Box   *box)
+{
+  int best = -1;
+  int best_growth = G_MAXINT;
+  int i;
+
+  if (box->x1 == box->x2 || box->y1 == box->y2)
+    return;
+
+  /* Drop boxes that the new one covers completely */
+  i = 0;
+  while (i < area->n_boxes)
+    {
+      if (box_contains (&area->boxes[i], box))
+        return;
+
+      if (box_contains (box, &area->boxes[i]))
+        area->boxes[i] = area->boxes[--area->n_boxes];
+      else
+        i++;
+    }
+
+  if (area->n_boxes < MAX_INVALID_BOXES)
+    {
+      area->boxes[area->n_boxes++] = *box;
+      return;
+    }
+
+  for (i = 0; i < area->n_boxes; i++)
+    {
+      Box merged = area->boxes[i];
+      int growth;
+
+      box_union (&merged, box);
+      growth = box_area (&merged) - box_area (&area->boxes[i]);
+      if (growth < best_growth)
+        {
+          best = i;
+          best_growth = growth;
+        }
+    }
+
+  box_union (&area->boxes[best], box);
+}
+
+static void
+invalid_area_set_full (InvalidArea *area,
+                       int          width,
+                       int          height)
+{
+  area->n_boxes = 1;
+  area->boxes[0].x1 = 0;
+  area->boxes[0].y1 = 0;
+  area->boxes[0].x2 = width;
+  area->boxes[0].y2 = height;
+}
+
 /**
  * meta_texture_tower_new:
  *
@@ -190,6 +290,9 @@ meta_texture_tower_update_area (MetaTextureTower *tower,
 
   g_return_if_fail (tower != NULL);
 
+  if (width <= 0 || height <= 0)
+    return;
+
   if (tower->textures[0] == NULL)
     return;
 
@@ -211,18 +314,7 @@ meta_texture_tower_update_area (MetaTextureTower *tower,
       invalid.x2 = MIN (texture_width, (invalid.x2 + 1) / 2);
       invalid.y2 = MIN (texture_height, (invalid.y2 + 1) / 2);
 
-      if (tower->invalid[i].x1 == tower->invalid[i].x2 ||
-          tower->invalid[i].y1 == tower->invalid[i].y2)
-        {
-          tower->invalid[i] = invalid;
-        }
-      else
-        {
-          tower->invalid[i].x1 = MIN (tower->invalid[i].x1, invalid.x1);
-          tower->invalid[i].y1 = MIN (tower->invalid[i].y1, invalid.y1);
-          tower->invalid[i].x2 = MAX (tower->invalid[i].x2, invalid.x2);
-          tower->invalid[i].y2 = MAX (tower->invalid[i].y2, invalid.y2);
-        }
+      invalid_area_add (&tower->invalid[i], &invalid);
     }
 }
 
@@ -381,10 +473,7 @@ texture_tower_create_texture (MetaTextureTower *tower,
                                                            TEXTURE_FORMAT);
     }
 
-  tower->invalid[level].x1 = 0;
-  tower->invalid[level].y1 = 0;
-  tower->invalid[level].x2 = width;
-  tower->invalid[level].y2 = height;
+  invalid_area_set_full (&tower->invalid[level], width, height);
 }
 
 static void
@@ -397,10 +486,12 @@ texture_tower_revalidate_fbo (MetaTextureTower *tower,
   CoglTexture *dest_texture = tower->textures[level];
   int dest_texture_width = cogl_texture_get_width (dest_texture);
   int dest_texture_height = cogl_texture_get_height (dest_texture);
-  Box *invalid = &tower->invalid[level];
+  InvalidArea *invalid = &tower->invalid[level];
+  float coords[8 * MAX_INVALID_BOXES];
   CoglFramebuffer *fb;
   CoglError *catch_error = NULL;
   CoglPipeline *pipeline;
+  int i;
 
   if (tower->fbos[level] == NULL)
     tower->fbos[level] = cogl_offscreen_new_with_texture (dest_texture);
@@ -426,15 +517,29 @@ texture_tower_revalidate_fbo (MetaTextureTower *tower,
   pipeline = cogl_pipeline_copy (tower->pipeline_template);
   cogl_pipeline_set_layer_texture (pipeline, 0, tower->textures[level - 1]);
 
-  cogl_framebuffer_draw_textured_rectangle (fb, pipeline,
-                                            invalid->x1, invalid->y1,
-                                            invalid->x2, invalid->y2,
-                                            (2. * invalid->x1) / source_texture_width,
-                                            (2. * invalid->y1) / source_texture_height,
-                                            (2. * invalid->x2) / source_texture_width,
-                                            (2. * invalid->y2) / source_texture_height);
+  for (i = 0; i < invalid->n_boxes; i++)
+    {
+      Box *box = &invalid->boxes[i];
+      float *v = coords + 8 * i;
+
+      v[0] = box->x1;
+      v[1] = box->y1;
+      v[2] = box->x2;
+      v[3] = box->y2;
+      v[4] = (2. * box->x1) / source_texture_width;
+      v[5] = (2. * box->y1) / source_texture_height;
+      v[6] = (2. * box->x2) / source_texture_width;
+      v[7] = (2. * box->y2) / source_texture_height;
+
+      pixels_rendered[level] += box_area (box);
+    }
+
+  cogl_framebuffer_draw_textured_rectangles (fb, pipeline,
+                                             coords, invalid->n_boxes);
 
   cogl_object_unref (pipeline);
+
+  invalid->n_boxes = 0;
 }
 
 static void
@@ -477,9 +582,9 @@ meta_texture_tower_get_paint_texture (MetaTextureTower *tower)
   level = MIN (level, tower->n_levels - 1);
 
   if (tower->textures[level] == NULL ||
-      (tower->invalid[level].x2 != tower->invalid[level].x1 &&
-       tower->invalid[level].y2 != tower->invalid[level].y1))
+      tower->invalid[level].n_boxes > 0)
     {
+      gint64 start_time = meta_frame_timings_begin_phase ();
       int i;
 
       for (i = 1; i <= level; i++)
@@ -494,11 +599,46 @@ meta_texture_tower_get_paint_texture (MetaTextureTower *tower)
 
       for (i = 1; i <= level; i++)
        {
-         if (tower->invalid[level].x2 != tower->invalid[level].x1 &&
-             tower->invalid[level].y2 != tower->invalid[level].y1)
+         if (tower->invalid[i].n_boxes > 0)
            texture_tower_revalidate (tower, i);
        }
+
+      meta_frame_timings_end_phase (META_FRAME_PHASE_TEXTURE_TOWER, start_time);
    }
 
   return tower->textures[level];
 }
+
+/**
+ * meta_texture_tower_get_fill_stats:
+ * @pixels: (out caller-allocates) (array length=n_levels): location to
+ *  store the number of pixels drawn for each level
+ * @n_levels: number of elements in @pixels
+ *
+ * Retrieves the number of pixels that have been re-rendered for each
+ * level of all texture towers since the last call to
+ * meta_texture_tower_reset_fill_stats(). Level 0 is the base texture
+ * and is never rendered, so @pixels[0] is always 0.
+ *
+ * Return value: the number of levels filled in
+ */
+int
+meta_texture_tower_get_fill_stats (guint64 *pixels,
+                                   int      n_levels)
+{
+  n_levels = MIN (n_levels, MAX_TEXTURE_LEVELS);
+  memcpy (pixels, pixels_rendered, n_levels * sizeof (guint64));
+
+  return n_levels;
+}
+
+/**
+ * meta_texture_tower_reset_fill_stats:
+ *
+ * Resets the counters returned by meta_texture_tower_get_fill_stats().
+ */
+void
+meta_texture_tower_reset_fill_stats (void)
+{
+  memset (pixels_rendered, 0, sizeof (pixels_rendered));
+}
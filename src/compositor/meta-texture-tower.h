@@ -64,6 +64,10 @@ void              meta_texture_tower_update_area       (MetaTextureTower *tower,
                                                         int               height);
 CoglTexture      *meta_texture_tower_get_paint_texture (MetaTextureTower *tower);
 
+int               meta_texture_tower_get_fill_stats    (guint64          *pixels,
+                                                        int               n_levels);
+void              meta_texture_tower_reset_fill_stats  (void);
+
 G_BEGIN_DECLS
 
 #endif /* __META_TEXTURE_TOWER_H__ */
@@ -36,7 +36,9 @@ void meta_window_actor_frame_complete (MetaWindowActor    *self,
 void meta_window_actor_invalidate_shadow (MetaWindowActor *self);
 
 void meta_window_actor_set_redirected (MetaWindowActor *self, gboolean state);
+gboolean meta_window_actor_is_unredirected (MetaWindowActor *self);
 
+/* Whether the window allows it; the caller checks it covers a monitor */
 gboolean meta_window_actor_should_unredirect (MetaWindowActor *self);
 
 void meta_window_actor_get_shape_bounds (MetaWindowActor       *self,
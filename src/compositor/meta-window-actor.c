@@ -24,6 +24,7 @@
 #include "frame.h"
 #include <meta/window.h>
 #include <meta/meta-shaped-texture.h>
+#include "meta-shaped-texture-private.h"
 #include "xprops.h"
 
 #include "compositor-private.h"
@@ -78,9 +79,15 @@ struct _MetaWindowActorPrivate
   /* The region we should clip to when painting the shadow */
   cairo_region_t   *shadow_clip;
 
-  /* The region that is visible, used to optimize out redraws */
+  /* The region that is visible, used to optimize out redraws. This is
+   * kept from one paint to the next, so it only changes when stacking
+   * or geometry changes make meta_window_group_paint() compute
+   * something different. */
   cairo_region_t   *unobscured_region;
 
+  /* Damage received since the last frame, applied in pre_paint */
+  cairo_region_t   *pending_damage;
+
   guint              send_frame_messages_timer;
   gint64             frame_drawn_time;
 
@@ -135,8 +142,15 @@ struct _MetaWindowActorPrivate
 
   guint             unredirected           : 1;
 
-  /* This is used to detect fullscreen windows that need to be unredirected */
-  guint             full_damage_frames_count;
+  /* Set when nothing of the window was visible as of the last paint */
+  guint             obscured               : 1;
+  /* Damage arrived while the window was obscured and was not applied;
+   * the whole texture is updated when the window becomes visible */
+  guint             obscured_damage        : 1;
+
+  /* This is used to detect windows covering a monitor that need to be
+   * unredirected, see update_full_damage_score() */
+  guint             full_damage_score;
   guint             does_full_damage  : 1;
 };
 
@@ -183,6 +197,8 @@ static void meta_window_actor_handle_updates (MetaWindowActor *self);
 
 static void check_needs_reshape (MetaWindowActor *self);
 
+static gboolean is_fully_obscured (MetaWindowActor *self);
+
 static void do_send_frame_drawn (MetaWindowActor *self, FrameData *frame);
 static void do_send_frame_timings (MetaWindowActor  *self,
                                    FrameData        *frame,
@@ -431,6 +447,7 @@ meta_window_actor_dispose (GObject *object)
     }
 
   g_clear_pointer (&priv->unobscured_region, cairo_region_destroy);
+  g_clear_pointer (&priv->pending_damage, cairo_region_destroy);
   g_clear_pointer (&priv->shape_region, cairo_region_destroy);
   g_clear_pointer (&priv->opaque_region, cairo_region_destroy);
   g_clear_pointer (&priv->shadow_clip, cairo_region_destroy);
@@ -664,6 +681,12 @@ meta_window_actor_paint (ClutterActor *actor)
       priv->send_frame_messages_timer = 0;
     }
 
+  /* A clone would show stale contents; pre_paint should have applied
+   * the damage the window got while obscured as soon as the clone was
+   * mapped. */
+  g_warn_if_fail (!(priv->obscured_damage &&
+                    clutter_actor_is_in_clone_paint (actor)));
+
   if (shadow != NULL)
     {
       MetaShadowParams params;
@@ -997,6 +1020,14 @@ meta_window_actor_damage_all (MetaWindowActor *self)
   if (!priv->mapped || priv->needs_pixmap)
     return;
 
+  if (is_fully_obscured (self))
+    {
+      priv->obscured_damage = TRUE;
+      priv->needs_damage_all = FALSE;
+      g_clear_pointer (&priv->pending_damage, cairo_region_destroy);
+      return;
+    }
+
   redraw_queued = meta_shaped_texture_update_area (META_SHAPED_TEXTURE (priv->actor),
                                                    0, 0,
                                                    cogl_texture_get_width (texture),
@@ -1006,6 +1037,9 @@ meta_window_actor_damage_all (MetaWindowActor *self)
 
   priv->repaint_scheduled = priv->repaint_scheduled  || redraw_queued;
 
+  /* Anything queued is covered by the full update */
+  g_clear_pointer (&priv->pending_damage, cairo_region_destroy);
+
   priv->needs_damage_all = FALSE;
 }
 
@@ -1108,6 +1142,14 @@ is_frozen (MetaWindowActor *self)
   return self->priv->freeze_count ? TRUE : FALSE;
 }
 
+static gboolean
+is_fully_obscured (MetaWindowActor *self)
+{
+  MetaWindowActorPrivate *priv = self->priv;
+
+  return priv->obscured && !clutter_actor_has_mapped_clones (priv->actor);
+}
+
 static void
 meta_window_actor_queue_create_pixmap (MetaWindowActor *self)
 {
@@ -1340,9 +1382,6 @@ meta_window_actor_should_unredirect (MetaWindowActor *self)
   if (priv->argb32 && !meta_window_requested_bypass_compositor (metaWindow))
     return FALSE;
 
-  if (!meta_window_is_monitor_sized (metaWindow))
-    return FALSE;
-
   if (meta_window_requested_bypass_compositor (metaWindow))
     return TRUE;
 
@@ -1355,6 +1394,12 @@ meta_window_actor_should_unredirect (MetaWindowActor *self)
   return FALSE;
 }
 
+gboolean
+meta_window_actor_is_unredirected (MetaWindowActor *self)
+{
+  return self->priv->unredirected;
+}
+
 void
 meta_window_actor_set_redirected (MetaWindowActor *self, gboolean state)
 {
@@ -1763,6 +1808,49 @@ see_region (cairo_region_t *region,
 }
 #endif
 
+/* Brings the texture of a window that has just become visible up to
+ * date with the damage it received while obscured. This is called
+ * from meta_window_group_paint() before the window is painted, or
+ * from pre_paint when the window got a clone or is otherwise no
+ * longer fully obscured. Whatever uncovered the window or mapped the
+ * clone already queued a redraw of the area it now shows, so no
+ * further redraw is queued here.
+ */
+static void
+meta_window_actor_update_obscured_damage (MetaWindowActor *self)
+{
+  MetaWindowActorPrivate *priv = self->priv;
+  MetaCompScreen *info = meta_screen_get_compositor_data (priv->screen);
+  CoglTexture *texture;
+  cairo_region_t *empty_region;
+
+  priv->obscured_damage = FALSE;
+
+  /* A new pixmap is complete when fetched */
+  if (priv->unredirected || !priv->mapped || priv->needs_pixmap)
+    return;
+
+  if (is_frozen (self))
+    {
+      priv->needs_damage_all = TRUE;
+      return;
+    }
+
+  texture = meta_shaped_texture_get_texture (META_SHAPED_TEXTURE (priv->actor));
+  if (texture == NULL)
+    return;
+
+  empty_region = cairo_region_create ();
+  meta_shaped_texture_update_area (META_SHAPED_TEXTURE (priv->actor),
+                                   0, 0,
+                                   cogl_texture_get_width (texture),
+                                   cogl_texture_get_height (texture),
+                                   empty_region);
+  cairo_region_destroy (empty_region);
+
+  info->damage_updates_applied++;
+}
+
 /**
  * meta_window_actor_set_unobscured_region:
  * @self: a #MetaWindowActor
@@ -1771,6 +1859,8 @@ see_region (cairo_region_t *region,
  *
  * Provides a hint as to what areas of the window need to queue
  * redraws when damaged. Regions not in @unobscured_region are completely obscured.
+ * If none of the window is visible, damage is not applied to the texture
+ * until a later call makes part of it visible again.
  * Unlike meta_window_actor_set_clip_region(), the region here
  * doesn't take into account any clipping that is in effect while drawing.
  */
@@ -1787,6 +1877,22 @@ meta_window_actor_set_unobscured_region (MetaWindowActor *self,
     priv->unobscured_region = cairo_region_copy (unobscured_region);
   else
     priv->unobscured_region = NULL;
+
+  if (priv->unobscured_region != NULL && priv->shape_region != NULL)
+    {
+      cairo_rectangle_int_t bounds;
+
+      meta_window_actor_get_shape_bounds (self, &bounds);
+      priv->obscured = cairo_region_contains_rectangle (priv->unobscured_region,
+                                                        &bounds) == CAIRO_REGION_OVERLAP_OUT;
+    }
+  else
+    {
+      priv->obscured = FALSE;
+    }
+
+  if (priv->obscured_damage && !priv->obscured)
+    meta_window_actor_update_obscured_damage (self);
 }
 
 /**
@@ -1922,6 +2028,7 @@ check_needs_pixmap (MetaWindowActor *self)
 
       meta_shaped_texture_set_pixmap (META_SHAPED_TEXTURE (priv->actor),
                                       priv->back_pixmap);
+      priv->obscured_damage = FALSE;
 
       texture = meta_shaped_texture_get_texture (META_SHAPED_TEXTURE (priv->actor));
 
@@ -2016,37 +2123,174 @@ check_needs_shadow (MetaWindowActor *self)
     meta_shadow_unref (old_shadow);
 }
 
+/* Damage events are not applied to the texture as they arrive; a
+ * client that floods us with small updates (a terminal scrolling, a
+ * video playing) can send hundreds of them per frame. Instead we
+ * collect the damage into a region and apply it once per frame in
+ * meta_window_actor_pre_paint(). Past MAX_PENDING_DAMAGE_RECTS
+ * rectangles the region is replaced by its bounding box, since
+ * updating one larger area is cheaper than many small ones.
+ */
+#define MAX_PENDING_DAMAGE_RECTS 16
+
+static void
+meta_window_actor_queue_damage (MetaWindowActor             *self,
+                                const cairo_rectangle_int_t *rect)
+{
+  MetaWindowActorPrivate *priv = self->priv;
+
+  if (priv->pending_damage == NULL)
+    {
+      priv->pending_damage = cairo_region_create_rectangle (rect);
+    }
+  else
+    {
+      cairo_region_union_rectangle (priv->pending_damage, rect);
+
+      if (cairo_region_num_rectangles (priv->pending_damage) > MAX_PENDING_DAMAGE_RECTS)
+        {
+          cairo_rectangle_int_t extents;
+
+          cairo_region_get_extents (priv->pending_damage, &extents);
+          cairo_region_destroy (priv->pending_damage);
+          priv->pending_damage = cairo_region_create_rectangle (&extents);
+        }
+    }
+
+  /* If the damage is visible, make sure a frame gets drawn so that
+   * pre_paint applies it; as in meta_window_actor_queue_frame_drawn()
+   * a 1-pixel redraw is enough, the real clip is queued when the
+   * damage is applied. Damage to obscured areas just waits for the
+   * next frame. */
+  if (!priv->repaint_scheduled &&
+      (priv->unobscured_region == NULL ||
+       clutter_actor_has_mapped_clones (priv->actor) ||
+       cairo_region_contains_rectangle (priv->unobscured_region, rect) != CAIRO_REGION_OVERLAP_OUT))
+    {
+      const cairo_rectangle_int_t clip = { 0, 0, 1, 1 };
+      clutter_actor_queue_redraw_with_clip (priv->actor, &clip);
+      priv->repaint_scheduled = TRUE;
+    }
+}
+
+static void
+meta_window_actor_flush_damage (MetaWindowActor *self)
+{
+  MetaWindowActorPrivate *priv = self->priv;
+  MetaCompScreen *info = meta_screen_get_compositor_data (priv->screen);
+  cairo_region_t *unobscured_region;
+  gboolean redraw_queued = FALSE;
+  int n_rects, i;
+
+  if (priv->pending_damage == NULL)
+    return;
+
+  /* Keep the damage around until the window is thawed; if the window
+   * was damaged while frozen, needs_damage_all covers it anyway */
+  if (is_frozen (self))
+    return;
+
+  if (priv->unredirected || !priv->mapped || priv->needs_pixmap)
+    {
+      g_clear_pointer (&priv->pending_damage, cairo_region_destroy);
+      return;
+    }
+
+  /* The window was covered up after the damage was queued */
+  if (is_fully_obscured (self))
+    {
+      priv->obscured_damage = TRUE;
+      g_clear_pointer (&priv->pending_damage, cairo_region_destroy);
+      return;
+    }
+
+  unobscured_region = clutter_actor_has_mapped_clones (priv->actor) ?
+                      NULL : priv->unobscured_region;
+
+  n_rects = cairo_region_num_rectangles (priv->pending_damage);
+  for (i = 0; i < n_rects; i++)
+    {
+      cairo_rectangle_int_t rect;
+
+      cairo_region_get_rectangle (priv->pending_damage, i, &rect);
+      redraw_queued |= meta_shaped_texture_update_area (META_SHAPED_TEXTURE (priv->actor),
+                                                        rect.x, rect.y,
+                                                        rect.width, rect.height,
+                                                        unobscured_region);
+    }
+
+  info->damage_updates_applied += n_rects;
+
+  priv->repaint_scheduled = priv->repaint_scheduled || redraw_queued;
+
+  g_clear_pointer (&priv->pending_damage, cairo_region_destroy);
+}
+
+/* A window that keeps redrawing all of itself (a game or a video
+ * player) is unredirected when it covers a monitor, so that it bypasses
+ * compositing. Full damage raises the score by one and other damage
+ * lowers it by PARTIAL_DAMAGE_PENALTY; does_full_damage is set when the
+ * score reaches FULL_DAMAGE_SCORE_MAX and cleared again only when it
+ * drops below FULL_DAMAGE_SCORE_REDIRECT, so that an occasional partial
+ * update doesn't make us flip back and forth.
+ */
+#define FULL_DAMAGE_SCORE_MAX       100
+#define FULL_DAMAGE_SCORE_REDIRECT   50
+#define PARTIAL_DAMAGE_PENALTY        5
+
+static void
+update_full_damage_score (MetaWindowActor *self,
+                          XRectangle      *area)
+{
+  MetaWindowActorPrivate *priv = self->priv;
+
+  /* The damage is relative to the window pixmap, which has the size
+   * of the input rect */
+  if (area->x == 0 && area->y == 0 &&
+      area->width == priv->last_width && area->height == priv->last_height)
+    {
+      if (priv->full_damage_score < FULL_DAMAGE_SCORE_MAX)
+        priv->full_damage_score++;
+    }
+  else
+    {
+      priv->full_damage_score = MAX ((int) priv->full_damage_score - PARTIAL_DAMAGE_PENALTY, 0);
+    }
+
+  if (priv->full_damage_score >= FULL_DAMAGE_SCORE_MAX)
+    priv->does_full_damage = TRUE;
+  else if (priv->full_damage_score < FULL_DAMAGE_SCORE_REDIRECT)
+    priv->does_full_damage = FALSE;
+}
+
 void
 meta_window_actor_process_damage (MetaWindowActor    *self,
                                   XDamageNotifyEvent *event)
 {
   MetaWindowActorPrivate *priv = self->priv;
   MetaCompScreen *info = meta_screen_get_compositor_data (priv->screen);
-  gboolean redraw_queued;
+  cairo_rectangle_int_t area;
 
   priv->received_damage = TRUE;
+  info->damage_events_received++;
 
-  if (meta_window_is_fullscreen (priv->window) && g_list_last (info->windows)->data == self && !priv->unredirected)
+  update_full_damage_score (self, &event->area);
+
+  /* Drop damage event for unredirected windows; but keep the damage
+   * reporting, so that we notice if the window stops redrawing all of
+   * itself and should be composited again. */
+  if (priv->unredirected)
     {
-      MetaRectangle window_rect;
-      meta_window_get_outer_rect (priv->window, &window_rect);
+      MetaDisplay *display = meta_screen_get_display (priv->screen);
 
-      if (window_rect.x == event->area.x &&
-          window_rect.y == event->area.y &&
-          window_rect.width == event->area.width &&
-          window_rect.height == event->area.height)
-        priv->full_damage_frames_count++;
-      else
-        priv->full_damage_frames_count = 0;
+      meta_error_trap_push (display);
+      XDamageSubtract (meta_display_get_xdisplay (display), priv->damage, None, None);
+      meta_error_trap_pop (display);
 
-      if (priv->full_damage_frames_count >= 100)
-        priv->does_full_damage = TRUE;
+      priv->received_damage = FALSE;
+      return;
     }
 
-  /* Drop damage event for unredirected windows */
-  if (priv->unredirected)
-    return;
-
   if (is_frozen (self))
     {
       /* The window is frozen due to an effect in progress: we ignore damage
@@ -2070,16 +2314,24 @@ meta_window_actor_process_damage (MetaWindowActor    *self,
   if (!priv->mapped || priv->needs_pixmap)
     return;
 
-  redraw_queued = meta_shaped_texture_update_area (META_SHAPED_TEXTURE (priv->actor),
-                                                   event->area.x,
-                                                   event->area.y,
-                                                   event->area.width,
-                                                   event->area.height,
-                                                   clutter_actor_has_mapped_clones (priv->actor) ?
-                                                   NULL : priv->unobscured_region);
+  /* Nothing of the window can be seen, so rather than updating the
+   * texture and its mipmaps for every frame the client draws, just
+   * remember that it is out of date; it is updated all at once when
+   * the window is uncovered. */
+  if (is_fully_obscured (self))
+    {
+      priv->obscured_damage = TRUE;
+      g_clear_pointer (&priv->pending_damage, cairo_region_destroy);
+      info->damage_events_deferred++;
+      return;
+    }
 
-  priv->repaint_scheduled = priv->repaint_scheduled  || redraw_queued;
+  area.x = event->area.x;
+  area.y = event->area.y;
+  area.width = event->area.width;
+  area.height = event->area.height;
 
+  meta_window_actor_queue_damage (self, &area);
 }
 
 void
@@ -2133,10 +2385,42 @@ scan_visible_region (guchar         *mask_data,
   return meta_region_builder_finish (&builder);
 }
 
+static CoglTexture *
+create_mask_texture (CoglTexture *paint_tex,
+                     int          width,
+                     int          height,
+                     int          stride,
+                     guchar      *mask_data)
+{
+  if (meta_texture_rectangle_check (paint_tex))
+    {
+      return meta_texture_rectangle_new (width, height,
+                                         COGL_PIXEL_FORMAT_A_8,
+                                         COGL_PIXEL_FORMAT_A_8,
+                                         stride,
+                                         mask_data,
+                                         NULL /* error */);
+    }
+  else
+    {
+      /* Note: we don't allow slicing for this texture because we
+       * need to use it with multi-texturing which doesn't support
+       * sliced textures */
+      return cogl_texture_new_from_data (width, height,
+                                         COGL_TEXTURE_NO_SLICING,
+                                         COGL_PIXEL_FORMAT_A_8,
+                                         COGL_PIXEL_FORMAT_ANY,
+                                         stride,
+                                         mask_data);
+    }
+}
+
+/* Builds a mask texture the size of the whole window; used when the
+ * shape is too complex to paint rectangle by rectangle. */
 static void
-build_and_scan_frame_mask (MetaWindowActor       *self,
-                           cairo_rectangle_int_t *client_area,
-                           cairo_region_t        *shape_region)
+build_and_scan_full_mask (MetaWindowActor       *self,
+                          cairo_rectangle_int_t *client_area,
+                          cairo_region_t        *shape_region)
 {
   MetaWindowActorPrivate *priv = self->priv;
   guchar *mask_data;
@@ -2192,27 +2476,8 @@ build_and_scan_frame_mask (MetaWindowActor       *self,
   cairo_destroy (cr);
   cairo_surface_destroy (surface);
 
-  if (meta_texture_rectangle_check (paint_tex))
-    {
-      mask_texture = meta_texture_rectangle_new (tex_width, tex_height,
-                                                 COGL_PIXEL_FORMAT_A_8,
-                                                 COGL_PIXEL_FORMAT_A_8,
-                                                 stride,
-                                                 mask_data,
-                                                 NULL /* error */);
-    }
-  else
-    {
-      /* Note: we don't allow slicing for this texture because we
-       * need to use it with multi-texturing which doesn't support
-       * sliced textures */
-      mask_texture = cogl_texture_new_from_data (tex_width, tex_height,
-                                                 COGL_TEXTURE_NO_SLICING,
-                                                 COGL_PIXEL_FORMAT_A_8,
-                                                 COGL_PIXEL_FORMAT_ANY,
-                                                 stride,
-                                                 mask_data);
-    }
+  mask_texture = create_mask_texture (paint_tex, tex_width, tex_height,
+                                      stride, mask_data);
 
   meta_shaped_texture_set_mask_texture (META_SHAPED_TEXTURE (priv->actor),
                                         mask_texture);
@@ -2221,6 +2486,188 @@ build_and_scan_frame_mask (MetaWindowActor       *self,
   g_free (mask_data);
 }
 
+/* Rather than a mask the size of the window, the frame mask is drawn
+ * one border strip at a time, and only the MASK_TILE_SIZE square cells
+ * of a strip that contain partially transparent pixels - the
+ * antialiased corners - are uploaded as mask textures. The rest of the
+ * shape is the scanned region, which MetaShapedTexture paints without
+ * a mask.
+ */
+#define MASK_TILE_SIZE 32
+
+/* Shapes with more rectangles than this get a full mask, rather than
+ * being painted rectangle by rectangle */
+#define MAX_SHAPE_RECTS 64
+
+static gboolean
+has_soft_pixels (guchar *mask_data,
+                 int     stride,
+                 int     x,
+                 int     y,
+                 int     width,
+                 int     height)
+{
+  int i, j;
+
+  for (j = y; j < y + height; j++)
+    {
+      guchar *row = mask_data + j * stride;
+
+      for (i = x; i < x + width; i++)
+        if (row[i] != 0 && row[i] != 255)
+          return TRUE;
+    }
+
+  return FALSE;
+}
+
+static void
+add_soft_edge_tiles (CoglTexture           *paint_tex,
+                     guchar                *mask_data,
+                     int                    stride,
+                     cairo_rectangle_int_t *strip_rect,
+                     GArray                *tile_rects,
+                     GPtrArray             *tile_textures)
+{
+  int x, y;
+
+  for (y = 0; y < strip_rect->height; y += MASK_TILE_SIZE)
+    {
+      int height = MIN (MASK_TILE_SIZE, strip_rect->height - y);
+      int run_start = -1;
+
+      /* Adjacent soft cells in a row share one tile */
+      for (x = 0; x <= strip_rect->width; x += MASK_TILE_SIZE)
+        {
+          gboolean soft = FALSE;
+
+          if (x < strip_rect->width)
+            soft = has_soft_pixels (mask_data, stride, x, y,
+                                    MIN (MASK_TILE_SIZE, strip_rect->width - x),
+                                    height);
+
+          if (soft && run_start < 0)
+            run_start = x;
+
+          if (!soft && run_start >= 0)
+            {
+              cairo_rectangle_int_t rect;
+              CoglTexture *texture;
+
+              rect.x = run_start;
+              rect.y = y;
+              rect.width = MIN (x, strip_rect->width) - run_start;
+              rect.height = height;
+
+              texture = create_mask_texture (paint_tex, rect.width, rect.height, stride,
+                                             mask_data + rect.y * stride + rect.x);
+
+              rect.x += strip_rect->x;
+              rect.y += strip_rect->y;
+
+              g_array_append_val (tile_rects, rect);
+              g_ptr_array_add (tile_textures, texture);
+
+              run_start = -1;
+            }
+        }
+    }
+}
+
+static void
+build_and_scan_frame_mask (MetaWindowActor       *self,
+                           cairo_rectangle_int_t *client_area,
+                           cairo_region_t        *shape_region)
+{
+  MetaWindowActorPrivate *priv = self->priv;
+  CoglTexture *paint_tex;
+  GArray *tile_rects;
+  GPtrArray *tile_textures;
+  int i;
+
+  paint_tex = meta_shaped_texture_get_texture (META_SHAPED_TEXTURE (priv->actor));
+  if (paint_tex == NULL)
+    return;
+
+  if (cairo_region_num_rectangles (shape_region) > MAX_SHAPE_RECTS)
+    {
+      build_and_scan_full_mask (self, client_area, shape_region);
+      return;
+    }
+
+  tile_rects = g_array_new (FALSE, FALSE, sizeof (cairo_rectangle_int_t));
+  tile_textures = g_ptr_array_new_with_free_func ((GDestroyNotify) cogl_object_unref);
+
+  if (priv->window->frame != NULL)
+    {
+      cairo_region_t *frame_paint_region;
+      cairo_rectangle_int_t rect = { 0, 0,
+                                     cogl_texture_get_width (paint_tex),
+                                     cogl_texture_get_height (paint_tex) };
+      int n_strips;
+
+      /* Make sure we don't paint the frame over the client window. */
+      frame_paint_region = cairo_region_create_rectangle (&rect);
+      cairo_region_subtract_rectangle (frame_paint_region, client_area);
+
+      n_strips = cairo_region_num_rectangles (frame_paint_region);
+      for (i = 0; i < n_strips; i++)
+        {
+          cairo_region_t *strip_region, *scanned_region;
+          cairo_rectangle_int_t strip_rect, scan_rect;
+          cairo_surface_t *surface;
+          guchar *mask_data;
+          cairo_t *cr;
+          int stride;
+
+          cairo_region_get_rectangle (frame_paint_region, i, &strip_rect);
+
+          stride = cairo_format_stride_for_width (CAIRO_FORMAT_A8, strip_rect.width);
+          mask_data = g_malloc0 (stride * strip_rect.height);
+
+          surface = cairo_image_surface_create_for_data (mask_data,
+                                                         CAIRO_FORMAT_A8,
+                                                         strip_rect.width,
+                                                         strip_rect.height,
+                                                         stride);
+          cairo_surface_set_device_offset (surface, - strip_rect.x, - strip_rect.y);
+
+          cr = cairo_create (surface);
+          meta_frame_get_mask (priv->window->frame, cr);
+          cairo_destroy (cr);
+          cairo_surface_flush (surface);
+
+          scan_rect.x = scan_rect.y = 0;
+          scan_rect.width = strip_rect.width;
+          scan_rect.height = strip_rect.height;
+          strip_region = cairo_region_create_rectangle (&scan_rect);
+
+          scanned_region = scan_visible_region (mask_data, stride, strip_region);
+          cairo_region_translate (scanned_region, strip_rect.x, strip_rect.y);
+          cairo_region_union (shape_region, scanned_region);
+
+          add_soft_edge_tiles (paint_tex, mask_data, stride, &strip_rect,
+                               tile_rects, tile_textures);
+
+          cairo_region_destroy (scanned_region);
+          cairo_region_destroy (strip_region);
+          cairo_surface_destroy (surface);
+          g_free (mask_data);
+        }
+
+      cairo_region_destroy (frame_paint_region);
+    }
+
+  meta_shaped_texture_set_mask_tiles (META_SHAPED_TEXTURE (priv->actor),
+                                      shape_region,
+                                      (cairo_rectangle_int_t *) tile_rects->data,
+                                      (CoglTexture **) tile_textures->pdata,
+                                      tile_rects->len);
+
+  g_ptr_array_unref (tile_textures);
+  g_array_unref (tile_rects);
+}
+
 static void
 meta_window_actor_update_shape_region (MetaWindowActor       *self,
                                        cairo_rectangle_int_t *client_area)
@@ -2397,6 +2844,14 @@ meta_window_actor_pre_paint (MetaWindowActor *self)
   GList *l;
 
   meta_window_actor_handle_updates (self);
+  meta_window_actor_flush_damage (self);
+
+  /* meta_window_group_paint() only catches up with the damage when
+   * the window itself is uncovered; a clone mapped since (in the
+   * overview, say) shows the window without that ever happening.
+   */
+  if (priv->obscured_damage && !is_fully_obscured (self))
+    meta_window_actor_update_obscured_damage (self);
 
   for (l = priv->frames; l != NULL; l = l->next)
     {
@@ -2443,9 +2898,21 @@ void
 meta_window_actor_post_paint (MetaWindowActor *self)
 {
   MetaWindowActorPrivate *priv = self->priv;
+  MetaCompScreen *info = meta_screen_get_compositor_data (priv->screen);
 
   priv->repaint_scheduled = FALSE;
 
+  if (priv->actor)
+    {
+      MetaShapedTexture *stex = META_SHAPED_TEXTURE (priv->actor);
+      guint n_rects, n_batches;
+
+      meta_shaped_texture_finish_frame_stats (stex);
+      meta_shaped_texture_get_paint_stats (stex, &n_rects, &n_batches);
+      info->paint_rects += n_rects;
+      info->paint_batches += n_batches;
+    }
+
  /* This window had damage, but wasn't actually redrawn because
   * it is obscured. So we should wait until timer expiration
   * before sending _NET_WM_FRAME_* messages.
@@ -9,6 +9,7 @@
 
 #include "clutter-utils.h"
 #include "compositor-private.h"
+#include "meta-frame-timings.h"
 #include "meta-window-actor-private.h"
 #include "meta-window-group.h"
 #include "meta-background-actor-private.h"
@@ -97,22 +98,14 @@ meta_window_group_paint (ClutterActor *actor)
   int paint_x_origin, paint_y_origin;
   int actor_x_origin, actor_y_origin;
   int paint_x_offset, paint_y_offset;
+  gint64 start_time;
+  int i;
 
   MetaWindowGroup *window_group = META_WINDOW_GROUP (actor);
   MetaCompScreen *info = meta_screen_get_compositor_data (window_group->screen);
   ClutterActor *stage = clutter_actor_get_stage (actor);
 
-  /* Start off by treating all windows as completely unobscured, so damage anywhere
-   * in a window queues redraws, but confine it more below. */
-  clutter_actor_iter_init (&iter, actor);
-  while (clutter_actor_iter_next (&iter, &child))
-    {
-      if (META_IS_WINDOW_ACTOR (child))
-        {
-          MetaWindowActor *window_actor = META_WINDOW_ACTOR (child);
-          meta_window_actor_set_unobscured_region (window_actor, NULL);
-        }
-    }
+  start_time = meta_frame_timings_begin_phase ();
 
   /* Normally we expect an actor to be drawn at it's position on the screen.
    * However, if we're inside the paint of a ClutterClone, that won't be the
@@ -130,7 +123,17 @@ meta_window_group_paint (ClutterActor *actor)
   if (!painting_untransformed (window_group, &paint_x_origin, &paint_y_origin) ||
       !meta_actor_is_untransformed (actor, &actor_x_origin, &actor_y_origin))
     {
+      /* We can't tell what is visible, so treat all windows as completely
+       * unobscured; damage anywhere in a window then queues redraws. */
+      clutter_actor_iter_init (&iter, actor);
+      while (clutter_actor_iter_next (&iter, &child))
+        {
+          if (META_IS_WINDOW_ACTOR (child))
+            meta_window_actor_set_unobscured_region (META_WINDOW_ACTOR (child), NULL);
+        }
+
       CLUTTER_ACTOR_CLASS (meta_window_group_parent_class)->paint (actor);
+      meta_frame_timings_end_phase (META_FRAME_PHASE_WINDOW_GROUP_PAINT, start_time);
       return;
     }
 
@@ -154,11 +157,15 @@ meta_window_group_paint (ClutterActor *actor)
 
   clip_region = cairo_region_create_rectangle (&clip_rect);
 
-  if (info->unredirected_window != NULL)
+  for (i = 0; i < info->n_unredirect_monitors; i++)
     {
       cairo_rectangle_int_t unredirected_rect;
-      MetaWindow *window = meta_window_actor_get_meta_window (info->unredirected_window);
+      MetaWindow *window;
+
+      if (info->unredirect_monitors[i].window == NULL)
+        continue;
 
+      window = meta_window_actor_get_meta_window (info->unredirect_monitors[i].window);
       meta_window_get_outer_rect (window, (MetaRectangle *)&unredirected_rect);
       cairo_region_subtract_rectangle (unobscured_region, &unredirected_rect);
       cairo_region_subtract_rectangle (clip_region, &unredirected_rect);
@@ -167,16 +174,24 @@ meta_window_group_paint (ClutterActor *actor)
   /* We walk the list from top to bottom (opposite of painting order),
    * and subtract the opaque area of each window out of the visible
    * region that we pass to the windows below.
+   *
+   * Every window actor gets its unobscured region set here, and it is
+   * not reset after painting: a window stays marked as obscured from
+   * frame to frame, so damage to it isn't applied, until a change in
+   * stacking or geometry uncovers it. Windows we skip are treated as
+   * completely unobscured.
    */
   clutter_actor_iter_init (&iter, actor);
   while (clutter_actor_iter_prev (&iter, &child))
     {
-      if (!CLUTTER_ACTOR_IS_VISIBLE (child))
-        continue;
-
-      if (info->unredirected_window != NULL &&
-          child == CLUTTER_ACTOR (info->unredirected_window))
-        continue;
+      if (!CLUTTER_ACTOR_IS_VISIBLE (child) ||
+          (META_IS_WINDOW_ACTOR (child) &&
+           meta_window_actor_is_unredirected (META_WINDOW_ACTOR (child))))
+        {
+          if (META_IS_WINDOW_ACTOR (child))
+            meta_window_actor_set_unobscured_region (META_WINDOW_ACTOR (child), NULL);
+          continue;
+        }
 
       /* If an actor has effects applied, then that can change the area
        * it paints and the opacity, so we no longer can figure out what
@@ -195,7 +210,11 @@ meta_window_group_paint (ClutterActor *actor)
        * hopes that no-one will do that.
        */
       if (clutter_actor_has_effects (child))
-        continue;
+        {
+          if (META_IS_WINDOW_ACTOR (child))
+            meta_window_actor_set_unobscured_region (META_WINDOW_ACTOR (child), NULL);
+          continue;
+        }
 
       if (META_IS_WINDOW_ACTOR (child))
         {
@@ -203,7 +222,10 @@ meta_window_group_paint (ClutterActor *actor)
           int x, y;
 
           if (!meta_actor_is_untransformed (CLUTTER_ACTOR (window_actor), &x, &y))
-            continue;
+            {
+              meta_window_actor_set_unobscured_region (window_actor, NULL);
+              continue;
+            }
 
           x += paint_x_offset;
           y += paint_y_offset;
@@ -275,6 +297,8 @@ meta_window_group_paint (ClutterActor *actor)
           meta_background_actor_set_clip_region (background_actor, NULL);
         }
     }
+
+  meta_frame_timings_end_phase (META_FRAME_PHASE_WINDOW_GROUP_PAINT, start_time);
 }
 
 static gboolean
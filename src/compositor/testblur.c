@@ -0,0 +1,199 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* Mutter shadow blur benchmark and consistency check */
+
+/*
+ * Copyright (C) 2010 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include "meta-box-blur.h"
+#include "region-utils.h"
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define N_ITERATIONS 20
+
+/* A rectangle with its corners cut off in steps, roughly like a
+ * window with rounded corners */
+static cairo_region_t *
+make_shape_region (int width,
+                   int height,
+                   int corner)
+{
+  cairo_region_t *region = cairo_region_create ();
+  cairo_rectangle_int_t rect;
+  int i;
+
+  for (i = 0; i < corner; i++)
+    {
+      int inset = corner - i;
+
+      rect.x = inset;
+      rect.y = i;
+      rect.width = width - 2 * inset;
+      rect.height = 1;
+      cairo_region_union_rectangle (region, &rect);
+
+      rect.y = height - 1 - i;
+      cairo_region_union_rectangle (region, &rect);
+    }
+
+  rect.x = 0;
+  rect.y = corner;
+  rect.width = width;
+  rect.height = height - 2 * corner;
+  cairo_region_union_rectangle (region, &rect);
+
+  return region;
+}
+
+/* Mirrors the setup done by make_shadow() in meta-shadow-factory.c */
+static guchar *
+blur_shape (cairo_region_t *region,
+            int             radius,
+            int            *buffer_width_out,
+            int            *buffer_height_out)
+{
+  int d = meta_box_blur_get_filter_size (radius);
+  int spread = meta_box_blur_get_spread (radius);
+  cairo_region_t *row_convolve_region;
+  cairo_region_t *column_convolve_region;
+  cairo_rectangle_int_t extents;
+  guchar *buffer;
+  int buffer_width, buffer_height;
+  int n_rectangles, i, j;
+
+  cairo_region_get_extents (region, &extents);
+  buffer_width = (extents.width + 2 * spread + 3) & ~3;
+  buffer_height = (extents.height + 2 * spread + 3) & ~3;
+
+  buffer = g_malloc0 (buffer_width * buffer_height);
+
+  n_rectangles = cairo_region_num_rectangles (region);
+  for (i = 0; i < n_rectangles; i++)
+    {
+      cairo_rectangle_int_t rect;
+
+      cairo_region_get_rectangle (region, i, &rect);
+      for (j = spread + rect.y; j < spread + rect.y + rect.height; j++)
+        memset (buffer + buffer_width * j + spread + rect.x, 255, rect.width);
+    }
+
+  row_convolve_region = meta_make_border_region (region, spread, spread, FALSE);
+  column_convolve_region = meta_make_border_region (region, 0, spread, TRUE);
+
+  buffer = meta_box_blur_region (buffer, buffer_width, buffer_height,
+                                 row_convolve_region, column_convolve_region,
+                                 spread, spread, d);
+
+  cairo_region_destroy (row_convolve_region);
+  cairo_region_destroy (column_convolve_region);
+
+  *buffer_width_out = buffer_width;
+  *buffer_height_out = buffer_height;
+
+  return buffer;
+}
+
+static gboolean
+run_case (int width,
+          int height,
+          int corner,
+          int radius)
+{
+  cairo_region_t *region = make_shape_region (width, height, corner);
+  guchar *reference = NULL;
+  int buffer_width, buffer_height;
+  gboolean ok = TRUE;
+  int backend;
+
+  printf ("%5dx%-5d radius %3d:", width, height, radius);
+
+  for (backend = META_BOX_BLUR_BACKEND_REFERENCE;
+       backend < META_BOX_BLUR_N_BACKENDS;
+       backend++)
+    {
+      guchar *buffer;
+      gint64 start, elapsed;
+      int i;
+
+      if (!meta_box_blur_backend_supported (backend))
+        continue;
+
+      meta_box_blur_set_backend (backend);
+
+      /* Warm up, and keep the result for the comparison */
+      buffer = blur_shape (region, radius, &buffer_width, &buffer_height);
+
+      start = g_get_monotonic_time ();
+      for (i = 0; i < N_ITERATIONS; i++)
+        g_free (blur_shape (region, radius, &buffer_width, &buffer_height));
+      elapsed = g_get_monotonic_time () - start;
+
+      printf ("  %s %7.3fms", meta_box_blur_backend_name (backend),
+              elapsed / (1000. * N_ITERATIONS));
+
+      if (reference == NULL)
+        {
+          reference = buffer;
+        }
+      else
+        {
+          if (memcmp (reference, buffer, buffer_width * buffer_height) != 0)
+            {
+              printf (" (MISMATCH)");
+              ok = FALSE;
+            }
+          g_free (buffer);
+        }
+    }
+
+  printf ("\n");
+
+  g_free (reference);
+  cairo_region_destroy (region);
+
+  return ok;
+}
+
+int
+main (int argc, char **argv)
+{
+  static const int sizes[][2] = {
+    { 64, 64 }, { 400, 300 }, { 1280, 800 }, { 1920, 1080 }, { 3840, 2160 }
+  };
+  static const int radii[] = { 1, 3, 6, 12, 24 };
+  gboolean ok = TRUE;
+  guint i, j;
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++)
+    for (j = 0; j < G_N_ELEMENTS (radii); j++)
+      ok &= run_case (sizes[i][0], sizes[i][1], 8, radii[j]);
+
+  if (!ok)
+    {
+      printf ("Backends produced different output!\n");
+      return 1;
+    }
+
+  printf ("All backends agree.\n");
+  return 0;
+}
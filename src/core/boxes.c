@@ -33,6 +33,7 @@
 #include "boxes-private.h"
 #include <meta/util.h>
 #include <X11/Xutil.h>  /* Just for the definition of the various gravities */
+#include <stdlib.h>     /* For qsort() and bsearch() */
 
 /* It would make sense to use GSlice here, but until we clean up the
  * rest of this file and the internal API to use these functions, we
@@ -425,127 +426,62 @@ meta_rectangle_resize_with_gravity (const MetaRectangle *old_rect,
   rect->height = new_height;
 }
 
-/* Not so simple helper function for get_minimal_spanning_set_for_region() */
-static GList*
-merge_spanning_rects_in_region (GList *region)
+/* Helpers for get_minimal_spanning_set_for_region() */
+static int
+compare_ints (const void *a, const void *b)
 {
-  /* NOTE FOR ANY OPTIMIZATION PEOPLE OUT THERE: Please see the
-   * documentation of get_minimal_spanning_set_for_region() for performance
-   * considerations that also apply to this function.
-   */
-
-  GList* compare;
-  compare = region;
+  int a_int = *(const int *) a;
+  int b_int = *(const int *) b;
 
-  if (region == NULL)
-    {
-      meta_warning ("Region to merge was empty!  Either you have a some "
-                    "pathological STRUT list or there's a bug somewhere!\n");
-      return NULL;
-    }
-
-  while (compare && compare->next)
-    {
-      MetaRectangle *a = compare->data;
-      GList *other = compare->next;
-
-      g_assert (a->width > 0 && a->height > 0);
-
-      while (other)
-        {
-          MetaRectangle *b = other->data;
-          GList *delete_me = NULL;
-
-          g_assert (b->width > 0 && b->height > 0);
+  return (a_int > b_int) - (a_int < b_int);
+}
 
-          /* If a contains b, just remove b */
-          if (meta_rectangle_contains_rect (a, b))
-            {
-              delete_me = other;
-            }
-          /* If b contains a, just remove a */
-          else if (meta_rectangle_contains_rect (a, b))
-            {
-              delete_me = compare;
-            }
-          /* If a and b might be mergeable horizontally */
-          else if (a->y == b->y && a->height == b->height)
-            {
-              /* If a and b overlap */
-              if (meta_rectangle_overlap (a, b))
-                {
-                  int new_x = MIN (a->x, b->x);
-                  a->width = MAX (a->x + a->width, b->x + b->width) - new_x;
-                  a->x = new_x;
-                  delete_me = other;
-                }
-              /* If a and b are adjacent */
-              else if (a->x + a->width == b->x || a->x == b->x + b->width)
-                {
-                  int new_x = MIN (a->x, b->x);
-                  a->width = MAX (a->x + a->width, b->x + b->width) - new_x;
-                  a->x = new_x;
-                  delete_me = other;
-                }
-            }
-          /* If a and b might be mergeable vertically */
-          else if (a->x == b->x && a->width == b->width)
-            {
-              /* If a and b overlap */
-              if (meta_rectangle_overlap (a, b))
-                {
-                  int new_y = MIN (a->y, b->y);
-                  a->height = MAX (a->y + a->height, b->y + b->height) - new_y;
-                  a->y = new_y;
-                  delete_me = other;
-                }
-              /* If a and b are adjacent */
-              else if (a->y + a->height == b->y || a->y == b->y + b->height)
-                {
-                  int new_y = MIN (a->y, b->y);
-                  a->height = MAX (a->y + a->height, b->y + b->height) - new_y;
-                  a->y = new_y;
-                  delete_me = other;
-                }
-            }
+/* Sorts @values and drops duplicates; returns how many are left */
+static int
+sort_unique_ints (int *values,
+                  int  n_values)
+{
+  int i, n_unique;
 
-          other = other->next;
+  qsort (values, n_values, sizeof (int), compare_ints);
 
-          /* Delete any rectangle in the list that is no longer wanted */
-          if (delete_me != NULL)
-            {
-              /* Deleting the rect we compare others to is a little tricker */
-              if (compare == delete_me)
-                {
-                  compare = compare->next;
-                  other = compare->next;
-                  a = compare->data;
-                }
+  n_unique = 0;
+  for (i = 0; i < n_values; i++)
+    if (n_unique == 0 || values[n_unique - 1] != values[i])
+      values[n_unique++] = values[i];
 
-              /* Okay, we can free it now */
-              g_free (delete_me->data);
-              region = g_list_delete_link (region, delete_me);
-            }
+  return n_unique;
+}
 
-        }
+/* Index of @value, which must be present, in the sorted @values */
+static int
+find_int (const int *values,
+          int        n_values,
+          int        value)
+{
+  const int *found;
 
-      compare = compare->next;
-    }
+  found = bsearch (&value, values, n_values, sizeof (int), compare_ints);
+  g_assert (found != NULL);
 
-  return region;
+  return found - values;
 }
 
-/* Simple helper function for get_minimal_spanning_set_for_region()... */
-static gint
-compare_rect_areas (gconstpointer a, gconstpointer b)
+static int
+compare_rect_areas (const void *a, const void *b)
 {
-  const MetaRectangle *a_rect = (gconstpointer) a;
-  const MetaRectangle *b_rect = (gconstpointer) b;
+  const MetaRectangle *a_rect = a;
+  const MetaRectangle *b_rect = b;
 
   int a_area = meta_rectangle_area (a_rect);
   int b_area = meta_rectangle_area (b_rect);
 
-  return b_area - a_area; /* positive ret value denotes b > a, ... */
+  /* Biggest first; the rest only makes the order predictable */
+  if (a_area != b_area)
+    return b_area - a_area;
+  if (a_rect->y != b_rect->y)
+    return a_rect->y - b_rect->y;
+  return a_rect->x - b_rect->x;
 }
 
 /**
@@ -573,127 +509,195 @@ meta_rectangle_get_minimal_spanning_set_for_region (
   const MetaRectangle *basic_rect,
   const GSList  *all_struts)
 {
-  /* NOTE FOR OPTIMIZERS: This function *might* be somewhat slow,
-   * especially due to the call to merge_spanning_rects_in_region() (which
-   * is O(n^2) where n is the size of the list generated in this function).
-   * This is made more onerous due to the fact that it involves a fair
-   * number of memory allocation and deallocation calls.  However, n is 1
-   * for default installations of Gnome (because partial struts aren't used
-   * by default and only partial struts increase the size of the spanning
-   * set generated).  With one partial strut, n will be 2 or 3.  With 2
-   * partial struts, n will probably be 4 or 5.  So, n probably isn't large
-   * enough to make this worth bothering.  Further, it is only called from
-   * workspace.c:ensure_work_areas_validated (at least as of the time of
-   * writing this comment), which in turn should only be called if the
-   * strut list changes or the screen or monitor size changes.  If it ever
-   * does show up on profiles (most likely because people start using
-   * ridiculously huge numbers of partial struts), possible optimizations
-   * include:
+  /* The rectangles we want are exactly the maximal rectangles inside
+   * the region: ones that can't grow in any direction without covering
+   * part of a strut or leaving basic_rect.
+   *
+   * The edges of basic_rect and of the struts split basic_rect into a
+   * grid of cells, each of which is either covered by a strut or not,
+   * and every maximal rectangle is made of whole cells. So we sweep
+   * down the rows of the grid, keeping for each column the number of
+   * free cells above and including the current row. A maximal
+   * rectangle whose bottom edge is in the current row is then a run of
+   * columns as wide as possible for the smallest height in it, found
+   * with a stack as in the "largest rectangle in a histogram" problem,
+   * that also can't grow downwards.
    *
-   * (1) rewrite merge_spanning_rects_in_region() to be O(n) or O(nlogn).
-   *     I'm not totally sure it's possible, but with a couple copies of
-   *     the list and sorting them appropriately, I believe it might be.
-   * (2) only call merge_spanning_rects_in_region() with a subset of the
-   *     full list of rectangles.  I believe from some of my preliminary
-   *     debugging and thinking about it that it is possible to figure out
-   *     apriori groups of rectangles which are only merge candidates with
-   *     each other.  (See testboxes.c:get_screen_region() when which==2
-   *     and track the steps of this function carefully to see what gave
-   *     me the hint that this might work)
-   * (3) figure out how to avoid merge_spanning_rects_in_region().  I think
-   *     it might be possible to modify this function to make that
-   *     possible, and I spent just a little while thinking about it, but n
-   *     wasn't large enough to convince me to care yet.
-   * (4) Some of the stuff Rob mentioned at http://mail.gnome.org/archives\
-   *     /metacity-devel-list/2005-November/msg00028.html.  (Sorry for the
-   *     URL splitting.)
+   * With n struts the grid has O(n^2) cells, and this takes time
+   * linear in the number of cells.
    */
 
+  MetaRectangle *struts;
+  int            n_struts;
+  int           *xs, *ys;
+  int            n_xs, n_ys;
+  int            n_cols, n_rows, stride;
+  int           *covered;
+  int           *heights;
+  int           *blocked_below;
+  int           *stack_start, *stack_height;
+  GArray        *spans;
   GList         *ret;
-  GList         *tmp_list;
   const GSList  *strut_iter;
-  MetaRectangle *temp_rect;
+  int            row, col, i;
 
-  /* The algorithm is basically as follows:
-   *   Initialize rectangle_set to basic_rect
-   *   Foreach strut:
-   *     Foreach rectangle in rectangle_set:
-   *       - Split the rectangle into new rectangles that don't overlap the
-   *         strut (but which are as big as possible otherwise)
-   *       - Remove the old (pre-split) rectangle from the rectangle_set,
-   *         and replace it with the new rectangles generated from the
-   *         splitting
-   */
+  n_struts = g_slist_length ((GSList *) all_struts);
+  struts = g_new (MetaRectangle, MAX (n_struts, 1));
+  xs = g_new (int, 2 * n_struts + 2);
+  ys = g_new (int, 2 * n_struts + 2);
 
-  temp_rect = g_new (MetaRectangle, 1);
-  *temp_rect = *basic_rect;
-  ret = g_list_prepend (NULL, temp_rect);
+  xs[0] = BOX_LEFT (*basic_rect);
+  xs[1] = BOX_RIGHT (*basic_rect);
+  ys[0] = BOX_TOP (*basic_rect);
+  ys[1] = BOX_BOTTOM (*basic_rect);
+  n_xs = n_ys = 2;
 
+  /* Only the parts of the struts inside basic_rect matter */
+  i = 0;
   for (strut_iter = all_struts; strut_iter; strut_iter = strut_iter->next)
     {
-      GList *rect_iter; 
       MetaRectangle *strut_rect = &((MetaStrut*)strut_iter->data)->rect;
 
-      tmp_list = ret;
-      ret = NULL;
-      rect_iter = tmp_list;
-      while (rect_iter)
+      if (!meta_rectangle_intersect (basic_rect, strut_rect, &struts[i]))
+        continue;
+
+      xs[n_xs++] = BOX_LEFT (struts[i]);
+      xs[n_xs++] = BOX_RIGHT (struts[i]);
+      ys[n_ys++] = BOX_TOP (struts[i]);
+      ys[n_ys++] = BOX_BOTTOM (struts[i]);
+      i++;
+    }
+  n_struts = i;
+
+  n_xs = sort_unique_ints (xs, n_xs);
+  n_ys = sort_unique_ints (ys, n_ys);
+  n_cols = n_xs - 1;
+  n_rows = n_ys - 1;
+
+  /* Count the struts covering each cell: mark the corners of each
+   * strut in a difference array, then sum it up in both directions.
+   */
+  stride = n_cols + 1;
+  covered = g_new0 (int, (n_rows + 1) * stride);
+  for (i = 0; i < n_struts; i++)
+    {
+      int col1 = find_int (xs, n_xs, BOX_LEFT (struts[i]));
+      int col2 = find_int (xs, n_xs, BOX_RIGHT (struts[i]));
+      int row1 = find_int (ys, n_ys, BOX_TOP (struts[i]));
+      int row2 = find_int (ys, n_ys, BOX_BOTTOM (struts[i]));
+
+      covered[row1 * stride + col1]++;
+      covered[row1 * stride + col2]--;
+      covered[row2 * stride + col1]--;
+      covered[row2 * stride + col2]++;
+    }
+
+  for (row = 0; row <= n_rows; row++)
+    for (col = 0; col <= n_cols; col++)
+      {
+        int *cell = &covered[row * stride + col];
+
+        if (row > 0)
+          *cell += cell[-stride];
+        if (col > 0)
+          *cell += cell[-1];
+        if (row > 0 && col > 0)
+          *cell -= cell[-stride - 1];
+      }
+
+#define CELL_IS_COVERED(row, col) (covered[(row) * stride + (col)] > 0)
+
+  heights = g_new0 (int, n_cols);
+  blocked_below = g_new (int, n_cols + 1);
+  stack_start = g_new (int, n_cols + 1);
+  stack_height = g_new (int, n_cols + 1);
+  spans = g_array_new (FALSE, FALSE, sizeof (MetaRectangle));
+
+  for (row = 0; row < n_rows; row++)
+    {
+      int depth;
+
+      for (col = 0; col < n_cols; col++)
+        heights[col] = CELL_IS_COVERED (row, col) ? 0 : heights[col] + 1;
+
+      /* blocked_below[col] is the number of covered cells in the next
+       * row left of col; the bottom edge of basic_rect blocks all of
+       * them.
+       */
+      blocked_below[0] = 0;
+      for (col = 0; col < n_cols; col++)
+        blocked_below[col + 1] = blocked_below[col] +
+          (row == n_rows - 1 || CELL_IS_COVERED (row + 1, col));
+
+      /* The stack holds runs of columns of increasing height; an
+       * extra column of height 0 at the end empties it.
+       */
+      depth = 0;
+      for (col = 0; col <= n_cols; col++)
         {
-          MetaRectangle *rect = (MetaRectangle*) rect_iter->data;
-          if (!meta_rectangle_overlap (rect, strut_rect))
-            ret = g_list_prepend (ret, rect);
-          else
+          int height = col < n_cols ? heights[col] : 0;
+          int start = col;
+
+          while (depth > 0 && stack_height[depth - 1] > height)
             {
-              /* If there is area in rect left of strut */
-              if (BOX_LEFT (*rect) < BOX_LEFT (*strut_rect))
-                {
-                  temp_rect = g_new (MetaRectangle, 1);
-                  *temp_rect = *rect;
-                  temp_rect->width = BOX_LEFT (*strut_rect) - BOX_LEFT (*rect);
-                  ret = g_list_prepend (ret, temp_rect);
-                }
-              /* If there is area in rect right of strut */
-              if (BOX_RIGHT (*rect) > BOX_RIGHT (*strut_rect))
-                {
-                  int new_x;
-                  temp_rect = g_new (MetaRectangle, 1);
-                  *temp_rect = *rect;
-                  new_x = BOX_RIGHT (*strut_rect);
-                  temp_rect->width = BOX_RIGHT(*rect) - new_x;
-                  temp_rect->x = new_x;
-                  ret = g_list_prepend (ret, temp_rect);
-                }
-              /* If there is area in rect above strut */
-              if (BOX_TOP (*rect) < BOX_TOP (*strut_rect))
-                {
-                  temp_rect = g_new (MetaRectangle, 1);
-                  *temp_rect = *rect;
-                  temp_rect->height = BOX_TOP (*strut_rect) - BOX_TOP (*rect);
-                  ret = g_list_prepend (ret, temp_rect);
-                }
-              /* If there is area in rect below strut */
-              if (BOX_BOTTOM (*rect) > BOX_BOTTOM (*strut_rect))
+              depth--;
+              start = stack_start[depth];
+
+              /* Columns start to col - 1 at stack_height[depth] tall
+               * is as wide as it can be; it's maximal if it can't go
+               * down either.
+               */
+              if (blocked_below[col] > blocked_below[start])
                 {
-                  int new_y;
-                  temp_rect = g_new (MetaRectangle, 1);
-                  *temp_rect = *rect;
-                  new_y = BOX_BOTTOM (*strut_rect);
-                  temp_rect->height = BOX_BOTTOM (*rect) - new_y;
-                  temp_rect->y = new_y;
-                  ret = g_list_prepend (ret, temp_rect);
+                  MetaRectangle span;
+                  int top_row = row + 1 - stack_height[depth];
+
+                  span.x = xs[start];
+                  span.y = ys[top_row];
+                  span.width = xs[col] - xs[start];
+                  span.height = ys[row + 1] - ys[top_row];
+                  g_array_append_val (spans, span);
                 }
-              g_free (rect);
             }
-          rect_iter = rect_iter->next;
+
+          if (height > 0 &&
+              (depth == 0 || stack_height[depth - 1] < height))
+            {
+              stack_start[depth] = start;
+              stack_height[depth] = height;
+              depth++;
+            }
         }
-      g_list_free (tmp_list);
     }
 
+#undef CELL_IS_COVERED
+
+  g_free (struts);
+  g_free (xs);
+  g_free (ys);
+  g_free (covered);
+  g_free (heights);
+  g_free (blocked_below);
+  g_free (stack_start);
+  g_free (stack_height);
+
+  if (spans->len == 0)
+    meta_warning ("Region to merge was empty!  Either you have a some "
+                  "pathological STRUT list or there's a bug somewhere!\n");
+
   /* Sort by maximal area, just because I feel like it... */
-  ret = g_list_sort (ret, compare_rect_areas);
+  g_array_sort (spans, compare_rect_areas);
+
+  ret = NULL;
+  for (i = (int) spans->len - 1; i >= 0; i--)
+    {
+      MetaRectangle *temp_rect = g_new (MetaRectangle, 1);
+
+      *temp_rect = g_array_index (spans, MetaRectangle, i);
+      ret = g_list_prepend (ret, temp_rect);
+    }
 
-  /* Merge rectangles if possible so that the list really is minimal */
-  ret = merge_spanning_rects_in_region (ret);
+  g_array_free (spans, TRUE);
 
   return ret;
 }
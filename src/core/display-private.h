@@ -37,6 +37,7 @@
 #include <meta/boxes.h>
 #include <meta/display.h>
 #include "keybindings-private.h"
+#include "keybinding-index.h"
 #include <meta/prefs.h>
 #include <meta/barrier.h>
 
@@ -226,6 +227,7 @@ struct _MetaDisplay
   /* Keybindings stuff */
   MetaKeyBinding *key_bindings;
   int             n_key_bindings;
+  MetaKeyBindingIndex *key_bindings_index;
   int             min_keycode;
   int             max_keycode;
   KeySym *keymap;
@@ -263,6 +265,14 @@ struct _MetaDisplay
   MetaWindowPropHooks *prop_hooks_table;
   GHashTable *prop_hooks;
   int n_prop_hooks;
+  GHashTable *prefetched_properties;
+  GSList *property_notify_windows;
+  guint property_notify_idle_id;
+  GHashTable *property_notify_stats;
+
+  /* Managed by xprops.c */
+  GQueue prop_fetches;
+  GSource *prop_fetch_source;
 
   /* Managed by group-props.c */
   MetaGroupPropHooks *group_prop_hooks;
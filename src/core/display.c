@@ -1139,6 +1139,7 @@ meta_display_close (MetaDisplay *display,
 
   meta_display_free_window_prop_hooks (display);
   meta_display_free_group_prop_hooks (display);
+  meta_prop_free_value_fetches (display);
   
   g_free (display->name);
 
@@ -2173,6 +2174,20 @@ event_callback (XEvent   *event,
   monitor = meta_monitor_manager_get ();
   if (meta_monitor_manager_handle_xevent (monitor, event))
     return FALSE;
+
+  /* Property changes are reloaded in a batch after the events that
+   * arrived together with them, but anything else might depend on
+   * their values (a _NET_ACTIVE_WINDOW message on the user time, a
+   * ConfigureRequest on the size hints, ...) so catch up first.
+   * Titles and the like are fetched asynchronously and don't hold
+   * anything up.
+   * Damage events are too frequent to let them split up the batch,
+   * and don't look at window properties.
+   */
+  if (event->type != PropertyNotify &&
+      !(display->damage_event_base != 0 &&
+        event->type == display->damage_event_base + XDamageNotify))
+    meta_display_flush_property_notifies (display);
   
   bypass_compositor = FALSE;
   filter_out_event = FALSE;
@@ -26,6 +26,10 @@
 
 #include "window-private.h"
 
+typedef struct _MetaWindowEdgeCache MetaWindowEdgeCache;
+
+void        meta_window_edge_cache_free            (MetaWindowEdgeCache *cache);
+
 void        meta_window_edge_resistance_for_move   (MetaWindow  *window,
                                                     int          old_x,
                                                     int          old_y,
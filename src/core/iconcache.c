@@ -27,6 +27,7 @@
 #include <meta/errors.h>
 
 #include <X11/Xatom.h>
+#include <string.h>
 
 /* The icon-reading code is also in libwnck, please sync bugfixes */
 
@@ -46,85 +47,65 @@ get_fallback_icons (MetaScreen     *screen,
   *mini_iconp = meta_ui_get_default_mini_icon (screen->ui);
 }
 
+/* Where one image in a _NET_WM_ICON property is; offset is that of
+ * the pixels (past the width and height), in 32-bit items.
+ */
+typedef struct
+{
+  int    width;
+  int    height;
+  gulong offset;
+} IconImage;
+
 static gboolean
-find_largest_sizes (gulong *data,
-                    gulong  nitems,
-                    int    *width,
-                    int    *height)
+find_largest_sizes (IconImage *images,
+                    int        n_images,
+                    int       *width,
+                    int       *height)
 {
+  int i;
+
   *width = 0;
   *height = 0;
 
-  while (nitems > 0)
+  for (i = 0; i < n_images; i++)
     {
-      int w, h;
-
-      if (nitems < 3)
-        return FALSE; /* no space for w, h */
-
-      w = data[0];
-      h = data[1];
-
-      if (nitems < ((gulong)(w * h) + 2))
-        return FALSE; /* not enough data */
-
-      *width = MAX (w, *width);
-      *height = MAX (h, *height);
-
-      data += (w * h) + 2;
-      nitems -= (w * h) + 2;
+      *width = MAX (images[i].width, *width);
+      *height = MAX (images[i].height, *height);
     }
 
   return TRUE;
 }
 
-static gboolean
-find_best_size (gulong  *data,
-                gulong   nitems,
-                int      ideal_width,
-                int      ideal_height,
-                int     *width,
-                int     *height,
-                gulong **start)
+static IconImage *
+find_best_size (IconImage *images,
+                int        n_images,
+                int        ideal_width,
+                int        ideal_height)
 {
-  int best_w;
-  int best_h;
-  gulong *best_start;
+  IconImage *best;
   int max_width, max_height;
+  int i;
 
-  *width = 0;
-  *height = 0;
-  *start = NULL;
-
-  if (!find_largest_sizes (data, nitems, &max_width, &max_height))
-    return FALSE;
+  if (!find_largest_sizes (images, n_images, &max_width, &max_height))
+    return NULL;
 
   if (ideal_width < 0)
     ideal_width = max_width;
   if (ideal_height < 0)
     ideal_height = max_height;
 
-  best_w = 0;
-  best_h = 0;
-  best_start = NULL;
+  best = NULL;
 
-  while (nitems > 0)
+  for (i = 0; i < n_images; i++)
     {
-      int w, h;
+      int w = images[i].width;
+      int h = images[i].height;
       gboolean replace;
 
       replace = FALSE;
 
-      if (nitems < 3)
-        return FALSE; /* no space for w, h */
-
-      w = data[0];
-      h = data[1];
-
-      if (nitems < ((gulong)(w * h) + 2))
-        break; /* not enough data */
-
-      if (best_start == NULL)
+      if (best == NULL)
         {
           replace = TRUE;
         }
@@ -132,7 +113,7 @@ find_best_size (gulong  *data,
         {
           /* work with averages */
           const int ideal_size = (ideal_width + ideal_height) / 2;
-          int best_size = (best_w + best_h) / 2;
+          int best_size = (best->width + best->height) / 2;
           int this_size = (w + h) / 2;
 
           /* larger than desired is always better than smaller */
@@ -153,25 +134,10 @@ find_best_size (gulong  *data,
         }
 
       if (replace)
-        {
-          best_start = data + 2;
-          best_w = w;
-          best_h = h;
-        }
-
-      data += (w * h) + 2;
-      nitems -= (w * h) + 2;
+        best = &images[i];
     }
 
-  if (best_start)
-    {
-      *start = best_start;
-      *width = best_w;
-      *height = best_h;
-      return TRUE;
-    }
-  else
-    return FALSE;
+  return best;
 }
 
 static void
@@ -206,31 +172,150 @@ argbdata_to_pixdata (gulong *argb_data, int len, guchar **pixdata)
     }
 }
 
+static GdkPixbuf* scaled_from_pixdata (guchar *pixdata,
+                                       int     w,
+                                       int     h,
+                                       int     new_w,
+                                       int     new_h);
+
+/* Icons made from _NET_WM_ICON data, looked up by the image they were
+ * made from and the size they were scaled to, so that windows with the
+ * same icon (all the windows of an application, usually) share one
+ * pixbuf rather than each converting and scaling their own copy. The
+ * pool doesn't hold references; entries go away with their pixbuf.
+ */
+typedef struct
+{
+  guint    hash;
+  int      width;
+  int      height;
+  int      scaled_width;
+  int      scaled_height;
+  guint32 *pixels;
+} IconPoolKey;
+
+static GHashTable *icon_pool = NULL;
+
+static guint
+icon_pool_key_hash (gconstpointer key)
+{
+  return ((const IconPoolKey *) key)->hash;
+}
+
 static gboolean
-read_rgb_icon (MetaDisplay   *display,
-               Window         xwindow,
-               int            ideal_width,
-               int            ideal_height,
-               int            ideal_mini_width,
-               int            ideal_mini_height,
-               int           *width,
-               int           *height,
-               guchar       **pixdata,
-               int           *mini_width,
-               int           *mini_height,
-               guchar       **mini_pixdata)
+icon_pool_key_equal (gconstpointer a,
+                     gconstpointer b)
+{
+  const IconPoolKey *key_a = a;
+  const IconPoolKey *key_b = b;
+
+  return key_a->hash == key_b->hash &&
+         key_a->width == key_b->width &&
+         key_a->height == key_b->height &&
+         key_a->scaled_width == key_b->scaled_width &&
+         key_a->scaled_height == key_b->scaled_height &&
+         memcmp (key_a->pixels, key_b->pixels,
+                 key_a->width * key_a->height * sizeof (guint32)) == 0;
+}
+
+static void
+icon_pool_key_free (gpointer data)
+{
+  IconPoolKey *key = data;
+
+  g_free (key->pixels);
+  g_slice_free (IconPoolKey, key);
+}
+
+static void
+icon_pool_pixbuf_finalized (gpointer  data,
+                            GObject  *where_the_object_was)
+{
+  g_hash_table_remove (icon_pool, data);
+}
+
+static GdkPixbuf *
+icon_from_argb (gulong *argb_data,
+                int     width,
+                int     height,
+                int     scaled_width,
+                int     scaled_height)
+{
+  IconPoolKey *key;
+  GdkPixbuf *pixbuf;
+  guchar *pixdata;
+  guint32 hash = 2166136261u;
+  int i, n_pixels;
+
+  if (icon_pool == NULL)
+    icon_pool = g_hash_table_new_full (icon_pool_key_hash,
+                                       icon_pool_key_equal,
+                                       icon_pool_key_free,
+                                       NULL);
+
+  /* The property data comes as longs; keep the 32 bits that matter */
+  n_pixels = width * height;
+  key = g_slice_new (IconPoolKey);
+  key->width = width;
+  key->height = height;
+  key->scaled_width = scaled_width;
+  key->scaled_height = scaled_height;
+  key->pixels = g_new (guint32, n_pixels);
+  for (i = 0; i < n_pixels; i++)
+    {
+      key->pixels[i] = argb_data[i];
+      hash = (hash ^ key->pixels[i]) * 16777619u;
+    }
+  key->hash = hash ^ (width << 16) ^ height;
+
+  pixbuf = g_hash_table_lookup (icon_pool, key);
+  if (pixbuf != NULL)
+    {
+      icon_pool_key_free (key);
+      return g_object_ref (pixbuf);
+    }
+
+  argbdata_to_pixdata (argb_data, n_pixels, &pixdata);
+  pixbuf = scaled_from_pixdata (pixdata, width, height,
+                                scaled_width, scaled_height);
+  if (pixbuf == NULL)
+    {
+      icon_pool_key_free (key);
+      return NULL;
+    }
+
+  meta_verbose ("Converted %dx%d _NET_WM_ICON image to %dx%d "
+                "(%u icons in pool)\n",
+                width, height, scaled_width, scaled_height,
+                g_hash_table_size (icon_pool) + 1);
+
+  g_hash_table_insert (icon_pool, key, pixbuf);
+  g_object_weak_ref (G_OBJECT (pixbuf), icon_pool_pixbuf_finalized, key);
+
+  return pixbuf;
+}
+
+/* How much of _NET_WM_ICON is asked for in the first request, in
+ * 32-bit items. Properties that fit are read in one round trip; for
+ * bigger ones, with many large images, the rest is read a header at a
+ * time, and then only the images that are actually used.
+ */
+#define NET_WM_ICON_FIRST_CHUNK (16 * 1024)
+
+static gboolean
+get_net_wm_icon_items (MetaDisplay *display,
+                       Window       xwindow,
+                       gulong       offset,
+                       gulong       length,
+                       gulong     **items,
+                       gulong      *n_items,
+                       gulong      *n_remaining)
 {
   Atom type;
   int format;
-  gulong nitems;
   gulong bytes_after;
   int result, err;
   guchar *data;
-  gulong *best;
-  int w, h;
-  gulong *best_mini;
-  int mini_w, mini_h;
-  gulong *data_as_long;
 
   meta_error_trap_push_with_return (display);
   type = None;
@@ -238,8 +323,8 @@ read_rgb_icon (MetaDisplay   *display,
   result = XGetWindowProperty (display->xdisplay,
 			       xwindow,
                                display->atom__NET_WM_ICON,
-			       0, G_MAXLONG,
-			       False, XA_CARDINAL, &type, &format, &nitems,
+			       offset, length,
+			       False, XA_CARDINAL, &type, &format, n_items,
 			       &bytes_after, &data);
   err = meta_error_trap_pop_with_return (display);
 
@@ -247,40 +332,165 @@ read_rgb_icon (MetaDisplay   *display,
       result != Success)
     return FALSE;
 
-  if (type != XA_CARDINAL)
+  if (type != XA_CARDINAL || format != 32)
     {
-      XFree (data);
+      if (data)
+        XFree (data);
       return FALSE;
     }
 
-  data_as_long = (gulong *)data;
+  *items = (gulong *)data;
+  if (n_remaining)
+    *n_remaining = bytes_after / 4;
+
+  return TRUE;
+}
+
+/* Finds the images in the property, given its first n_chunk items.
+ * Returns NULL if the property is malformed.
+ */
+static GArray *
+read_icon_headers (MetaDisplay *display,
+                   Window       xwindow,
+                   gulong      *chunk,
+                   gulong       n_chunk,
+                   gulong       n_total)
+{
+  GArray *images;
+  gulong pos;
 
-  if (!find_best_size (data_as_long, nitems,
-                       ideal_width, ideal_height,
-                       &w, &h, &best))
+  images = g_array_new (FALSE, FALSE, sizeof (IconImage));
+
+  pos = 0;
+  while (pos < n_total)
     {
-      XFree (data);
-      return FALSE;
+      IconImage image;
+      gulong w, h;
+
+      if (n_total - pos < 3)
+        goto malformed; /* no space for w, h */
+
+      if (pos + 2 <= n_chunk)
+        {
+          w = chunk[pos];
+          h = chunk[pos + 1];
+        }
+      else
+        {
+          gulong *header;
+          gulong n_items;
+
+          if (!get_net_wm_icon_items (display, xwindow, pos, 2,
+                                      &header, &n_items, NULL))
+            goto malformed;
+
+          if (n_items < 2)
+            {
+              XFree (header);
+              goto malformed;
+            }
+
+          w = header[0];
+          h = header[1];
+          XFree (header);
+        }
+
+      if (w > G_MAXINT16 || h > G_MAXINT16 ||
+          n_total - pos - 2 < w * h)
+        goto malformed; /* not enough data */
+
+      image.width = w;
+      image.height = h;
+      image.offset = pos + 2;
+      g_array_append_val (images, image);
+
+      pos += (w * h) + 2;
     }
 
-  if (!find_best_size (data_as_long, nitems,
-                       ideal_mini_width, ideal_mini_height,
-                       &mini_w, &mini_h, &best_mini))
+  return images;
+
+ malformed:
+  g_array_free (images, TRUE);
+  return NULL;
+}
+
+static GdkPixbuf *
+icon_from_image (MetaDisplay *display,
+                 Window       xwindow,
+                 gulong      *chunk,
+                 gulong       n_chunk,
+                 IconImage   *image,
+                 int          ideal_width,
+                 int          ideal_height)
+{
+  gulong n_pixels = image->width * image->height;
+  GdkPixbuf *pixbuf;
+  gulong *pixels;
+  gulong n_items;
+
+  if (image->offset + n_pixels <= n_chunk)
+    return icon_from_argb (chunk + image->offset,
+                           image->width, image->height,
+                           ideal_width, ideal_height);
+
+  if (!get_net_wm_icon_items (display, xwindow, image->offset, n_pixels,
+                              &pixels, &n_items, NULL))
+    return NULL;
+
+  if (n_items < n_pixels)
+    pixbuf = NULL;
+  else
+    pixbuf = icon_from_argb (pixels,
+                             image->width, image->height,
+                             ideal_width, ideal_height);
+  XFree (pixels);
+
+  return pixbuf;
+}
+
+static gboolean
+read_rgb_icon (MetaDisplay   *display,
+               Window         xwindow,
+               int            ideal_width,
+               int            ideal_height,
+               int            ideal_mini_width,
+               int            ideal_mini_height,
+               GdkPixbuf    **iconp,
+               GdkPixbuf    **mini_iconp)
+{
+  gulong *chunk;
+  gulong n_chunk, n_remaining;
+  GArray *images;
+  IconImage *best;
+  IconImage *best_mini;
+
+  if (!get_net_wm_icon_items (display, xwindow,
+                              0, NET_WM_ICON_FIRST_CHUNK,
+                              &chunk, &n_chunk, &n_remaining))
+    return FALSE;
+
+  images = read_icon_headers (display, xwindow,
+                              chunk, n_chunk, n_chunk + n_remaining);
+  if (images == NULL || images->len == 0)
     {
-      XFree (data);
+      if (images)
+        g_array_free (images, TRUE);
+      XFree (chunk);
       return FALSE;
     }
 
-  *width = w;
-  *height = h;
-
-  *mini_width = mini_w;
-  *mini_height = mini_h;
+  best = find_best_size ((IconImage *)images->data, images->len,
+                         ideal_width, ideal_height);
+  best_mini = find_best_size ((IconImage *)images->data, images->len,
+                              ideal_mini_width, ideal_mini_height);
 
-  argbdata_to_pixdata (best, w * h, pixdata);
-  argbdata_to_pixdata (best_mini, mini_w * mini_h, mini_pixdata);
+  *iconp = icon_from_image (display, xwindow, chunk, n_chunk,
+                            best, ideal_width, ideal_height);
+  *mini_iconp = icon_from_image (display, xwindow, chunk, n_chunk,
+                                 best_mini, ideal_mini_width, ideal_mini_height);
 
-  XFree (data);
+  g_array_free (images, TRUE);
+  XFree (chunk);
 
   return TRUE;
 }
@@ -717,10 +927,6 @@ meta_read_icons (MetaScreen     *screen,
                  int             ideal_mini_width,
                  int             ideal_mini_height)
 {
-  guchar *pixdata;
-  int w, h;
-  guchar *mini_pixdata;
-  int mini_w, mini_h;
   Pixmap pixmap;
   Pixmap mask;
 
@@ -747,8 +953,6 @@ meta_read_icons (MetaScreen     *screen,
   if (!meta_icon_cache_get_icon_invalidated (icon_cache))
     return FALSE; /* we have no new info to use */
 
-  pixdata = NULL;
-
   /* Our algorithm here assumes that we can't have for example origin
    * < USING_NET_WM_ICON and icon_cache->net_wm_icon_dirty == FALSE
    * unless we have tried to read NET_WM_ICON.
@@ -767,15 +971,8 @@ meta_read_icons (MetaScreen     *screen,
       if (read_rgb_icon (screen->display, xwindow,
                          ideal_width, ideal_height,
                          ideal_mini_width, ideal_mini_height,
-                         &w, &h, &pixdata,
-                         &mini_w, &mini_h, &mini_pixdata))
+                         iconp, mini_iconp))
         {
-          *iconp = scaled_from_pixdata (pixdata, w, h,
-                                        ideal_width, ideal_height);
-
-          *mini_iconp = scaled_from_pixdata (mini_pixdata, mini_w, mini_h,
-                                             ideal_mini_width, ideal_mini_height);
-
           if (*iconp && *mini_iconp)
             {
               replace_cache (icon_cache, USING_NET_WM_ICON,
@@ -0,0 +1,346 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <config.h>
+#include "keybinding-index.h"
+
+#include <string.h>
+
+/* The hash table is open-addressed with linear probing. Each slot
+ * holds the table index of the first binding of a chain, plus one,
+ * so that zero can mean an empty slot; SLOT_DELETED marks a slot
+ * whose chain went away and that probes must step over. The rest of
+ * each chain is threaded through next[], in ascending table order.
+ */
+#define SLOT_EMPTY    0
+#define SLOT_DELETED -1
+
+#define MIN_SLOTS 16
+
+struct _MetaKeyBindingIndex
+{
+  int  *slots;
+  guint n_slots;     /* always a power of two */
+  guint n_chains;    /* slots holding a chain */
+  guint n_deleted;   /* slots that are SLOT_DELETED */
+
+  int  *next;
+  int   n_next;
+};
+
+static inline guint
+hash_key (unsigned int keycode,
+          unsigned int mask)
+{
+  guint h = keycode * 0x9e3779b1u ^ mask * 0x85ebca77u;
+
+  return h ^ (h >> 15);
+}
+
+/* Returns the slot holding the chain for keycode/mask, or -1 */
+static int
+find_chain (MetaKeyBindingIndex *idx,
+            MetaKeyBinding      *bindings,
+            unsigned int         keycode,
+            unsigned int         mask)
+{
+  guint slot_mask = idx->n_slots - 1;
+  guint pos = hash_key (keycode, mask) & slot_mask;
+
+  while (idx->slots[pos] != SLOT_EMPTY)
+    {
+      int head = idx->slots[pos] - 1;
+
+      if (head >= 0 &&
+          bindings[head].keycode == keycode &&
+          bindings[head].mask == mask)
+        return pos;
+
+      pos = (pos + 1) & slot_mask;
+    }
+
+  return -1;
+}
+
+static guint
+find_free_slot (MetaKeyBindingIndex *idx,
+                unsigned int         keycode,
+                unsigned int         mask)
+{
+  guint slot_mask = idx->n_slots - 1;
+  guint pos = hash_key (keycode, mask) & slot_mask;
+
+  while (idx->slots[pos] > 0)
+    pos = (pos + 1) & slot_mask;
+
+  return pos;
+}
+
+static void
+resize_slots (MetaKeyBindingIndex *idx,
+              MetaKeyBinding      *bindings,
+              guint                n_chains)
+{
+  int *old_slots = idx->slots;
+  guint old_n_slots = idx->n_slots;
+  guint n_slots = MIN_SLOTS;
+  guint i;
+
+  /* Keep the table at most a quarter full after resizing, so that
+   * a run of additions doesn't immediately resize it again.
+   */
+  while (n_slots < 4 * n_chains)
+    n_slots *= 2;
+
+  idx->slots = g_new0 (int, n_slots);
+  idx->n_slots = n_slots;
+  idx->n_deleted = 0;
+
+  for (i = 0; i < old_n_slots; i++)
+    {
+      int head = old_slots[i] - 1;
+
+      if (head >= 0)
+        {
+          guint pos = find_free_slot (idx,
+                                      bindings[head].keycode,
+                                      bindings[head].mask);
+          idx->slots[pos] = head + 1;
+        }
+    }
+
+  g_free (old_slots);
+}
+
+static void
+ensure_next (MetaKeyBindingIndex *idx,
+             int                  n_bindings)
+{
+  if (n_bindings > idx->n_next)
+    {
+      int n_next = MAX (n_bindings, 2 * idx->n_next);
+
+      idx->next = g_renew (int, idx->next, n_next);
+      idx->n_next = n_next;
+    }
+}
+
+MetaKeyBindingIndex *
+meta_key_binding_index_new (void)
+{
+  MetaKeyBindingIndex *idx = g_slice_new0 (MetaKeyBindingIndex);
+
+  idx->slots = g_new0 (int, MIN_SLOTS);
+  idx->n_slots = MIN_SLOTS;
+
+  return idx;
+}
+
+void
+meta_key_binding_index_free (MetaKeyBindingIndex *idx)
+{
+  g_free (idx->slots);
+  g_free (idx->next);
+  g_slice_free (MetaKeyBindingIndex, idx);
+}
+
+void
+meta_key_binding_index_rebuild (MetaKeyBindingIndex *idx,
+                                MetaKeyBinding      *bindings,
+                                int                  n_bindings)
+{
+  guint n_slots = MIN_SLOTS;
+  int i;
+
+  while (n_slots < 2 * (guint) n_bindings)
+    n_slots *= 2;
+
+  if (n_slots != idx->n_slots)
+    {
+      g_free (idx->slots);
+      idx->slots = g_new0 (int, n_slots);
+      idx->n_slots = n_slots;
+    }
+  else
+    {
+      memset (idx->slots, 0, n_slots * sizeof (int));
+    }
+
+  idx->n_chains = 0;
+  idx->n_deleted = 0;
+
+  ensure_next (idx, n_bindings);
+
+  /* Walking backwards means each binding goes at the head of its
+   * chain, which keeps the chains in table order without walking them.
+   */
+  for (i = n_bindings - 1; i >= 0; i--)
+    {
+      int pos = find_chain (idx, bindings,
+                            bindings[i].keycode, bindings[i].mask);
+
+      if (pos >= 0)
+        {
+          idx->next[i] = idx->slots[pos] - 1;
+        }
+      else
+        {
+          pos = find_free_slot (idx, bindings[i].keycode, bindings[i].mask);
+          idx->next[i] = -1;
+          idx->n_chains++;
+        }
+
+      idx->slots[pos] = i + 1;
+    }
+}
+
+void
+meta_key_binding_index_add (MetaKeyBindingIndex *idx,
+                            MetaKeyBinding      *bindings,
+                            int                  i)
+{
+  int pos;
+
+  ensure_next (idx, i + 1);
+
+  pos = find_chain (idx, bindings, bindings[i].keycode, bindings[i].mask);
+  if (pos >= 0)
+    {
+      int prev = idx->slots[pos] - 1;
+
+      if (i < prev)
+        {
+          idx->next[i] = prev;
+          idx->slots[pos] = i + 1;
+        }
+      else
+        {
+          while (idx->next[prev] >= 0 && idx->next[prev] < i)
+            prev = idx->next[prev];
+
+          idx->next[i] = idx->next[prev];
+          idx->next[prev] = i;
+        }
+
+      return;
+    }
+
+  if (2 * (idx->n_chains + idx->n_deleted + 1) > idx->n_slots)
+    resize_slots (idx, bindings, idx->n_chains + 1);
+
+  pos = find_free_slot (idx, bindings[i].keycode, bindings[i].mask);
+  if (idx->slots[pos] == SLOT_DELETED)
+    idx->n_deleted--;
+
+  idx->slots[pos] = i + 1;
+  idx->next[i] = -1;
+  idx->n_chains++;
+}
+
+void
+meta_key_binding_index_remove (MetaKeyBindingIndex *idx,
+                               MetaKeyBinding      *bindings,
+                               int                  i)
+{
+  int pos, prev;
+
+  pos = find_chain (idx, bindings, bindings[i].keycode, bindings[i].mask);
+  g_return_if_fail (pos >= 0);
+
+  prev = idx->slots[pos] - 1;
+  if (prev == i)
+    {
+      if (idx->next[i] >= 0)
+        {
+          idx->slots[pos] = idx->next[i] + 1;
+        }
+      else
+        {
+          idx->slots[pos] = SLOT_DELETED;
+          idx->n_chains--;
+          idx->n_deleted++;
+        }
+    }
+  else
+    {
+      while (idx->next[prev] >= 0 && idx->next[prev] != i)
+        prev = idx->next[prev];
+
+      g_return_if_fail (idx->next[prev] == i);
+
+      idx->next[prev] = idx->next[i];
+    }
+
+  idx->next[i] = -1;
+}
+
+void
+meta_key_binding_index_delete (MetaKeyBindingIndex *idx,
+                               MetaKeyBinding      *bindings,
+                               int                  i,
+                               int                  n_bindings)
+{
+  int *slots = idx->slots;
+  int *next = idx->next;
+  guint n_slots = idx->n_slots;
+  guint pos;
+  int j;
+
+  meta_key_binding_index_remove (idx, bindings, i);
+
+  /* Moving the later bindings down keeps their order, so every chain
+   * stays in table order; only the numbers need to change. Which ones
+   * do is random, so the loops subtract the comparison rather than
+   * branching on it. The arrays are in locals so that the compiler
+   * knows the stores don't change the bounds.
+   */
+  for (pos = 0; pos < n_slots; pos++)
+    slots[pos] -= slots[pos] > i + 1;
+
+  for (j = 0; j < i; j++)
+    next[j] -= next[j] > i;
+
+  /* Past i, a binding's next one is further on still, or -1 */
+  memmove (&next[i], &next[i + 1], (n_bindings - i - 1) * sizeof (int));
+  for (j = i; j < n_bindings - 1; j++)
+    next[j] -= next[j] >= 0;
+}
+
+int
+meta_key_binding_index_lookup (MetaKeyBindingIndex *idx,
+                               MetaKeyBinding      *bindings,
+                               unsigned int         keycode,
+                               unsigned int         mask)
+{
+  int pos = find_chain (idx, bindings, keycode, mask);
+
+  if (pos < 0)
+    return -1;
+
+  return idx->slots[pos] - 1;
+}
+
+int
+meta_key_binding_index_next (MetaKeyBindingIndex *idx,
+                             int                  i)
+{
+  return idx->next[i];
+}
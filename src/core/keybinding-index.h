@@ -0,0 +1,82 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/**
+ * \file keybinding-index.h  Hash index over the key binding table
+ *
+ * The display's key binding table is a flat array; looking up the
+ * binding for a key press used to mean walking all of it. A
+ * MetaKeyBindingIndex maps each (keycode, mask) pair to the chain of
+ * bindings that use it, in table order, so that key events only
+ * touch the bindings that can actually match.
+ *
+ * The index does not own the binding array; every call that needs
+ * to look at a binding's key is passed the array.
+ */
+
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef META_KEYBINDING_INDEX_H
+#define META_KEYBINDING_INDEX_H
+
+#include "keybindings-private.h"
+
+typedef struct _MetaKeyBindingIndex MetaKeyBindingIndex;
+
+MetaKeyBindingIndex *meta_key_binding_index_new     (void);
+void                 meta_key_binding_index_free    (MetaKeyBindingIndex *idx);
+
+/* Throw away the current contents and index bindings[0..n_bindings-1] */
+void meta_key_binding_index_rebuild (MetaKeyBindingIndex *idx,
+                                     MetaKeyBinding      *bindings,
+                                     int                  n_bindings);
+
+/* Add or remove bindings[i]. The binding's keycode and mask must not
+ * change while it is in the index; remove it first, then add it back.
+ */
+void meta_key_binding_index_add     (MetaKeyBindingIndex *idx,
+                                     MetaKeyBinding      *bindings,
+                                     int                  i);
+void meta_key_binding_index_remove  (MetaKeyBindingIndex *idx,
+                                     MetaKeyBinding      *bindings,
+                                     int                  i);
+
+/* Remove bindings[i] from the first n_bindings, for when the ones
+ * after it are about to be moved down over it: their entries are
+ * renumbered to match, so the index needs no rebuild afterwards.
+ */
+void meta_key_binding_index_delete  (MetaKeyBindingIndex *idx,
+                                     MetaKeyBinding      *bindings,
+                                     int                  i,
+                                     int                  n_bindings);
+
+/* Iterate the bindings for a key in table order:
+ *
+ *  for (i = meta_key_binding_index_lookup (idx, bindings, keycode, mask);
+ *       i >= 0;
+ *       i = meta_key_binding_index_next (idx, i))
+ */
+int  meta_key_binding_index_lookup  (MetaKeyBindingIndex *idx,
+                                     MetaKeyBinding      *bindings,
+                                     unsigned int         keycode,
+                                     unsigned int         mask);
+int  meta_key_binding_index_next    (MetaKeyBindingIndex *idx,
+                                     int                  i);
+
+#endif
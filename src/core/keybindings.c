@@ -34,6 +34,7 @@
 
 #include <config.h>
 #include "keybindings-private.h"
+#include "keybinding-index.h"
 #include "workspace-private.h"
 #include <meta/compositor.h>
 #include <meta/errors.h>
@@ -148,6 +149,15 @@ static gboolean process_workspace_switch_grab (MetaDisplay   *display,
 static void grab_key_bindings           (MetaDisplay *display);
 static void ungrab_key_bindings         (MetaDisplay *display);
 
+static void change_binding_keygrabs     (MetaKeyBinding *bindings,
+                                         int             n_bindings,
+                                         MetaDisplay    *display,
+                                         Window          xwindow,
+                                         gboolean        binding_per_window,
+                                         gboolean        grab);
+static void remove_binding              (MetaDisplay    *display,
+                                         int             i);
+
 
 static GHashTable *key_handlers;
 static GHashTable *external_grabs;
@@ -336,8 +346,9 @@ get_keycodes_for_keysym (MetaDisplay  *display,
   return n_keycodes;
 }
 
-static void
-reload_iso_next_group_combos (MetaDisplay *display)
+static int
+get_iso_next_group_combos (MetaDisplay   *display,
+                           MetaKeyCombo **combos_p)
 {
   const char *iso_next_group_option;
   MetaKeyCombo *combos;
@@ -346,12 +357,11 @@ reload_iso_next_group_combos (MetaDisplay *display)
   int n_combos;
   int i;
 
-  g_clear_pointer (&display->iso_next_group_combos, g_free);
-  display->n_iso_next_group_combos = 0;
+  *combos_p = NULL;
 
   iso_next_group_option = meta_prefs_get_iso_next_group_option ();
   if (iso_next_group_option == NULL)
-    return;
+    return 0;
 
   n_keycodes = get_keycodes_for_keysym (display, XK_ISO_Next_Group, &keycodes);
 
@@ -462,8 +472,16 @@ reload_iso_next_group_combos (MetaDisplay *display)
 
   g_free (keycodes);
 
-  display->n_iso_next_group_combos = n_combos;
-  display->iso_next_group_combos = combos;
+  *combos_p = combos;
+  return n_combos;
+}
+
+static void
+reload_iso_next_group_combos (MetaDisplay *display)
+{
+  g_clear_pointer (&display->iso_next_group_combos, g_free);
+  display->n_iso_next_group_combos =
+    get_iso_next_group_combos (display, &display->iso_next_group_combos);
 }
 
 static guint
@@ -510,6 +528,10 @@ reload_keycodes (MetaDisplay *display)
           ++i;
         }
     }
+
+  meta_key_binding_index_rebuild (display->key_bindings_index,
+                                  display->key_bindings,
+                                  display->n_key_bindings);
 }
 
 static void
@@ -538,6 +560,10 @@ reload_modifiers (MetaDisplay *display)
           ++i;
         }
     }
+
+  meta_key_binding_index_rebuild (display->key_bindings_index,
+                                  display->key_bindings,
+                                  display->n_key_bindings);
 }
 
 
@@ -769,22 +795,21 @@ display_get_keybinding (MetaDisplay  *display,
                         unsigned int  keycode,
                         unsigned long mask)
 {
+  MetaKeyBinding *binding = NULL;
   int i;
 
-  i = display->n_key_bindings - 1;
-  while (i >= 0)
+  /* If several bindings match, the last one in the table wins */
+  for (i = meta_key_binding_index_lookup (display->key_bindings_index,
+                                          display->key_bindings,
+                                          keycode, mask);
+       i >= 0;
+       i = meta_key_binding_index_next (display->key_bindings_index, i))
     {
-      if (display->key_bindings[i].keysym == keysym &&
-          display->key_bindings[i].keycode == keycode &&
-          display->key_bindings[i].mask == mask)
-        {
-          return &display->key_bindings[i];
-        }
-
-      --i;
+      if (display->key_bindings[i].keysym == keysym)
+        binding = &display->key_bindings[i];
     }
 
-  return NULL;
+  return binding;
 }
 
 static guint
@@ -897,9 +922,23 @@ gboolean
 meta_display_remove_keybinding (MetaDisplay *display,
                                 const char  *name)
 {
+  MetaKeyHandler *handler;
+  int i;
+
   if (!meta_prefs_remove_keybinding (name))
     return FALSE;
 
+  /* Take the bindings out of the table now, while their handler is
+   * still around; the table update queued by the preferences will
+   * then have nothing left to do for them.
+   */
+  handler = HANDLER (name);
+  meta_error_trap_push (display);
+  for (i = display->n_key_bindings - 1; i >= 0; i--)
+    if (display->key_bindings[i].handler == handler)
+      remove_binding (display, i);
+  meta_error_trap_pop (display);
+
   g_hash_table_remove (key_handlers, name);
 
   return TRUE;
@@ -1013,6 +1052,303 @@ meta_display_process_mapping_event (MetaDisplay *display,
     }
 }
 
+static void
+resolve_binding (MetaDisplay    *display,
+                 MetaKeyBinding *binding)
+{
+  if (binding->keysym != 0)
+    binding->keycode = keysym_to_keycode (display, binding->keysym);
+
+  meta_display_devirtualize_modifiers (display, binding->modifiers,
+                                       &binding->mask);
+}
+
+/* Grab or ungrab one binding on every screen or window that currently
+ * has the binding table grabbed, so that a change to a few bindings
+ * doesn't mean redoing the grabs for all of them.
+ */
+static void
+change_single_binding_keygrabs (MetaDisplay    *display,
+                                MetaKeyBinding *binding,
+                                gboolean        grab)
+{
+  GSList *tmp;
+
+  if (binding->handler->flags & META_KEY_BINDING_PER_WINDOW)
+    {
+      GSList *windows;
+
+      windows = meta_display_list_windows (display, META_LIST_DEFAULT);
+      for (tmp = windows; tmp; tmp = tmp->next)
+        {
+          MetaWindow *w = tmp->data;
+          Window xwindow;
+
+          if (!w->keys_grabbed)
+            continue;
+
+          if (!w->grab_on_frame)
+            xwindow = w->xwindow;
+          else if (w->frame != NULL)
+            xwindow = w->frame->xwindow;
+          else
+            continue;
+
+          change_binding_keygrabs (binding, 1, display, xwindow, TRUE, grab);
+        }
+      g_slist_free (windows);
+    }
+  else
+    {
+      for (tmp = display->screens; tmp; tmp = tmp->next)
+        {
+          MetaScreen *screen = tmp->data;
+
+          if (screen->keys_grabbed)
+            change_binding_keygrabs (binding, 1, display, screen->xroot,
+                                     FALSE, grab);
+        }
+    }
+}
+
+/* Whether a binding in the table still needs the grab of @binding */
+static gboolean
+binding_grab_needed (MetaDisplay    *display,
+                     MetaKeyBinding *binding)
+{
+  gboolean per_window;
+  int i;
+
+  per_window = (binding->handler->flags & META_KEY_BINDING_PER_WINDOW) != 0;
+
+  for (i = meta_key_binding_index_lookup (display->key_bindings_index,
+                                          display->key_bindings,
+                                          binding->keycode,
+                                          binding->mask);
+       i >= 0;
+       i = meta_key_binding_index_next (display->key_bindings_index, i))
+    {
+      MetaKeyBinding *other = &display->key_bindings[i];
+
+      if (per_window ==
+          ((other->handler->flags & META_KEY_BINDING_PER_WINDOW) != 0))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/* Take display->key_bindings[i] out of the table. The bindings after
+ * it move down so that the table keeps its order: when several bindings
+ * share a combo, which one wins depends on it.
+ */
+static void
+drop_binding (MetaDisplay *display,
+              int          i)
+{
+  meta_key_binding_index_delete (display->key_bindings_index,
+                                 display->key_bindings, i,
+                                 display->n_key_bindings);
+  display->n_key_bindings--;
+
+  memmove (&display->key_bindings[i], &display->key_bindings[i + 1],
+           (display->n_key_bindings - i) * sizeof (MetaKeyBinding));
+}
+
+/* Drop display->key_bindings[i] and release its grab, unless another
+ * binding still needs it.
+ */
+static void
+remove_binding (MetaDisplay *display,
+                int          i)
+{
+  MetaKeyBinding binding = display->key_bindings[i];
+
+  drop_binding (display, i);
+
+  if (!binding_grab_needed (display, &binding))
+    change_single_binding_keygrabs (display, &binding, FALSE);
+}
+
+static int
+compare_bindings (const MetaKeyBinding *a,
+                  const MetaKeyBinding *b)
+{
+  int result = strcmp (a->name, b->name);
+
+  if (result != 0)
+    return result;
+  if (a->handler != b->handler)
+    return a->handler < b->handler ? -1 : 1;
+  if (a->keysym != b->keysym)
+    return a->keysym < b->keysym ? -1 : 1;
+  if (a->keycode != b->keycode)
+    return a->keycode < b->keycode ? -1 : 1;
+  if (a->mask != b->mask)
+    return a->mask < b->mask ? -1 : 1;
+  if (a->modifiers != b->modifiers)
+    return a->modifiers < b->modifiers ? -1 : 1;
+
+  return 0;
+}
+
+static int
+compare_binding_indices (gconstpointer a,
+                         gconstpointer b,
+                         gpointer      user_data)
+{
+  MetaKeyBinding *bindings = user_data;
+
+  return compare_bindings (&bindings[*(const int *)a],
+                           &bindings[*(const int *)b]);
+}
+
+static int *
+sort_bindings (MetaKeyBinding *bindings,
+               int             n_bindings)
+{
+  int *order = g_new (int, MAX (n_bindings, 1));
+  int i;
+
+  for (i = 0; i < n_bindings; i++)
+    order[i] = i;
+
+  g_qsort_with_data (order, n_bindings, sizeof (int),
+                     compare_binding_indices, bindings);
+
+  return order;
+}
+
+/* Brings the binding table in line with the preferences. The new
+ * table replaces the old one as a whole, so it has the same order as
+ * after a full rebuild, but only the grabs of the bindings that changed
+ * are redone.
+ */
+static void
+update_key_binding_table (MetaDisplay *display)
+{
+  MetaKeyBinding *old_bindings;
+  MetaKeyBinding *new_bindings = NULL;
+  int n_new_bindings = 0;
+  GList *prefs, *grabs;
+  GArray *removed;
+  int *old_order, *new_order;
+  int n_old_bindings, n_added;
+  int i, j;
+
+  prefs = meta_prefs_get_keybindings ();
+  grabs = g_hash_table_get_values (external_grabs);
+  rebuild_binding_table (display, &new_bindings, &n_new_bindings,
+                         prefs, grabs);
+  g_list_free (prefs);
+  g_list_free (grabs);
+
+  for (i = 0; i < n_new_bindings; i++)
+    resolve_binding (display, &new_bindings[i]);
+
+  n_old_bindings = display->n_key_bindings;
+  old_order = sort_bindings (display->key_bindings, n_old_bindings);
+  new_order = sort_bindings (new_bindings, n_new_bindings);
+
+  /* Merge the two sorted lists; what is only in the old table goes
+   * away, what is only in the new one gets added. The added bindings
+   * are collected at the start of new_order.
+   */
+  removed = g_array_new (FALSE, FALSE, sizeof (int));
+  n_added = 0;
+  i = j = 0;
+  while (i < n_old_bindings || j < n_new_bindings)
+    {
+      int result;
+
+      if (i == n_old_bindings)
+        result = 1;
+      else if (j == n_new_bindings)
+        result = -1;
+      else
+        result = compare_bindings (&display->key_bindings[old_order[i]],
+                                   &new_bindings[new_order[j]]);
+
+      if (result < 0)
+        {
+          g_array_append_val (removed, old_order[i]);
+          i++;
+        }
+      else if (result > 0)
+        {
+          new_order[n_added++] = new_order[j];
+          j++;
+        }
+      else
+        {
+          i++;
+          j++;
+        }
+    }
+
+  meta_topic (META_DEBUG_KEYBINDINGS,
+              "Updating key binding table: %u removed, %d added\n",
+              removed->len, n_added);
+
+  old_bindings = display->key_bindings;
+  display->key_bindings = new_bindings;
+  display->n_key_bindings = n_new_bindings;
+  meta_key_binding_index_rebuild (display->key_bindings_index,
+                                  display->key_bindings,
+                                  display->n_key_bindings);
+
+  meta_error_trap_push (display);
+
+  for (i = 0; i < (int) removed->len; i++)
+    {
+      MetaKeyBinding *binding = &old_bindings[g_array_index (removed, int, i)];
+
+      if (!binding_grab_needed (display, binding))
+        change_single_binding_keygrabs (display, binding, FALSE);
+    }
+
+  for (i = 0; i < n_added; i++)
+    change_single_binding_keygrabs (display, &new_bindings[new_order[i]], TRUE);
+
+  meta_error_trap_pop (display);
+
+  g_array_free (removed, TRUE);
+  g_free (old_order);
+  g_free (new_order);
+  g_free (old_bindings);
+}
+
+/* Whether the overlay key or the ISO_Next_Group combos would change
+ * if they were reloaded from the preferences now */
+static gboolean
+special_bindings_changed (MetaDisplay *display)
+{
+  MetaKeyCombo combo;
+  MetaKeyCombo *combos;
+  int n_combos;
+  gboolean changed;
+
+  meta_prefs_get_overlay_binding (&combo);
+  if (combo.keysym != 0)
+    combo.keycode = keysym_to_keycode (display, combo.keysym);
+  else
+    combo.keycode = 0;
+
+  if (combo.keysym != display->overlay_key_combo.keysym ||
+      combo.keycode != display->overlay_key_combo.keycode ||
+      combo.modifiers != display->overlay_key_combo.modifiers)
+    return TRUE;
+
+  n_combos = get_iso_next_group_combos (display, &combos);
+  changed = n_combos != display->n_iso_next_group_combos ||
+    (n_combos > 0 &&
+     memcmp (combos, display->iso_next_group_combos,
+             n_combos * sizeof (MetaKeyCombo)) != 0);
+  g_free (combos);
+
+  return changed;
+}
+
 static void
 bindings_changed_callback (MetaPreference pref,
                            void          *data)
@@ -1024,12 +1360,19 @@ bindings_changed_callback (MetaPreference pref,
   switch (pref)
     {
     case META_PREF_KEYBINDINGS:
-      ungrab_key_bindings (display);
-      rebuild_key_binding_table (display);
-      rebuild_special_bindings (display);
-      reload_keycodes (display);
-      reload_modifiers (display);
-      grab_key_bindings (display);
+      if (special_bindings_changed (display))
+        {
+          ungrab_key_bindings (display);
+          rebuild_key_binding_table (display);
+          rebuild_special_bindings (display);
+          reload_keycodes (display);
+          reload_modifiers (display);
+          grab_key_bindings (display);
+        }
+      else
+        {
+          update_key_binding_table (display);
+        }
       break;
     default:
       break;
@@ -1050,6 +1393,7 @@ meta_display_shutdown_keys (MetaDisplay *display)
   if (display->modmap)
     XFreeModifiermap (display->modmap);
   g_free (display->key_bindings);
+  meta_key_binding_index_free (display->key_bindings_index);
 }
 
 static const char*
@@ -1341,10 +1685,10 @@ meta_display_grab_accelerator (MetaDisplay *display,
   if (keycode == 0)
     return META_KEYBINDING_ACTION_NONE;
 
-  for (i = 0; i < display->n_key_bindings; i++)
-    if (display->key_bindings[i].keycode == keycode &&
-        display->key_bindings[i].mask == mask)
-      return META_KEYBINDING_ACTION_NONE;
+  if (meta_key_binding_index_lookup (display->key_bindings_index,
+                                     display->key_bindings,
+                                     keycode, mask) >= 0)
+    return META_KEYBINDING_ACTION_NONE;
 
   for (l = display->screens; l; l = l->next)
     {
@@ -1375,6 +1719,10 @@ meta_display_grab_accelerator (MetaDisplay *display,
   binding->modifiers = grab->combo->modifiers;
   binding->mask = mask;
 
+  meta_key_binding_index_add (display->key_bindings_index,
+                              display->key_bindings,
+                              display->n_key_bindings - 1);
+
   return grab->action;
 }
 
@@ -1394,9 +1742,7 @@ meta_display_ungrab_accelerator (MetaDisplay *display,
     return FALSE;
 
   for (i = 0; i < display->n_key_bindings; i++)
-    if (display->key_bindings[i].keysym == grab->combo->keysym &&
-        display->key_bindings[i].keycode == grab->combo->keycode &&
-        display->key_bindings[i].modifiers == grab->combo->modifiers)
+    if (display->key_bindings[i].name == grab->name)
       {
         GSList *l;
         for (l = display->screens; l; l = l->next)
@@ -1408,10 +1754,7 @@ meta_display_ungrab_accelerator (MetaDisplay *display,
                                  display->key_bindings[i].mask);
           }
 
-        display->key_bindings[i].keysym = 0;
-        display->key_bindings[i].keycode = 0;
-        display->key_bindings[i].modifiers = 0;
-        display->key_bindings[i].mask = 0;
+        drop_binding (display, i);
         break;
       }
 
@@ -1837,34 +2180,31 @@ invoke_handler_by_name (MetaDisplay    *display,
 
 /* now called from only one place, may be worth merging */
 static gboolean
-process_event (MetaKeyBinding       *bindings,
-               int                   n_bindings,
-               MetaDisplay          *display,
+process_event (MetaDisplay          *display,
                MetaScreen           *screen,
                MetaWindow           *window,
                XIDeviceEvent        *event,
                KeySym                keysym,
                gboolean              on_window)
 {
+  MetaKeyBinding *bindings = display->key_bindings;
+  unsigned int mask;
   int i;
 
   /* we used to have release-based bindings but no longer. */
-  if (event->evtype == XI_KeyRelease)
+  if (event->evtype != XI_KeyPress)
     return FALSE;
 
-  /*
-   * TODO: This would be better done with a hash table;
-   * it doesn't suit to use O(n) for such a common operation.
-   */
-  for (i=0; i<n_bindings; i++)
+  mask = event->mods.effective & 0xff & ~(display->ignored_modifier_mask);
+
+  for (i = meta_key_binding_index_lookup (display->key_bindings_index,
+                                          bindings, event->detail, mask);
+       i >= 0;
+       i = meta_key_binding_index_next (display->key_bindings_index, i))
     {
       MetaKeyHandler *handler = bindings[i].handler;
 
       if ((!on_window && handler->flags & META_KEY_BINDING_PER_WINDOW) ||
-          event->evtype != XI_KeyPress ||
-          bindings[i].keycode != event->detail ||
-          ((event->mods.effective & 0xff & ~(display->ignored_modifier_mask)) !=
-           bindings[i].mask) ||
           meta_compositor_filter_keybinding (display->compositor, screen, &bindings[i]))
         continue;
 
@@ -1926,10 +2266,7 @@ process_overlay_key (MetaDisplay *display,
            * the event. Other clients with global grabs will be out of
            * luck.
            */
-          if (process_event (display->key_bindings,
-                             display->n_key_bindings,
-                             display, screen, NULL, event, keysym,
-                             FALSE))
+          if (process_event (display, screen, NULL, event, keysym, FALSE))
             {
               /* As normally, after we've handled a global key
                * binding, we unfreeze the keyboard but keep the grab
@@ -2190,9 +2527,7 @@ meta_display_process_key_event (MetaDisplay   *display,
     }
 
   /* Do the normal keybindings */
-  return process_event (display->key_bindings,
-                        display->n_key_bindings,
-                        display, screen, window, event, keysym,
+  return process_event (display, screen, window, event, keysym,
                         !all_keys_grabbed && window);
 }
 
@@ -4761,6 +5096,7 @@ meta_display_init_keys (MetaDisplay *display)
   display->meta_mask = 0;
   display->key_bindings = NULL;
   display->n_key_bindings = 0;
+  display->key_bindings_index = meta_key_binding_index_new ();
 
   XDisplayKeycodes (display->xdisplay,
                     &display->min_keycode,
@@ -42,6 +42,7 @@
 #include "keybindings-private.h"
 #include "stack.h"
 #include "xprops.h"
+#include "window-props.h"
 #include <meta/compositor.h>
 #include "mutter-enum-types.h"
 #include "core.h"
@@ -910,11 +911,10 @@ list_windows (MetaScreen *screen)
           meta_verbose ("Failed to get attributes for window 0x%lx\n",
                         children[i]);
 	  g_free (info);
+          continue;
         }
-      else
-        {
-	  info->xwindow = children[i];
-	}
+
+      info->xwindow = children[i];
 
       result = g_list_prepend (result, info);
     }
@@ -930,6 +930,9 @@ meta_screen_manage_all_windows (MetaScreen *screen)
 {
   GList *windows;
   GList *list;
+  gboolean prefetch;
+  gint64 start;
+  int n_windows;
 
   meta_display_grab (screen->display);
 
@@ -937,19 +940,53 @@ meta_screen_manage_all_windows (MetaScreen *screen)
     screen->guard_window = create_guard_window (screen->display->xdisplay,
                                                 screen);
 
+  start = g_get_monotonic_time ();
+
   windows = list_windows (screen);
 
+  /* Rather than waiting for the properties of each window in turn
+   * while managing it, ask for the properties of all of them up
+   * front, so that there is only one round trip for the lot.
+   */
+  prefetch = g_getenv ("META_DISABLE_PROPERTY_PREFETCH") == NULL;
+  if (prefetch)
+    {
+      for (list = windows; list != NULL; list = list->next)
+        {
+          WindowInfo *info = list->data;
+
+          /* meta_window_new_with_attrs() ignores these */
+          if (info->attrs.override_redirect && info->attrs.class == InputOnly)
+            continue;
+
+          meta_display_prefetch_initial_properties (screen->display,
+                                                    info->xwindow,
+                                                    info->attrs.override_redirect);
+        }
+    }
+
+  n_windows = 0;
   meta_stack_freeze (screen->stack);
   for (list = windows; list != NULL; list = list->next)
     {
       WindowInfo *info = list->data;
 
-      meta_window_new_with_attrs (screen->display, info->xwindow, TRUE,
-                                  META_COMP_EFFECT_NONE,
-                                  &info->attrs);
+      if (meta_window_new_with_attrs (screen->display, info->xwindow, TRUE,
+                                      META_COMP_EFFECT_NONE,
+                                      &info->attrs))
+        n_windows++;
     }
   meta_stack_thaw (screen->stack);
 
+  if (prefetch)
+    meta_display_discard_prefetched_properties (screen->display);
+
+  meta_topic (META_DEBUG_STARTUP,
+              "Managed %d of %d existing windows in %.1fms (%s)\n",
+              n_windows, g_list_length (windows),
+              (g_get_monotonic_time () - start) / 1000.,
+              prefetch ? "properties prefetched" : "properties fetched per window");
+
   g_list_foreach (windows, (GFunc)g_free, NULL);
   g_list_free (windows);
 
@@ -72,11 +72,15 @@
  * no longer pending b) if necessary, drop the predicted stacking
  * order to recompute it at the next opportunity.
  *
+ * The stacks are kept as an array plus a hash table mapping each
+ * window to its position, so that applying an op doesn't have to
+ * search the stack. Consecutive requests that restack the same window
+ * are collapsed into the last one when it determines where the window
+ * ends up anyway; see meta_stack_op_supersedes().
+ *
  * Possible optimizations:
- *  Keep the stacks as an array + reverse-mapping hash table to avoid
- *    linear lookups.
- *  Keep the stacks as a GList + reverse-mapping hash table to avoid
- *    linear lookups and to make restacking constant-time.
+ *  Keep the stacks as a GList + reverse-mapping hash table to make
+ *    restacking constant-time.
  */
 
 typedef union _MetaStackOp MetaStackOp;
@@ -123,6 +127,15 @@ union _MetaStackOp
   } lower_below;
 };
 
+/* A stack of windows, bottom to top, along with the position of
+ * each window in it.
+ */
+typedef struct
+{
+  GArray     *windows;
+  GHashTable *positions;  /* Window => position + 1 */
+} MetaTrackedStack;
+
 struct _MetaStackTracker
 {
   MetaScreen *screen;
@@ -130,7 +143,7 @@ struct _MetaStackTracker
   /* This is the last state of the stack as based on events received
    * from the X server.
    */
-  GArray *server_stack;
+  MetaTrackedStack *server_stack;
 
   /* This is the serial of the last request we made that was reflected
    * in server_stack
@@ -145,12 +158,21 @@ struct _MetaStackTracker
   /* This is how we think the stack is, based on server_stack, and
    * on requests we've made subsequent to server_stack
    */
-  GArray *predicted_stack;
+  MetaTrackedStack *predicted_stack;
 
   /* Idle function used to sync the compositor's view of the window
    * stack up with our best guess before a frame is drawn.
    */
   guint sync_stack_later;
+
+  /* Logged under META_DEBUG_STACK each time the stack is synced,
+   * then reset.
+   */
+  guint n_queued;      /* requests queued */
+  guint n_collapsed;   /* requests that replaced the one before */
+  guint n_replays;     /* times predicted_stack was recomputed */
+  guint n_replayed;    /* requests applied doing that */
+  gint64 replay_time;  /* microseconds spent doing that */
 };
 
 static void
@@ -195,13 +217,13 @@ meta_stack_tracker_dump (MetaStackTracker *tracker)
   meta_push_no_msg_prefix ();
   meta_topic (META_DEBUG_STACK, "  server_serial: %ld\n", tracker->server_serial);
   meta_topic (META_DEBUG_STACK, "  server_stack: ");
-  for (i = 0; i < tracker->server_stack->len; i++)
-    meta_topic (META_DEBUG_STACK, "  %#lx", g_array_index (tracker->server_stack, Window, i));
+  for (i = 0; i < tracker->server_stack->windows->len; i++)
+    meta_topic (META_DEBUG_STACK, "  %#lx", g_array_index (tracker->server_stack->windows, Window, i));
   if (tracker->predicted_stack)
     {
       meta_topic (META_DEBUG_STACK, "\n  predicted_stack: ");
-      for (i = 0; i < tracker->predicted_stack->len; i++)
-	meta_topic (META_DEBUG_STACK, "  %#lx", g_array_index (tracker->predicted_stack, Window, i));
+      for (i = 0; i < tracker->predicted_stack->windows->len; i++)
+	meta_topic (META_DEBUG_STACK, "  %#lx", g_array_index (tracker->predicted_stack->windows, Window, i));
     }
   meta_topic (META_DEBUG_STACK, "\n  queued_requests: [");
   for (l = tracker->queued_requests->head; l; l = l->next)
@@ -219,43 +241,80 @@ meta_stack_op_free (MetaStackOp *op)
   g_slice_free (MetaStackOp, op);
 }
 
-static int
-find_window (GArray *stack,
-	     Window  window)
+static MetaTrackedStack *
+tracked_stack_new (Window *windows,
+                   guint   n_windows)
 {
+  MetaTrackedStack *stack = g_slice_new (MetaTrackedStack);
   guint i;
 
-  for (i = 0; i < stack->len; i++)
-    if (g_array_index (stack, Window, i) == window)
-      return i;
+  stack->windows = g_array_sized_new (FALSE, FALSE, sizeof (Window), n_windows);
+  g_array_set_size (stack->windows, n_windows);
+  memcpy (stack->windows->data, windows, sizeof (Window) * n_windows);
+
+  stack->positions = g_hash_table_new (NULL, NULL);
+  for (i = 0; i < n_windows; i++)
+    g_hash_table_insert (stack->positions,
+                         GUINT_TO_POINTER (windows[i]),
+                         GUINT_TO_POINTER (i + 1));
+
+  return stack;
+}
+
+static void
+tracked_stack_free (MetaTrackedStack *stack)
+{
+  g_array_free (stack->windows, TRUE);
+  g_hash_table_destroy (stack->positions);
+  g_slice_free (MetaTrackedStack, stack);
+}
+
+/* Records the current positions of stack->windows[start..end] */
+static void
+update_positions (MetaTrackedStack *stack,
+                  int               start,
+                  int               end)
+{
+  int i;
+
+  for (i = start; i <= end; i++)
+    g_hash_table_insert (stack->positions,
+                         GUINT_TO_POINTER (g_array_index (stack->windows, Window, i)),
+                         GUINT_TO_POINTER (i + 1));
+}
 
-  return -1;
+static int
+find_window (MetaTrackedStack *stack,
+	     Window            window)
+{
+  return GPOINTER_TO_UINT (g_hash_table_lookup (stack->positions,
+                                                GUINT_TO_POINTER (window))) - 1;
 }
 
 /* Returns TRUE if stack was changed */
 static gboolean
-move_window_above (GArray *stack,
-                   Window  window,
-                   int     old_pos,
-                   int     above_pos)
+move_window_above (MetaTrackedStack *stack,
+                   Window            window,
+                   int               old_pos,
+                   int               above_pos)
 {
-  int i;
+  Window *windows = (Window *)stack->windows->data;
 
   if (old_pos < above_pos)
     {
-      for (i = old_pos; i < above_pos; i++)
-	g_array_index (stack, Window, i) = g_array_index (stack, Window, i + 1);
-
-      g_array_index (stack, Window, above_pos) = window;
+      memmove (&windows[old_pos], &windows[old_pos + 1],
+               (above_pos - old_pos) * sizeof (Window));
+      windows[above_pos] = window;
+      update_positions (stack, old_pos, above_pos);
 
       return TRUE;
     }
   else if (old_pos > above_pos + 1)
     {
-      for (i = old_pos; i > above_pos + 1; i--)
-	g_array_index (stack, Window, i) = g_array_index (stack, Window, i - 1);
-
-      g_array_index (stack, Window, above_pos + 1) = window;
+      memmove (&windows[above_pos + 2], &windows[above_pos + 1],
+               (old_pos - above_pos - 1) * sizeof (Window));
+      windows[above_pos + 1] = window;
+      update_positions (stack, above_pos + 1, old_pos);
 
       return TRUE;
     }
@@ -265,8 +324,8 @@ move_window_above (GArray *stack,
 
 /* Returns TRUE if stack was changed */
 static gboolean
-meta_stack_op_apply (MetaStackOp *op,
-		     GArray      *stack)
+meta_stack_op_apply (MetaStackOp      *op,
+		     MetaTrackedStack *stack)
 {
   switch (op->any.type)
     {
@@ -280,7 +339,8 @@ meta_stack_op_apply (MetaStackOp *op,
 	    return FALSE;
 	  }
 
-	g_array_append_val (stack, op->add.window);
+	g_array_append_val (stack->windows, op->add.window);
+        update_positions (stack, stack->windows->len - 1, stack->windows->len - 1);
 	return TRUE;
       }
     case STACK_OP_REMOVE:
@@ -293,7 +353,10 @@ meta_stack_op_apply (MetaStackOp *op,
 	    return FALSE;
 	  }
 
-	g_array_remove_index (stack, old_pos);
+	g_array_remove_index (stack->windows, old_pos);
+        g_hash_table_remove (stack->positions,
+                             GUINT_TO_POINTER (op->remove.window));
+        update_positions (stack, old_pos, (int)stack->windows->len - 1);
 	return TRUE;
       }
     case STACK_OP_RAISE_ABOVE:
@@ -349,7 +412,7 @@ meta_stack_op_apply (MetaStackOp *op,
 	  }
 	else
 	  {
-	    above_pos = stack->len - 1;
+	    above_pos = stack->windows->len - 1;
 	  }
 
 	return move_window_above (stack, op->lower_below.window, old_pos, above_pos);
@@ -360,18 +423,6 @@ meta_stack_op_apply (MetaStackOp *op,
   return FALSE;
 }
 
-static GArray *
-copy_stack (Window *windows,
-	    guint   n_windows)
-{
-  GArray *stack = g_array_new (FALSE, FALSE, sizeof (Window));
-
-  g_array_set_size (stack, n_windows);
-  memcpy (stack->data, windows, sizeof (Window) * n_windows);
-
-  return stack;
-}
-
 MetaStackTracker *
 meta_stack_tracker_new (MetaScreen *screen)
 {
@@ -388,7 +439,7 @@ meta_stack_tracker_new (MetaScreen *screen)
   XQueryTree (screen->display->xdisplay,
               screen->xroot,
               &ignored1, &ignored2, &children, &n_children);
-  tracker->server_stack = copy_stack (children, n_children);
+  tracker->server_stack = tracked_stack_new (children, n_children);
   XFree (children);
 
   tracker->queued_requests = g_queue_new ();
@@ -402,9 +453,9 @@ meta_stack_tracker_free (MetaStackTracker *tracker)
   if (tracker->sync_stack_later)
     meta_later_remove (tracker->sync_stack_later);
 
-  g_array_free (tracker->server_stack, TRUE);
+  tracked_stack_free (tracker->server_stack);
   if (tracker->predicted_stack)
-    g_array_free (tracker->predicted_stack, TRUE);
+    tracked_stack_free (tracker->predicted_stack);
 
   g_queue_foreach (tracker->queued_requests, (GFunc)meta_stack_op_free, NULL);
   g_queue_free (tracker->queued_requests);
@@ -413,11 +464,73 @@ meta_stack_tracker_free (MetaStackTracker *tracker)
   g_free (tracker);
 }
 
+/* Whether applying @op after @prev leaves the stack the same as
+ * applying only @op, whatever the stack is when they are replayed.
+ * A restack places the window regardless of where @prev put it, but
+ * it does nothing if its sibling has gone from the stack, and then
+ * the effect of @prev would be lost; so the sibling has to be one
+ * that @prev depended on as well, or none at all.
+ */
+static gboolean
+meta_stack_op_supersedes (MetaStackOp *op,
+                          MetaStackOp *prev)
+{
+  Window window, prev_sibling;
+
+  if (prev->any.type == STACK_OP_RAISE_ABOVE)
+    {
+      window = prev->raise_above.window;
+      prev_sibling = prev->raise_above.sibling;
+    }
+  else if (prev->any.type == STACK_OP_LOWER_BELOW)
+    {
+      window = prev->lower_below.window;
+      prev_sibling = prev->lower_below.sibling;
+    }
+  else
+    return FALSE;
+
+  switch (op->any.type)
+    {
+    case STACK_OP_ADD:
+      return FALSE;
+    case STACK_OP_REMOVE:
+      return op->remove.window == window;
+    case STACK_OP_RAISE_ABOVE:
+      return op->raise_above.window == window &&
+             op->raise_above.sibling != window &&
+             (op->raise_above.sibling == None ||
+              op->raise_above.sibling == prev_sibling);
+    case STACK_OP_LOWER_BELOW:
+      return op->lower_below.window == window &&
+             op->lower_below.sibling != window &&
+             (op->lower_below.sibling == None ||
+              op->lower_below.sibling == prev_sibling);
+    }
+
+  return FALSE;
+}
+
 static void
 stack_tracker_queue_request (MetaStackTracker *tracker,
 			     MetaStackOp      *op)
 {
+  MetaStackOp *prev = g_queue_peek_tail (tracker->queued_requests);
+
   meta_stack_op_dump (op, "Queueing: ", "\n");
+  tracker->n_queued++;
+
+  /* The queue stays sorted by serial, since op is newer than prev;
+   * when the event for prev arrives, op stays queued and still gets
+   * applied on top of it.
+   */
+  if (prev && meta_stack_op_supersedes (op, prev))
+    {
+      meta_stack_op_dump (prev, "Collapsing: ", "\n");
+      meta_stack_op_free (g_queue_pop_tail (tracker->queued_requests));
+      tracker->n_collapsed++;
+    }
+
   g_queue_push_tail (tracker->queued_requests, op);
   if (!tracker->predicted_stack ||
       meta_stack_op_apply (op, tracker->predicted_stack))
@@ -549,7 +662,7 @@ stack_tracker_event_received (MetaStackTracker *tracker,
     {
       if (tracker->predicted_stack)
         {
-          g_array_free (tracker->predicted_stack, TRUE);
+          tracked_stack_free (tracker->predicted_stack);
           tracker->predicted_stack = NULL;
         }
 
@@ -647,7 +760,7 @@ meta_stack_tracker_get_stack (MetaStackTracker *tracker,
 			      Window          **windows,
 			      int              *n_windows)
 {
-  GArray *stack;
+  MetaTrackedStack *stack;
 
   if (tracker->queued_requests->length == 0)
     {
@@ -658,23 +771,29 @@ meta_stack_tracker_get_stack (MetaStackTracker *tracker,
       if (tracker->predicted_stack == NULL)
         {
           GList *l;
+          gint64 start = g_get_monotonic_time ();
 
-          tracker->predicted_stack = copy_stack ((Window *)tracker->server_stack->data,
-                                                 tracker->server_stack->len);
+          tracker->predicted_stack =
+            tracked_stack_new ((Window *)tracker->server_stack->windows->data,
+                               tracker->server_stack->windows->len);
           for (l = tracker->queued_requests->head; l; l = l->next)
             {
               MetaStackOp *op = l->data;
               meta_stack_op_apply (op, tracker->predicted_stack);
             }
+
+          tracker->n_replays++;
+          tracker->n_replayed += tracker->queued_requests->length;
+          tracker->replay_time += g_get_monotonic_time () - start;
         }
 
       stack = tracker->predicted_stack;
     }
 
   if (windows)
-    *windows = (Window *)stack->data;
+    *windows = (Window *)stack->windows->data;
   if (n_windows)
-    *n_windows = stack->len;
+    *n_windows = stack->windows->len;
 }
 
 /**
@@ -726,6 +845,22 @@ meta_stack_tracker_sync_stack (MetaStackTracker *tracker)
   g_list_free (meta_windows);
 
   meta_screen_restacked (tracker->screen);
+
+  meta_topic (META_DEBUG_STACK,
+              "Synced stack: %d windows, %u requests queued "
+              "(%u collapsed, %u pending), %u replays of %u requests "
+              "in %.3f ms\n",
+              n_windows,
+              tracker->n_queued, tracker->n_collapsed,
+              tracker->queued_requests->length,
+              tracker->n_replays, tracker->n_replayed,
+              tracker->replay_time / 1000.);
+
+  tracker->n_queued = 0;
+  tracker->n_collapsed = 0;
+  tracker->n_replays = 0;
+  tracker->n_replayed = 0;
+  tracker->replay_time = 0;
 }
 
 static gboolean
@@ -37,6 +37,7 @@
 #include <meta/workspace.h>
 
 #include <X11/Xatom.h>
+#include <string.h>
 
 #define WINDOW_HAS_TRANSIENT_TYPE(w)                    \
           (w->type == META_WINDOW_DIALOG ||             \
@@ -79,6 +80,10 @@ meta_stack_new (MetaScreen *screen)
 
   stack->freeze_count = 0;
   stack->last_root_children_stacked = NULL;
+  stack->last_client_list = NULL;
+  stack->last_client_list_stacking = NULL;
+  stack->last_sync_bytes = 0;
+  stack->total_sync_bytes = 0;
 
   stack->n_positions = 0;
 
@@ -100,6 +105,10 @@ meta_stack_free (MetaStack *stack)
 
   if (stack->last_root_children_stacked)
     g_array_free (stack->last_root_children_stacked, TRUE);
+  if (stack->last_client_list)
+    g_array_free (stack->last_client_list, TRUE);
+  if (stack->last_client_list_stacking)
+    g_array_free (stack->last_client_list_stacking, TRUE);
   
   g_free (stack);
 }
@@ -1131,6 +1140,53 @@ raise_window_relative_to_managed_windows (MetaScreen *screen,
     }
 }
 
+/* Sizes on the wire of the requests stack_sync_to_server() makes,
+ * for the stack->last_sync_bytes count. XRestackWindows() on n windows
+ * is n - 1 ConfigureWindow requests with a sibling and a stack mode.
+ */
+#define CONFIGURE_WINDOW_SIZE(n_values) (12 + 4 * (n_values))
+#define RESTACK_WINDOWS_SIZE(n_windows) \
+  (((n_windows) > 1 ? (n_windows) - 1 : 0) * CONFIGURE_WINDOW_SIZE (2))
+#define CHANGE_PROPERTY_SIZE(n_items)   (24 + 4 * (n_items))
+
+static gboolean
+window_arrays_equal (GArray *a,
+                     GArray *b)
+{
+  return a != NULL && b != NULL &&
+         a->len == b->len &&
+         memcmp (a->data, b->data, a->len * sizeof (Window)) == 0;
+}
+
+/* Sets @atom on the root window to @windows, unless it is already
+ * set to that; @last holds what it was last set to. Returns the
+ * number of bytes sent.
+ */
+static gulong
+sync_window_list_property (MetaScreen  *screen,
+                           Atom         atom,
+                           GArray      *windows,
+                           GArray     **last)
+{
+  if (window_arrays_equal (windows, *last))
+    return 0;
+
+  XChangeProperty (screen->display->xdisplay,
+                   screen->xroot,
+                   atom,
+                   XA_WINDOW,
+                   32, PropModeReplace,
+                   (unsigned char *)windows->data,
+                   windows->len);
+
+  if (*last == NULL)
+    *last = g_array_new (FALSE, FALSE, sizeof (Window));
+  g_array_set_size (*last, windows->len);
+  memcpy ((*last)->data, windows->data, windows->len * sizeof (Window));
+
+  return CHANGE_PROPERTY_SIZE (windows->len);
+}
+
 /**
  * stack_sync_to_server:
  *
@@ -1152,6 +1208,8 @@ stack_sync_to_server (MetaStack *stack)
   GList *tmp;
   GArray *all_hidden;
   int n_override_redirect = 0;
+  gulong sync_bytes = 0;
+  guint i;
   
   /* Bail out if frozen */
   if (stack->freeze_count > 0)
@@ -1166,8 +1224,10 @@ stack_sync_to_server (MetaStack *stack)
    * _NET hints, and "root_children_stacked" is in top-to-bottom
    * order for XRestackWindows()
    */
-  stacked = g_array_new (FALSE, FALSE, sizeof (Window));
-  root_children_stacked = g_array_new (FALSE, FALSE, sizeof (Window));
+  stacked = g_array_sized_new (FALSE, FALSE, sizeof (Window),
+                               stack->windows->len);
+  root_children_stacked = g_array_sized_new (FALSE, FALSE, sizeof (Window),
+                                             stack->windows->len);
   all_hidden = g_array_new (FALSE, FALSE, sizeof (Window));
 
   /* The screen guard window sits above all hidden windows and acts as
@@ -1185,11 +1245,13 @@ stack_sync_to_server (MetaStack *stack)
       meta_topic (META_DEBUG_STACK, "%u:%d - %s ",
 		  w->layer, w->stack_position, w->desc);
 
-      /* remember, stacked is in reverse order (bottom to top) */
+      /* remember, stacked is in reverse order (bottom to top); it's
+       * built top to bottom and reversed below
+       */
       if (w->override_redirect)
 	n_override_redirect++;
       else
-	g_array_prepend_val (stacked, w->xwindow);
+	g_array_append_val (stacked, w->xwindow);
       
       if (w->frame)
 	top_level_window = w->frame->xwindow;
@@ -1212,6 +1274,15 @@ stack_sync_to_server (MetaStack *stack)
   meta_topic (META_DEBUG_STACK, "\n");
   meta_pop_no_msg_prefix ();
 
+  for (i = 0; i < stacked->len / 2; i++)
+    {
+      Window tmp_window = g_array_index (stacked, Window, i);
+
+      g_array_index (stacked, Window, i) =
+        g_array_index (stacked, Window, stacked->len - 1 - i);
+      g_array_index (stacked, Window, stacked->len - 1 - i) = tmp_window;
+    }
+
   /* All windows should be in some stacking order */
   if (stacked->len != stack->windows->len - n_override_redirect)
     meta_bug ("%u windows stacked, %u windows exist in stack\n",
@@ -1240,6 +1311,7 @@ stack_sync_to_server (MetaStack *stack)
           XRestackWindows (stack->screen->display->xdisplay,
                            (Window *) root_children_stacked->data,
                            root_children_stacked->len);
+          sync_bytes += RESTACK_WINDOWS_SIZE (root_children_stacked->len);
         }
     }
   else if (root_children_stacked->len > 0)
@@ -1287,6 +1359,7 @@ stack_sync_to_server (MetaStack *stack)
 
                   raise_window_relative_to_managed_windows (stack->screen,
                                                             *newp);
+                  sync_bytes += CONFIGURE_WINDOW_SIZE (2);
                 }
               else
                 {
@@ -1310,6 +1383,7 @@ stack_sync_to_server (MetaStack *stack)
                                     *newp,
                                     CWSibling | CWStackMode,
                                     &changes);
+                  sync_bytes += CONFIGURE_WINDOW_SIZE (2);
                 }
 
               last_window = *newp;
@@ -1333,6 +1407,7 @@ stack_sync_to_server (MetaStack *stack)
                                                      XNextRequest (stack->screen->display->xdisplay));
           XRestackWindows (stack->screen->display->xdisplay,
                            (Window *) newp, new_end - newp);
+          sync_bytes += RESTACK_WINDOWS_SIZE (new_end - newp);
         }
     }
 
@@ -1348,6 +1423,7 @@ stack_sync_to_server (MetaStack *stack)
   XRestackWindows (stack->screen->display->xdisplay,
 		   (Window *)all_hidden->data,
 		   all_hidden->len);
+  sync_bytes += CONFIGURE_WINDOW_SIZE (1) + RESTACK_WINDOWS_SIZE (all_hidden->len);
   g_array_free (all_hidden, TRUE);
 
   meta_error_trap_pop (stack->screen->display);
@@ -1358,23 +1434,26 @@ stack_sync_to_server (MetaStack *stack)
   
   /* Sync _NET_CLIENT_LIST and _NET_CLIENT_LIST_STACKING */
 
-  XChangeProperty (stack->screen->display->xdisplay,
-                   stack->screen->xroot,
-                   stack->screen->display->atom__NET_CLIENT_LIST,
-                   XA_WINDOW,
-                   32, PropModeReplace,
-                   (unsigned char *)stack->windows->data,
-                   stack->windows->len);
-  XChangeProperty (stack->screen->display->xdisplay,
-                   stack->screen->xroot,
-                   stack->screen->display->atom__NET_CLIENT_LIST_STACKING,
-                   XA_WINDOW,
-                   32, PropModeReplace,
-                   (unsigned char *)stacked->data,
-                   stacked->len);
+  sync_bytes +=
+    sync_window_list_property (stack->screen,
+                               stack->screen->display->atom__NET_CLIENT_LIST,
+                               stack->windows,
+                               &stack->last_client_list);
+  sync_bytes +=
+    sync_window_list_property (stack->screen,
+                               stack->screen->display->atom__NET_CLIENT_LIST_STACKING,
+                               stacked,
+                               &stack->last_client_list_stacking);
 
   g_array_free (stacked, TRUE);
 
+  stack->last_sync_bytes = sync_bytes;
+  stack->total_sync_bytes += sync_bytes;
+  meta_topic (META_DEBUG_STACK,
+              "Sent %lu bytes of requests syncing the stack "
+              "(%" G_GUINT64_FORMAT " in total)\n",
+              stack->last_sync_bytes, stack->total_sync_bytes);
+
   if (stack->last_root_children_stacked)
     g_array_free (stack->last_root_children_stacked, TRUE);
   stack->last_root_children_stacked = root_children_stacked;
@@ -101,6 +101,21 @@ struct _MetaStack
    */
   GArray *last_root_children_stacked;
 
+  /**
+   * The last values we set _NET_CLIENT_LIST and _NET_CLIENT_LIST_STACKING
+   * to, so that we don't rewrite them (and make every pager reread them)
+   * when they haven't changed.
+   */
+  GArray *last_client_list;
+  GArray *last_client_list_stacking;
+
+  /**
+   * Size of the requests stack_sync_to_server() sent on its last run,
+   * and in total, in bytes.
+   */
+  gulong   last_sync_bytes;
+  guint64  total_sync_bytes;
+
   /**
    * Number of stack positions; same as the length of added, but
    * kept for quick reference.
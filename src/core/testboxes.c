@@ -27,6 +27,7 @@
 #include <stdio.h>
 #include <X11/Xutil.h> /* Just for the definition of the various gravities */
 #include <time.h>      /* To initialize random seed */
+#include <string.h>
 
 #define NUM_RANDOM_RUNS 10000
 
@@ -1386,10 +1387,373 @@ test_find_closest_point_to_line ()
   printf ("%s passed.\n", G_STRFUNC);
 }
 
+/* The spanning set code as it was before it became a sweep over a
+ * grid; benchmark_spanning_sets() checks the new code against it.
+ */
+/* Not so simple helper function for old_get_minimal_spanning_set_for_region() */
+static GList*
+old_merge_spanning_rects_in_region (GList *region)
+{
+  GList* compare;
+  compare = region;
+
+  if (region == NULL)
+    return NULL;
+
+  while (compare && compare->next)
+    {
+      MetaRectangle *a = compare->data;
+      GList *other = compare->next;
+
+      g_assert (a->width > 0 && a->height > 0);
+
+      while (other)
+        {
+          MetaRectangle *b = other->data;
+          GList *delete_me = NULL;
+
+          g_assert (b->width > 0 && b->height > 0);
+
+          /* If a contains b, just remove b */
+          if (meta_rectangle_contains_rect (a, b))
+            {
+              delete_me = other;
+            }
+          /* If b contains a, just remove a */
+          else if (meta_rectangle_contains_rect (a, b))
+            {
+              delete_me = compare;
+            }
+          /* If a and b might be mergeable horizontally */
+          else if (a->y == b->y && a->height == b->height)
+            {
+              /* If a and b overlap */
+              if (meta_rectangle_overlap (a, b))
+                {
+                  int new_x = MIN (a->x, b->x);
+                  a->width = MAX (a->x + a->width, b->x + b->width) - new_x;
+                  a->x = new_x;
+                  delete_me = other;
+                }
+              /* If a and b are adjacent */
+              else if (a->x + a->width == b->x || a->x == b->x + b->width)
+                {
+                  int new_x = MIN (a->x, b->x);
+                  a->width = MAX (a->x + a->width, b->x + b->width) - new_x;
+                  a->x = new_x;
+                  delete_me = other;
+                }
+            }
+          /* If a and b might be mergeable vertically */
+          else if (a->x == b->x && a->width == b->width)
+            {
+              /* If a and b overlap */
+              if (meta_rectangle_overlap (a, b))
+                {
+                  int new_y = MIN (a->y, b->y);
+                  a->height = MAX (a->y + a->height, b->y + b->height) - new_y;
+                  a->y = new_y;
+                  delete_me = other;
+                }
+              /* If a and b are adjacent */
+              else if (a->y + a->height == b->y || a->y == b->y + b->height)
+                {
+                  int new_y = MIN (a->y, b->y);
+                  a->height = MAX (a->y + a->height, b->y + b->height) - new_y;
+                  a->y = new_y;
+                  delete_me = other;
+                }
+            }
+
+          other = other->next;
+
+          /* Delete any rectangle in the list that is no longer wanted */
+          if (delete_me != NULL)
+            {
+              /* Deleting the rect we compare others to is a little tricker */
+              if (compare == delete_me)
+                {
+                  compare = compare->next;
+                  other = compare->next;
+                  a = compare->data;
+                }
+
+              /* Okay, we can free it now */
+              g_free (delete_me->data);
+              region = g_list_delete_link (region, delete_me);
+            }
+
+        }
+
+      compare = compare->next;
+    }
+
+  return region;
+}
+
+/* Simple helper function for old_get_minimal_spanning_set_for_region()... */
+static gint
+old_compare_rect_areas (gconstpointer a, gconstpointer b)
+{
+  const MetaRectangle *a_rect = (gconstpointer) a;
+  const MetaRectangle *b_rect = (gconstpointer) b;
+
+  int a_area = meta_rectangle_area (a_rect);
+  int b_area = meta_rectangle_area (b_rect);
+
+  return b_area - a_area; /* positive ret value denotes b > a, ... */
+}
+
+static GList*
+old_get_minimal_spanning_set_for_region (const MetaRectangle *basic_rect,
+                                         const GSList        *all_struts)
+{
+  GList         *ret;
+  GList         *tmp_list;
+  const GSList  *strut_iter;
+  MetaRectangle *temp_rect;
+
+  /* The algorithm is basically as follows:
+   *   Initialize rectangle_set to basic_rect
+   *   Foreach strut:
+   *     Foreach rectangle in rectangle_set:
+   *       - Split the rectangle into new rectangles that don't overlap the
+   *         strut (but which are as big as possible otherwise)
+   *       - Remove the old (pre-split) rectangle from the rectangle_set,
+   *         and replace it with the new rectangles generated from the
+   *         splitting
+   */
+
+  temp_rect = g_new (MetaRectangle, 1);
+  *temp_rect = *basic_rect;
+  ret = g_list_prepend (NULL, temp_rect);
+
+  for (strut_iter = all_struts; strut_iter; strut_iter = strut_iter->next)
+    {
+      GList *rect_iter; 
+      MetaRectangle *strut_rect = &((MetaStrut*)strut_iter->data)->rect;
+
+      tmp_list = ret;
+      ret = NULL;
+      rect_iter = tmp_list;
+      while (rect_iter)
+        {
+          MetaRectangle *rect = (MetaRectangle*) rect_iter->data;
+          if (!meta_rectangle_overlap (rect, strut_rect))
+            ret = g_list_prepend (ret, rect);
+          else
+            {
+              /* If there is area in rect left of strut */
+              if (BOX_LEFT (*rect) < BOX_LEFT (*strut_rect))
+                {
+                  temp_rect = g_new (MetaRectangle, 1);
+                  *temp_rect = *rect;
+                  temp_rect->width = BOX_LEFT (*strut_rect) - BOX_LEFT (*rect);
+                  ret = g_list_prepend (ret, temp_rect);
+                }
+              /* If there is area in rect right of strut */
+              if (BOX_RIGHT (*rect) > BOX_RIGHT (*strut_rect))
+                {
+                  int new_x;
+                  temp_rect = g_new (MetaRectangle, 1);
+                  *temp_rect = *rect;
+                  new_x = BOX_RIGHT (*strut_rect);
+                  temp_rect->width = BOX_RIGHT(*rect) - new_x;
+                  temp_rect->x = new_x;
+                  ret = g_list_prepend (ret, temp_rect);
+                }
+              /* If there is area in rect above strut */
+              if (BOX_TOP (*rect) < BOX_TOP (*strut_rect))
+                {
+                  temp_rect = g_new (MetaRectangle, 1);
+                  *temp_rect = *rect;
+                  temp_rect->height = BOX_TOP (*strut_rect) - BOX_TOP (*rect);
+                  ret = g_list_prepend (ret, temp_rect);
+                }
+              /* If there is area in rect below strut */
+              if (BOX_BOTTOM (*rect) > BOX_BOTTOM (*strut_rect))
+                {
+                  int new_y;
+                  temp_rect = g_new (MetaRectangle, 1);
+                  *temp_rect = *rect;
+                  new_y = BOX_BOTTOM (*strut_rect);
+                  temp_rect->height = BOX_BOTTOM (*rect) - new_y;
+                  temp_rect->y = new_y;
+                  ret = g_list_prepend (ret, temp_rect);
+                }
+              g_free (rect);
+            }
+          rect_iter = rect_iter->next;
+        }
+      g_list_free (tmp_list);
+    }
+
+  /* Sort by maximal area, just because I feel like it... */
+  ret = g_list_sort (ret, old_compare_rect_areas);
+
+  /* Merge rectangles if possible so that the list really is minimal */
+  ret = old_merge_spanning_rects_in_region (ret);
+
+  return ret;
+}
+
+#define BENCHMARK_MONITORS         6
+#define BENCHMARK_MONITOR_WIDTH    1920
+#define BENCHMARK_MONITOR_HEIGHT   1080
+#define BENCHMARK_RUNS             20
+
+/* Struts like the ones of docks and panels: along one of the edges of
+ * one of a row of monitors, covering part of it.
+ */
+static GSList*
+get_random_strut_list (int n_struts)
+{
+  GSList *ans;
+  int i;
+
+  ans = NULL;
+  for (i = 0; i < n_struts; i++)
+    {
+      int monitor_x = (rand () % BENCHMARK_MONITORS) * BENCHMARK_MONITOR_WIDTH;
+      int thickness = rand () % 64 + 1;
+      int x_length = rand () % BENCHMARK_MONITOR_WIDTH + 1;
+      int y_length = rand () % BENCHMARK_MONITOR_HEIGHT + 1;
+      int x_offset = rand () % (BENCHMARK_MONITOR_WIDTH - x_length + 1);
+      int y_offset = rand () % (BENCHMARK_MONITOR_HEIGHT - y_length + 1);
+
+      switch (rand () % 4)
+        {
+        case 0:
+          ans = g_slist_prepend (ans, new_meta_strut (monitor_x, y_offset,
+                                                      thickness, y_length,
+                                                      META_SIDE_LEFT));
+          break;
+        case 1:
+          ans = g_slist_prepend (ans, new_meta_strut (monitor_x + BENCHMARK_MONITOR_WIDTH - thickness,
+                                                      y_offset,
+                                                      thickness, y_length,
+                                                      META_SIDE_RIGHT));
+          break;
+        case 2:
+          ans = g_slist_prepend (ans, new_meta_strut (monitor_x + x_offset, 0,
+                                                      x_length, thickness,
+                                                      META_SIDE_TOP));
+          break;
+        case 3:
+          ans = g_slist_prepend (ans, new_meta_strut (monitor_x + x_offset,
+                                                      BENCHMARK_MONITOR_HEIGHT - thickness,
+                                                      x_length, thickness,
+                                                      META_SIDE_BOTTOM));
+          break;
+        }
+    }
+
+  return ans;
+}
+
+static gint
+compare_rects (gconstpointer a, gconstpointer b)
+{
+  const MetaRectangle *a_rect = a;
+  const MetaRectangle *b_rect = b;
+
+  if (a_rect->x != b_rect->x)
+    return a_rect->x - b_rect->x;
+  if (a_rect->y != b_rect->y)
+    return a_rect->y - b_rect->y;
+  if (a_rect->width != b_rect->width)
+    return a_rect->width - b_rect->width;
+  return a_rect->height - b_rect->height;
+}
+
+/* Rectangles of the same area can come out in either order */
+static void
+verify_regions_are_equal (GList *code, GList *answer)
+{
+  code = g_list_sort (g_list_copy (code), compare_rects);
+  answer = g_list_sort (g_list_copy (answer), compare_rects);
+
+  verify_lists_are_equal (code, answer);
+
+  g_list_free (code);
+  g_list_free (answer);
+}
+
+static void
+benchmark_spanning_sets ()
+{
+  MetaRectangle basic_rect;
+  GTimer *timer;
+  int n_struts;
+
+  basic_rect = meta_rect (0, 0,
+                          BENCHMARK_MONITORS * BENCHMARK_MONITOR_WIDTH,
+                          BENCHMARK_MONITOR_HEIGHT);
+  timer = g_timer_new ();
+
+  printf ("%8s %10s %14s %14s\n", "struts", "rects", "old us/run", "new us/run");
+
+  for (n_struts = 1; n_struts <= 128; n_struts *= 2)
+    {
+      double old_time, new_time;
+      guint n_rects;
+      int i;
+
+      old_time = new_time = 0;
+      n_rects = 0;
+
+      for (i = 0; i < BENCHMARK_RUNS; i++)
+        {
+          GSList *struts;
+          GList *old_region, *new_region;
+
+          struts = get_random_strut_list (n_struts);
+
+          g_timer_start (timer);
+          old_region = old_get_minimal_spanning_set_for_region (&basic_rect,
+                                                                struts);
+          old_time += g_timer_elapsed (timer, NULL);
+
+          g_timer_start (timer);
+          new_region = meta_rectangle_get_minimal_spanning_set_for_region (&basic_rect,
+                                                                           struts);
+          new_time += g_timer_elapsed (timer, NULL);
+
+          verify_regions_are_equal (new_region, old_region);
+          n_rects += g_list_length (new_region);
+
+          meta_rectangle_free_list_and_elements (old_region);
+          meta_rectangle_free_list_and_elements (new_region);
+          free_strut_list (struts);
+        }
+
+      printf ("%8d %10u %14.1f %14.1f\n",
+              n_struts, n_rects / BENCHMARK_RUNS,
+              old_time * 1e6 / BENCHMARK_RUNS,
+              new_time * 1e6 / BENCHMARK_RUNS);
+    }
+
+  g_timer_destroy (timer);
+
+  printf ("%s passed.\n", G_STRFUNC);
+}
+
+/* Usage: testboxes [--benchmark]
+ *
+ * With --benchmark, only compares the spanning set code against the
+ * old implementation on random strut lists of increasing size.
+ */
 int
-main()
+main (int argc, char **argv)
 {
   init_random_ness ();
+
+  if (argc > 1 && strcmp (argv[1], "--benchmark") == 0)
+    {
+      benchmark_spanning_sets ();
+      return 0;
+    }
+
   test_area ();
   test_intersect ();
   test_equal ();
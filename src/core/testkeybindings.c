@@ -0,0 +1,311 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* Mutter key binding lookup benchmark and consistency check */
+
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include "keybinding-index.h"
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/X.h>
+
+#define N_LOOKUPS 100000
+#define N_UPDATES 100
+
+static const unsigned int masks[] = {
+  0,
+  ControlMask,
+  Mod1Mask,
+  Mod4Mask,
+  ControlMask | Mod1Mask,
+  ControlMask | ShiftMask,
+  Mod4Mask | ShiftMask,
+  ControlMask | Mod1Mask | ShiftMask
+};
+
+static void
+random_binding (GRand          *rand,
+                MetaKeyBinding *binding)
+{
+  binding->name = "benchmark";
+  binding->keycode = g_rand_int_range (rand, 8, 256);
+  binding->keysym = binding->keycode + 0x1000;
+  binding->mask = masks[g_rand_int_range (rand, 0, G_N_ELEMENTS (masks))];
+  binding->modifiers = 0;
+  binding->handler = NULL;
+}
+
+/* What display_get_keybinding() used to do */
+static int
+linear_lookup (MetaKeyBinding *bindings,
+               int             n_bindings,
+               unsigned int    keysym,
+               unsigned int    keycode,
+               unsigned int    mask)
+{
+  int i;
+
+  for (i = n_bindings - 1; i >= 0; i--)
+    if (bindings[i].keysym == keysym &&
+        bindings[i].keycode == keycode &&
+        bindings[i].mask == mask)
+      return i;
+
+  return -1;
+}
+
+/* Like display_get_keybinding(), the last match wins */
+static int
+index_lookup (MetaKeyBindingIndex *idx,
+              MetaKeyBinding      *bindings,
+              unsigned int         keysym,
+              unsigned int         keycode,
+              unsigned int         mask)
+{
+  int result = -1;
+  int i;
+
+  for (i = meta_key_binding_index_lookup (idx, bindings, keycode, mask);
+       i >= 0;
+       i = meta_key_binding_index_next (idx, i))
+    if (bindings[i].keysym == keysym)
+      result = i;
+
+  return result;
+}
+
+/* Like process_event(), the first match wins */
+static int
+index_lookup_first (MetaKeyBindingIndex *idx,
+                    MetaKeyBinding      *bindings,
+                    unsigned int         keysym,
+                    unsigned int         keycode,
+                    unsigned int         mask)
+{
+  int i;
+
+  for (i = meta_key_binding_index_lookup (idx, bindings, keycode, mask);
+       i >= 0;
+       i = meta_key_binding_index_next (idx, i))
+    if (bindings[i].keysym == keysym)
+      return i;
+
+  return -1;
+}
+
+static gboolean
+check_index (MetaKeyBindingIndex *idx,
+             MetaKeyBinding      *bindings,
+             int                  n_bindings)
+{
+  unsigned int keycode;
+  guint m;
+
+  for (keycode = 8; keycode < 256; keycode++)
+    for (m = 0; m < G_N_ELEMENTS (masks); m++)
+      if (index_lookup (idx, bindings, keycode + 0x1000, keycode, masks[m]) !=
+          linear_lookup (bindings, n_bindings, keycode + 0x1000, keycode, masks[m]))
+        return FALSE;
+
+  return TRUE;
+}
+
+static int
+serial_of (MetaKeyBinding *bindings,
+           int             i)
+{
+  return i >= 0 ? (int) bindings[i].modifiers : -1;
+}
+
+/* Check that the table kept up to date across removals and additions
+ * finds the same bindings, in both precedence orders, as a table built
+ * from scratch out of the bindings still alive, in the order they were
+ * created in; that is the order a rebuild of the table gives.
+ */
+static gboolean
+check_against_fresh (MetaKeyBindingIndex *idx,
+                     MetaKeyBinding      *bindings,
+                     int                  n_bindings,
+                     MetaKeyBinding      *created,
+                     gboolean            *alive,
+                     int                  n_created)
+{
+  MetaKeyBindingIndex *fresh_idx = meta_key_binding_index_new ();
+  MetaKeyBinding *fresh = g_new (MetaKeyBinding, n_bindings);
+  unsigned int keycode;
+  gboolean ok = TRUE;
+  int n_fresh = 0;
+  guint m;
+  int i;
+
+  for (i = 0; i < n_created; i++)
+    if (alive[i])
+      fresh[n_fresh++] = created[i];
+
+  meta_key_binding_index_rebuild (fresh_idx, fresh, n_fresh);
+
+  for (keycode = 8; keycode < 256; keycode++)
+    for (m = 0; m < G_N_ELEMENTS (masks); m++)
+      {
+        unsigned int keysym = keycode + 0x1000;
+        unsigned int mask = masks[m];
+
+        if (serial_of (bindings,
+                       index_lookup (idx, bindings, keysym, keycode, mask)) !=
+            serial_of (fresh,
+                       index_lookup (fresh_idx, fresh, keysym, keycode, mask)) ||
+            serial_of (bindings,
+                       index_lookup_first (idx, bindings, keysym, keycode, mask)) !=
+            serial_of (fresh,
+                       index_lookup_first (fresh_idx, fresh, keysym, keycode, mask)))
+          ok = FALSE;
+      }
+
+  meta_key_binding_index_free (fresh_idx);
+  g_free (fresh);
+
+  return ok;
+}
+
+static gboolean
+run_case (int n_bindings)
+{
+  GRand *rand = g_rand_new_with_seed (n_bindings);
+  MetaKeyBindingIndex *idx = meta_key_binding_index_new ();
+  MetaKeyBinding *bindings;
+  MetaKeyBinding *keys;
+  MetaKeyBinding *created;
+  gboolean *alive;
+  int n_created;
+  gint64 start;
+  double linear_time, index_time, rebuild_time, update_time;
+  volatile int sink = 0;
+  gboolean ok = TRUE;
+  int i;
+
+  /* Every binding remembers its serial number in the modifiers, so
+   * that it can be found in the freshly built table as well.
+   */
+  bindings = g_new (MetaKeyBinding, n_bindings);
+  created = g_new (MetaKeyBinding, n_bindings + N_UPDATES);
+  alive = g_new (gboolean, n_bindings + N_UPDATES);
+  for (i = 0; i < n_bindings; i++)
+    {
+      random_binding (rand, &bindings[i]);
+      bindings[i].modifiers = i;
+      created[i] = bindings[i];
+      alive[i] = TRUE;
+    }
+  n_created = n_bindings;
+
+  /* Half the key presses hit a binding, half don't */
+  keys = g_new (MetaKeyBinding, N_LOOKUPS);
+  for (i = 0; i < N_LOOKUPS; i++)
+    {
+      if (i % 2 == 0)
+        keys[i] = bindings[g_rand_int_range (rand, 0, n_bindings)];
+      else
+        random_binding (rand, &keys[i]);
+    }
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < N_LOOKUPS; i++)
+    sink += linear_lookup (bindings, n_bindings,
+                           keys[i].keysym, keys[i].keycode, keys[i].mask);
+  linear_time = (g_get_monotonic_time () - start) * 1000. / N_LOOKUPS;
+
+  meta_key_binding_index_rebuild (idx, bindings, n_bindings);
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < N_LOOKUPS; i++)
+    sink += index_lookup (idx, bindings,
+                          keys[i].keysym, keys[i].keycode, keys[i].mask);
+  index_time = (g_get_monotonic_time () - start) * 1000. / N_LOOKUPS;
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < 100; i++)
+    meta_key_binding_index_rebuild (idx, bindings, n_bindings);
+  rebuild_time = (g_get_monotonic_time () - start) / 100.;
+
+  ok &= check_index (idx, bindings, n_bindings);
+
+  /* Replace one binding at a time the way the keybindings code does:
+   * move the later bindings down over it, then append a new one.
+   */
+  start = g_get_monotonic_time ();
+  for (i = 0; i < N_UPDATES; i++)
+    {
+      int victim = g_rand_int_range (rand, 0, n_bindings);
+      int last = n_bindings - 1;
+
+      alive[bindings[victim].modifiers] = FALSE;
+      meta_key_binding_index_delete (idx, bindings, victim, n_bindings);
+      memmove (&bindings[victim], &bindings[victim + 1],
+               (last - victim) * sizeof (MetaKeyBinding));
+
+      random_binding (rand, &bindings[last]);
+      bindings[last].modifiers = n_created;
+      created[n_created] = bindings[last];
+      alive[n_created++] = TRUE;
+      meta_key_binding_index_add (idx, bindings, last);
+    }
+  update_time = (g_get_monotonic_time () - start) / (double) N_UPDATES;
+
+  ok &= check_index (idx, bindings, n_bindings);
+  ok &= check_against_fresh (idx, bindings, n_bindings,
+                             created, alive, n_created);
+
+  printf ("%5d bindings: lookup linear %8.1fns index %6.1fns   "
+          "rebuild %7.2fus   delete+add %5.2fus%s\n",
+          n_bindings, linear_time, index_time,
+          rebuild_time, update_time, ok ? "" : "   (MISMATCH)");
+
+  meta_key_binding_index_free (idx);
+  g_free (bindings);
+  g_free (keys);
+  g_free (created);
+  g_free (alive);
+  g_rand_free (rand);
+
+  return ok;
+}
+
+int
+main (int argc, char **argv)
+{
+  static const int sizes[] = { 10, 100, 1000 };
+  gboolean ok = TRUE;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++)
+    ok &= run_case (sizes[i]);
+
+  if (!ok)
+    {
+      printf ("Index lookups differ from the linear scan or a fresh table!\n");
+      return 1;
+    }
+
+  printf ("Index lookups agree with the linear scan and a fresh table.\n");
+  return 0;
+}
@@ -749,13 +749,49 @@ typedef struct
   GDestroyNotify notify;
   int source;
   gboolean run_once;
+  GList *link; /* in laters[when] */
 } MetaLater;
 
-static GSList *laters = NULL;
+#define N_LATER_TYPES (META_LATER_IDLE + 1)
+
+/* Laters of each type, in the order they were added; each queue owns a
+ * reference to its laters. Removing a later while run_repaint_laters()
+ * is walking the queues only takes it out of laters_by_id, and leaves
+ * the unlinking to when the walk is over.
+ */
+static GQueue laters[N_LATER_TYPES];
+static GHashTable *laters_by_id = NULL;
+static int running_laters = 0;
+static GSList *removed_laters = NULL;
+
 /* This is a dummy timeline used to get the Clutter master clock running */
 static ClutterTimeline *later_timeline;
 static guint later_repaint_func = 0;
 
+/* How long the laters of each type took in each of the last
+ * LATER_TIMING_FRAMES frames, logged under META_DEBUG_COMPOSITOR once
+ * every that many frames.
+ */
+#define LATER_TIMING_FRAMES 60
+
+typedef struct
+{
+  gint64 time[N_LATER_TYPES]; /* microseconds */
+  guint  n_run[N_LATER_TYPES];
+} LaterFrameTiming;
+
+static LaterFrameTiming later_timings[LATER_TIMING_FRAMES];
+static guint later_timing_frame = 0;
+
+static const char * const later_type_names[N_LATER_TYPES] = {
+  "resize",
+  "calc-showing",
+  "check-fullscreen",
+  "sync-stack",
+  "before-redraw",
+  "idle"
+};
+
 static void ensure_later_repaint_func (void);
 
 static void
@@ -784,54 +820,127 @@ destroy_later (MetaLater *later)
   unref_later (later);
 }
 
-/* Used to sort the list of laters with the highest priority
- * functions first.
- */
-static int
-compare_laters (gconstpointer a,
-                gconstpointer b)
+static void
+unlink_later (MetaLater *later)
+{
+  g_queue_delete_link (&laters[later->when], later->link);
+  later->link = NULL;
+  destroy_later (later);
+}
+
+static gboolean
+run_later (MetaLater *later)
+{
+  LaterFrameTiming *timing = &later_timings[later_timing_frame];
+  gboolean result;
+  gint64 start;
+
+  start = g_get_monotonic_time ();
+  result = later->func (later->data);
+
+  timing->time[later->when] += g_get_monotonic_time () - start;
+  timing->n_run[later->when] += 1;
+
+  return result;
+}
+
+static void
+print_later_timings (void)
+{
+  int type, frame;
+
+  for (type = 0; type < N_LATER_TYPES; type++)
+    {
+      gint64 total = 0, max = 0;
+      guint n_run = 0;
+
+      for (frame = 0; frame < LATER_TIMING_FRAMES; frame++)
+        {
+          total += later_timings[frame].time[type];
+          max = MAX (max, later_timings[frame].time[type]);
+          n_run += later_timings[frame].n_run[type];
+        }
+
+      if (n_run == 0)
+        continue;
+
+      meta_topic (META_DEBUG_COMPOSITOR,
+                  "Laters %-16s: %u run in the last %d frames, "
+                  "%" G_GINT64_FORMAT " us/frame average, "
+                  "%" G_GINT64_FORMAT " us max\n",
+                  later_type_names[type], n_run, LATER_TIMING_FRAMES,
+                  total / LATER_TIMING_FRAMES, max);
+    }
+}
+
+static void
+next_later_timing_frame (void)
 {
-  return ((const MetaLater *)a)->when - ((const MetaLater *)b)->when;
+  later_timing_frame = (later_timing_frame + 1) % LATER_TIMING_FRAMES;
+  if (later_timing_frame == 0)
+    print_later_timings ();
+
+  memset (&later_timings[later_timing_frame], 0, sizeof (LaterFrameTiming));
 }
 
 static gboolean
 run_repaint_laters (gpointer data)
 {
-  GSList *laters_copy;
-  GSList *l;
   gboolean keep_timeline_running = FALSE;
+  guint last_id;
+  int when;
+
+  /* Laters added by the ones we run wait for the next frame */
+  last_id = last_later_id;
 
-  laters_copy = NULL;
-  for (l = laters; l; l = l->next)
+  running_laters++;
+
+  for (when = 0; when <= META_LATER_BEFORE_REDRAW; when++)
     {
-      MetaLater *later = l->data;
-      if (later->source == 0 ||
-          (later->when <= META_LATER_BEFORE_REDRAW && !later->run_once))
+      GList *l;
+
+      for (l = laters[when].head; l; l = l->next)
         {
+          MetaLater *later = l->data;
+
+          if (later->id > last_id)
+            break;
+
+          if (later->func == NULL)
+            continue; /* removed */
+
+          if (later->source != 0 && later->run_once)
+            continue;
+
           later->ref_count++;
-          laters_copy = g_slist_prepend (laters_copy, later);
+
+          if (run_later (later))
+            {
+              if (later->source == 0)
+                keep_timeline_running = TRUE;
+            }
+          else
+            meta_later_remove (later->id);
+
+          unref_later (later);
         }
     }
-  laters_copy = g_slist_reverse (laters_copy);
 
-  for (l = laters_copy; l; l = l->next)
+  if (--running_laters == 0)
     {
-      MetaLater *later = l->data;
+      GSList *l;
 
-      if (later->func && later->func (later->data))
-        {
-          if (later->source == 0)
-            keep_timeline_running = TRUE;
-        }
-      else
-        meta_later_remove (later->id);
-      unref_later (later);
+      for (l = removed_laters; l; l = l->next)
+        unlink_later (l->data);
+
+      g_slist_free (removed_laters);
+      removed_laters = NULL;
     }
 
   if (!keep_timeline_running)
     clutter_timeline_stop (later_timeline);
 
-  g_slist_free (laters_copy);
+  next_later_timing_frame ();
 
   /* Just keep the repaint func around - it's cheap if the list is empty */
   return TRUE;
@@ -856,7 +965,7 @@ call_idle_later (gpointer data)
 {
   MetaLater *later = data;
 
-  if (!later->func (later->data))
+  if (!run_later (later))
     {
       meta_later_remove (later->id);
       return FALSE;
@@ -893,6 +1002,9 @@ meta_later_add (MetaLaterType  when,
 {
   MetaLater *later = g_slice_new0 (MetaLater);
 
+  if (laters_by_id == NULL)
+    laters_by_id = g_hash_table_new (NULL, NULL);
+
   later->id = ++last_later_id;
   later->ref_count = 1;
   later->when = when;
@@ -900,7 +1012,9 @@ meta_later_add (MetaLaterType  when,
   later->data = data;
   later->notify = notify;
 
-  laters = g_slist_insert_sorted (laters, later, compare_laters);
+  g_queue_push_tail (&laters[when], later);
+  later->link = laters[when].tail;
+  g_hash_table_insert (laters_by_id, GUINT_TO_POINTER (later->id), later);
 
   switch (when)
     {
@@ -939,22 +1053,34 @@ meta_later_add (MetaLaterType  when,
 void
 meta_later_remove (guint later_id)
 {
-  GSList *l;
+  MetaLater *later;
+
+  if (laters_by_id == NULL)
+    return;
+
+  later = g_hash_table_lookup (laters_by_id, GUINT_TO_POINTER (later_id));
+  if (later == NULL)
+    return;
 
-  for (l = laters; l; l = l->next)
+  g_hash_table_remove (laters_by_id, GUINT_TO_POINTER (later_id));
+
+  if (running_laters > 0)
     {
-      MetaLater *later = l->data;
-      if (later->id == later_id)
+      /* Don't run it, but leave the queue as it is until
+       * run_repaint_laters() is done with it
+       */
+      if (later->source)
         {
-          laters = g_slist_delete_link (laters, l);
-          /* If this was a "repaint func" later, we just let the
-           * repaint func run and get removed
-           */
-          destroy_later (later);
-          return;
+          g_source_remove (later->source);
+          later->source = 0;
         }
+      later->func = NULL;
+      removed_laters = g_slist_prepend (removed_laters, later);
+    }
+  else
+    {
+      unlink_later (later);
     }
 }
 
 /* eof util.c */
-
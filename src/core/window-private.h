@@ -384,6 +384,10 @@ struct _MetaWindow
 
   /* window that gets updated net_wm_user_time values */
   Window user_time_window;
+
+  /* Atoms with a PropertyNotify that hasn't been handled yet, or NULL;
+   * see meta_window_queue_property_notify() */
+  GArray *pending_property_notifies;
   
   /* The size we set the window to last (i.e. what we believe
    * to be its actual size on the server). The x, y are
@@ -428,6 +432,9 @@ struct _MetaWindow
   /* Managed by stack.c */
   MetaStackLayer layer;
   int stack_position; /* see comment in stack.h */
+
+  /* Our index in each of the window queues, or -1; see window.c */
+  int queue_slot[NUMBER_OF_QUEUES];
   
   /* Current dialog open for this window */
   int dialog_pid;
@@ -680,7 +687,9 @@ gboolean meta_window_updates_are_frozen (MetaWindow *window);
 
 void meta_window_set_opaque_region        (MetaWindow     *window,
                                            cairo_region_t *region);
-void meta_window_update_opaque_region_x11 (MetaWindow *window);
+void meta_window_update_opaque_region_x11 (MetaWindow   *window,
+                                           const gulong *region,
+                                           int           nitems);
 
 void meta_window_set_shape_region         (MetaWindow     *window,
                                            cairo_region_t *region);
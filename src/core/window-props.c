@@ -70,6 +70,9 @@ struct _MetaWindowPropHooks
 static void init_prop_value            (MetaWindow          *window,
                                         MetaWindowPropHooks *hooks,
                                         MetaPropValue       *value);
+static void init_prop_value_for_hooks  (MetaWindowPropHooks *hooks,
+                                        gboolean             override_redirect,
+                                        MetaPropValue       *value);
 static void reload_prop_value          (MetaWindow          *window,
                                         MetaWindowPropHooks *hooks,
                                         MetaPropValue       *value,
@@ -93,6 +96,13 @@ meta_window_reload_property_from_xwindow (MetaWindow      *window,
 
   init_prop_value (window, hooks, &value);
 
+  /* Whatever a fetch still in flight returns would be older than this
+   * and must not overwrite it; reload_net_wm_name() for instance
+   * reloads WM_NAME here while a fetch of it may be pending.
+   */
+  meta_prop_cancel_value_fetch (window->display, xwindow,
+                                property, window);
+
   meta_prop_get_values (window->display, xwindow,
                         &value, 1);
 
@@ -113,29 +123,409 @@ meta_window_reload_property (MetaWindow      *window,
                                             initial);
 }
 
+/* How often each property changes, against how often we actually
+ * went and got its value; see meta_window_queue_property_notify()
+ */
+typedef struct
+{
+  guint n_notifies;
+  guint n_reloads;
+} PropertyNotifyStats;
+
+/* A queued reload, between sending the request and handling the reply */
+typedef struct
+{
+  MetaWindow *window;
+  MetaWindowPropHooks *hooks;
+  MetaPropValue value;
+  MetaPropRequest *request;
+} PendingReload;
+
+static PropertyNotifyStats *
+get_property_notify_stats (MetaDisplay *display,
+                           Atom         property)
+{
+  PropertyNotifyStats *stats;
+
+  if (display->property_notify_stats == NULL)
+    display->property_notify_stats =
+      g_hash_table_new_full (NULL, NULL, NULL, g_free);
+
+  stats = g_hash_table_lookup (display->property_notify_stats,
+                               GINT_TO_POINTER (property));
+  if (stats == NULL)
+    {
+      stats = g_new0 (PropertyNotifyStats, 1);
+      g_hash_table_insert (display->property_notify_stats,
+                           GINT_TO_POINTER (property), stats);
+    }
+
+  return stats;
+}
+
+/* Properties that only affect how the window is presented; nothing
+ * that happens later depends on them having been reloaded, so the
+ * main loop doesn't have to wait for their values.
+ */
+static gboolean
+can_reload_async (MetaDisplay *display,
+                  Atom         property)
+{
+  return (property == display->atom__NET_WM_NAME ||
+          property == XA_WM_NAME ||
+          property == display->atom__NET_WM_ICON_NAME ||
+          property == XA_WM_ICON_NAME ||
+          property == display->atom__NET_WM_OPAQUE_REGION ||
+          property == display->atom__NET_WM_ICON_GEOMETRY);
+}
+
+static void
+async_reload_done (MetaDisplay   *display,
+                   Window         xwindow,
+                   MetaPropValue *value,
+                   gpointer       user_data)
+{
+  MetaWindow *window = user_data;
+
+  reload_prop_value (window, find_hooks (display, value->atom), value,
+                     FALSE);
+}
+
+/* Returns %FALSE if there was nothing to fetch, in which case the
+ * caller has to reload the property itself. */
+static gboolean
+reload_property_async (MetaWindow          *window,
+                       MetaWindowPropHooks *hooks)
+{
+  MetaPropValue value = { 0, };
+
+  init_prop_value (window, hooks, &value);
+  if (value.atom == None)
+    return FALSE;
+
+  meta_prop_fetch_value_async (window->display, window->xwindow,
+                               value.atom, value.type,
+                               async_reload_done, window);
+
+  return TRUE;
+}
+
+static gboolean
+flush_property_notifies_idle (gpointer data)
+{
+  MetaDisplay *display = data;
+
+  display->property_notify_idle_id = 0;
+  meta_display_flush_property_notifies (display);
+
+  return FALSE;
+}
+
 void
-meta_window_load_initial_properties (MetaWindow *window)
+meta_window_queue_property_notify (MetaWindow *window,
+                                   Atom        property)
 {
-  int i, j;
-  MetaPropValue *values;
-  int n_properties = 0;
+  MetaDisplay *display = window->display;
+  GArray *pending;
+  guint i;
+
+  get_property_notify_stats (display, property)->n_notifies++;
+
+  if (!find_hooks (display, property))
+    return;
+
+  pending = window->pending_property_notifies;
+  if (pending == NULL)
+    {
+      pending = g_array_new (FALSE, FALSE, sizeof (Atom));
+      window->pending_property_notifies = pending;
+      display->property_notify_windows =
+        g_slist_prepend (display->property_notify_windows, window);
+    }
+  else
+    {
+      for (i = 0; i < pending->len; i++)
+        if (g_array_index (pending, Atom, i) == property)
+          return;
+    }
+
+  g_array_append_val (pending, property);
+
+  if (display->property_notify_idle_id == 0)
+    display->property_notify_idle_id =
+      g_idle_add_full (G_PRIORITY_DEFAULT,
+                       flush_property_notifies_idle, display, NULL);
+}
+
+void
+meta_window_discard_property_notifies (MetaWindow *window)
+{
+  meta_prop_cancel_value_fetches (window->display, window);
+
+  if (window->pending_property_notifies == NULL)
+    return;
+
+  g_array_free (window->pending_property_notifies, TRUE);
+  window->pending_property_notifies = NULL;
+
+  window->display->property_notify_windows =
+    g_slist_remove (window->display->property_notify_windows, window);
+}
+
+void
+meta_display_flush_property_notifies (MetaDisplay *display)
+{
+  GSList *windows, *l;
+  PendingReload *reloads;
+  int n_reloads, n_requests, n_async, i;
+
+  if (display->property_notify_windows == NULL)
+    return;
+
+  /* Take the whole queue first; reloading can queue up more */
+  windows = g_slist_reverse (display->property_notify_windows);
+  display->property_notify_windows = NULL;
+
+  n_reloads = 0;
+  for (l = windows; l; l = l->next)
+    n_reloads += ((MetaWindow *) l->data)->pending_property_notifies->len;
+
+  reloads = g_new0 (PendingReload, n_reloads);
+
+  /* Send all the requests before waiting for any of the replies */
+  i = 0;
+  n_requests = 0;
+  n_async = 0;
+  for (l = windows; l; l = l->next)
+    {
+      MetaWindow *window = l->data;
+      GArray *pending = window->pending_property_notifies;
+      guint j;
+
+      window->pending_property_notifies = NULL;
+
+      for (j = 0; j < pending->len; j++)
+        {
+          Atom property = g_array_index (pending, Atom, j);
+          MetaWindowPropHooks *hooks = find_hooks (display, property);
+          PendingReload *reload;
+          Window xwindow = window->xwindow;
+
+          get_property_notify_stats (display, property)->n_reloads++;
+
+          if (can_reload_async (display, property) &&
+              reload_property_async (window, hooks))
+            {
+              n_async++;
+              continue;
+            }
+
+          reload = &reloads[i++];
+
+          if (property == display->atom__NET_WM_USER_TIME &&
+              window->user_time_window)
+            xwindow = window->user_time_window;
+
+          reload->window = g_object_ref (window);
+          reload->hooks = hooks;
+          init_prop_value (window, reload->hooks, &reload->value);
+
+          if (reload->value.atom != None)
+            {
+              reload->request = meta_prop_request_values (display, xwindow,
+                                                          &reload->value, 1);
+              n_requests++;
+            }
+        }
+
+      g_array_free (pending, TRUE);
+    }
+
+  g_slist_free (windows);
 
-  values = g_new0 (MetaPropValue, window->display->n_prop_hooks);
+  meta_verbose ("Reloading %d properties, %d of them fetched and %d "
+                "fetched asynchronously\n",
+                n_reloads, n_requests, n_async);
+
+  /* Asynchronous reloads didn't take an entry */
+  n_reloads = i;
+  for (i = 0; i < n_reloads; i++)
+    {
+      PendingReload *reload = &reloads[i];
+
+      if (reload->request)
+        meta_prop_collect_values (reload->request);
+
+      if (!reload->window->unmanaging)
+        reload_prop_value (reload->window, reload->hooks, &reload->value,
+                           FALSE);
+
+      meta_prop_free_values (&reload->value, 1);
+      g_object_unref (reload->window);
+    }
+
+  g_free (reloads);
+}
+
+static void
+log_property_notify_stats (gpointer key,
+                           gpointer value,
+                           gpointer data)
+{
+  MetaDisplay *display = data;
+  PropertyNotifyStats *stats = value;
+  char *property_name;
+
+  meta_error_trap_push (display);
+  property_name = XGetAtomName (display->xdisplay, GPOINTER_TO_INT (key));
+  meta_error_trap_pop (display);
+
+  meta_verbose ("  %-40s %8u notifies %8u reloads\n",
+                property_name ? property_name : "(unknown)",
+                stats->n_notifies, stats->n_reloads);
+
+  if (property_name)
+    XFree (property_name);
+}
+
+/* Initial properties requested ahead of managing a window; see
+ * meta_display_prefetch_initial_properties()
+ */
+typedef struct
+{
+  Window xwindow;
+  gboolean override_redirect;
+  MetaPropValue *values;
+  int n_values;
+  MetaPropRequest *request;
+} PrefetchedProperties;
+
+static int
+init_initial_prop_values (MetaDisplay   *display,
+                          gboolean       override_redirect,
+                          MetaPropValue *values)
+{
+  int i, j;
 
   j = 0;
-  for (i = 0; i < window->display->n_prop_hooks; i++)
+  for (i = 0; i < display->n_prop_hooks; i++)
     {
-      MetaWindowPropHooks *hooks = &window->display->prop_hooks_table[i];
+      MetaWindowPropHooks *hooks = &display->prop_hooks_table[i];
       if (hooks->load_initially)
         {
-          init_prop_value (window, hooks, &values[j]);
+          init_prop_value_for_hooks (hooks, override_redirect, &values[j]);
           ++j;
         }
     }
-  n_properties = j;
 
-  meta_prop_get_values (window->display, window->xwindow,
-                        values, n_properties);
+  return j;
+}
+
+static void
+prefetched_properties_free (PrefetchedProperties *prefetched)
+{
+  if (prefetched->request)
+    {
+      meta_prop_collect_values (prefetched->request);
+      meta_prop_free_values (prefetched->values, prefetched->n_values);
+    }
+
+  g_free (prefetched->values);
+  g_slice_free (PrefetchedProperties, prefetched);
+}
+
+void
+meta_display_prefetch_initial_properties (MetaDisplay *display,
+                                          Window       xwindow,
+                                          gboolean     override_redirect)
+{
+  PrefetchedProperties *prefetched;
+
+  if (display->prefetched_properties == NULL)
+    display->prefetched_properties =
+      g_hash_table_new_full (meta_unsigned_long_hash, meta_unsigned_long_equal,
+                             NULL,
+                             (GDestroyNotify) prefetched_properties_free);
+  else if (g_hash_table_lookup (display->prefetched_properties, &xwindow))
+    return;
+
+  prefetched = g_slice_new (PrefetchedProperties);
+  prefetched->xwindow = xwindow;
+  prefetched->override_redirect = override_redirect;
+  prefetched->values = g_new0 (MetaPropValue, display->n_prop_hooks);
+  prefetched->n_values = init_initial_prop_values (display, override_redirect,
+                                                   prefetched->values);
+  prefetched->request = meta_prop_request_values (display, xwindow,
+                                                  prefetched->values,
+                                                  prefetched->n_values);
+
+  g_hash_table_insert (display->prefetched_properties,
+                       &prefetched->xwindow, prefetched);
+}
+
+void
+meta_display_discard_prefetched_properties (MetaDisplay *display)
+{
+  if (display->prefetched_properties == NULL)
+    return;
+
+  g_hash_table_destroy (display->prefetched_properties);
+  display->prefetched_properties = NULL;
+}
+
+/* Takes the prefetched values for window if there are any; the
+ * caller frees them like ones it fetched itself.
+ */
+static gboolean
+take_prefetched_properties (MetaWindow     *window,
+                            MetaPropValue **values,
+                            int            *n_values)
+{
+  PrefetchedProperties *prefetched;
+  gboolean usable;
+
+  if (window->display->prefetched_properties == NULL)
+    return FALSE;
+
+  prefetched = g_hash_table_lookup (window->display->prefetched_properties,
+                                    &window->xwindow);
+  if (prefetched == NULL)
+    return FALSE;
+
+  usable = prefetched->override_redirect == window->override_redirect;
+  if (usable)
+    {
+      meta_prop_collect_values (prefetched->request);
+      prefetched->request = NULL;
+
+      *values = prefetched->values;
+      *n_values = prefetched->n_values;
+      prefetched->values = NULL;
+    }
+
+  g_hash_table_remove (window->display->prefetched_properties,
+                       &window->xwindow);
+
+  return usable;
+}
+
+void
+meta_window_load_initial_properties (MetaWindow *window)
+{
+  int i, j;
+  MetaPropValue *values;
+  int n_properties = 0;
+
+  if (!take_prefetched_properties (window, &values, &n_properties))
+    {
+      values = g_new0 (MetaPropValue, window->display->n_prop_hooks);
+      n_properties = init_initial_prop_values (window->display,
+                                               window->override_redirect,
+                                               values);
+
+      meta_prop_get_values (window->display, window->xwindow,
+                            values, n_properties);
+    }
 
   j = 0;
   for (i = 0; i < window->display->n_prop_hooks; i++)
@@ -163,9 +553,17 @@ static void
 init_prop_value (MetaWindow          *window,
                  MetaWindowPropHooks *hooks,
                  MetaPropValue       *value)
+{
+  init_prop_value_for_hooks (hooks, window->override_redirect, value);
+}
+
+static void
+init_prop_value_for_hooks (MetaWindowPropHooks *hooks,
+                           gboolean             override_redirect,
+                           MetaPropValue       *value)
 {
   if (!hooks || hooks->type == META_PROP_VALUE_INVALID ||
-      (window->override_redirect && !hooks->include_override_redirect))
+      (override_redirect && !hooks->include_override_redirect))
     {
       value->type = META_PROP_VALUE_INVALID;
       value->atom = None;
@@ -565,7 +963,12 @@ reload_opaque_region (MetaWindow    *window,
                       MetaPropValue *value,
                       gboolean       initial)
 {
-  meta_window_update_opaque_region_x11 (window);
+  if (value->type != META_PROP_VALUE_INVALID)
+    meta_window_update_opaque_region_x11 (window,
+                                          value->v.cardinal_list.cardinals,
+                                          value->v.cardinal_list.n_cardinals);
+  else
+    meta_window_update_opaque_region_x11 (window, NULL, 0);
 }
 
 static void
@@ -1839,6 +2242,27 @@ meta_display_init_window_prop_hooks (MetaDisplay *display)
 void
 meta_display_free_window_prop_hooks (MetaDisplay *display)
 {
+  meta_display_discard_prefetched_properties (display);
+
+  if (display->property_notify_idle_id != 0)
+    {
+      g_source_remove (display->property_notify_idle_id);
+      display->property_notify_idle_id = 0;
+    }
+
+  if (display->property_notify_stats != NULL)
+    {
+      if (meta_is_verbose ())
+        {
+          meta_verbose ("Property notifies received and reloads done:\n");
+          g_hash_table_foreach (display->property_notify_stats,
+                                log_property_notify_stats, display);
+        }
+
+      g_hash_table_destroy (display->property_notify_stats);
+      display->property_notify_stats = NULL;
+    }
+
   g_hash_table_unref (display->prop_hooks);
   display->prop_hooks = NULL;
 
@@ -51,6 +51,38 @@ void meta_window_reload_property_from_xwindow (MetaWindow      *window,
                                                Atom             property,
                                                gboolean         initial);
 
+/**
+ * meta_window_queue_property_notify:
+ * @window:     The window.
+ * @property:   The atom a PropertyNotify was received for.
+ *
+ * Arranges for @property of @window to be reloaded by
+ * meta_display_flush_property_notifies(). Any number of notifies
+ * for the same property before then cause a single reload, and the
+ * values of all queued properties are fetched in one round trip.
+ */
+void meta_window_queue_property_notify (MetaWindow *window,
+                                        Atom        property);
+
+/**
+ * meta_window_discard_property_notifies:
+ * @window:     The window.
+ *
+ * Drops the queued reloads for a window that is being unmanaged.
+ */
+void meta_window_discard_property_notifies (MetaWindow *window);
+
+/**
+ * meta_display_flush_property_notifies:
+ * @display:  The display.
+ *
+ * Reloads the properties queued with meta_window_queue_property_notify().
+ * This happens on its own once the current batch of events has been
+ * handled, but has to be done sooner before handling an event that
+ * might depend on the new values.
+ */
+void meta_display_flush_property_notifies (MetaDisplay *display);
+
 /**
  * meta_window_load_initial_properties:
  * @window:      The window.
@@ -61,6 +93,31 @@ void meta_window_reload_property_from_xwindow (MetaWindow      *window,
  */
 void meta_window_load_initial_properties (MetaWindow *window);
 
+/**
+ * meta_display_prefetch_initial_properties:
+ * @display:           The display.
+ * @xwindow:           A window that is about to be managed.
+ * @override_redirect: Whether @xwindow is override-redirect.
+ *
+ * Sends the requests for the properties that
+ * meta_window_load_initial_properties() will need for @xwindow,
+ * without waiting for the replies. Doing this for a batch of windows
+ * before managing any of them lets all the replies come back in a
+ * single round trip.
+ */
+void meta_display_prefetch_initial_properties (MetaDisplay *display,
+                                               Window       xwindow,
+                                               gboolean     override_redirect);
+
+/**
+ * meta_display_discard_prefetched_properties:
+ * @display:  The display.
+ *
+ * Drops the prefetched properties of windows that didn't end up
+ * being managed.
+ */
+void meta_display_discard_prefetched_properties (MetaDisplay *display);
+
 /**
  * meta_display_init_window_prop_hooks:
  * @display:  The display.
@@ -829,6 +829,7 @@ meta_window_new_with_attrs (MetaDisplay       *display,
   gulong event_mask;
   MetaMoveResizeFlags flags;
   MetaScreen *screen;
+  int i;
 
   g_assert (attrs != NULL);
 
@@ -1095,6 +1096,8 @@ meta_window_new_with_attrs (MetaDisplay       *display,
   window->denied_focus_and_not_transient = FALSE;
   window->unmanaging = FALSE;
   window->is_in_queues = 0;
+  for (i = 0; i < NUMBER_OF_QUEUES; i++)
+    window->queue_slot[i] = -1;
   window->keys_grabbed = FALSE;
   window->grab_on_frame = FALSE;
   window->all_keys_grabbed = FALSE;
@@ -1664,6 +1667,8 @@ meta_window_unmanage (MetaWindow  *window,
 
   meta_verbose ("Unmanaging 0x%lx\n", window->xwindow);
 
+  meta_window_discard_property_notifies (window);
+
   if (window->display->compositor)
     {
       if (window->visible_to_compositor)
@@ -2267,8 +2272,118 @@ meta_window_calc_showing (MetaWindow  *window)
   implement_showing (window, meta_window_should_be_showing (window));
 }
 
+#ifdef WITH_VERBOSE_MODE
+static const gchar* meta_window_queue_names[NUMBER_OF_QUEUES] =
+  {"calc_showing", "move_resize", "update_icon"};
+#endif
+
+/* The windows waiting in one of the queues, in no particular order.
+ * Each window stores its index in window->queue_slot[], so that it
+ * can be added and removed in constant time.
+ */
+typedef struct
+{
+  MetaWindow **windows;
+  guint        n_windows;
+  guint        n_allocated;
+
+  /* For debugging output */
+  guint        peak_windows;
+  gint64       drain_start;
+} MetaWindowQueue;
+
 static guint queue_later[NUMBER_OF_QUEUES] = {0, 0, 0};
-static GSList *queue_pending[NUMBER_OF_QUEUES] = {NULL, NULL, NULL};
+static MetaWindowQueue queue_pending[NUMBER_OF_QUEUES];
+
+static void
+window_queue_append (guint       queuenum,
+                     MetaWindow *window)
+{
+  MetaWindowQueue *queue = &queue_pending[queuenum];
+
+  if (queue->n_windows == queue->n_allocated)
+    {
+      queue->n_allocated = MAX (16, 2 * queue->n_allocated);
+      queue->windows = g_renew (MetaWindow *, queue->windows,
+                                queue->n_allocated);
+    }
+
+  window->queue_slot[queuenum] = queue->n_windows;
+  queue->windows[queue->n_windows++] = window;
+
+  queue->peak_windows = MAX (queue->peak_windows, queue->n_windows);
+}
+
+static void
+window_queue_remove (guint       queuenum,
+                     MetaWindow *window)
+{
+  MetaWindowQueue *queue = &queue_pending[queuenum];
+  int slot = window->queue_slot[queuenum];
+  MetaWindow *last;
+
+  /* The window may not actually be in the queue because it may be
+   * in the batch an idle handler is working on
+   */
+  if (slot < 0)
+    return;
+
+  g_assert (queue->windows[slot] == window);
+
+  last = queue->windows[--queue->n_windows];
+  queue->windows[slot] = last;
+  last->queue_slot[queuenum] = slot;
+
+  window->queue_slot[queuenum] = -1;
+}
+
+/* Empties a queue for its idle handler, which must pass the batch to
+ * window_queue_finish() when it's done with it. The windows keep
+ * their is_in_queues bit, so that queueing them again while the
+ * batch is being worked on does nothing.
+ */
+static MetaWindow **
+window_queue_take (guint  queuenum,
+                   guint *n_windows)
+{
+  MetaWindowQueue *queue = &queue_pending[queuenum];
+  MetaWindow **windows;
+  guint i;
+
+  windows = queue->windows;
+  *n_windows = queue->n_windows;
+
+  for (i = 0; i < queue->n_windows; i++)
+    windows[i]->queue_slot[queuenum] = -1;
+
+  queue->windows = NULL;
+  queue->n_windows = 0;
+  queue->n_allocated = 0;
+  queue_later[queuenum] = 0;
+
+  queue->drain_start = g_get_monotonic_time ();
+
+  return windows;
+}
+
+static void
+window_queue_finish (guint        queuenum,
+                     MetaWindow **windows,
+                     guint        n_windows)
+{
+  MetaWindowQueue *queue = &queue_pending[queuenum];
+
+  meta_topic (META_DEBUG_WINDOW_STATE,
+              "Drained %u windows from the %s queue in %.3fms "
+              "(peak length %u)\n",
+              n_windows, meta_window_queue_names[queuenum],
+              (g_get_monotonic_time () - queue->drain_start) / 1000.,
+              queue->peak_windows);
+
+  queue->peak_windows = queue->n_windows;
+
+  g_free (windows);
+}
 
 static int
 stackcmp (gconstpointer a, gconstpointer b)
@@ -2283,31 +2398,96 @@ stackcmp (gconstpointer a, gconstpointer b)
                                    aw, bw);
 }
 
+static int
+stackcmp_indirect (gconstpointer a,
+                   gconstpointer b,
+                   gpointer      user_data)
+{
+  return stackcmp (*(MetaWindow * const *)a, *(MetaWindow * const *)b);
+}
+
+/* Puts a batch taken from the calc_showing queue in stacking order,
+ * bottom to top. If the batch is a good part of the stack, picking
+ * the queued windows out of the already sorted stack is cheaper than
+ * sorting them.
+ */
+static void
+sort_calc_showing_batch (MetaWindow **windows,
+                         guint        n_windows)
+{
+  MetaScreen *screen = windows[0]->screen;
+  guint i;
+
+  for (i = 1; i < n_windows; i++)
+    if (windows[i]->screen != screen)
+      break;
+
+  if (i == n_windows && n_windows * 16 >= (guint) screen->stack->n_positions)
+    {
+      GList *stacked, *l;
+      guint n_found = 0;
+
+      stacked = meta_stack_list_windows (screen->stack, NULL);
+      for (l = stacked; l; l = l->next)
+        {
+          MetaWindow *window = l->data;
+
+          if (window->is_in_queues & META_QUEUE_CALC_SHOWING)
+            n_found++;
+        }
+
+      /* Windows that aren't in the stack (override-redirect ones) can
+       * only be placed by sorting.
+       */
+      if (n_found == n_windows)
+        {
+          n_found = 0;
+          for (l = stacked; l; l = l->next)
+            {
+              MetaWindow *window = l->data;
+
+              if (window->is_in_queues & META_QUEUE_CALC_SHOWING)
+                windows[n_found++] = window;
+            }
+
+          g_list_free (stacked);
+          return;
+        }
+
+      g_list_free (stacked);
+    }
+
+  g_qsort_with_data (windows, n_windows, sizeof (MetaWindow *),
+                     stackcmp_indirect, NULL);
+}
+
+typedef enum
+{
+  CALC_SHOWING_UNPLACED,
+  CALC_SHOWING_SHOW,
+  CALC_SHOWING_HIDE
+} CalcShowingAction;
+
 static gboolean
 idle_calc_showing (gpointer data)
 {
-  GSList *tmp;
-  GSList *copy;
-  GSList *should_show;
-  GSList *should_hide;
-  GSList *unplaced;
-  GSList *displays;
-  MetaWindow *first_window;
+  MetaWindow **windows;
+  guint n_windows;
+  CalcShowingAction *actions;
+  MetaDisplay *display;
   guint queue_index = GPOINTER_TO_INT (data);
+  guint i;
 
-  g_return_val_if_fail (queue_pending[queue_index] != NULL, FALSE);
+  g_return_val_if_fail (queue_pending[queue_index].n_windows > 0, FALSE);
 
   meta_topic (META_DEBUG_WINDOW_STATE,
               "Clearing the calc_showing queue\n");
 
-  /* Work with a copy, for reentrancy. The allowed reentrancy isn't
-   * complete; destroying a window while we're in here would result in
-   * badness. But it's OK to queue/unqueue calc_showings.
+  /* Work with a separate batch, for reentrancy. The allowed reentrancy
+   * isn't complete; destroying a window while we're in here would
+   * result in badness. But it's OK to queue/unqueue calc_showings.
    */
-  copy = g_slist_copy (queue_pending[queue_index]);
-  g_slist_free (queue_pending[queue_index]);
-  queue_pending[queue_index] = NULL;
-  queue_later[queue_index] = 0;
+  windows = window_queue_take (queue_index, &n_windows);
 
   destroying_windows_disallowed += 1;
 
@@ -2316,90 +2496,48 @@ idle_calc_showing (gpointer data)
    * for unplaced windows, which have to be mapped from bottom to
    * top so placement works.
    */
-  should_show = NULL;
-  should_hide = NULL;
-  unplaced = NULL;
-  displays = NULL;
+  sort_calc_showing_batch (windows, n_windows);
 
-  tmp = copy;
-  while (tmp != NULL)
+  actions = g_new (CalcShowingAction, n_windows);
+  for (i = 0; i < n_windows; i++)
     {
-      MetaWindow *window;
-
-      window = tmp->data;
+      MetaWindow *window = windows[i];
 
       if (!window->placed)
-        unplaced = g_slist_prepend (unplaced, window);
+        actions[i] = CALC_SHOWING_UNPLACED;
       else if (meta_window_should_be_showing (window))
-        should_show = g_slist_prepend (should_show, window);
+        actions[i] = CALC_SHOWING_SHOW;
       else
-        should_hide = g_slist_prepend (should_hide, window);
-
-      tmp = tmp->next;
-    }
-
-  /* bottom to top */
-  unplaced = g_slist_sort (unplaced, stackcmp);
-  should_hide = g_slist_sort (should_hide, stackcmp);
-  /* top to bottom */
-  should_show = g_slist_sort (should_show, stackcmp);
-  should_show = g_slist_reverse (should_show);
-
-  first_window = copy->data;
-
-  meta_display_grab (first_window->display);
-
-  tmp = unplaced;
-  while (tmp != NULL)
-    {
-      MetaWindow *window;
-
-      window = tmp->data;
-
-      meta_window_calc_showing (window);
-
-      tmp = tmp->next;
+        actions[i] = CALC_SHOWING_HIDE;
     }
 
-  tmp = should_show;
-  while (tmp != NULL)
-    {
-      MetaWindow *window;
-
-      window = tmp->data;
-
-      implement_showing (window, TRUE);
-
-      tmp = tmp->next;
-    }
+  display = windows[0]->display;
 
-  tmp = should_hide;
-  while (tmp != NULL)
-    {
-      MetaWindow *window;
+  meta_display_grab (display);
 
-      window = tmp->data;
+  /* bottom to top */
+  for (i = 0; i < n_windows; i++)
+    if (actions[i] == CALC_SHOWING_UNPLACED)
+      meta_window_calc_showing (windows[i]);
 
-      implement_showing (window, FALSE);
+  /* top to bottom */
+  for (i = n_windows; i > 0; i--)
+    if (actions[i - 1] == CALC_SHOWING_SHOW)
+      implement_showing (windows[i - 1], TRUE);
 
-      tmp = tmp->next;
-    }
+  /* bottom to top */
+  for (i = 0; i < n_windows; i++)
+    if (actions[i] == CALC_SHOWING_HIDE)
+      implement_showing (windows[i], FALSE);
 
-  tmp = copy;
-  while (tmp != NULL)
+  for (i = 0; i < n_windows; i++)
     {
-      MetaWindow *window;
-
-      window = tmp->data;
-
       /* important to set this here for reentrancy -
-       * if we queue a window again while it's in "copy",
+       * if we queue a window again while it's in the batch,
        * then queue_calc_showing will just return since
        * we are still in the calc_showing queue
        */
-      window->is_in_queues &= ~META_QUEUE_CALC_SHOWING;
-
-      tmp = tmp->next;
+      windows[i]->is_in_queues &= ~META_QUEUE_CALC_SHOWING;
     }
 
   if (meta_prefs_get_focus_mode () != G_DESKTOP_FOCUS_MODE_CLICK)
@@ -2409,37 +2547,26 @@ idle_calc_showing (gpointer data)
        * that, we set a sentinel property on the root window if we're
        * not in mouse_mode.
        */
-      tmp = should_show;
-      while (tmp != NULL)
+      for (i = 0; i < n_windows; i++)
         {
-          MetaWindow *window = tmp->data;
+          MetaWindow *window = windows[i];
 
-          if (!window->display->mouse_mode)
+          if (actions[i] == CALC_SHOWING_SHOW &&
+              !window->display->mouse_mode)
             meta_display_increment_focus_sentinel (window->display);
-
-          tmp = tmp->next;
         }
     }
 
-  meta_display_ungrab (first_window->display);
-
-  g_slist_free (copy);
+  meta_display_ungrab (display);
 
-  g_slist_free (unplaced);
-  g_slist_free (should_show);
-  g_slist_free (should_hide);
-  g_slist_free (displays);
+  g_free (actions);
+  window_queue_finish (queue_index, windows, n_windows);
 
   destroying_windows_disallowed -= 1;
 
   return FALSE;
 }
 
-#ifdef WITH_VERBOSE_MODE
-static const gchar* meta_window_queue_names[NUMBER_OF_QUEUES] =
-  {"calc_showing", "move_resize", "update_icon"};
-#endif
-
 static void
 meta_window_unqueue (MetaWindow *window, guint queuebits)
 {
@@ -2457,17 +2584,14 @@ meta_window_unqueue (MetaWindow *window, guint queuebits)
               window->desc,
               meta_window_queue_names[queuenum]);
 
-          /* Note that window may not actually be in the queue
-           * because it may have been in "copy" inside the idle handler
-           */
-          queue_pending[queuenum] = g_slist_remove (queue_pending[queuenum], window);
+          window_queue_remove (queuenum, window);
           window->is_in_queues &= ~(1<<queuenum);
 
           /* Okay, so maybe we've used up all the entries in the queue.
            * In that case, we should kill the function that deals with
            * the queue, because there's nothing left for it to do.
            */
-          if (queue_pending[queuenum] == NULL && queue_later[queuenum] != 0)
+          if (queue_pending[queuenum].n_windows == 0 && queue_later[queuenum] != 0)
             {
               meta_later_remove (queue_later[queuenum]);
               queue_later[queuenum] = 0;
@@ -2553,8 +2677,7 @@ meta_window_queue (MetaWindow *window, guint queuebits)
               );
 
           /* And now we actually put it on the queue. */
-          queue_pending[queuenum] = g_slist_prepend (queue_pending[queuenum],
-                                                     window);
+          window_queue_append (queuenum, window);
       }
   }
 }
@@ -5584,37 +5707,28 @@ meta_window_move_resize_now (MetaWindow  *window)
 static gboolean
 idle_move_resize (gpointer data)
 {
-  GSList *tmp;
-  GSList *copy;
+  MetaWindow **windows;
+  guint n_windows;
   guint queue_index = GPOINTER_TO_INT (data);
+  guint i;
 
   meta_topic (META_DEBUG_GEOMETRY, "Clearing the move_resize queue\n");
 
-  /* Work with a copy, for reentrancy. The allowed reentrancy isn't
-   * complete; destroying a window while we're in here would result in
-   * badness. But it's OK to queue/unqueue move_resizes.
+  /* Work with a separate batch, for reentrancy. The allowed reentrancy
+   * isn't complete; destroying a window while we're in here would
+   * result in badness. But it's OK to queue/unqueue move_resizes.
    */
-  copy = g_slist_copy (queue_pending[queue_index]);
-  g_slist_free (queue_pending[queue_index]);
-  queue_pending[queue_index] = NULL;
-  queue_later[queue_index] = 0;
+  windows = window_queue_take (queue_index, &n_windows);
 
   destroying_windows_disallowed += 1;
 
-  tmp = copy;
-  while (tmp != NULL)
+  for (i = 0; i < n_windows; i++)
     {
-      MetaWindow *window;
-
-      window = tmp->data;
-
       /* As a side effect, sets window->move_resize_queued = FALSE */
-      meta_window_move_resize_now (window);
-
-      tmp = tmp->next;
+      meta_window_move_resize_now (windows[i]);
     }
 
-  g_slist_free (copy);
+  window_queue_finish (queue_index, windows, n_windows);
 
   destroying_windows_disallowed -= 1;
 
@@ -7306,8 +7420,6 @@ static gboolean
 process_property_notify (MetaWindow     *window,
                          XPropertyEvent *event)
 {
-  Window xid = window->xwindow;
-
   if (meta_is_verbose ()) /* avoid looking up the name if we don't have to */
     {
       char *property_name = XGetAtomName (window->display->xdisplay,
@@ -7318,13 +7430,9 @@ process_property_notify (MetaWindow     *window,
       XFree (property_name);
     }
 
-  if (event->atom == window->display->atom__NET_WM_USER_TIME &&
-      window->user_time_window)
-    {
-        xid = window->user_time_window;
-    }
-
-  meta_window_reload_property_from_xwindow (window, xid, event->atom, FALSE);
+  /* The new value is fetched along with any others once the current
+   * batch of events has been handled. */
+  meta_window_queue_property_notify (window, event->atom);
 
   return TRUE;
 }
@@ -7639,17 +7747,17 @@ meta_window_set_opaque_region (MetaWindow     *window,
     meta_compositor_window_shape_changed (window->display->compositor, window);
 }
 
+/* @region is the value of _NET_WM_OPAQUE_REGION as fetched by
+ * window-props.c, or %NULL if it isn't set.
+ */
 void
-meta_window_update_opaque_region_x11 (MetaWindow *window)
+meta_window_update_opaque_region_x11 (MetaWindow   *window,
+                                      const gulong *region,
+                                      int           nitems)
 {
   cairo_region_t *opaque_region = NULL;
-  gulong *region = NULL;
-  int nitems;
 
-  if (meta_prop_get_cardinal_list (window->display,
-                                   window->xwindow,
-                                   window->display->atom__NET_WM_OPAQUE_REGION,
-                                   &region, &nitems))
+  if (region != NULL)
     {
       cairo_rectangle_int_t *rects;
       int i, rect_index, nrects;
@@ -7688,8 +7796,6 @@ meta_window_update_opaque_region_x11 (MetaWindow *window)
     }
 
  out:
-  meta_XFree (region);
-
   meta_window_set_opaque_region (window, opaque_region);
   cairo_region_destroy (opaque_region);
 }
@@ -7846,37 +7952,28 @@ meta_window_update_icon_now (MetaWindow *window)
 static gboolean
 idle_update_icon (gpointer data)
 {
-  GSList *tmp;
-  GSList *copy;
+  MetaWindow **windows;
+  guint n_windows;
   guint queue_index = GPOINTER_TO_INT (data);
+  guint i;
 
   meta_topic (META_DEBUG_GEOMETRY, "Clearing the update_icon queue\n");
 
-  /* Work with a copy, for reentrancy. The allowed reentrancy isn't
-   * complete; destroying a window while we're in here would result in
-   * badness. But it's OK to queue/unqueue update_icons.
+  /* Work with a separate batch, for reentrancy. The allowed reentrancy
+   * isn't complete; destroying a window while we're in here would
+   * result in badness. But it's OK to queue/unqueue update_icons.
    */
-  copy = g_slist_copy (queue_pending[queue_index]);
-  g_slist_free (queue_pending[queue_index]);
-  queue_pending[queue_index] = NULL;
-  queue_later[queue_index] = 0;
+  windows = window_queue_take (queue_index, &n_windows);
 
   destroying_windows_disallowed += 1;
 
-  tmp = copy;
-  while (tmp != NULL)
+  for (i = 0; i < n_windows; i++)
     {
-      MetaWindow *window;
-
-      window = tmp->data;
-
-      meta_window_update_icon_now (window);
-      window->is_in_queues &= ~META_QUEUE_UPDATE_ICON;
-
-      tmp = tmp->next;
+      meta_window_update_icon_now (windows[i]);
+      windows[i]->is_in_queues &= ~META_QUEUE_UPDATE_ICON;
     }
 
-  g_slist_free (copy);
+  window_queue_finish (queue_index, windows, n_windows);
 
   destroying_windows_disallowed -= 1;
 
@@ -35,6 +35,9 @@
 
 #include <meta/workspace.h>
 #include "window-private.h"
+#include "edge-resistance.h"
+
+typedef struct _MetaWorkAreas MetaWorkAreas;
 
 struct _MetaWorkspace
 {
@@ -56,6 +59,16 @@ struct _MetaWorkspace
 
   GList  *list_containing_self;
 
+  /* The work areas, regions and edges below point into work_areas,
+   * which is shared with the other workspaces that have the same
+   * struts; they are only valid while work_areas_invalid is unset.
+   * stale_work_areas is what was last computed before the work areas
+   * were invalidated, kept so that monitors the changed struts don't
+   * touch can be carried over instead of recomputed.
+   */
+  MetaWorkAreas *work_areas;
+  MetaWorkAreas *stale_work_areas;
+
   MetaRectangle work_area_screen;
   MetaRectangle *work_area_monitor;
   GList  *screen_region;
@@ -67,6 +80,9 @@ struct _MetaWorkspace
   GSList *all_struts;
   guint work_areas_invalid : 1;
 
+  /* Window edges kept from the last move/resize on this workspace */
+  MetaWindowEdgeCache *edge_cache;
+
   guint showing_desktop : 1;
 };
 
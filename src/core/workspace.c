@@ -61,6 +61,7 @@ static void focus_ancestor_or_top_window (MetaWorkspace *workspace,
                                           guint32        timestamp);
 static void free_this                    (gpointer candidate,
                                           gpointer dummy);
+static void work_areas_unref             (MetaWorkAreas *areas);
 
 G_DEFINE_TYPE (MetaWorkspace, meta_workspace, G_TYPE_OBJECT);
 
@@ -183,6 +184,8 @@ meta_workspace_new (MetaScreen *screen)
   meta_screen_foreach_window (screen, maybe_add_to_list, &workspace->mru_list);
 
   workspace->work_areas_invalid = TRUE;
+  workspace->work_areas = NULL;
+  workspace->stale_work_areas = NULL;
   workspace->work_area_monitor = NULL;
   workspace->work_area_screen.x = 0;
   workspace->work_area_screen.y = 0;
@@ -197,6 +200,7 @@ meta_workspace_new (MetaScreen *screen)
 
   workspace->builtin_struts = NULL;
   workspace->all_struts = NULL;
+  workspace->edge_cache = NULL;
 
   workspace->showing_desktop = FALSE;
   
@@ -210,23 +214,6 @@ free_this (gpointer candidate, gpointer dummy)
   g_free (candidate);
 }
 
-/**
- * workspace_free_all_struts:
- * @workspace: The workspace.
- *
- * Frees the combined struts list of a workspace.
- */
-static void
-workspace_free_all_struts (MetaWorkspace *workspace)
-{
-  if (workspace->all_struts == NULL)
-    return;
-    
-  g_slist_foreach (workspace->all_struts, free_this, NULL);
-  g_slist_free (workspace->all_struts);
-  workspace->all_struts = NULL;
-}
-
 /**
  * workspace_free_builtin_struts:
  * @workspace: The workspace.
@@ -248,8 +235,6 @@ void
 meta_workspace_remove (MetaWorkspace *workspace)
 {
   GList *tmp;
-  MetaScreen *screen;
-  int i;
 
   g_return_if_fail (workspace != workspace->screen->active_workspace);
 
@@ -273,13 +258,9 @@ meta_workspace_remove (MetaWorkspace *workspace)
 
   g_assert (workspace->windows == NULL);
 
-  screen = workspace->screen;
-  
   workspace->screen->workspaces =
     g_list_remove (workspace->screen->workspaces, workspace);
   
-  g_free (workspace->work_area_monitor);
-
   g_list_free (workspace->mru_list);
   g_list_free (workspace->list_containing_self);
 
@@ -287,20 +268,16 @@ meta_workspace_remove (MetaWorkspace *workspace)
 
   /* screen.c:update_num_workspaces(), which calls us, removes windows from
    * workspaces first, which can cause the workareas on the workspace to be
-   * invalidated (and hence for struts/regions/edges to be freed).
-   * So, no point trying to double free it; that causes a crash
-   * anyway.  #361804.
+   * invalidated, in which case work_areas is already NULL.
    */
+  work_areas_unref (workspace->work_areas);
+  work_areas_unref (workspace->stale_work_areas);
 
-  if (!workspace->work_areas_invalid)
+  if (workspace->edge_cache)
     {
-      workspace_free_all_struts (workspace);
-      for (i = 0; i < screen->n_monitor_infos; i++)
-        meta_rectangle_free_list_and_elements (workspace->monitor_region[i]);
-      g_free (workspace->monitor_region);
-      meta_rectangle_free_list_and_elements (workspace->screen_region);
-      meta_rectangle_free_list_and_elements (workspace->screen_edges);
-      meta_rectangle_free_list_and_elements (workspace->monitor_edges);
+      /* Make sure no grab is still looking at the edges */
+      meta_display_cleanup_edges (workspace->screen->display);
+      meta_window_edge_cache_free (workspace->edge_cache);
     }
 
   g_object_unref (workspace);
@@ -768,7 +745,6 @@ meta_workspace_invalidate_work_area (MetaWorkspace *workspace)
 {
   GList *tmp;
   GList *windows;
-  int i;
   
   if (workspace->work_areas_invalid)
     {
@@ -787,18 +763,17 @@ meta_workspace_invalidate_work_area (MetaWorkspace *workspace)
   if (workspace == workspace->screen->active_workspace)
     meta_display_cleanup_edges (workspace->screen->display);
 
-  g_free (workspace->work_area_monitor);
+  /* Keep the old work areas around; whatever the changed struts
+   * don't touch can be carried over when they are next validated.
+   */
+  work_areas_unref (workspace->stale_work_areas);
+  workspace->stale_work_areas = workspace->work_areas;
+  workspace->work_areas = NULL;
+
+  workspace->all_struts = NULL;
   workspace->work_area_monitor = NULL;
-      
-  workspace_free_all_struts (workspace);
-
-  for (i = 0; i < workspace->screen->n_monitor_infos; i++)
-    meta_rectangle_free_list_and_elements (workspace->monitor_region[i]);
-  g_free (workspace->monitor_region);
-  meta_rectangle_free_list_and_elements (workspace->screen_region);
-  meta_rectangle_free_list_and_elements (workspace->screen_edges);
-  meta_rectangle_free_list_and_elements (workspace->monitor_edges);
   workspace->monitor_region = NULL;
+  workspace->n_monitor_regions = 0;
   workspace->screen_region = NULL;
   workspace->screen_edges = NULL;
   workspace->monitor_edges = NULL;
@@ -842,68 +817,269 @@ copy_strut_list(GSList *original)
   return g_slist_reverse (result);
 }
 
+static gboolean
+strut_lists_equal (GSList *l,
+                   GSList *m)
+{
+  for (; l && m; l = l->next, m = m->next)
+    {
+      MetaStrut *a = l->data;
+      MetaStrut *b = m->data;
+
+      if (a->side != b->side ||
+          !meta_rectangle_equal (&a->rect, &b->rect))
+        return FALSE;
+    }
+
+  return l == NULL && m == NULL;
+}
+
+/* Sort function giving the strut lists of workspaces a canonical
+ * order, so that workspaces with the same struts can share work areas.
+ */
+static int
+compare_struts (gconstpointer a,
+                gconstpointer b)
+{
+  const MetaStrut *sa = a;
+  const MetaStrut *sb = b;
+
+  if (sa->side != sb->side)
+    return sa->side < sb->side ? -1 : 1;
+  if (sa->rect.x != sb->rect.x)
+    return sa->rect.x < sb->rect.x ? -1 : 1;
+  if (sa->rect.y != sb->rect.y)
+    return sa->rect.y < sb->rect.y ? -1 : 1;
+  if (sa->rect.width != sb->rect.width)
+    return sa->rect.width < sb->rect.width ? -1 : 1;
+  if (sa->rect.height != sb->rect.height)
+    return sa->rect.height < sb->rect.height ? -1 : 1;
+
+  return 0;
+}
+
+/* Like strut_lists_equal(), but only looks at the struts overlapping
+ * @rect; both lists must be sorted with compare_struts().
+ */
+static gboolean
+overlapping_struts_equal (const MetaRectangle *rect,
+                          GSList              *l,
+                          GSList              *m)
+{
+  while (TRUE)
+    {
+      while (l && !meta_rectangle_overlap (rect, &((MetaStrut*)l->data)->rect))
+        l = l->next;
+      while (m && !meta_rectangle_overlap (rect, &((MetaStrut*)m->data)->rect))
+        m = m->next;
+
+      if (l == NULL || m == NULL)
+        return l == m;
+
+      if (compare_struts (l->data, m->data) != 0)
+        return FALSE;
+
+      l = l->next;
+      m = m->next;
+    }
+}
+
+static GList *
+copy_rect_list (GList *original)
+{
+  GList *result = NULL;
+
+  while (original)
+    {
+      result = g_list_prepend (result,
+                               g_memdup (original->data, sizeof (MetaRectangle)));
+      original = original->next;
+    }
+
+  return g_list_reverse (result);
+}
+
+/* Everything that ensure_work_areas_validated() derives from a set of
+ * struts and the monitor layout. Workspaces with the same struts share
+ * one of these rather than each computing their own copy.
+ */
+struct _MetaWorkAreas
+{
+  int             ref_count;
+
+  GSList         *struts;           /* sorted with compare_struts() */
+  MetaRectangle   screen_rect;
+  MetaRectangle  *monitor_rects;
+  int             n_monitors;
+
+  MetaRectangle   work_area_screen;
+  MetaRectangle  *work_area_monitor;
+  GList          *screen_region;
+  GList         **monitor_region;
+  GList          *screen_edges;
+  GList          *monitor_edges;
+};
+
 static void
-ensure_work_areas_validated (MetaWorkspace *workspace)
+work_areas_unref (MetaWorkAreas *areas)
 {
-  GList         *windows;
-  GList         *tmp;
-  MetaRectangle  work_area;
-  int            i;  /* C89 absolutely sucks... */
+  int i;
 
-  if (!workspace->work_areas_invalid)
+  if (areas == NULL || --areas->ref_count > 0)
     return;
 
-  g_assert (workspace->all_struts == NULL);
-  g_assert (workspace->monitor_region == NULL);
-  g_assert (workspace->screen_region == NULL);
-  g_assert (workspace->screen_edges == NULL);
-  g_assert (workspace->monitor_edges == NULL);
+  g_slist_foreach (areas->struts, free_this, NULL);
+  g_slist_free (areas->struts);
 
-  /* STEP 1: Get the list of struts */
+  for (i = 0; i < areas->n_monitors; i++)
+    meta_rectangle_free_list_and_elements (areas->monitor_region[i]);
+  g_free (areas->monitor_region);
+  g_free (areas->monitor_rects);
+  g_free (areas->work_area_monitor);
+  meta_rectangle_free_list_and_elements (areas->screen_region);
+  meta_rectangle_free_list_and_elements (areas->screen_edges);
+  meta_rectangle_free_list_and_elements (areas->monitor_edges);
 
-  workspace->all_struts = copy_strut_list (workspace->builtin_struts);
+  g_slice_free (MetaWorkAreas, areas);
+}
 
-  windows = meta_workspace_list_windows (workspace);
-  for (tmp = windows; tmp != NULL; tmp = tmp->next)
+static gboolean
+work_areas_match (MetaWorkAreas *areas,
+                  MetaScreen    *screen,
+                  GSList        *struts)
+{
+  int i;
+
+  if (areas->n_monitors != screen->n_monitor_infos ||
+      !meta_rectangle_equal (&areas->screen_rect, &screen->rect))
+    return FALSE;
+
+  for (i = 0; i < areas->n_monitors; i++)
+    if (!meta_rectangle_equal (&areas->monitor_rects[i],
+                               &screen->monitor_infos[i].rect))
+      return FALSE;
+
+  return strut_lists_equal (areas->struts, struts);
+}
+
+/* Looks for work areas already computed for @struts: what this
+ * workspace had before it was invalidated, or what another workspace
+ * with the same struts is using.
+ */
+static MetaWorkAreas *
+find_work_areas (MetaWorkspace *workspace,
+                 GSList        *struts)
+{
+  MetaScreen *screen = workspace->screen;
+  GList *tmp;
+
+  if (workspace->stale_work_areas &&
+      work_areas_match (workspace->stale_work_areas, screen, struts))
+    return workspace->stale_work_areas;
+
+  for (tmp = screen->workspaces; tmp != NULL; tmp = tmp->next)
     {
-      MetaWindow *win = tmp->data;
-      GSList *s_iter;
+      MetaWorkspace *other = tmp->data;
 
-      for (s_iter = win->struts; s_iter != NULL; s_iter = s_iter->next) {
-        workspace->all_struts = g_slist_prepend (workspace->all_struts,
-                                                 copy_strut(s_iter->data));
-      }
+      if (other != workspace &&
+          !other->work_areas_invalid &&
+          work_areas_match (other->work_areas, screen, struts))
+        return other->work_areas;
     }
-  g_list_free (windows);
 
-  /* STEP 2: Get the maximal/spanning rects for the onscreen and
-   *         on-single-monitor regions
-   */  
-  g_assert (workspace->monitor_region == NULL);
-  g_assert (workspace->screen_region   == NULL);
+  return NULL;
+}
+
+static MetaWorkAreas *
+work_areas_new (MetaWorkspace *workspace,
+                GSList        *struts)
+{
+  MetaScreen    *screen = workspace->screen;
+  MetaWorkAreas *previous = workspace->stale_work_areas;
+  MetaWorkAreas *areas;
+  MetaRectangle  work_area;
+  GList         *tmp;
+  int            n_reused = 0;
+  int            i;
+
+  areas = g_slice_new0 (MetaWorkAreas);
+  areas->ref_count = 1;
+  areas->struts = struts;
+  areas->screen_rect = screen->rect;
+  areas->n_monitors = screen->n_monitor_infos;
+  areas->monitor_rects = g_new (MetaRectangle, areas->n_monitors);
+  for (i = 0; i < areas->n_monitors; i++)
+    areas->monitor_rects[i] = screen->monitor_infos[i].rect;
 
-  workspace->monitor_region = g_new (GList*,
-                                      workspace->screen->n_monitor_infos);
-  for (i = 0; i < workspace->screen->n_monitor_infos; i++)
+  /* STEP 2: Get the maximal/spanning rects for the onscreen and
+   *         on-single-monitor regions, and (STEP 3) the work areas
+   *         (region-to-maximize-to) for each monitor.
+   *
+   * A monitor's region only depends on the struts overlapping it, so
+   * if those are the same as before the work area was invalidated,
+   * the old region and work area are copied rather than recomputed.
+   */
+  areas->monitor_region = g_new (GList*, areas->n_monitors);
+  areas->work_area_monitor = g_new (MetaRectangle, areas->n_monitors);
+  for (i = 0; i < areas->n_monitors; i++)
     {
-      workspace->monitor_region[i] =
-        meta_rectangle_get_minimal_spanning_set_for_region (
-          &workspace->screen->monitor_infos[i].rect,
-          workspace->all_struts);
+      const MetaRectangle *monitor_rect = &areas->monitor_rects[i];
+
+      if (previous != NULL &&
+          i < previous->n_monitors &&
+          meta_rectangle_equal (&previous->monitor_rects[i], monitor_rect) &&
+          overlapping_struts_equal (monitor_rect, previous->struts, struts))
+        {
+          areas->monitor_region[i] =
+            copy_rect_list (previous->monitor_region[i]);
+          areas->work_area_monitor[i] = previous->work_area_monitor[i];
+          n_reused++;
+          continue;
+        }
+
+      areas->monitor_region[i] =
+        meta_rectangle_get_minimal_spanning_set_for_region (monitor_rect,
+                                                            struts);
+
+      work_area = *monitor_rect;
+      if (areas->monitor_region[i] == NULL)
+        /* FIXME: constraints.c untested with this, but it might be nice for
+         * a screen reader or magnifier.
+         */
+        work_area = meta_rect (work_area.x, work_area.y, -1, -1);
+      else
+        meta_rectangle_clip_to_region (areas->monitor_region[i],
+                                       FIXED_DIRECTION_NONE,
+                                       &work_area);
+
+      areas->work_area_monitor[i] = work_area;
+      meta_topic (META_DEBUG_WORKAREA,
+                  "Computed work area for workspace %d "
+                  "monitor %d: %d,%d %d x %d\n",
+                  meta_workspace_index (workspace),
+                  i,
+                  areas->work_area_monitor[i].x,
+                  areas->work_area_monitor[i].y,
+                  areas->work_area_monitor[i].width,
+                  areas->work_area_monitor[i].height);
     }
-  workspace->screen_region =
-    meta_rectangle_get_minimal_spanning_set_for_region (
-      &workspace->screen->rect,
-      workspace->all_struts);
 
-  /* STEP 3: Get the work areas (region-to-maximize-to) for the screen and
-   *         monitors.
-   */
-  work_area = workspace->screen->rect;  /* start with the screen */
-  if (workspace->screen_region == NULL)
+  if (n_reused > 0)
+    meta_topic (META_DEBUG_WORKAREA,
+                "Kept work areas of %d of %d monitors for workspace %d\n",
+                n_reused, areas->n_monitors,
+                meta_workspace_index (workspace));
+
+  areas->screen_region =
+    meta_rectangle_get_minimal_spanning_set_for_region (&screen->rect,
+                                                        struts);
+
+  /* STEP 3: Get the work area for the screen */
+  work_area = screen->rect;  /* start with the screen */
+  if (areas->screen_region == NULL)
     work_area = meta_rect (0, 0, -1, -1);
   else
-    meta_rectangle_clip_to_region (workspace->screen_region,
+    meta_rectangle_clip_to_region (areas->screen_region,
                                    FIXED_DIRECTION_NONE,
                                    &work_area);
 
@@ -916,7 +1092,7 @@ ensure_work_areas_validated (MetaWorkspace *workspace)
                     work_area.width, MIN_SANE_AREA);
       if (work_area.width < 1)
         {
-          work_area.x = (workspace->screen->rect.width - MIN_SANE_AREA)/2;
+          work_area.x = (screen->rect.width - MIN_SANE_AREA)/2;
           work_area.width = MIN_SANE_AREA;
         }
       else
@@ -933,7 +1109,7 @@ ensure_work_areas_validated (MetaWorkspace *workspace)
                     work_area.height, MIN_SANE_AREA);
       if (work_area.height < 1)
         {
-          work_area.y = (workspace->screen->rect.height - MIN_SANE_AREA)/2;
+          work_area.y = (screen->rect.height - MIN_SANE_AREA)/2;
           work_area.height = MIN_SANE_AREA;
         }
       else
@@ -943,90 +1119,104 @@ ensure_work_areas_validated (MetaWorkspace *workspace)
           work_area.height += 2*amount;
         }
     }
-  workspace->work_area_screen = work_area;
+  areas->work_area_screen = work_area;
   meta_topic (META_DEBUG_WORKAREA,
               "Computed work area for workspace %d: %d,%d %d x %d\n",
               meta_workspace_index (workspace),
-              workspace->work_area_screen.x,
-              workspace->work_area_screen.y,
-              workspace->work_area_screen.width,
-              workspace->work_area_screen.height);    
-
-  /* Now find the work areas for each monitor */
-  g_free (workspace->work_area_monitor);
-  workspace->work_area_monitor = g_new (MetaRectangle,
-                                         workspace->screen->n_monitor_infos);
-
-  for (i = 0; i < workspace->screen->n_monitor_infos; i++)
-    {
-      work_area = workspace->screen->monitor_infos[i].rect;
-
-      if (workspace->monitor_region[i] == NULL)
-        /* FIXME: constraints.c untested with this, but it might be nice for
-         * a screen reader or magnifier.
-         */
-        work_area = meta_rect (work_area.x, work_area.y, -1, -1);
-      else
-        meta_rectangle_clip_to_region (workspace->monitor_region[i],
-                                       FIXED_DIRECTION_NONE,
-                                       &work_area);
-
-      workspace->work_area_monitor[i] = work_area;
-      meta_topic (META_DEBUG_WORKAREA,
-                  "Computed work area for workspace %d "
-                  "monitor %d: %d,%d %d x %d\n",
-                  meta_workspace_index (workspace),
-                  i,
-                  workspace->work_area_monitor[i].x,
-                  workspace->work_area_monitor[i].y,
-                  workspace->work_area_monitor[i].width,
-                  workspace->work_area_monitor[i].height);
-    }
+              areas->work_area_screen.x,
+              areas->work_area_screen.y,
+              areas->work_area_screen.width,
+              areas->work_area_screen.height);
 
   /* STEP 4: Make sure the screen_region is nonempty (separate from step 2
    *         since it relies on step 3).
    */  
-  if (workspace->screen_region == NULL)
+  if (areas->screen_region == NULL)
     {
       MetaRectangle *nonempty_region;
       nonempty_region = g_new (MetaRectangle, 1);
-      *nonempty_region = workspace->work_area_screen;
-      workspace->screen_region = g_list_prepend (NULL, nonempty_region);
+      *nonempty_region = areas->work_area_screen;
+      areas->screen_region = g_list_prepend (NULL, nonempty_region);
     }
 
   /* STEP 5: Cache screen and monitor edges for edge resistance and snapping */
-  g_assert (workspace->screen_edges    == NULL);
-  g_assert (workspace->monitor_edges  == NULL);
-  workspace->screen_edges =
-    meta_rectangle_find_onscreen_edges (&workspace->screen->rect,
-                                        workspace->all_struts);
+  areas->screen_edges =
+    meta_rectangle_find_onscreen_edges (&screen->rect, struts);
   tmp = NULL;
-  for (i = 0; i < workspace->screen->n_monitor_infos; i++)
-    tmp = g_list_prepend (tmp, &workspace->screen->monitor_infos[i].rect);
-  workspace->monitor_edges =
-    meta_rectangle_find_nonintersected_monitor_edges (tmp,
-                                                       workspace->all_struts);
+  for (i = 0; i < areas->n_monitors; i++)
+    tmp = g_list_prepend (tmp, &areas->monitor_rects[i]);
+  areas->monitor_edges =
+    meta_rectangle_find_nonintersected_monitor_edges (tmp, struts);
   g_list_free (tmp);
 
-  /* We're all done, YAAY!  Record that everything has been validated. */
-  workspace->work_areas_invalid = FALSE;
+  return areas;
 }
 
-static gboolean
-strut_lists_equal (GSList *l,
-                   GSList *m)
+static void
+ensure_work_areas_validated (MetaWorkspace *workspace)
 {
-  for (; l && m; l = l->next, m = m->next)
+  MetaWorkAreas *areas;
+  GSList        *struts;
+  GList         *windows;
+  GList         *tmp;
+
+  if (!workspace->work_areas_invalid)
+    return;
+
+  g_assert (workspace->work_areas == NULL);
+
+  /* STEP 1: Get the list of struts */
+
+  struts = copy_strut_list (workspace->builtin_struts);
+
+  windows = meta_workspace_list_windows (workspace);
+  for (tmp = windows; tmp != NULL; tmp = tmp->next)
     {
-      MetaStrut *a = l->data;
-      MetaStrut *b = m->data;
+      MetaWindow *win = tmp->data;
+      GSList *s_iter;
 
-      if (a->side != b->side ||
-          !meta_rectangle_equal (&a->rect, &b->rect))
-        return FALSE;
+      for (s_iter = win->struts; s_iter != NULL; s_iter = s_iter->next) {
+        struts = g_slist_prepend (struts, copy_strut(s_iter->data));
+      }
     }
+  g_list_free (windows);
 
-  return l == NULL && m == NULL;
+  struts = g_slist_sort (struts, compare_struts);
+
+  /* STEPS 2-5: unless some workspace already has work areas for these
+   * struts, compute the regions, work areas and edges.
+   */
+  areas = find_work_areas (workspace, struts);
+  if (areas != NULL)
+    {
+      meta_topic (META_DEBUG_WORKAREA,
+                  "Reusing work areas for workspace %d\n",
+                  meta_workspace_index (workspace));
+
+      areas->ref_count++;
+      g_slist_foreach (struts, free_this, NULL);
+      g_slist_free (struts);
+    }
+  else
+    {
+      areas = work_areas_new (workspace, struts);
+    }
+
+  work_areas_unref (workspace->stale_work_areas);
+  workspace->stale_work_areas = NULL;
+
+  workspace->work_areas = areas;
+  workspace->all_struts = areas->struts;
+  workspace->work_area_screen = areas->work_area_screen;
+  workspace->work_area_monitor = areas->work_area_monitor;
+  workspace->screen_region = areas->screen_region;
+  workspace->monitor_region = areas->monitor_region;
+  workspace->n_monitor_regions = areas->n_monitors;
+  workspace->screen_edges = areas->screen_edges;
+  workspace->monitor_edges = areas->monitor_edges;
+
+  /* We're all done, YAAY!  Record that everything has been validated. */
+  workspace->work_areas_invalid = FALSE;
 }
 
 /**
@@ -964,22 +964,213 @@ latin1_to_utf8 (const char *text)
   return g_string_free (str, FALSE);
 }
 
-void
-meta_prop_get_values (MetaDisplay   *display,
-                      Window         xwindow,
-                      MetaPropValue *values,
-                      int            n_values)
+/* Fills in the type to ask the server for, if the caller didn't */
+static void
+init_required_type (MetaDisplay   *display,
+                    MetaPropValue *value)
 {
-  int i;
+  if (value->required_type == None)
+    {
+      switch (value->type)
+        {
+        case META_PROP_VALUE_INVALID:
+          /* This means we don't really want a value, e.g. got
+           * property notify on an atom we don't care about.
+           */
+          if (value->atom != None)
+            meta_bug ("META_PROP_VALUE_INVALID requested in %s\n", G_STRFUNC);
+          break;
+        case META_PROP_VALUE_UTF8_LIST:
+        case META_PROP_VALUE_UTF8:
+          value->required_type = display->atom_UTF8_STRING;
+          break;
+        case META_PROP_VALUE_STRING:
+        case META_PROP_VALUE_STRING_AS_UTF8:
+          value->required_type = XA_STRING;
+          break;
+        case META_PROP_VALUE_MOTIF_HINTS:
+          value->required_type = AnyPropertyType;
+          break;
+        case META_PROP_VALUE_CARDINAL_LIST:
+        case META_PROP_VALUE_CARDINAL:
+          value->required_type = XA_CARDINAL;
+          break;
+        case META_PROP_VALUE_WINDOW:
+          value->required_type = XA_WINDOW;
+          break;
+        case META_PROP_VALUE_ATOM_LIST:
+          value->required_type = XA_ATOM;
+          break;
+        case META_PROP_VALUE_TEXT_PROPERTY:
+          value->required_type = AnyPropertyType;
+          break;
+        case META_PROP_VALUE_WM_HINTS:
+          value->required_type = XA_WM_HINTS;
+          break;
+        case META_PROP_VALUE_CLASS_HINT:
+          value->required_type = XA_STRING;
+          break;
+        case META_PROP_VALUE_SIZE_HINTS:
+          value->required_type = XA_WM_SIZE_HINTS;
+          break;
+        case META_PROP_VALUE_SYNC_COUNTER:
+        case META_PROP_VALUE_SYNC_COUNTER_LIST:
+          value->required_type = XA_CARDINAL;
+          break;
+        }
+    }
+}
+
+/* Converts the property in @results to @value, which takes ownership
+ * of the data; @value becomes invalid if it doesn't have the expected
+ * type or format.
+ */
+static void
+value_from_results (MetaPropValue      *value,
+                    GetPropertyResults *results)
+{
+  switch (value->type)
+    {
+    case META_PROP_VALUE_INVALID:
+      g_assert_not_reached ();
+      break;
+    case META_PROP_VALUE_UTF8_LIST:
+      if (!utf8_list_from_results (results,
+                                   &value->v.string_list.strings,
+                                   &value->v.string_list.n_strings))
+        value->type = META_PROP_VALUE_INVALID;
+      break;
+    case META_PROP_VALUE_UTF8:
+      if (!utf8_string_from_results (results,
+                                     &value->v.str))
+        value->type = META_PROP_VALUE_INVALID;
+      break;
+    case META_PROP_VALUE_STRING:
+      if (!latin1_string_from_results (results,
+                                       &value->v.str))
+        value->type = META_PROP_VALUE_INVALID;
+      break;
+    case META_PROP_VALUE_STRING_AS_UTF8:
+      if (!latin1_string_from_results (results,
+                                       &value->v.str))
+        value->type = META_PROP_VALUE_INVALID;
+      else
+        {
+          char *new_str;
+          char *xmalloc_new_str;
+
+          new_str = latin1_to_utf8 (value->v.str);
+          xmalloc_new_str = ag_Xmalloc (strlen (new_str) + 1);
+          if (xmalloc_new_str != NULL)
+            {
+              strcpy (xmalloc_new_str, new_str);
+              meta_XFree (value->v.str);
+              value->v.str = xmalloc_new_str;
+            }
+
+          g_free (new_str);
+        }
+      break;
+    case META_PROP_VALUE_MOTIF_HINTS:
+      if (!motif_hints_from_results (results,
+                                     &value->v.motif_hints))
+        value->type = META_PROP_VALUE_INVALID;
+      break;
+    case META_PROP_VALUE_CARDINAL_LIST:
+      if (!cardinal_list_from_results (results,
+                                       &value->v.cardinal_list.cardinals,
+                                       &value->v.cardinal_list.n_cardinals))
+        value->type = META_PROP_VALUE_INVALID;
+      break;
+    case META_PROP_VALUE_CARDINAL:
+      if (!cardinal_with_atom_type_from_results (results,
+                                                 value->required_type,
+                                                 &value->v.cardinal))
+        value->type = META_PROP_VALUE_INVALID;
+      break;
+    case META_PROP_VALUE_WINDOW:
+      if (!window_from_results (results,
+                                &value->v.xwindow))
+        value->type = META_PROP_VALUE_INVALID;
+      break;
+    case META_PROP_VALUE_ATOM_LIST:
+      if (!atom_list_from_results (results,
+                                   &value->v.atom_list.atoms,
+                                   &value->v.atom_list.n_atoms))
+        value->type = META_PROP_VALUE_INVALID;
+      break;
+    case META_PROP_VALUE_TEXT_PROPERTY:
+      if (!text_property_from_results (results, &value->v.str))
+        value->type = META_PROP_VALUE_INVALID;
+      break;
+    case META_PROP_VALUE_WM_HINTS:
+      if (!wm_hints_from_results (results, &value->v.wm_hints))
+        value->type = META_PROP_VALUE_INVALID;
+      break;
+    case META_PROP_VALUE_CLASS_HINT:
+      if (!class_hint_from_results (results, &value->v.class_hint))
+        value->type = META_PROP_VALUE_INVALID;
+      break;
+    case META_PROP_VALUE_SIZE_HINTS:
+      if (!size_hints_from_results (results,
+                                    &value->v.size_hints.hints,
+                                    &value->v.size_hints.flags))
+        value->type = META_PROP_VALUE_INVALID;
+      break;
+#ifdef HAVE_XSYNC
+    case META_PROP_VALUE_SYNC_COUNTER:
+      if (!counter_from_results (results,
+                                 &value->v.xcounter))
+        value->type = META_PROP_VALUE_INVALID;
+      break;
+    case META_PROP_VALUE_SYNC_COUNTER_LIST:
+      if (!counter_list_from_results (results,
+                                      &value->v.xcounter_list.counters,
+                                      &value->v.xcounter_list.n_counters))
+        value->type = META_PROP_VALUE_INVALID;
+      break;
+#else
+    case META_PROP_VALUE_SYNC_COUNTER:
+    case META_PROP_VALUE_SYNC_COUNTER_LIST:
+      value->type = META_PROP_VALUE_INVALID;
+      if (results->prop)
+        {
+          XFree (results->prop);
+          results->prop = NULL;
+        }
+      break;
+#endif
+    }
+}
+
+struct _MetaPropRequest
+{
+  MetaDisplay *display;
+  Window xwindow;
+  MetaPropValue *values;
+  int n_values;
+  AgGetPropertyTask **tasks;
+};
+
+MetaPropRequest *
+meta_prop_request_values (MetaDisplay   *display,
+                          Window         xwindow,
+                          MetaPropValue *values,
+                          int            n_values)
+{
+  MetaPropRequest *request;
   AgGetPropertyTask **tasks;
+  int i;
 
   meta_verbose ("Requesting %d properties of 0x%lx at once\n",
                 n_values, xwindow);
-  
-  if (n_values == 0)
-    return;
-  
-  tasks = g_new0 (AgGetPropertyTask*, n_values);
+
+  request = g_slice_new (MetaPropRequest);
+  request->display = display;
+  request->xwindow = xwindow;
+  request->values = values;
+  request->n_values = n_values;
+  request->tasks = tasks = g_new0 (AgGetPropertyTask*, MAX (n_values, 1));
 
   /* Start up tasks. The "values" array can have values
    * with atom == None, which means to ignore that element.
@@ -987,56 +1178,7 @@ meta_prop_get_values (MetaDisplay   *display,
   i = 0;
   while (i < n_values)
     {
-      if (values[i].required_type == None)
-        {
-          switch (values[i].type)
-            {
-            case META_PROP_VALUE_INVALID:
-              /* This means we don't really want a value, e.g. got
-               * property notify on an atom we don't care about.
-               */
-              if (values[i].atom != None)
-                meta_bug ("META_PROP_VALUE_INVALID requested in %s\n", G_STRFUNC);
-              break;
-            case META_PROP_VALUE_UTF8_LIST:
-            case META_PROP_VALUE_UTF8:
-              values[i].required_type = display->atom_UTF8_STRING;
-              break;
-            case META_PROP_VALUE_STRING:
-            case META_PROP_VALUE_STRING_AS_UTF8:
-              values[i].required_type = XA_STRING;
-              break;
-            case META_PROP_VALUE_MOTIF_HINTS:
-              values[i].required_type = AnyPropertyType;
-              break;
-            case META_PROP_VALUE_CARDINAL_LIST:
-            case META_PROP_VALUE_CARDINAL:
-              values[i].required_type = XA_CARDINAL;
-              break;
-            case META_PROP_VALUE_WINDOW:
-              values[i].required_type = XA_WINDOW;
-              break;
-            case META_PROP_VALUE_ATOM_LIST:
-              values[i].required_type = XA_ATOM;
-              break;
-            case META_PROP_VALUE_TEXT_PROPERTY:
-              values[i].required_type = AnyPropertyType;
-              break;
-            case META_PROP_VALUE_WM_HINTS:
-              values[i].required_type = XA_WM_HINTS;
-              break;
-            case META_PROP_VALUE_CLASS_HINT:
-              values[i].required_type = XA_STRING;
-              break;
-            case META_PROP_VALUE_SIZE_HINTS:
-              values[i].required_type = XA_WM_SIZE_HINTS;
-              break;
-            case META_PROP_VALUE_SYNC_COUNTER:
-            case META_PROP_VALUE_SYNC_COUNTER_LIST:
-	      values[i].required_type = XA_CARDINAL;
-              break;
-            }
-        }
+      init_required_type (display, &values[i]);
 
       if (values[i].atom != None)
         tasks[i] = get_task (display, xwindow,
@@ -1044,13 +1186,39 @@ meta_prop_get_values (MetaDisplay   *display,
       
       ++i;
     }  
-  
-  /* Get replies for all our tasks */
-  meta_topic (META_DEBUG_SYNC, "Syncing to get %d GetProperty replies in %s\n",
-              n_values, G_STRFUNC);
-  XSync (display->xdisplay, False);
-  
-  /* Collect results, should arrive in order requested */
+
+  return request;
+}
+
+void
+meta_prop_collect_values (MetaPropRequest *request)
+{
+  MetaDisplay *display = request->display;
+  Window xwindow = request->xwindow;
+  MetaPropValue *values = request->values;
+  int n_values = request->n_values;
+  AgGetPropertyTask **tasks = request->tasks;
+  int i;
+
+  /* Only go to the server if some of the replies haven't arrived
+   * yet; when the requests were sent well ahead of time, something
+   * else has usually synced in the meantime.
+   */
+  for (i = 0; i < n_values; i++)
+    {
+      if (tasks[i] != NULL && !ag_task_have_reply (tasks[i]))
+        {
+          meta_topic (META_DEBUG_SYNC,
+                      "Syncing to get %d GetProperty replies in %s\n",
+                      n_values, G_STRFUNC);
+          XSync (display->xdisplay, False);
+          break;
+        }
+    }
+
+  /* Collect results. Other requests may have been sent in between,
+   * so take our own tasks rather than whatever completed first.
+   */
   i = 0;
   while (i < n_values)
     {
@@ -1066,8 +1234,7 @@ meta_prop_get_values (MetaDisplay   *display,
           goto next;
         }
       
-      task = ag_get_next_completed_task (display->xdisplay);
-      g_assert (task != NULL);
+      task = tasks[i];
       g_assert (ag_task_have_reply (task));
 
       results.display = display;
@@ -1095,124 +1262,27 @@ meta_prop_get_values (MetaDisplay   *display,
           goto next;
         }
 
-      switch (values[i].type)
-        {
-        case META_PROP_VALUE_INVALID:
-          g_assert_not_reached ();
-          break;
-        case META_PROP_VALUE_UTF8_LIST:
-          if (!utf8_list_from_results (&results,
-                                       &values[i].v.string_list.strings,
-                                       &values[i].v.string_list.n_strings))
-            values[i].type = META_PROP_VALUE_INVALID;
-          break;
-        case META_PROP_VALUE_UTF8:
-          if (!utf8_string_from_results (&results,
-                                         &values[i].v.str))
-            values[i].type = META_PROP_VALUE_INVALID;
-          break;
-        case META_PROP_VALUE_STRING:
-          if (!latin1_string_from_results (&results,
-                                           &values[i].v.str))
-            values[i].type = META_PROP_VALUE_INVALID;
-          break;
-        case META_PROP_VALUE_STRING_AS_UTF8:
-          if (!latin1_string_from_results (&results,
-                                           &values[i].v.str))
-            values[i].type = META_PROP_VALUE_INVALID;
-          else
-            {
-              char *new_str;
-              char *xmalloc_new_str;
-
-              new_str = latin1_to_utf8 (values[i].v.str);
-              xmalloc_new_str = ag_Xmalloc (strlen (new_str) + 1);
-              if (xmalloc_new_str != NULL)
-                {
-                  strcpy (xmalloc_new_str, new_str);
-                  meta_XFree (values[i].v.str);
-                  values[i].v.str = xmalloc_new_str;
-                }
-
-              g_free (new_str);
-            }
-          break;
-        case META_PROP_VALUE_MOTIF_HINTS:
-          if (!motif_hints_from_results (&results,
-                                         &values[i].v.motif_hints))
-            values[i].type = META_PROP_VALUE_INVALID;
-          break;
-        case META_PROP_VALUE_CARDINAL_LIST:
-          if (!cardinal_list_from_results (&results,
-                                           &values[i].v.cardinal_list.cardinals,
-                                           &values[i].v.cardinal_list.n_cardinals))
-            values[i].type = META_PROP_VALUE_INVALID;
-          break;
-        case META_PROP_VALUE_CARDINAL:
-          if (!cardinal_with_atom_type_from_results (&results,
-                                                     values[i].required_type,
-                                                     &values[i].v.cardinal))
-            values[i].type = META_PROP_VALUE_INVALID;
-          break;
-        case META_PROP_VALUE_WINDOW:
-          if (!window_from_results (&results,
-                                    &values[i].v.xwindow))
-            values[i].type = META_PROP_VALUE_INVALID;
-          break;
-        case META_PROP_VALUE_ATOM_LIST:
-          if (!atom_list_from_results (&results,
-                                       &values[i].v.atom_list.atoms,
-                                       &values[i].v.atom_list.n_atoms))
-            values[i].type = META_PROP_VALUE_INVALID;
-          break;
-        case META_PROP_VALUE_TEXT_PROPERTY:
-          if (!text_property_from_results (&results, &values[i].v.str))
-            values[i].type = META_PROP_VALUE_INVALID;
-          break;
-        case META_PROP_VALUE_WM_HINTS:
-          if (!wm_hints_from_results (&results, &values[i].v.wm_hints))
-            values[i].type = META_PROP_VALUE_INVALID;
-          break;
-        case META_PROP_VALUE_CLASS_HINT:
-          if (!class_hint_from_results (&results, &values[i].v.class_hint))
-            values[i].type = META_PROP_VALUE_INVALID;
-          break;
-        case META_PROP_VALUE_SIZE_HINTS:
-          if (!size_hints_from_results (&results,
-                                        &values[i].v.size_hints.hints,
-                                        &values[i].v.size_hints.flags))
-            values[i].type = META_PROP_VALUE_INVALID;
-          break;
-#ifdef HAVE_XSYNC
-        case META_PROP_VALUE_SYNC_COUNTER:
-          if (!counter_from_results (&results,
-                                     &values[i].v.xcounter))
-            values[i].type = META_PROP_VALUE_INVALID;
-          break;
-        case META_PROP_VALUE_SYNC_COUNTER_LIST:
-          if (!counter_list_from_results (&results,
-                                          &values[i].v.xcounter_list.counters,
-                                          &values[i].v.xcounter_list.n_counters))
-            values[i].type = META_PROP_VALUE_INVALID;
-          break;
-#else
-        case META_PROP_VALUE_SYNC_COUNTER:
-        case META_PROP_VALUE_SYNC_COUNTER_LIST:
-          values[i].type = META_PROP_VALUE_INVALID;
-          if (results.prop)
-            {
-              XFree (results.prop);
-              results.prop = NULL;
-            }
-          break;
-#endif
-        }
+      value_from_results (&values[i], &results);
 
     next:
       ++i;
     }
 
   g_free (tasks);
+  g_slice_free (MetaPropRequest, request);
+}
+
+void
+meta_prop_get_values (MetaDisplay   *display,
+                      Window         xwindow,
+                      MetaPropValue *values,
+                      int            n_values)
+{
+  if (n_values == 0)
+    return;
+
+  meta_prop_collect_values (meta_prop_request_values (display, xwindow,
+                                                      values, n_values));
 }
 
 static void
@@ -1280,3 +1350,379 @@ meta_prop_free_values (MetaPropValue *values,
   /* Zero the whole thing to quickly detect breakage */
   memset (values, '\0', sizeof (MetaPropValue) * n_values);
 }
+
+/* Properties are read asynchronously in chunks of this many 32-bit
+ * units (256 KiB); the next chunk is only asked for once the previous
+ * one has arrived, so one huge property can't hold up the connection.
+ */
+#define FETCH_CHUNK_LENGTH 65536
+
+typedef struct
+{
+  MetaPropValue value;
+  Window xwindow;
+  AgGetPropertyTask *task;
+  long offset;
+  GetPropertyResults results;
+  gboolean failed;
+  gboolean cancelled;
+  MetaPropValueFunc callback;
+  gpointer user_data;
+} PropFetch;
+
+typedef struct
+{
+  GSource source;
+  GPollFD poll_fd;
+  MetaDisplay *display;
+} PropFetchSource;
+
+static gboolean
+fetch_is_ready (PropFetch *fetch)
+{
+  return fetch->task == NULL || ag_task_have_reply (fetch->task);
+}
+
+static gboolean
+have_ready_fetches (MetaDisplay *display)
+{
+  GList *l;
+
+  for (l = display->prop_fetches.head; l; l = l->next)
+    if (fetch_is_ready (l->data))
+      return TRUE;
+
+  return FALSE;
+}
+
+static gsize
+client_item_size (int format)
+{
+  /* Xlib hands back 32-bit items as longs, and 16-bit ones as shorts */
+  switch (format)
+    {
+    case 32:
+      return sizeof (long);
+    case 16:
+      return sizeof (short);
+    default:
+      return 1;
+    }
+}
+
+/* Adds the reply to the current task to what we have so far. Returns
+ * %FALSE if another chunk has been asked for, and %TRUE if the fetch
+ * is finished.
+ */
+static gboolean
+receive_chunk (MetaDisplay *display,
+               PropFetch   *fetch)
+{
+  GetPropertyResults *results = &fetch->results;
+  Atom type = None;
+  int format = 0;
+  unsigned long n_items = 0, bytes_after = 0;
+  unsigned char *prop = NULL;
+
+  if (fetch->task == NULL)
+    {
+      fetch->failed = TRUE;
+      return TRUE;
+    }
+
+  if (ag_task_get_reply_and_free (fetch->task, &type, &format,
+                                  &n_items, &bytes_after, &prop) != Success ||
+      type == None)
+    {
+      fetch->task = NULL;
+      fetch->failed = TRUE;
+      if (prop)
+        XFree (prop);
+      return TRUE;
+    }
+
+  fetch->task = NULL;
+
+  if (results->prop == NULL)
+    {
+      results->type = type;
+      results->format = format;
+      results->n_items = n_items;
+      results->prop = prop;
+    }
+  else if (type != results->type || format != results->format)
+    {
+      /* The property was replaced while we were reading it; there's
+       * a PropertyNotify for the new value on its way.
+       */
+      fetch->failed = TRUE;
+      XFree (prop);
+      return TRUE;
+    }
+  else
+    {
+      gsize item_size = client_item_size (format);
+      gsize old_size = results->n_items * item_size;
+      gsize new_size = n_items * item_size;
+      unsigned char *combined;
+
+      /* Keep the trailing nul XGetWindowProperty() adds */
+      combined = ag_Xmalloc (old_size + new_size + 1);
+      if (combined == NULL)
+        {
+          fetch->failed = TRUE;
+          XFree (prop);
+          return TRUE;
+        }
+
+      memcpy (combined, results->prop, old_size);
+      memcpy (combined + old_size, prop, new_size);
+      combined[old_size + new_size] = '\0';
+
+      XFree (results->prop);
+      XFree (prop);
+      results->prop = combined;
+      results->n_items += n_items;
+    }
+
+  results->bytes_after = bytes_after;
+
+  if (bytes_after == 0 || fetch->cancelled)
+    return TRUE;
+
+  meta_topic (META_DEBUG_SYNC,
+              "Fetching %lu more bytes of property on 0x%lx\n",
+              bytes_after, fetch->xwindow);
+
+  fetch->offset += FETCH_CHUNK_LENGTH;
+  fetch->task = ag_task_create (display->xdisplay, fetch->xwindow,
+                                fetch->value.atom,
+                                fetch->offset, FETCH_CHUNK_LENGTH,
+                                False, fetch->value.required_type);
+  if (fetch->task == NULL)
+    {
+      fetch->failed = TRUE;
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+static void
+finish_fetch (MetaDisplay *display,
+              PropFetch   *fetch)
+{
+  if (fetch->failed || fetch->cancelled)
+    {
+      fetch->value.type = META_PROP_VALUE_INVALID;
+      if (fetch->results.prop)
+        XFree (fetch->results.prop);
+    }
+  else
+    {
+      value_from_results (&fetch->value, &fetch->results);
+    }
+
+  if (!fetch->cancelled)
+    fetch->callback (display, fetch->xwindow, &fetch->value,
+                     fetch->user_data);
+
+  meta_prop_free_values (&fetch->value, 1);
+  g_slice_free (PropFetch, fetch);
+}
+
+static void
+process_ready_fetches (MetaDisplay *display)
+{
+  GList *l, *next;
+
+  /* Callbacks may start new fetches, which go at the tail, or cancel
+   * others, which only marks them; so the links we haven't got to
+   * yet stay valid.
+   */
+  for (l = display->prop_fetches.head; l; l = next)
+    {
+      PropFetch *fetch = l->data;
+
+      next = l->next;
+
+      if (!fetch_is_ready (fetch))
+        continue;
+
+      if (!receive_chunk (display, fetch))
+        continue;
+
+      g_queue_delete_link (&display->prop_fetches, l);
+      finish_fetch (display, fetch);
+    }
+}
+
+static gboolean
+prop_fetch_source_prepare (GSource *source,
+                           gint    *timeout)
+{
+  PropFetchSource *fetch_source = (PropFetchSource *) source;
+  MetaDisplay *display = fetch_source->display;
+
+  *timeout = -1;
+
+  if (g_queue_is_empty (&display->prop_fetches))
+    return FALSE;
+
+  /* Send any requests that were made since the last iteration */
+  XFlush (display->xdisplay);
+
+  return have_ready_fetches (display);
+}
+
+static gboolean
+prop_fetch_source_check (GSource *source)
+{
+  PropFetchSource *fetch_source = (PropFetchSource *) source;
+  MetaDisplay *display = fetch_source->display;
+
+  if (g_queue_is_empty (&display->prop_fetches))
+    return FALSE;
+
+  /* Replies are picked up by async-getprop's handler whenever Xlib
+   * reads from the connection; make sure that has happened, in case
+   * GDK hasn't got to it yet.
+   */
+  if (fetch_source->poll_fd.revents & G_IO_IN)
+    XPending (display->xdisplay);
+
+  return have_ready_fetches (display);
+}
+
+static gboolean
+prop_fetch_source_dispatch (GSource     *source,
+                            GSourceFunc  callback,
+                            gpointer     user_data)
+{
+  PropFetchSource *fetch_source = (PropFetchSource *) source;
+
+  process_ready_fetches (fetch_source->display);
+
+  return TRUE;
+}
+
+static GSourceFuncs prop_fetch_source_funcs = {
+  prop_fetch_source_prepare,
+  prop_fetch_source_check,
+  prop_fetch_source_dispatch,
+  NULL
+};
+
+static void
+ensure_prop_fetch_source (MetaDisplay *display)
+{
+  PropFetchSource *fetch_source;
+
+  if (display->prop_fetch_source != NULL)
+    return;
+
+  display->prop_fetch_source = g_source_new (&prop_fetch_source_funcs,
+                                             sizeof (PropFetchSource));
+  fetch_source = (PropFetchSource *) display->prop_fetch_source;
+  fetch_source->display = display;
+  fetch_source->poll_fd.fd = ConnectionNumber (display->xdisplay);
+  fetch_source->poll_fd.events = G_IO_IN;
+
+  g_source_add_poll (display->prop_fetch_source, &fetch_source->poll_fd);
+  g_source_set_priority (display->prop_fetch_source, G_PRIORITY_DEFAULT);
+  g_source_attach (display->prop_fetch_source, NULL);
+}
+
+void
+meta_prop_fetch_value_async (MetaDisplay       *display,
+                             Window             xwindow,
+                             Atom               xatom,
+                             MetaPropValueType  type,
+                             MetaPropValueFunc  callback,
+                             gpointer           user_data)
+{
+  PropFetch *fetch;
+
+  g_return_if_fail (type != META_PROP_VALUE_INVALID);
+
+  fetch = g_slice_new0 (PropFetch);
+  fetch->value.type = type;
+  fetch->value.atom = xatom;
+  fetch->xwindow = xwindow;
+  fetch->callback = callback;
+  fetch->user_data = user_data;
+
+  fetch->results.display = display;
+  fetch->results.xwindow = xwindow;
+  fetch->results.xatom = xatom;
+
+  init_required_type (display, &fetch->value);
+
+  fetch->task = ag_task_create (display->xdisplay, xwindow, xatom,
+                                0, FETCH_CHUNK_LENGTH,
+                                False, fetch->value.required_type);
+
+  ensure_prop_fetch_source (display);
+  g_queue_push_tail (&display->prop_fetches, fetch);
+}
+
+void
+meta_prop_cancel_value_fetches (MetaDisplay *display,
+                                gpointer     user_data)
+{
+  GList *l;
+
+  /* The replies still have to be picked up; they are just dropped */
+  for (l = display->prop_fetches.head; l; l = l->next)
+    {
+      PropFetch *fetch = l->data;
+
+      if (fetch->user_data == user_data)
+        fetch->cancelled = TRUE;
+    }
+}
+
+void
+meta_prop_cancel_value_fetch (MetaDisplay *display,
+                              Window       xwindow,
+                              Atom         xatom,
+                              gpointer     user_data)
+{
+  GList *l;
+
+  for (l = display->prop_fetches.head; l; l = l->next)
+    {
+      PropFetch *fetch = l->data;
+
+      if (fetch->xwindow == xwindow &&
+          fetch->value.atom == xatom &&
+          fetch->user_data == user_data)
+        fetch->cancelled = TRUE;
+    }
+}
+
+void
+meta_prop_free_value_fetches (MetaDisplay *display)
+{
+  PropFetch *fetch;
+
+  if (display->prop_fetch_source != NULL)
+    {
+      g_source_destroy (display->prop_fetch_source);
+      g_source_unref (display->prop_fetch_source);
+      display->prop_fetch_source = NULL;
+    }
+
+  if (g_queue_is_empty (&display->prop_fetches))
+    return;
+
+  /* async-getprop only lets go of a task once its reply is in */
+  XSync (display->xdisplay, False);
+
+  while ((fetch = g_queue_pop_head (&display->prop_fetches)) != NULL)
+    {
+      fetch->cancelled = TRUE;
+      receive_chunk (display, fetch);
+      finish_fetch (display, fetch);
+    }
+}
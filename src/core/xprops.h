@@ -223,9 +223,60 @@ void meta_prop_get_values (MetaDisplay   *display,
                            MetaPropValue *values,
                            int            n_values);
 
+/* The same in two steps: meta_prop_request_values() sends the
+ * requests without waiting for the replies, and
+ * meta_prop_collect_values() fills in @values from them, waiting for
+ * any that haven't arrived yet. This lets requests for many windows
+ * share a single round trip. Every request must be collected, and
+ * @values must stay around until then.
+ */
+typedef struct _MetaPropRequest MetaPropRequest;
+
+MetaPropRequest *meta_prop_request_values (MetaDisplay     *display,
+                                           Window           xwindow,
+                                           MetaPropValue   *values,
+                                           int              n_values);
+void             meta_prop_collect_values (MetaPropRequest *request);
+
 void meta_prop_free_values (MetaPropValue *values,
                             int            n_values);
 
+/* Fetches a single property without blocking. @callback is called
+ * from the main loop once the reply has arrived, with @value filled
+ * in as by meta_prop_get_values(); the value is freed when the
+ * callback returns. Large properties are read in chunks, each one
+ * requested once the previous one has arrived, rather than all at
+ * once.
+ */
+typedef void (* MetaPropValueFunc) (MetaDisplay   *display,
+                                    Window         xwindow,
+                                    MetaPropValue *value,
+                                    gpointer       user_data);
+
+void meta_prop_fetch_value_async    (MetaDisplay       *display,
+                                     Window             xwindow,
+                                     Atom               xatom,
+                                     MetaPropValueType  type,
+                                     MetaPropValueFunc  callback,
+                                     gpointer           user_data);
+
+/* Makes sure none of the pending callbacks for @user_data is called */
+void meta_prop_cancel_value_fetches (MetaDisplay       *display,
+                                     gpointer           user_data);
+
+/* Same, but only for the fetches of @xatom on @xwindow; for when the
+ * property is read synchronously, which gets a value at least as new.
+ */
+void meta_prop_cancel_value_fetch   (MetaDisplay       *display,
+                                     Window             xwindow,
+                                     Atom               xatom,
+                                     gpointer           user_data);
+
+/* Drops all pending fetches without calling their callbacks; for when
+ * the display is closed.
+ */
+void meta_prop_free_value_fetches   (MetaDisplay       *display);
+
 #endif
 
 
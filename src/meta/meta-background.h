@@ -110,4 +110,6 @@ GDesktopBackgroundShading meta_background_get_shading (MetaBackground *self);
 const ClutterColor *meta_background_get_color (MetaBackground *self);
 const ClutterColor *meta_background_get_second_color (MetaBackground *self);
 
+gsize meta_background_get_texture_memory (MetaBackground *self);
+
 #endif /* META_BACKGROUND_H */
@@ -395,6 +395,12 @@ meta_frames_style_updated  (GtkWidget *widget)
 
   meta_frames_font_changed (frames);
 
+  /* Pieces drawn with the old style contexts would otherwise be
+   * reused; the new contexts may even get the same addresses.
+   */
+  if (meta_theme_get_current ())
+    meta_theme_clear_piece_cache (meta_theme_get_current ());
+
   update_style_contexts (frames);
 
   g_hash_table_foreach (frames->frames,
@@ -708,18 +714,21 @@ meta_frames_get_borders (MetaFrames *frames,
   meta_ui_frame_get_borders (frames, frame, borders);
 }
 
-static void
-meta_ui_frame_get_corner_radiuses (MetaFrames  *frames,
-                                   MetaUIFrame *frame,
-                                   float       *top_left,
-                                   float       *top_right,
-                                   float       *bottom_left,
-                                   float       *bottom_right)
+typedef enum
+{
+  CORNER_TOP_LEFT,
+  CORNER_TOP_RIGHT,
+  CORNER_BOTTOM_RIGHT,
+  CORNER_BOTTOM_LEFT,
+  N_CORNERS
+} CornerPosition;
+
+/* The shape of a rounded frame corner, which only depends on the radius
+ * the theme gives it. Themes use only a few radiuses, so these are
+ * computed once and kept; see get_corner().
+ */
+typedef struct
 {
-  MetaFrameGeometry fgeom;
-
-  meta_frames_calc_geometry (frames, frame, &fgeom);
-
   /* For compatibility with the code in get_visible_rect(), there's
    * a mysterious sqrt() added to the corner radiuses:
    *
@@ -728,15 +737,83 @@ meta_ui_frame_get_corner_radiuses (MetaFrames  *frames,
    * It's unclear why the radius is calculated like this, but we
    * need to be consistent with it.
    */
+  float radius;
+
+  /* The parts cut off a top left corner, as runs of rows of the same
+   * width, starting at the top edge
+   */
+  cairo_rectangle_int_t *spans;
+  int n_spans;
+
+  /* Antialiased masks of the visible part of the ceil(radius)-sized
+   * square in each corner; created when first needed
+   */
+  int mask_size;
+  cairo_surface_t *masks[N_CORNERS];
+} MetaFrameCorner;
 
-  if (top_left)
-    *top_left = fgeom.top_left_corner_rounded_radius + sqrt(fgeom.top_left_corner_rounded_radius);
-  if (top_right)
-    *top_right = fgeom.top_right_corner_rounded_radius + sqrt(fgeom.top_right_corner_rounded_radius);
-  if (bottom_left)
-    *bottom_left = fgeom.bottom_left_corner_rounded_radius + sqrt(fgeom.bottom_left_corner_rounded_radius);
-  if (bottom_right)
-    *bottom_right = fgeom.bottom_right_corner_rounded_radius + sqrt(fgeom.bottom_right_corner_rounded_radius);
+static GHashTable *frame_corners = NULL;
+
+static MetaFrameCorner *
+get_corner (int corner)
+{
+  MetaFrameCorner *frame_corner;
+  GArray *spans;
+  int i;
+
+  if (frame_corners == NULL)
+    frame_corners = g_hash_table_new (NULL, NULL);
+
+  frame_corner = g_hash_table_lookup (frame_corners, GINT_TO_POINTER (corner));
+  if (frame_corner)
+    return frame_corner;
+
+  frame_corner = g_slice_new0 (MetaFrameCorner);
+  frame_corner->radius = sqrt(corner) + corner;
+  frame_corner->mask_size = ceil (frame_corner->radius);
+
+  spans = g_array_new (FALSE, FALSE, sizeof (cairo_rectangle_int_t));
+  for (i=0; i<corner; i++)
+    {
+      const float radius = frame_corner->radius;
+      const int width = floor(0.5 + radius - sqrt(radius*radius - (radius-(i+0.5))*(radius-(i+0.5))));
+      cairo_rectangle_int_t *last;
+
+      last = spans->len > 0 ?
+        &g_array_index (spans, cairo_rectangle_int_t, spans->len - 1) : NULL;
+
+      if (last && last->width == width)
+        {
+          last->height += 1;
+        }
+      else
+        {
+          cairo_rectangle_int_t span = { 0, i, width, 1 };
+          g_array_append_val (spans, span);
+        }
+    }
+
+  frame_corner->n_spans = spans->len;
+  frame_corner->spans = (cairo_rectangle_int_t *) g_array_free (spans, FALSE);
+
+  g_hash_table_insert (frame_corners, GINT_TO_POINTER (corner), frame_corner);
+
+  return frame_corner;
+}
+
+static void
+meta_ui_frame_get_corners (MetaFrames      *frames,
+                           MetaUIFrame     *frame,
+                           MetaFrameCorner *corners[N_CORNERS])
+{
+  MetaFrameGeometry fgeom;
+
+  meta_frames_calc_geometry (frames, frame, &fgeom);
+
+  corners[CORNER_TOP_LEFT] = get_corner (fgeom.top_left_corner_rounded_radius);
+  corners[CORNER_TOP_RIGHT] = get_corner (fgeom.top_right_corner_rounded_radius);
+  corners[CORNER_BOTTOM_RIGHT] = get_corner (fgeom.bottom_right_corner_rounded_radius);
+  corners[CORNER_BOTTOM_LEFT] = get_corner (fgeom.bottom_left_corner_rounded_radius);
 }
 
 void
@@ -806,6 +883,46 @@ get_visible_frame_rect (MetaFrameGeometry     *fgeom,
   rect->height = window_height - fgeom->borders.invisible.bottom - rect->y;
 }
 
+/* Adds the parts that a rounded corner cuts off frame_rect to rects */
+static void
+append_corner_spans (GArray                *rects,
+                     cairo_rectangle_int_t *frame_rect,
+                     int                    corner,
+                     CornerPosition         position)
+{
+  MetaFrameCorner *frame_corner;
+  int i;
+
+  if (corner == 0)
+    return;
+
+  frame_corner = get_corner (corner);
+
+  for (i = 0; i < frame_corner->n_spans; i++)
+    {
+      const cairo_rectangle_int_t *span = &frame_corner->spans[i];
+      cairo_rectangle_int_t rect;
+
+      if (span->width == 0)
+        continue;
+
+      rect.width = span->width;
+      rect.height = span->height;
+
+      if (position == CORNER_TOP_LEFT || position == CORNER_BOTTOM_LEFT)
+        rect.x = frame_rect->x;
+      else
+        rect.x = frame_rect->x + frame_rect->width - span->width;
+
+      if (position == CORNER_TOP_LEFT || position == CORNER_TOP_RIGHT)
+        rect.y = frame_rect->y + span->y;
+      else
+        rect.y = frame_rect->y + frame_rect->height - span->y - span->height;
+
+      g_array_append_val (rects, rect);
+    }
+}
+
 static cairo_region_t *
 get_visible_region (MetaFrames        *frames,
                     MetaUIFrame       *frame,
@@ -815,84 +932,29 @@ get_visible_region (MetaFrames        *frames,
 {
   cairo_region_t *corners_region;
   cairo_region_t *visible_region;
-  cairo_rectangle_int_t rect;
   cairo_rectangle_int_t frame_rect;
+  GArray *rects;
 
-  corners_region = cairo_region_create ();
   get_visible_frame_rect (fgeom, window_width, window_height, &frame_rect);
-  
-  if (fgeom->top_left_corner_rounded_radius != 0)
-    {
-      const int corner = fgeom->top_left_corner_rounded_radius;
-      const float radius = sqrt(corner) + corner;
-      int i;
 
-      for (i=0; i<corner; i++)
-        {
-          const int width = floor(0.5 + radius - sqrt(radius*radius - (radius-(i+0.5))*(radius-(i+0.5))));
-          rect.x = frame_rect.x;
-          rect.y = frame_rect.y + i;
-          rect.width = width;
-          rect.height = 1;
-          
-          cairo_region_union_rectangle (corners_region, &rect);
-        }
-    }
-
-  if (fgeom->top_right_corner_rounded_radius != 0)
-    {
-      const int corner = fgeom->top_right_corner_rounded_radius;
-      const float radius = sqrt(corner) + corner;
-      int i;
-
-      for (i=0; i<corner; i++)
-        {
-          const int width = floor(0.5 + radius - sqrt(radius*radius - (radius-(i+0.5))*(radius-(i+0.5))));
-          rect.x = frame_rect.x + frame_rect.width - width;
-          rect.y = frame_rect.y + i;
-          rect.width = width;
-          rect.height = 1;
-          
-          cairo_region_union_rectangle (corners_region, &rect);
-        }
-    }
-
-  if (fgeom->bottom_left_corner_rounded_radius != 0)
-    {
-      const int corner = fgeom->bottom_left_corner_rounded_radius;
-      const float radius = sqrt(corner) + corner;
-      int i;
+  rects = g_array_new (FALSE, FALSE, sizeof (cairo_rectangle_int_t));
+  append_corner_spans (rects, &frame_rect,
+                       fgeom->top_left_corner_rounded_radius,
+                       CORNER_TOP_LEFT);
+  append_corner_spans (rects, &frame_rect,
+                       fgeom->top_right_corner_rounded_radius,
+                       CORNER_TOP_RIGHT);
+  append_corner_spans (rects, &frame_rect,
+                       fgeom->bottom_left_corner_rounded_radius,
+                       CORNER_BOTTOM_LEFT);
+  append_corner_spans (rects, &frame_rect,
+                       fgeom->bottom_right_corner_rounded_radius,
+                       CORNER_BOTTOM_RIGHT);
+
+  corners_region = cairo_region_create_rectangles ((cairo_rectangle_int_t *) rects->data,
+                                                   rects->len);
+  g_array_free (rects, TRUE);
 
-      for (i=0; i<corner; i++)
-        {
-          const int width = floor(0.5 + radius - sqrt(radius*radius - (radius-(i+0.5))*(radius-(i+0.5))));
-          rect.x = frame_rect.x;
-          rect.y = frame_rect.y + frame_rect.height - i - 1;
-          rect.width = width;
-          rect.height = 1;
-          
-          cairo_region_union_rectangle (corners_region, &rect);
-        }
-    }
-
-  if (fgeom->bottom_right_corner_rounded_radius != 0)
-    {
-      const int corner = fgeom->bottom_right_corner_rounded_radius;
-      const float radius = sqrt(corner) + corner;
-      int i;
-
-      for (i=0; i<corner; i++)
-        {
-          const int width = floor(0.5 + radius - sqrt(radius*radius - (radius-(i+0.5))*(radius-(i+0.5))));
-          rect.x = frame_rect.x + frame_rect.width - width;
-          rect.y = frame_rect.y + frame_rect.height - i - 1;
-          rect.width = width;
-          rect.height = 1;
-          
-          cairo_region_union_rectangle (corners_region, &rect);
-        }
-    }
-  
   visible_region = cairo_region_create_rectangle (&frame_rect);
   cairo_region_subtract (visible_region, corners_region);
   cairo_region_destroy (corners_region);
@@ -1837,6 +1899,118 @@ clip_region_to_visible_frame_border (cairo_region_t *region,
 
 #define TAU (2*M_PI)
 
+/* Traces the outline of the visible frame, as a rectangle with its
+ * corners rounded by the given radiuses
+ */
+static void
+trace_rounded_rect (cairo_t               *cr,
+                    cairo_rectangle_int_t *rect,
+                    float                  top_left,
+                    float                  top_right,
+                    float                  bottom_right,
+                    float                  bottom_left)
+{
+  double x, y;
+
+  /* top left */
+  x = rect->x;
+  y = rect->y;
+
+  cairo_arc (cr,
+             x + top_left,
+             y + top_left,
+             top_left,
+             2 * TAU / 4,
+             3 * TAU / 4);
+
+  /* top right */
+  x = rect->x + rect->width - top_right;
+  y = rect->y;
+
+  cairo_arc (cr,
+             x,
+             y + top_right,
+             top_right,
+             3 * TAU / 4,
+             4 * TAU / 4);
+
+  /* bottom right */
+  x = rect->x + rect->width - bottom_right;
+  y = rect->y + rect->height - bottom_right;
+
+  cairo_arc (cr,
+             x,
+             y,
+             bottom_right,
+             0 * TAU / 4,
+             1 * TAU / 4);
+
+  /* bottom left */
+  x = rect->x;
+  y = rect->y + rect->height - bottom_left;
+
+  cairo_arc (cr,
+             x + bottom_left,
+             y,
+             bottom_left,
+             1 * TAU / 4,
+             2 * TAU / 4);
+}
+
+/* Returns the alpha mask for the square of mask_size pixels in the
+ * given corner of the visible frame. This is exactly what filling the
+ * outline traced by trace_rounded_rect() gives in that square, since
+ * the outline is the same in every frame with this corner radius.
+ */
+static cairo_surface_t *
+get_corner_mask (MetaFrameCorner *frame_corner,
+                 CornerPosition   position)
+{
+  cairo_surface_t *surface;
+  cairo_t *cr;
+  int size = frame_corner->mask_size;
+
+  if (size == 0)
+    return NULL;
+
+  if (frame_corner->masks[position])
+    return frame_corner->masks[position];
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_A8, size, size);
+  cr = cairo_create (surface);
+
+  /* Draw the top left corner, mirrored into the right place */
+  if (position == CORNER_TOP_RIGHT || position == CORNER_BOTTOM_RIGHT)
+    {
+      cairo_translate (cr, size, 0);
+      cairo_scale (cr, -1, 1);
+    }
+  if (position == CORNER_BOTTOM_LEFT || position == CORNER_BOTTOM_RIGHT)
+    {
+      cairo_translate (cr, 0, size);
+      cairo_scale (cr, 1, -1);
+    }
+
+  cairo_arc (cr,
+             frame_corner->radius,
+             frame_corner->radius,
+             frame_corner->radius,
+             2 * TAU / 4,
+             3 * TAU / 4);
+  cairo_line_to (cr, size, 0);
+  cairo_line_to (cr, size, size);
+  cairo_line_to (cr, 0, size);
+  cairo_close_path (cr);
+
+  cairo_set_source_rgba (cr, 1, 1, 1, 1);
+  cairo_fill (cr);
+  cairo_destroy (cr);
+
+  frame_corner->masks[position] = surface;
+
+  return surface;
+}
+
 /*
  * Draw the opaque and semi-opaque pixels of this frame into a mask.
  *
@@ -1853,6 +2027,9 @@ clip_region_to_visible_frame_border (cairo_region_t *region,
  * discarded anyway) with appropriate alpha values to reproduce this
  * frame's alpha channel, as a mask to be applied to an opaque pixmap.
  *
+ * The corners are painted from masks made once per corner radius, and
+ * the rest of the frame is filled as rectangles.
+ *
  * @frame: This frame
  * @xwindow: The X window for the frame, which has the client window as a child
  * @width: The width of the framed window including any invisible borders
@@ -1867,9 +2044,12 @@ meta_frames_get_mask (MetaFrames          *frames,
                       cairo_t             *cr)
 {
   MetaUIFrame *frame = meta_frames_lookup_window (frames, xwindow);
-  float top_left, top_right, bottom_left, bottom_right;
-  int x, y;
+  MetaFrameCorner *corners[N_CORNERS];
   MetaFrameBorders borders;
+  cairo_rectangle_int_t rect;
+  cairo_rectangle_int_t squares[N_CORNERS];
+  cairo_region_t *region;
+  int i;
 
   if (frame == NULL)
     meta_bug ("No such frame 0x%lx\n", xwindow);
@@ -1877,56 +2057,65 @@ meta_frames_get_mask (MetaFrames          *frames,
   cairo_save (cr);
 
   meta_ui_frame_get_borders (frames, frame, &borders);
-  meta_ui_frame_get_corner_radiuses (frames, frame,
-                                     &top_left, &top_right,
-                                     &bottom_left, &bottom_right);
-
-  /* top left */
-  x = borders.invisible.left;
-  y = borders.invisible.top;
+  meta_ui_frame_get_corners (frames, frame, corners);
 
-  cairo_arc (cr,
-             x + top_left,
-             y + top_left,
-             top_left,
-             2 * TAU / 4,
-             3 * TAU / 4);
+  rect.x = borders.invisible.left;
+  rect.y = borders.invisible.top;
+  rect.width = width - borders.invisible.right - rect.x;
+  rect.height = height - borders.invisible.bottom - rect.y;
 
-  /* top right */
-  x = width - borders.invisible.right - top_right;
-  y = borders.invisible.top;
+  cairo_set_source_rgba (cr, 1, 1, 1, 1);
 
-  cairo_arc (cr,
-             x,
-             y + top_right,
-             top_right,
-             3 * TAU / 4,
-             4 * TAU / 4);
+  /* Windows too small for the corner squares to stay apart get the
+   * outline filled directly
+   */
+  if (corners[CORNER_TOP_LEFT]->mask_size + corners[CORNER_TOP_RIGHT]->mask_size > rect.width ||
+      corners[CORNER_BOTTOM_LEFT]->mask_size + corners[CORNER_BOTTOM_RIGHT]->mask_size > rect.width ||
+      corners[CORNER_TOP_LEFT]->mask_size + corners[CORNER_BOTTOM_LEFT]->mask_size > rect.height ||
+      corners[CORNER_TOP_RIGHT]->mask_size + corners[CORNER_BOTTOM_RIGHT]->mask_size > rect.height)
+    {
+      trace_rounded_rect (cr, &rect,
+                          corners[CORNER_TOP_LEFT]->radius,
+                          corners[CORNER_TOP_RIGHT]->radius,
+                          corners[CORNER_BOTTOM_RIGHT]->radius,
+                          corners[CORNER_BOTTOM_LEFT]->radius);
+      cairo_fill (cr);
+      cairo_restore (cr);
+      return;
+    }
 
-  /* bottom right */
-  x = width - borders.invisible.right - bottom_right;
-  y = height - borders.invisible.bottom - bottom_right;
+  for (i = 0; i < N_CORNERS; i++)
+    {
+      squares[i].width = corners[i]->mask_size;
+      squares[i].height = corners[i]->mask_size;
 
-  cairo_arc (cr,
-             x,
-             y,
-             bottom_right,
-             0 * TAU / 4,
-             1 * TAU / 4);
+      if (i == CORNER_TOP_LEFT || i == CORNER_BOTTOM_LEFT)
+        squares[i].x = rect.x;
+      else
+        squares[i].x = rect.x + rect.width - squares[i].width;
 
-  /* bottom left */
-  x = borders.invisible.left;
-  y = height - borders.invisible.bottom - bottom_left;
+      if (i == CORNER_TOP_LEFT || i == CORNER_TOP_RIGHT)
+        squares[i].y = rect.y;
+      else
+        squares[i].y = rect.y + rect.height - squares[i].height;
+    }
 
-  cairo_arc (cr,
-             x + bottom_left,
-             y,
-             bottom_left,
-             1 * TAU / 4,
-             2 * TAU / 4);
+  region = cairo_region_create_rectangle (&rect);
+  for (i = 0; i < N_CORNERS; i++)
+    cairo_region_subtract_rectangle (region, &squares[i]);
 
-  cairo_set_source_rgba (cr, 1, 1, 1, 1);
+  gdk_cairo_region (cr, region);
   cairo_fill (cr);
+  cairo_region_destroy (region);
+
+  for (i = 0; i < N_CORNERS; i++)
+    {
+      cairo_surface_t *mask;
+
+      mask = get_corner_mask (corners[i], i);
+      if (mask)
+        cairo_mask_surface (cr, mask, squares[i].x, squares[i].y);
+    }
 
   cairo_restore (cr);
 }
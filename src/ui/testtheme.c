@@ -0,0 +1,232 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* Mutter theme rendering benchmark */
+
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Usage: testtheme [THEME] [ITERATIONS]
+ *
+ * Draws every frame type of THEME (Adwaita by default), focused and
+ * unfocused, at a range of client sizes, and prints the average time
+ * per meta_theme_draw_frame() call.
+ */
+
+#include <config.h>
+#include "theme-private.h"
+#include <gtk/gtk.h>
+#include <stdlib.h>
+
+#define DEFAULT_ITERATIONS 200
+
+static const struct {
+  int width;
+  int height;
+} client_sizes[] = {
+  { 1, 1 },
+  { 64, 48 },
+  { 200, 150 },
+  { 480, 320 },
+  { 800, 600 },
+  { 1280, 1024 },
+  { 1920, 1080 }
+};
+
+static const char *
+frame_type_name (MetaFrameType type)
+{
+  switch (type)
+    {
+    case META_FRAME_TYPE_NORMAL:
+      return "normal";
+    case META_FRAME_TYPE_DIALOG:
+      return "dialog";
+    case META_FRAME_TYPE_MODAL_DIALOG:
+      return "modal_dialog";
+    case META_FRAME_TYPE_UTILITY:
+      return "utility";
+    case META_FRAME_TYPE_MENU:
+      return "menu";
+    case META_FRAME_TYPE_BORDER:
+      return "border";
+    case META_FRAME_TYPE_ATTACHED:
+      return "attached";
+    case META_FRAME_TYPE_LAST:
+      break;
+    }
+
+  return "<unknown>";
+}
+
+static void
+init_button_layout (MetaButtonLayout *button_layout)
+{
+  int i;
+
+  for (i = 0; i < MAX_BUTTONS_PER_CORNER; i++)
+    {
+      button_layout->left_buttons[i] = META_BUTTON_FUNCTION_LAST;
+      button_layout->left_buttons_has_spacer[i] = FALSE;
+      button_layout->right_buttons[i] = META_BUTTON_FUNCTION_LAST;
+      button_layout->right_buttons_has_spacer[i] = FALSE;
+    }
+
+  button_layout->left_buttons[0] = META_BUTTON_FUNCTION_MENU;
+
+  button_layout->right_buttons[0] = META_BUTTON_FUNCTION_MINIMIZE;
+  button_layout->right_buttons[1] = META_BUTTON_FUNCTION_MAXIMIZE;
+  button_layout->right_buttons[2] = META_BUTTON_FUNCTION_CLOSE;
+}
+
+static GdkPixbuf *
+make_icon (int size)
+{
+  GdkPixbuf *pixbuf;
+
+  pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, size, size);
+  gdk_pixbuf_fill (pixbuf, 0x3465a4ff);
+
+  return pixbuf;
+}
+
+int
+main (int argc, char **argv)
+{
+  const char *theme_name;
+  int iterations;
+  MetaTheme *theme;
+  GError *err;
+  GtkWidget *window;
+  GtkStyleContext *style;
+  PangoFontDescription *font_desc;
+  PangoLayout *layout;
+  int text_height;
+  MetaButtonLayout button_layout;
+  MetaButtonState button_states[META_BUTTON_TYPE_LAST];
+  GdkPixbuf *mini_icon, *icon;
+  GTimer *timer;
+  double total_ns;
+  int n_draws;
+  int type, focus, size, i;
+
+  gtk_init (&argc, &argv);
+
+  theme_name = argc > 1 ? argv[1] : "Adwaita";
+  iterations = argc > 2 ? atoi (argv[2]) : DEFAULT_ITERATIONS;
+  if (iterations <= 0)
+    iterations = DEFAULT_ITERATIONS;
+
+  err = NULL;
+  theme = meta_theme_load (theme_name, &err);
+  if (theme == NULL)
+    {
+      g_printerr ("Failed to load theme \"%s\": %s\n", theme_name, err->message);
+      g_error_free (err);
+      return 1;
+    }
+
+  window = gtk_window_new (GTK_WINDOW_TOPLEVEL);
+  style = meta_theme_create_style_context (gtk_widget_get_screen (window), NULL);
+
+  font_desc = meta_gtk_widget_get_font_desc (window, 1.0, NULL);
+  text_height = meta_pango_font_desc_get_text_height (font_desc,
+                                                      gtk_widget_get_pango_context (window));
+  layout = gtk_widget_create_pango_layout (window, "Benchmark window title");
+  pango_layout_set_font_description (layout, font_desc);
+
+  init_button_layout (&button_layout);
+  for (i = 0; i < META_BUTTON_TYPE_LAST; i++)
+    button_states[i] = META_BUTTON_STATE_NORMAL;
+
+  mini_icon = make_icon (16);
+  icon = make_icon (48);
+
+  timer = g_timer_new ();
+  total_ns = 0;
+  n_draws = 0;
+
+  g_print ("%-14s %-9s %11s %12s\n", "type", "focus", "size", "ns/draw");
+
+  for (type = 0; type < META_FRAME_TYPE_LAST; type++)
+    for (focus = 0; focus < 2; focus++)
+      for (size = 0; size < (int) G_N_ELEMENTS (client_sizes); size++)
+        {
+          MetaFrameFlags flags;
+          MetaFrameBorders borders;
+          cairo_surface_t *surface;
+          cairo_t *cr;
+          int client_width = client_sizes[size].width;
+          int client_height = client_sizes[size].height;
+          double ns;
+
+          flags = META_FRAME_ALLOWS_DELETE | META_FRAME_ALLOWS_MENU |
+                  META_FRAME_ALLOWS_MINIMIZE | META_FRAME_ALLOWS_MAXIMIZE |
+                  META_FRAME_ALLOWS_VERTICAL_RESIZE |
+                  META_FRAME_ALLOWS_HORIZONTAL_RESIZE |
+                  META_FRAME_ALLOWS_SHADE | META_FRAME_ALLOWS_MOVE;
+          if (focus)
+            flags |= META_FRAME_HAS_FOCUS;
+
+          meta_theme_get_frame_borders (theme, type, text_height, flags,
+                                        &borders);
+
+          /* Only the frame is drawn, so the surface doesn't need to
+           * be as big as the window; but the frame pieces do get
+           * bigger with the window, which is what we want to measure.
+           */
+          surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+                                                client_width + borders.total.left + borders.total.right,
+                                                client_height + borders.total.top + borders.total.bottom);
+          cr = cairo_create (surface);
+
+          g_timer_start (timer);
+          for (i = 0; i < iterations; i++)
+            meta_theme_draw_frame (theme, style, cr, type, flags,
+                                   client_width, client_height,
+                                   layout, text_height,
+                                   &button_layout, button_states,
+                                   mini_icon, icon);
+          cairo_surface_flush (surface);
+          g_timer_stop (timer);
+
+          ns = g_timer_elapsed (timer, NULL) * 1e9 / iterations;
+          total_ns += ns * iterations;
+          n_draws += iterations;
+
+          g_print ("%-14s %-9s %5dx%-5d %12.0f\n",
+                   frame_type_name (type),
+                   focus ? "focused" : "unfocused",
+                   client_width, client_height, ns);
+
+          cairo_destroy (cr);
+          cairo_surface_destroy (surface);
+        }
+
+  g_print ("\n%d draws, %.0f ns/draw on average\n",
+           n_draws, total_ns / n_draws);
+
+  g_timer_destroy (timer);
+  g_object_unref (mini_icon);
+  g_object_unref (icon);
+  g_object_unref (layout);
+  pango_font_description_free (font_desc);
+  g_object_unref (style);
+  gtk_widget_destroy (window);
+  meta_theme_free (theme);
+
+  return 0;
+}
@@ -441,16 +441,72 @@ typedef struct
   } d;
 } PosToken;
 
+/**
+ * The variables an expression can refer to, as resolved when it is
+ * compiled.
+ *
+ * \ingroup parser
+ */
+typedef enum
+{
+  POS_VAR_WIDTH,
+  POS_VAR_HEIGHT,
+  POS_VAR_OBJECT_WIDTH,
+  POS_VAR_OBJECT_HEIGHT,
+  POS_VAR_LEFT_WIDTH,
+  POS_VAR_RIGHT_WIDTH,
+  POS_VAR_TOP_HEIGHT,
+  POS_VAR_BOTTOM_HEIGHT,
+  POS_VAR_MINI_ICON_WIDTH,
+  POS_VAR_MINI_ICON_HEIGHT,
+  POS_VAR_ICON_WIDTH,
+  POS_VAR_ICON_HEIGHT,
+  POS_VAR_TITLE_WIDTH,
+  POS_VAR_TITLE_HEIGHT,
+  POS_VAR_FRAME_X_CENTER,
+  POS_VAR_FRAME_Y_CENTER,
+  POS_VAR_LAST
+} PosVariable;
+
+typedef enum
+{
+  POS_INSTR_INT,
+  POS_INSTR_DOUBLE,
+  POS_INSTR_VARIABLE,
+  POS_INSTR_OPERATOR
+} PosInstrType;
+
+/**
+ * An instruction in a compiled expression. Expressions are compiled
+ * to reverse Polish notation: values are pushed onto a stack, and
+ * each operator replaces the top two values with its result.
+ *
+ * \ingroup parser
+ */
+typedef struct
+{
+  PosInstrType type;
+
+  union
+  {
+    int int_val;
+    double double_val;
+    PosVariable var;
+    PosOperatorType op;
+  } d;
+} PosInstr;
+
 /**
  * MetaDrawSpec: (skip)
  *
  * A computed expression in our simple vector drawing language.
- * While it appears to take the form of a tree, this is actually
- * merely a list; concerns such as precedence of operators are
- * currently recomputed on every recalculation.
+ * Expressions that aren't constant are compiled once, when the theme
+ * is loaded, into a program with operator precedence already resolved
+ * and constant subexpressions folded; pos_eval() runs that program.
+ * Expressions that don't compile keep their tokens, which are
+ * evaluated the slow way so that the errors are reported as before.
  *
  * Created by meta_draw_spec_new(), destroyed by meta_draw_spec_free().
- * pos_eval() fills this with ...FIXME. Are tokens a tree or a list?
  * \ingroup parser
  */
 typedef struct _MetaDrawSpec MetaDrawSpec;
@@ -468,6 +524,12 @@ struct _MetaDrawSpec
   /** How many tokens are in the tokens list. */
   int n_tokens;
 
+  /** The compiled expression, or %NULL if it couldn't be compiled. */
+  PosInstr *program;
+
+  /** How many instructions are in the program. */
+  int n_instrs;
+
   /** Does the expression contain any variables? */
   gboolean constant : 1;
 };
@@ -635,6 +697,12 @@ struct _MetaDrawOpList
   MetaDrawOp **ops;
   int n_ops;
   int n_allocated;
+
+  /* Whether drawing the list only depends on its size and the frame
+   * borders, so it can be drawn from the theme's piece cache
+   */
+  guint cacheable_known : 1;
+  guint cacheable : 1;
 };
 
 typedef enum
@@ -875,6 +943,9 @@ struct _MetaTheme
   GHashTable *style_sets_by_name;
   MetaFrameStyleSet *style_sets_by_type[META_FRAME_TYPE_LAST];
 
+  /** Drawn frame pieces; see meta_theme_clear_piece_cache(). */
+  GHashTable *piece_cache;
+
   GQuark quark_width;
   GQuark quark_height;
   GQuark quark_object_width;
@@ -1039,6 +1110,8 @@ void meta_theme_draw_frame (MetaTheme              *theme,
                             GdkPixbuf              *mini_icon,
                             GdkPixbuf              *icon);
 
+void meta_theme_clear_piece_cache (MetaTheme *theme);
+
 void meta_theme_get_frame_borders (MetaTheme         *theme,
                                    MetaFrameType      type,
                                    int                text_height,
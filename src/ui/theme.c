@@ -2459,9 +2459,9 @@ pos_eval_get_variable (PosToken                  *t,
  * Evaluates a sequence of tokens within a particular environment context,
  * and returns the current value. May recur if parantheses are found.
  *
- * FIXME: Yes, we really do reparse the expression every time it's evaluated.
- *        We should keep the parse tree around all the time and just
- *        run the new values through it.
+ * This reparses the expression every time it's evaluated, so it's only
+ * used for constant expressions, which are evaluated once, and for
+ * expressions that pos_compile() couldn't compile.
  */
 static gboolean
 pos_eval_helper (PosToken                   *tokens,
@@ -2618,6 +2618,442 @@ pos_eval_helper (PosToken                   *tokens,
   return TRUE;
 }
 
+static const char * const pos_variable_names[POS_VAR_LAST] = {
+  "width",
+  "height",
+  "object_width",
+  "object_height",
+  "left_width",
+  "right_width",
+  "top_height",
+  "bottom_height",
+  "mini_icon_width",
+  "mini_icon_height",
+  "icon_width",
+  "icon_height",
+  "title_width",
+  "title_height",
+  "frame_x_center",
+  "frame_y_center"
+};
+
+static gboolean
+pos_variable_from_name (const char  *name,
+                        PosVariable *var)
+{
+  int i;
+
+  for (i = 0; i < POS_VAR_LAST; i++)
+    if (strcmp (name, pos_variable_names[i]) == 0)
+      {
+        *var = i;
+        return TRUE;
+      }
+
+  return FALSE;
+}
+
+/**
+ * pos_eval_variable:
+ * @var: a variable, as resolved by pos_compile()
+ * @env: The environment within which @var should be evaluated
+ * @result: (out): The value of that variable
+ * @err: (out): set to the problem if there was a problem
+ *
+ * Like pos_eval_get_variable(), for compiled expressions.
+ *
+ * Returns: %TRUE if the variable has a value in @env, %FALSE if it doesn't
+ */
+static gboolean
+pos_eval_variable (PosVariable                var,
+                   const MetaPositionExprEnv *env,
+                   int                       *result,
+                   GError                   **err)
+{
+  switch (var)
+    {
+    case POS_VAR_WIDTH:
+      *result = env->rect.width;
+      break;
+    case POS_VAR_HEIGHT:
+      *result = env->rect.height;
+      break;
+    case POS_VAR_OBJECT_WIDTH:
+      if (env->object_width < 0)
+        goto unknown;
+      *result = env->object_width;
+      break;
+    case POS_VAR_OBJECT_HEIGHT:
+      if (env->object_height < 0)
+        goto unknown;
+      *result = env->object_height;
+      break;
+    case POS_VAR_LEFT_WIDTH:
+      *result = env->left_width;
+      break;
+    case POS_VAR_RIGHT_WIDTH:
+      *result = env->right_width;
+      break;
+    case POS_VAR_TOP_HEIGHT:
+      *result = env->top_height;
+      break;
+    case POS_VAR_BOTTOM_HEIGHT:
+      *result = env->bottom_height;
+      break;
+    case POS_VAR_MINI_ICON_WIDTH:
+      *result = env->mini_icon_width;
+      break;
+    case POS_VAR_MINI_ICON_HEIGHT:
+      *result = env->mini_icon_height;
+      break;
+    case POS_VAR_ICON_WIDTH:
+      *result = env->icon_width;
+      break;
+    case POS_VAR_ICON_HEIGHT:
+      *result = env->icon_height;
+      break;
+    case POS_VAR_TITLE_WIDTH:
+      *result = env->title_width;
+      break;
+    case POS_VAR_TITLE_HEIGHT:
+      *result = env->title_height;
+      break;
+    case POS_VAR_FRAME_X_CENTER:
+      *result = env->frame_x_center;
+      break;
+    case POS_VAR_FRAME_Y_CENTER:
+      *result = env->frame_y_center;
+      break;
+    case POS_VAR_LAST:
+      g_assert_not_reached ();
+      break;
+    }
+
+  return TRUE;
+
+ unknown:
+  g_set_error (err, META_THEME_ERROR,
+               META_THEME_ERROR_UNKNOWN_VARIABLE,
+               _("Coordinate expression had unknown variable or constant \"%s\""),
+               pos_variable_names[var]);
+  return FALSE;
+}
+
+/* Same precedences as pos_eval_helper() */
+static int
+op_precedence (PosOperatorType op)
+{
+  switch (op)
+    {
+    case POS_OP_MULTIPLY:
+    case POS_OP_DIVIDE:
+    case POS_OP_MOD:
+      return 2;
+    case POS_OP_ADD:
+    case POS_OP_SUBTRACT:
+      return 1;
+    case POS_OP_MAX:
+    case POS_OP_MIN:
+      return 0;
+    case POS_OP_NONE:
+      break;
+    }
+
+  return -1;
+}
+
+static gboolean
+instr_is_constant (const PosInstr *instr)
+{
+  return instr->type == POS_INSTR_INT || instr->type == POS_INSTR_DOUBLE;
+}
+
+static void
+instr_to_expr (const PosInstr *instr,
+               PosExpr        *expr)
+{
+  if (instr->type == POS_INSTR_INT)
+    {
+      expr->type = POS_EXPR_INT;
+      expr->d.int_val = instr->d.int_val;
+    }
+  else
+    {
+      expr->type = POS_EXPR_DOUBLE;
+      expr->d.double_val = instr->d.double_val;
+    }
+}
+
+/**
+ * pos_compile_operator:
+ * @program: the program being compiled
+ * @n_instrs: (inout): the number of instructions in @program
+ * @op: the operator to append
+ *
+ * Appends an operator to a program. If both its operands are
+ * constants, which in reverse Polish notation means the two
+ * instructions before it push constants, it is computed here instead.
+ * Operations that fail, such as a division by zero, are left for
+ * pos_eval() to report.
+ */
+static void
+pos_compile_operator (PosInstr        *program,
+                      int             *n_instrs,
+                      PosOperatorType  op)
+{
+  PosInstr *a, *b;
+  PosExpr a_expr, b_expr;
+
+  if (*n_instrs >= 2)
+    {
+      a = &program[*n_instrs - 2];
+      b = &program[*n_instrs - 1];
+
+      if (instr_is_constant (a) && instr_is_constant (b))
+        {
+          instr_to_expr (a, &a_expr);
+          instr_to_expr (b, &b_expr);
+
+          if (do_operation (&a_expr, &b_expr, op, NULL))
+            {
+              if (a_expr.type == POS_EXPR_INT)
+                {
+                  a->type = POS_INSTR_INT;
+                  a->d.int_val = a_expr.d.int_val;
+                }
+              else
+                {
+                  a->type = POS_INSTR_DOUBLE;
+                  a->d.double_val = a_expr.d.double_val;
+                }
+
+              *n_instrs -= 1;
+              return;
+            }
+        }
+    }
+
+  program[*n_instrs].type = POS_INSTR_OPERATOR;
+  program[*n_instrs].d.op = op;
+  *n_instrs += 1;
+}
+
+/* Deepest operand stack a compiled expression may need */
+#define MAX_STACK 32
+
+/**
+ * pos_compile:
+ * @tokens: the tokens of an expression, with constants replaced
+ * @n_tokens: how many tokens are in the list
+ * @program_p: (out): the compiled expression
+ * @n_instrs_p: (out): how many instructions are in the program
+ *
+ * Compiles an expression to reverse Polish notation, resolving operator
+ * precedence and variable names once rather than on every evaluation.
+ *
+ * Nothing is reported on failure; expressions that can't be compiled,
+ * because they are malformed or use unknown variables, are evaluated by
+ * pos_eval_helper(), which reports the problem every time, as it always
+ * has.
+ *
+ * Returns: %TRUE if the expression was compiled, %FALSE otherwise
+ */
+static gboolean
+pos_compile (PosToken   *tokens,
+             int         n_tokens,
+             PosInstr  **program_p,
+             int        *n_instrs_p)
+{
+  PosInstr *program;
+  PosToken **ops;
+  int n_instrs, n_ops;
+  int depth, max_depth;
+  gboolean expect_operand;
+  int i;
+
+  /* The program never has more instructions than there are tokens */
+  program = g_new (PosInstr, MAX (n_tokens, 1));
+  ops = g_new (PosToken *, MAX (n_tokens, 1));
+  n_instrs = 0;
+  n_ops = 0;
+  depth = 0;
+  max_depth = 0;
+  expect_operand = TRUE;
+
+  for (i = 0; i < n_tokens; i++)
+    {
+      PosToken *t = &tokens[i];
+
+      switch (t->type)
+        {
+        case POS_TOKEN_INT:
+        case POS_TOKEN_DOUBLE:
+        case POS_TOKEN_VARIABLE:
+          if (!expect_operand)
+            goto failed;
+
+          if (t->type == POS_TOKEN_INT)
+            {
+              program[n_instrs].type = POS_INSTR_INT;
+              program[n_instrs].d.int_val = t->d.i.val;
+            }
+          else if (t->type == POS_TOKEN_DOUBLE)
+            {
+              program[n_instrs].type = POS_INSTR_DOUBLE;
+              program[n_instrs].d.double_val = t->d.d.val;
+            }
+          else
+            {
+              program[n_instrs].type = POS_INSTR_VARIABLE;
+              if (!pos_variable_from_name (t->d.v.name,
+                                           &program[n_instrs].d.var))
+                goto failed;
+            }
+
+          ++n_instrs;
+          ++depth;
+          max_depth = MAX (depth, max_depth);
+          expect_operand = FALSE;
+          break;
+
+        case POS_TOKEN_OPERATOR:
+          if (expect_operand)
+            goto failed;
+
+          /* All operators are left-associative */
+          while (n_ops > 0 &&
+                 ops[n_ops - 1]->type == POS_TOKEN_OPERATOR &&
+                 op_precedence (ops[n_ops - 1]->d.o.op) >= op_precedence (t->d.o.op))
+            {
+              pos_compile_operator (program, &n_instrs, ops[--n_ops]->d.o.op);
+              --depth;
+            }
+
+          ops[n_ops++] = t;
+          expect_operand = TRUE;
+          break;
+
+        case POS_TOKEN_OPEN_PAREN:
+          if (!expect_operand)
+            goto failed;
+
+          ops[n_ops++] = t;
+          break;
+
+        case POS_TOKEN_CLOSE_PAREN:
+          if (expect_operand)
+            goto failed;
+
+          while (n_ops > 0 && ops[n_ops - 1]->type == POS_TOKEN_OPERATOR)
+            {
+              pos_compile_operator (program, &n_instrs, ops[--n_ops]->d.o.op);
+              --depth;
+            }
+
+          if (n_ops == 0)
+            goto failed;
+
+          --n_ops; /* the open paren */
+          break;
+        }
+    }
+
+  if (expect_operand)
+    goto failed;
+
+  while (n_ops > 0)
+    {
+      if (ops[n_ops - 1]->type != POS_TOKEN_OPERATOR)
+        goto failed;
+
+      pos_compile_operator (program, &n_instrs, ops[--n_ops]->d.o.op);
+      --depth;
+    }
+
+  g_assert (depth == 1);
+
+  if (max_depth > MAX_STACK)
+    goto failed;
+
+  g_free (ops);
+
+  *program_p = program;
+  *n_instrs_p = n_instrs;
+
+  return TRUE;
+
+ failed:
+  g_free (ops);
+  g_free (program);
+
+  return FALSE;
+}
+
+/**
+ * pos_eval_program:
+ * @spec: an expression that pos_compile() has compiled
+ * @env: The environment context in which to evaluate the expression.
+ * @result: (out): The current value of the expression
+ * @err: (out): set to the problem if there was a problem
+ *
+ * Runs a compiled expression.
+ *
+ * Returns: %TRUE if we evaluated the expression successfully; %FALSE otherwise.
+ */
+static gboolean
+pos_eval_program (const MetaDrawSpec         *spec,
+                  const MetaPositionExprEnv  *env,
+                  PosExpr                    *result,
+                  GError                    **err)
+{
+  PosExpr stack[MAX_STACK];
+  int n_stack;
+  int i;
+
+  n_stack = 0;
+  for (i = 0; i < spec->n_instrs; i++)
+    {
+      const PosInstr *instr = &spec->program[i];
+
+      switch (instr->type)
+        {
+        case POS_INSTR_INT:
+          stack[n_stack].type = POS_EXPR_INT;
+          stack[n_stack].d.int_val = instr->d.int_val;
+          ++n_stack;
+          break;
+
+        case POS_INSTR_DOUBLE:
+          stack[n_stack].type = POS_EXPR_DOUBLE;
+          stack[n_stack].d.double_val = instr->d.double_val;
+          ++n_stack;
+          break;
+
+        case POS_INSTR_VARIABLE:
+          stack[n_stack].type = POS_EXPR_INT;
+          if (!pos_eval_variable (instr->d.var, env,
+                                  &stack[n_stack].d.int_val, err))
+            return FALSE;
+          ++n_stack;
+          break;
+
+        case POS_INSTR_OPERATOR:
+          g_assert (n_stack >= 2);
+          if (!do_operation (&stack[n_stack - 2], &stack[n_stack - 1],
+                             instr->d.op, err))
+            return FALSE;
+          --n_stack;
+          break;
+        }
+    }
+
+  g_assert (n_stack == 1);
+
+  *result = stack[0];
+
+  return TRUE;
+}
+
 /*
  *   expr = int | double | expr * expr | expr / expr |
  *          expr + expr | expr - expr | (expr)
@@ -2648,10 +3084,16 @@ pos_eval (MetaDrawSpec              *spec,
           GError                   **err)
 {
   PosExpr expr;
+  gboolean ok;
 
   *val_p = 0;
 
-  if (pos_eval_helper (spec->tokens, spec->n_tokens, env, &expr, err))
+  if (spec->program)
+    ok = pos_eval_program (spec, env, &expr, err);
+  else
+    ok = pos_eval_helper (spec->tokens, spec->n_tokens, env, &expr, err);
+
+  if (ok)
     {
       switch (expr.type)
         {
@@ -2865,6 +3307,7 @@ meta_draw_spec_free (MetaDrawSpec *spec)
 {
   if (!spec) return;
   free_tokens (spec->tokens, spec->n_tokens);
+  g_free (spec->program);
   g_slice_free (MetaDrawSpec, spec);
 }
 
@@ -2896,7 +3339,22 @@ meta_draw_spec_new (MetaTheme  *theme,
           return NULL;
         }
     }
-    
+  else if (pos_compile (spec->tokens, spec->n_tokens,
+                        &spec->program, &spec->n_instrs))
+    {
+      /* The tokens are only needed to report errors in expressions
+       * that we couldn't compile
+       */
+      free_tokens (spec->tokens, spec->n_tokens);
+      spec->tokens = NULL;
+      spec->n_tokens = 0;
+    }
+  else
+    {
+      meta_topic (META_DEBUG_THEMES,
+                  "Could not compile expression \"%s\"\n", expr);
+    }
+
   return spec;
 }
 
@@ -4124,6 +4582,8 @@ meta_draw_op_list_new (int n_preallocs)
   op_list->n_allocated = n_preallocs;
   op_list->ops = g_new (MetaDrawOp*, op_list->n_allocated);
   op_list->n_ops = 0;
+  op_list->cacheable_known = FALSE;
+  op_list->cacheable = FALSE;
 
   return op_list;
 }
@@ -4228,6 +4688,7 @@ meta_draw_op_list_append (MetaDrawOpList       *op_list,
 
   op_list->ops[op_list->n_ops] = op;
   op_list->n_ops += 1;
+  op_list->cacheable_known = FALSE;
 }
 
 gboolean
@@ -4595,8 +5056,241 @@ button_rect (MetaButtonType           type,
     }
 }
 
+/* Frame pieces and buttons that depend only on their size and on the
+ * frame borders are drawn once into a surface and then copied, rather
+ * than running their op lists on every expose. Surfaces are kept by
+ * the theme, looked up by op list, GTK style and those sizes; see
+ * meta_theme_clear_piece_cache().
+ */
+#define MAX_CACHED_PIECES 256
+
+typedef struct
+{
+  const MetaDrawOpList *op_list;
+  GtkStyleContext *style_gtk;
+  int width;
+  int height;
+  int left_width;
+  int right_width;
+  int top_height;
+  int bottom_height;
+} PieceCacheKey;
+
+static guint
+piece_cache_key_hash (gconstpointer data)
+{
+  const PieceCacheKey *key = data;
+
+  return (GPOINTER_TO_UINT (key->op_list) ^
+          GPOINTER_TO_UINT (key->style_gtk) ^
+          (key->width << 16) ^ key->height ^
+          (key->left_width << 24) ^ (key->right_width << 20) ^
+          (key->top_height << 12) ^ (key->bottom_height << 8));
+}
+
+static gboolean
+piece_cache_key_equal (gconstpointer a,
+                       gconstpointer b)
+{
+  const PieceCacheKey *key_a = a;
+  const PieceCacheKey *key_b = b;
+
+  return key_a->op_list == key_b->op_list &&
+         key_a->style_gtk == key_b->style_gtk &&
+         key_a->width == key_b->width &&
+         key_a->height == key_b->height &&
+         key_a->left_width == key_b->left_width &&
+         key_a->right_width == key_b->right_width &&
+         key_a->top_height == key_b->top_height &&
+         key_a->bottom_height == key_b->bottom_height;
+}
+
+static void
+piece_cache_key_free (gpointer data)
+{
+  g_slice_free (PieceCacheKey, data);
+}
+
+static gboolean
+draw_spec_is_cacheable (const MetaDrawSpec *spec)
+{
+  int i;
+
+  if (spec == NULL || spec->constant)
+    return TRUE;
+
+  /* Expressions that didn't compile may use anything */
+  if (spec->program == NULL)
+    return FALSE;
+
+  for (i = 0; i < spec->n_instrs; i++)
+    {
+      if (spec->program[i].type != POS_INSTR_VARIABLE)
+        continue;
+
+      switch (spec->program[i].d.var)
+        {
+        case POS_VAR_WIDTH:
+        case POS_VAR_HEIGHT:
+        case POS_VAR_OBJECT_WIDTH:
+        case POS_VAR_OBJECT_HEIGHT:
+        case POS_VAR_LEFT_WIDTH:
+        case POS_VAR_RIGHT_WIDTH:
+        case POS_VAR_TOP_HEIGHT:
+        case POS_VAR_BOTTOM_HEIGHT:
+          break;
+        default:
+          /* The title and icon sizes, or the position of the piece
+           * within the frame
+           */
+          return FALSE;
+        }
+    }
+
+  return TRUE;
+}
+
+#define BOX_IS_CACHEABLE(box)                   \
+  (draw_spec_is_cacheable ((box).x) &&          \
+   draw_spec_is_cacheable ((box).y) &&          \
+   draw_spec_is_cacheable ((box).width) &&      \
+   draw_spec_is_cacheable ((box).height))
+
+static gboolean draw_op_list_is_cacheable (MetaDrawOpList *op_list);
+
+static gboolean
+draw_op_is_cacheable (const MetaDrawOp *op)
+{
+  switch (op->type)
+    {
+    case META_DRAW_LINE:
+      return draw_spec_is_cacheable (op->data.line.x1) &&
+             draw_spec_is_cacheable (op->data.line.y1) &&
+             draw_spec_is_cacheable (op->data.line.x2) &&
+             draw_spec_is_cacheable (op->data.line.y2);
+    case META_DRAW_RECTANGLE:
+      return BOX_IS_CACHEABLE (op->data.rectangle);
+    case META_DRAW_ARC:
+      return BOX_IS_CACHEABLE (op->data.arc);
+    case META_DRAW_CLIP:
+      return BOX_IS_CACHEABLE (op->data.clip);
+    case META_DRAW_TINT:
+      return BOX_IS_CACHEABLE (op->data.tint);
+    case META_DRAW_GRADIENT:
+      return BOX_IS_CACHEABLE (op->data.gradient);
+    case META_DRAW_IMAGE:
+      return BOX_IS_CACHEABLE (op->data.image);
+    case META_DRAW_GTK_ARROW:
+      return BOX_IS_CACHEABLE (op->data.gtk_arrow);
+    case META_DRAW_GTK_BOX:
+      return BOX_IS_CACHEABLE (op->data.gtk_box);
+    case META_DRAW_GTK_VLINE:
+      return draw_spec_is_cacheable (op->data.gtk_vline.x) &&
+             draw_spec_is_cacheable (op->data.gtk_vline.y1) &&
+             draw_spec_is_cacheable (op->data.gtk_vline.y2);
+    case META_DRAW_ICON:
+    case META_DRAW_TITLE:
+      return FALSE;
+    case META_DRAW_OP_LIST:
+      return BOX_IS_CACHEABLE (op->data.op_list) &&
+             draw_op_list_is_cacheable (op->data.op_list.op_list);
+    case META_DRAW_TILE:
+      return BOX_IS_CACHEABLE (op->data.tile) &&
+             draw_spec_is_cacheable (op->data.tile.tile_xoffset) &&
+             draw_spec_is_cacheable (op->data.tile.tile_yoffset) &&
+             draw_spec_is_cacheable (op->data.tile.tile_width) &&
+             draw_spec_is_cacheable (op->data.tile.tile_height) &&
+             draw_op_list_is_cacheable (op->data.tile.op_list);
+    }
+
+  return FALSE;
+}
+
+#undef BOX_IS_CACHEABLE
+
+static gboolean
+draw_op_list_is_cacheable (MetaDrawOpList *op_list)
+{
+  int i;
+
+  if (!op_list->cacheable_known)
+    {
+      op_list->cacheable = TRUE;
+      for (i = 0; i < op_list->n_ops && op_list->cacheable; i++)
+        op_list->cacheable = draw_op_is_cacheable (op_list->ops[i]);
+
+      op_list->cacheable_known = TRUE;
+    }
+
+  return op_list->cacheable;
+}
+
+/* Draws an op list like meta_draw_op_list_draw_with_style() does,
+ * from piece_cache if the list allows it. The caller has clipped @cr
+ * to @rect.
+ */
+static void
+draw_op_list_cached (GHashTable         *piece_cache,
+                     MetaDrawOpList     *op_list,
+                     GtkStyleContext    *style_gtk,
+                     cairo_t            *cr,
+                     const MetaDrawInfo *info,
+                     MetaRectangle       rect)
+{
+  PieceCacheKey key;
+  cairo_surface_t *surface;
+
+  if (piece_cache == NULL ||
+      op_list->n_ops == 0 ||
+      info->fgeom == NULL ||
+      rect.width <= 0 || rect.height <= 0 ||
+      !draw_op_list_is_cacheable (op_list))
+    {
+      meta_draw_op_list_draw_with_style (op_list, style_gtk, cr, info, rect);
+      return;
+    }
+
+  key.op_list = op_list;
+  key.style_gtk = style_gtk;
+  key.width = rect.width;
+  key.height = rect.height;
+  key.left_width = info->fgeom->borders.visible.left;
+  key.right_width = info->fgeom->borders.visible.right;
+  key.top_height = info->fgeom->borders.visible.top;
+  key.bottom_height = info->fgeom->borders.visible.bottom;
+
+  surface = g_hash_table_lookup (piece_cache, &key);
+  if (surface == NULL)
+    {
+      cairo_t *piece_cr;
+
+      /* Interactive resizes leave a trail of sizes nobody will draw
+       * again; rather than tracking use, start over once in a while.
+       */
+      if (g_hash_table_size (piece_cache) >= MAX_CACHED_PIECES)
+        g_hash_table_remove_all (piece_cache);
+
+      surface = cairo_surface_create_similar (cairo_get_target (cr),
+                                              CAIRO_CONTENT_COLOR_ALPHA,
+                                              rect.width, rect.height);
+      piece_cr = cairo_create (surface);
+      meta_draw_op_list_draw_with_style (op_list, style_gtk, piece_cr, info,
+                                         meta_rect (0, 0,
+                                                    rect.width, rect.height));
+      cairo_destroy (piece_cr);
+
+      g_hash_table_insert (piece_cache,
+                           g_slice_dup (PieceCacheKey, &key),
+                           surface);
+    }
+
+  cairo_set_source_surface (cr, surface, rect.x, rect.y);
+  cairo_paint (cr);
+}
+
 static void
 meta_frame_style_draw_with_style (MetaFrameStyle          *style,
+                                  GHashTable              *piece_cache,
                                   GtkStyleContext         *style_gtk,
                                   cairo_t                 *cr,
                                   const MetaFrameGeometry *fgeom,
@@ -4765,11 +5459,24 @@ meta_frame_style_draw_with_style (MetaFrameStyle          *style,
             {
               MetaRectangle m_rect;
               m_rect = meta_rect (rect.x, rect.y, rect.width, rect.height);
-              meta_draw_op_list_draw_with_style (op_list,
-                                                 style_gtk,
-                                                 cr,
-                                                 &draw_info,
-                                                 m_rect);
+
+              /* The background and overlay cover the client area too,
+               * most of which is never seen; not worth keeping around.
+               */
+              if (i == META_FRAME_PIECE_ENTIRE_BACKGROUND ||
+                  i == META_FRAME_PIECE_OVERLAY)
+                meta_draw_op_list_draw_with_style (op_list,
+                                                   style_gtk,
+                                                   cr,
+                                                   &draw_info,
+                                                   m_rect);
+              else
+                draw_op_list_cached (piece_cache,
+                                     op_list,
+                                     style_gtk,
+                                     cr,
+                                     &draw_info,
+                                     m_rect);
             }
         }
 
@@ -4806,11 +5513,12 @@ meta_frame_style_draw_with_style (MetaFrameStyle          *style,
                       m_rect = meta_rect (rect.x, rect.y,
                                           rect.width, rect.height);
 
-                      meta_draw_op_list_draw_with_style (op_list,
-                                                         style_gtk,
-                                                         cr,
-                                                         &draw_info,
-                                                         m_rect);
+                      draw_op_list_cached (piece_cache,
+                                           op_list,
+                                           style_gtk,
+                                           cr,
+                                           &draw_info,
+                                           m_rect);
                     }
 
                   cairo_restore (cr);
@@ -5134,6 +5842,12 @@ meta_theme_new (void)
                            g_str_equal,
                            g_free,
                            (GDestroyNotify) meta_frame_style_set_unref);
+
+  theme->piece_cache =
+    g_hash_table_new_full (piece_cache_key_hash,
+                           piece_cache_key_equal,
+                           piece_cache_key_free,
+                           (GDestroyNotify) cairo_surface_destroy);
   
   /* Create our variable quarks so we can look up variables without
      having to strcmp for the names */
@@ -5187,6 +5901,8 @@ meta_theme_free (MetaTheme *theme)
     g_hash_table_destroy (theme->styles_by_name);
   if (theme->style_sets_by_name)  
     g_hash_table_destroy (theme->style_sets_by_name);
+  if (theme->piece_cache)
+    g_hash_table_destroy (theme->piece_cache);
 
   for (i = 0; i < META_FRAME_TYPE_LAST; i++)
     if (theme->style_sets_by_type[i])
@@ -5196,6 +5912,21 @@ meta_theme_free (MetaTheme *theme)
   g_free (theme);
 }
 
+/**
+ * meta_theme_clear_piece_cache: (skip)
+ *
+ * Drops the frame pieces the theme has kept drawn. This must be called
+ * whenever a #GtkStyleContext that frames were drawn with changes or
+ * goes away.
+ */
+void
+meta_theme_clear_piece_cache (MetaTheme *theme)
+{
+  g_return_if_fail (theme != NULL);
+
+  g_hash_table_remove_all (theme->piece_cache);
+}
+
 gboolean
 meta_theme_validate (MetaTheme *theme,
                      GError   **error)
@@ -5508,6 +6239,7 @@ meta_theme_draw_frame (MetaTheme              *theme,
                                    theme);  
 
   meta_frame_style_draw_with_style (style,
+                                    theme->piece_cache,
                                     style_gtk,
                                     cr,
                                     &fgeom,